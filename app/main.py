@@ -1,15 +1,37 @@
 from fastapi import FastAPI, HTTPException
 from pydantic import BaseModel
 from datetime import timedelta
-from key_value_store_module import KeyValueStore, TypeMismatchError
+import os
+from key_value_store_module import KeyValueStore, StorageBackend, FsyncPolicy, TypeMismatchError
 
 app = FastAPI()
-store = KeyValueStore()
+# STORAGE_BACKEND=memory keeps every store in process memory instead of Postgres
+store = KeyValueStore(StorageBackend.MEMORY) if os.environ.get("STORAGE_BACKEND") == "memory" else KeyValueStore()
+# SNAPSHOT_PATH is where /bgsave/ writes a snapshot of the memory backend, loaded on startup unless the append-only log is on
+if os.environ.get("STORAGE_BACKEND") == "memory" and os.environ.get("SNAPSHOT_PATH"):
+    store.usesnapshot(os.environ["SNAPSHOT_PATH"], not os.environ.get("APPENDONLY_PATH"))
+# APPENDONLY_PATH makes the memory backend durable: writes are logged there, fsynced every second, and replayed on startup
+if os.environ.get("STORAGE_BACKEND") == "memory" and os.environ.get("APPENDONLY_PATH"):
+    store.enableappendonlylog(os.environ["APPENDONLY_PATH"], FsyncPolicy.INTERVAL, timedelta(seconds=1))
 type_err = TypeMismatchError
 
 class Value(BaseModel):
     value: str
 
+class Values(BaseModel):
+    values: list[str]
+
+class Keys(BaseModel):
+    keys: list[str]
+
+class Fields(BaseModel):
+    fields: list[str]
+
+class Pairs(BaseModel):
+    pairs: dict[str, str]
+
+# the endpoints are plain functions, so FastAPI runs them in its threadpool instead of on the event loop;
+# the bindings release the GIL while a store call blocks, so one slow call does not hold up the others
 def handle_request(func, *args):
     try:
         res = func(*args)
@@ -18,85 +40,186 @@ def handle_request(func, *args):
         raise HTTPException(status_code=400, detail=str(e))
     
 @app.post("/setcapacity/")
-async def setcapacity(capacity: int):
+def setcapacity(capacity: int):
     return handle_request(store.setcapacity, capacity)
 
 @app.post("/uselru/")
-async def uselru():
+def uselru():
     return handle_request(store.uselru)
 
 @app.post("/uselfu/")
-async def uselfu():
+def uselfu():
     return handle_request(store.uselfu)
 
+@app.post("/usetinylfu/")
+def usetinylfu():
+    return handle_request(store.usetinylfu)
+
+@app.post("/setmaxmemory/")
+def setmaxmemory(store_id: int, bytes: int):
+    return handle_request(store.setmaxmemory, store_id, bytes)
+
+@app.get("/memoryusage/{key}/")
+def memoryusage(store_id: int, key: str):
+    return handle_request(store.memoryusage, store_id, key)
+
+@app.get("/memorystats/")
+def memorystats(store_id: int):
+    stats = handle_request(store.memorystats, store_id)["result"]
+    return {"result": {"used_memory": stats.used_memory, "maxmemory": stats.maxmemory, "keys": stats.keys}}
+
+@app.post("/bgrewriteaof/")
+def bgrewriteaof():
+    return handle_request(store.bgrewriteaof)
+
+@app.post("/bgsave/")
+def bgsave():
+    return handle_request(store.bgsave)
+
+@app.get("/lastsave/")
+def lastsave():
+    return handle_request(store.lastsave)
+
 @app.post("/expire/{key}/")
-async def expire(key: str, sec: int):
+def expire(key: str, sec: int):
     return handle_request(store.expire, key, timedelta(seconds=sec))
 
+@app.post("/pexpire/{key}/")
+def pexpire(store_id: int, key: str, ms: int):
+    return handle_request(store.pexpire, store_id, key, timedelta(milliseconds=ms))
+
+@app.post("/expireat/{key}/")
+def expireat(store_id: int, key: str, unix_time_seconds: int):
+    return handle_request(store.expireat, store_id, key, unix_time_seconds)
+
+@app.post("/pexpireat/{key}/")
+def pexpireat(store_id: int, key: str, unix_time_milliseconds: int):
+    return handle_request(store.pexpireat, store_id, key, unix_time_milliseconds)
+
+@app.get("/ttl/{key}/")
+def ttl(store_id: int, key: str):
+    return handle_request(store.ttl, store_id, key)
+
+@app.get("/pttl/{key}/")
+def pttl(store_id: int, key: str):
+    return handle_request(store.pttl, store_id, key)
+
 @app.post("/persist/{key}/")
-async def persist(key: str):
-    return handle_request(store.persist, key)
+def persist(store_id: int, key: str):
+    return handle_request(store.persist, store_id, key)
 
 @app.put("/set/{key}/")
-async def set(key: str, request: Value):
+def set(key: str, request: Value):
     return handle_request(store.set, key, request.value)
 
 @app.get("/get/{key}/")
-async def get(key: str):
+def get(key: str):
     return handle_request(store.get, key)
 
 @app.delete("/del/{key}/")
-async def delete(key: str):
+def delete(key: str):
     return handle_request(store.delete, key)
 
+@app.post("/mget/")
+def mget(store_id: int, request: Keys):
+    return handle_request(store.mget, store_id, request.keys)
+
+@app.put("/mset/")
+def mset(store_id: int, request: Pairs):
+    return handle_request(store.mset, store_id, list(request.pairs.items()))
+
+@app.post("/mdel/")
+def mdel(store_id: int, request: Keys):
+    return handle_request(store.delete, store_id, request.keys)
+
 @app.post("/lpush/{key}/")
-async def lpush(key: str, request: Value):
-    return handle_request(store.lpush, key, request.value)
+def lpush(store_id: int, key: str, request: Values):
+    return handle_request(store.lpush, store_id, key, request.values)
 
 @app.post("/rpush/{key}/")
-async def rpush(key: str, request: Value):
-    return handle_request(store.rpush, key, request.value)
+def rpush(store_id: int, key: str, request: Values):
+    return handle_request(store.rpush, store_id, key, request.values)
 
 @app.post("/lpop/{key}/")
-async def lpop(key: str):
-    return handle_request(store.lpop, key)
+def lpop(store_id: int, key: str, count: int | None = None):
+    if count is None:
+        return handle_request(store.lpop, store_id, key)
+    if count < 0:
+        raise HTTPException(status_code=400, detail="Count must be non-negative.")
+    return handle_request(store.lpop, store_id, key, count)
 
 @app.post("/rpop/{key}/")
-async def rpop(key: str):
-    return handle_request(store.rpop, key)
+def rpop(store_id: int, key: str, count: int | None = None):
+    if count is None:
+        return handle_request(store.rpop, store_id, key)
+    if count < 0:
+        raise HTTPException(status_code=400, detail="Count must be non-negative.")
+    return handle_request(store.rpop, store_id, key, count)
 
 @app.get("/lrange/{key}/")
-async def lrange(key: str, start: int, end: int):
-    if start < 0 or end < 0:
-        raise HTTPException(status_code=400, detail="Start and end must be non-negative.")
-    if start > end:
-        raise HTTPException(status_code=400, detail="Start cannot be greater than end.")
-    
-    return handle_request(store.lrange, key, start, end)
+def lrange(store_id: int, key: str, start: int, end: int):
+    # negative indexes count from the end of the list, as in Redis
+    return handle_request(store.lrange, store_id, key, start, end)
 
 @app.get("/llen/{key}/")
-async def llen(key: str):
-    return handle_request(store.llen, key)
+def llen(store_id: int, key: str):
+    return handle_request(store.llen, store_id, key)
 
 @app.post("/sadd/{key}/")
-async def sadd(key: str, request: Value):
-    return handle_request(store.sadd, key, request.value)
+def sadd(store_id: int, key: str, request: Values):
+    return handle_request(store.sadd, store_id, key, request.values)
 
 @app.post("/srem/{key}/")
-async def srem(key: str, request: Value):
-    return handle_request(store.srem, key, request.value)
+def srem(store_id: int, key: str, request: Values):
+    return handle_request(store.srem, store_id, key, request.values)
 
 @app.get("/smembers/{key}/")
-async def smembers(key: str):
-    return handle_request(store.smembers, key)
+def smembers(store_id: int, key: str):
+    return handle_request(store.smembers, store_id, key)
 
 @app.get("/sismember/{key}/")
-async def sismember(key: str, value: str):
-    return handle_request(store.sismember, key, value)
+def sismember(store_id: int, key: str, value: str):
+    return handle_request(store.sismember, store_id, key, value)
 
 @app.get("/scard/{key}/")
-async def scard(key: str):
-    return handle_request(store.scard, key)
+def scard(store_id: int, key: str):
+    return handle_request(store.scard, store_id, key)
+
+@app.post("/sinter/")
+def sinter(store_id: int, request: Keys):
+    return handle_request(store.sinter, store_id, request.keys)
+
+@app.post("/sunion/")
+def sunion(store_id: int, request: Keys):
+    return handle_request(store.sunion, store_id, request.keys)
+
+@app.post("/sdiff/")
+def sdiff(store_id: int, request: Keys):
+    return handle_request(store.sdiff, store_id, request.keys)
+
+@app.put("/hset/{key}/")
+def hset(store_id: int, key: str, request: Pairs):
+    return handle_request(store.hset, store_id, key, list(request.pairs.items()))
+
+@app.get("/hget/{key}/")
+def hget(store_id: int, key: str, field: str):
+    return handle_request(store.hget, store_id, key, field)
+
+@app.post("/hmget/{key}/")
+def hmget(store_id: int, key: str, request: Fields):
+    return handle_request(store.hmget, store_id, key, request.fields)
+
+@app.get("/hgetall/{key}/")
+def hgetall(store_id: int, key: str):
+    return handle_request(lambda *args: dict(store.hgetall(*args)), store_id, key)
+
+@app.post("/hdel/{key}/")
+def hdel(store_id: int, key: str, request: Fields):
+    return handle_request(store.hdel, store_id, key, request.fields)
+
+@app.get("/hlen/{key}/")
+def hlen(store_id: int, key: str):
+    return handle_request(store.hlen, store_id, key)
 
 if __name__ == '__main__': 
     import uvicorn
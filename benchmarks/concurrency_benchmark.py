@@ -0,0 +1,60 @@
+"""Measure KeyValueStore throughput from Python threads.
+
+Usage: python3 benchmarks/concurrency_benchmark.py [max_threads] [ops_per_thread]
+
+Needs the module built by build_py.sh (copied into app/) and the database from docker-compose.yml.
+The bindings release the GIL during store calls, so throughput should grow close to linearly
+with the thread count until the connection pool or the database saturates.
+"""
+
+import os
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "..", "app"))
+from key_value_store_module import KeyValueStore
+
+BENCH_STORE_ID = 0
+
+
+def worker(store, thread_id, ops_per_thread):
+    for i in range(ops_per_thread):
+        key = f"bench:{thread_id}:{i}"
+        if i % 2 == 0:
+            store.set(BENCH_STORE_ID, key, "value")
+        else:
+            store.get(BENCH_STORE_ID, key)
+
+
+def run(thread_count, ops_per_thread):
+    store = KeyValueStore(thread_count)
+    threads = [threading.Thread(target=worker, args=(store, t, ops_per_thread)) for t in range(thread_count)]
+
+    start = time.perf_counter()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.perf_counter() - start
+
+    store.delete(BENCH_STORE_ID, [f"bench:{t}:{i}" for t in range(thread_count) for i in range(0, ops_per_thread, 2)])
+    return thread_count * ops_per_thread / elapsed
+
+
+def main():
+    max_threads = int(sys.argv[1]) if len(sys.argv) > 1 else 16
+    ops_per_thread = int(sys.argv[2]) if len(sys.argv) > 2 else 1000
+
+    print("threads,ops_per_sec,speedup")
+    baseline = None
+    thread_count = 1
+    while thread_count <= max_threads:
+        ops_per_sec = run(thread_count, ops_per_thread)
+        baseline = baseline or ops_per_sec
+        print(f"{thread_count},{int(ops_per_sec)},{ops_per_sec / baseline:.2f}")
+        thread_count *= 2
+
+
+if __name__ == "__main__":
+    main()
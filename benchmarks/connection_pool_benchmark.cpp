@@ -0,0 +1,59 @@
+/**
+ * @file connection_pool_benchmark.cpp
+ * @brief Measure SET/GET throughput of KeyValueStore driven from many threads, for several connection pool sizes.
+ *
+ * Usage: connection_pool_benchmark [threads] [opsPerThread]
+ * Needs the database from docker-compose.yml. GETs use distinct keys per request so they miss the cache and reach the database.
+ * Rows are written under BENCH_STORE_ID and removed afterwards.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "key_value_store.h"
+
+constexpr size_t BENCH_STORE_ID = 0;
+
+int main(int argc, char** argv) {
+    size_t threadCount = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 16;
+    size_t opsPerThread = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1'000;
+
+    std::cout << "pool_size,threads,ops_per_sec,waits,avg_wait_us" << std::endl;
+    for (size_t poolSize = 1; poolSize <= threadCount; poolSize *= 2) {
+        KeyValueStore store(poolSize);
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&store, t, opsPerThread] {
+                for (size_t i = 0; i < opsPerThread; ++i) {
+                    auto key = "bench:" + std::to_string(t) + ":" + std::to_string(i);
+                    if (i % 2 == 0) {
+                        store.set(BENCH_STORE_ID, key, "value");
+                    } else {
+                        store.get(BENCH_STORE_ID, key);
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        auto metrics = store.poolMetrics();
+        auto avgWait = metrics.waits ? metrics.totalWait.count() / metrics.waits : 0;
+        std::cout << poolSize << "," << threadCount << ","
+                  << static_cast<size_t>(threadCount * opsPerThread / elapsed.count()) << ","
+                  << metrics.waits << "," << avgWait << std::endl;
+    }
+
+    pqxx::connection conn(CONNECTION_STRING);
+    pqxx::work txn(conn);
+    txn.exec_params("DELETE FROM " + std::string(STRING_TABLE) + " WHERE store_id = $1", BENCH_STORE_ID);
+    txn.commit();
+    return 0;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file eviction_policy_benchmark.cpp
+ * @brief Measure eviction policy throughput (operations per second) as the number of tracked keys grows.
+ *
+ * Usage: eviction_policy_benchmark [maxKeys] [opsPerRun]
+ * Each run tracks n keys, then mixes random accesses with evict-and-reinsert cycles,
+ * so the working set stays at n keys. An O(1) policy should report a flat rate across n.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "lru.h"
+#include "lfu.h"
+
+template <typename Policy>
+double opsPerSecond(const std::vector<std::string>& keys, size_t ops) {
+    Policy policy;
+    for (const auto& key : keys) {
+        policy.keyAccessed(key);
+    }
+
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+        if (i % 4 == 3) {
+            policy.keyAccessed(policy.evict());
+        } else {
+            policy.keyAccessed(keys[pick(rng)]);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return ops / elapsed.count();
+}
+
+int main(int argc, char** argv) {
+    size_t maxKeys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+    size_t ops = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1'000'000;
+
+    std::cout << "policy,keys,ops_per_sec" << std::endl;
+    for (size_t n = 1'000; n <= maxKeys; n *= 10) {
+        std::vector<std::string> keys;
+        keys.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            keys.push_back("key:" + std::to_string(i));
+        }
+
+        std::cout << "lru," << n << "," << static_cast<size_t>(opsPerSecond<LRU>(keys, ops)) << std::endl;
+        std::cout << "lfu," << n << "," << static_cast<size_t>(opsPerSecond<LFU>(keys, ops)) << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file hit_ratio_benchmark.cpp
+ * @brief Compare cache hit ratios of the eviction policies on Zipfian traces.
+ *
+ * Usage: hit_ratio_benchmark [items] [capacity] [requests]
+ * Each trace is replayed against a cache of fixed capacity that adds missed keys and evicts through the policy,
+ * the same way key_value_store.cpp drives it. The "shifting" traces move the popular keys halfway through
+ * to show how quickly each policy forgets keys that used to be hot.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "lru.h"
+#include "lfu.h"
+#include "tiny_lfu.h"
+#include "zipf_generator.h"
+
+double hitRatio(EvictionPolicy& policy, const std::vector<std::string>& trace, size_t capacity) {
+    std::unordered_set<std::string> cached;
+    size_t hits = 0;
+
+    for (const auto& key : trace) {
+        if (cached.contains(key)) {
+            ++hits;
+            policy.keyAccessed(key);
+            continue;
+        }
+
+        cached.insert(key);
+        policy.keyAccessed(key);
+        if (cached.size() > capacity) {
+            cached.erase(std::string(policy.evict().bytes()));
+        }
+    }
+    return static_cast<double>(hits) / trace.size();
+}
+
+std::vector<std::string> zipfTrace(size_t items, double skew, size_t requests, bool shifting) {
+    std::mt19937_64 rng(7);
+    ZipfGenerator zipf(items, skew);
+    std::vector<std::string> trace;
+    trace.reserve(requests);
+    for (size_t i = 0; i < requests; ++i) {
+        size_t rank = zipf(rng);
+        if (shifting && i >= requests / 2) {
+            rank = (rank + items / 2) % items;
+        }
+        trace.push_back("key:" + std::to_string(rank));
+    }
+    return trace;
+}
+
+int main(int argc, char** argv) {
+    size_t items = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100'000;
+    size_t capacity = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1'000;
+    size_t requests = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 1'000'000;
+
+    std::cout << "trace,skew,policy,hit_ratio" << std::endl;
+    for (bool shifting : {false, true}) {
+        for (double skew : {0.7, 0.9, 1.1}) {
+            auto trace = zipfTrace(items, skew, requests, shifting);
+            std::string name = shifting ? "shifting" : "static";
+
+            LRU lru;
+            LFU lfu;
+            TinyLFU tinyLfu(capacity);
+            std::cout << name << "," << skew << ",lru," << hitRatio(lru, trace, capacity) << std::endl;
+            std::cout << name << "," << skew << ",lfu," << hitRatio(lfu, trace, capacity) << std::endl;
+            std::cout << name << "," << skew << ",tinylfu," << hitRatio(tinyLfu, trace, capacity) << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file in_memory_engine_benchmark.cpp
+ * @brief Measure how in-memory GET/SET throughput scales with threads and shards.
+ *
+ * Usage: in_memory_engine_benchmark [keys] [opsPerThread] [maxThreads]
+ * Every thread runs 90% GET and 10% SET against one preloaded store, drawing keys uniformly or from a Zipfian distribution.
+ * The single-shard engine is the baseline: one lock for the whole keyspace. Under Zipf the hottest keys share shards,
+ * so the sharded engine scales less there than on uniform keys.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "in_memory_engine.h"
+#include "zipf_generator.h"
+
+std::vector<std::vector<size_t>> traces(size_t threads, size_t keys, size_t ops, bool zipf) {
+    std::vector<std::vector<size_t>> ret(threads);
+    ZipfGenerator zipfGenerator(keys, 0.99);
+    for (size_t t = 0; t < threads; ++t) {
+        std::mt19937_64 rng(t + 1);
+        std::uniform_int_distribution<size_t> uniform(0, keys - 1);
+        ret[t].reserve(ops);
+        for (size_t i = 0; i < ops; ++i) {
+            ret[t].push_back(zipf ? zipfGenerator(rng) : uniform(rng));
+        }
+    }
+    return ret;
+}
+
+double opsPerSecond(InMemoryEngine& engine, const std::vector<std::string>& names, const std::vector<std::vector<size_t>>& trace) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (const auto& ranks : trace) {
+        threads.emplace_back([&engine, &names, &ranks] {
+            for (size_t i = 0; i < ranks.size(); ++i) {
+                const auto& key = names[ranks[i]];
+                if (i % 10 == 0) {
+                    engine.insertString(1, key, key);
+                } else {
+                    engine.fetchLiveString(1, key);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return trace.size() * trace[0].size() / elapsed.count();
+}
+
+int main(int argc, char** argv) {
+    size_t keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100'000;
+    size_t ops = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1'000'000;
+    size_t maxThreads = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<std::string> names;
+    for (size_t i = 0; i < keys; ++i) {
+        names.push_back("key:" + std::to_string(i));
+    }
+
+    std::cout << "distribution,shards,threads,ops_per_sec" << std::endl;
+    for (bool zipf : {false, true}) {
+        for (size_t shards : {size_t(1), size_t(0)}) {
+            for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+                // capacity covers every key, so the run measures locking and lookups rather than eviction
+                InMemoryEngine engine(shards);
+                engine.setEvictionConfig(1, EvictionConfig{"lru", keys});
+                for (const auto& name : names) {
+                    engine.insertString(1, name, name);
+                }
+
+                auto trace = traces(threads, keys, ops, zipf);
+                std::cout << (zipf ? "zipf" : "uniform") << "," << engine.shardCount() << "," << threads << ","
+                          << static_cast<size_t>(opsPerSecond(engine, names, trace)) << std::endl;
+            }
+        }
+    }
+    return 0;
+}
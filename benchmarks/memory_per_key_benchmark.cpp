@@ -0,0 +1,85 @@
+/**
+ * @file memory_per_key_benchmark.cpp
+ * @brief Report the resident memory each small key costs in the in-memory engine.
+ *
+ * Usage: memory_per_key_benchmark [keys]
+ * Each layout loads the same keys ("key:<i>", with the key as value) in a forked child, so every row starts from a fresh heap,
+ * and reports the growth of the resident set divided by the number of keys. The copied_keys row is the layout the engine
+ * replaces: a map of std::string pairs plus an LRU that keeps its own two copies of every key, one in its index and one in its
+ * recency list. The engine rows keep each key once, in a slab-allocated record that the eviction policy refers to by view.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "in_memory_engine.h"
+
+size_t residentBytes() {
+    size_t pages = 0;
+    size_t resident = 0;
+    FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (statm) {
+        if (std::fscanf(statm, "%zu %zu", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        std::fclose(statm);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// each layout returns the resident set size while its keys are still loaded
+size_t copiedKeys(size_t keys) {
+    std::unordered_map<std::string, std::string> values;
+    std::list<std::string> recency;
+    std::unordered_map<std::string, std::list<std::string>::iterator> index;
+    for (size_t i = 0; i < keys; ++i) {
+        auto key = "key:" + std::to_string(i);
+        values.insert_or_assign(key, key);
+        recency.push_front(key);
+        index.insert_or_assign(key, recency.begin());
+    }
+    return residentBytes();
+}
+
+size_t engineKeys(const std::string& policy, size_t keys) {
+    InMemoryEngine engine(1);
+    engine.setEvictionConfig(1, EvictionConfig{policy, keys});
+    for (size_t i = 0; i < keys; ++i) {
+        auto key = "key:" + std::to_string(i);
+        engine.insertString(1, key, key);
+    }
+    return residentBytes();
+}
+
+/*
+    Loads the keys in a child and prints the growth of its resident set per key.
+*/
+void report(const std::string& name, const std::function<size_t(size_t)>& layout, size_t keys) {
+    std::cout.flush();
+    pid_t child = fork();
+    if (child == 0) {
+        size_t baseline = residentBytes();
+        size_t loaded = layout(keys);
+        std::cout << name << "," << keys << "," << static_cast<double>(loaded - baseline) / keys << std::endl;
+        std::_Exit(0);
+    }
+    waitpid(child, nullptr, 0);
+}
+
+int main(int argc, char** argv) {
+    size_t keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+
+    std::cout << "layout,keys,bytes_per_key" << std::endl;
+    report("copied_keys", copiedKeys, keys);
+    for (std::string policy : {"lru", "lfu", "tinylfu"}) {
+        report("engine_" + policy, [&policy](size_t n) { return engineKeys(policy, n); }, keys);
+    }
+    return 0;
+}
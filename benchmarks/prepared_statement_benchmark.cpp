@@ -0,0 +1,75 @@
+/**
+ * @file prepared_statement_benchmark.cpp
+ * @brief Compare ops/sec of the strings queries sent as parameterized text versus executed as prepared statements.
+ *
+ * Usage: prepared_statement_benchmark [ops]
+ * Needs the database from docker-compose.yml. Rows are written under BENCH_STORE_ID and removed afterwards.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <pqxx/pqxx>
+#include "key_value_store.h"
+
+constexpr size_t BENCH_STORE_ID = 0;
+constexpr size_t BENCH_KEYS = 1000;
+
+const std::string INSERT_SQL = "INSERT INTO " + std::string(STRING_TABLE) + " (store_id, key, value) VALUES ($1, $2, $3) "
+                               "ON CONFLICT (store_id, key) DO UPDATE SET value = excluded.value, expiration = NULL";
+const std::string FETCH_SQL = "SELECT value FROM " + std::string(STRING_TABLE) + " WHERE store_id = $1 AND key = $2";
+
+double opsPerSecond(size_t ops, const std::function<void(size_t)>& op) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+        op(i);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return ops / elapsed.count();
+}
+
+int main(int argc, char** argv) {
+    size_t ops = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10'000;
+
+    pqxx::connection conn(CONNECTION_STRING);
+    conn.prepare("bench_insert", INSERT_SQL);
+    conn.prepare("bench_fetch", FETCH_SQL);
+
+    auto key = [](size_t i) { return "bench:" + std::to_string(i % BENCH_KEYS); };
+
+    auto textInsert = opsPerSecond(ops, [&](size_t i) {
+        pqxx::work txn(conn);
+        txn.exec_params(INSERT_SQL, BENCH_STORE_ID, key(i), "value");
+        txn.commit();
+    });
+    auto preparedInsert = opsPerSecond(ops, [&](size_t i) {
+        pqxx::work txn(conn);
+        txn.exec_prepared("bench_insert", BENCH_STORE_ID, key(i), "value");
+        txn.commit();
+    });
+    auto textFetch = opsPerSecond(ops, [&](size_t i) {
+        pqxx::work txn(conn);
+        txn.exec_params(FETCH_SQL, BENCH_STORE_ID, key(i));
+        txn.commit();
+    });
+    auto preparedFetch = opsPerSecond(ops, [&](size_t i) {
+        pqxx::work txn(conn);
+        txn.exec_prepared("bench_fetch", BENCH_STORE_ID, key(i));
+        txn.commit();
+    });
+
+    {
+        pqxx::work txn(conn);
+        txn.exec_params("DELETE FROM " + std::string(STRING_TABLE) + " WHERE store_id = $1", BENCH_STORE_ID);
+        txn.commit();
+    }
+
+    std::cout << "query,mode,ops_per_sec" << std::endl;
+    std::cout << "insert,text," << static_cast<size_t>(textInsert) << std::endl;
+    std::cout << "insert,prepared," << static_cast<size_t>(preparedInsert) << std::endl;
+    std::cout << "fetch,text," << static_cast<size_t>(textFetch) << std::endl;
+    std::cout << "fetch,prepared," << static_cast<size_t>(preparedFetch) << std::endl;
+    return 0;
+}
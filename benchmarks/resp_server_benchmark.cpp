@@ -0,0 +1,105 @@
+/**
+ * @file resp_server_benchmark.cpp
+ * @brief Compare the RESP server's epoll and io_uring loops: requests per second and system calls per request.
+ *
+ * Usage: resp_server_benchmark [clients] [requestsPerClient] [loops]
+ * Each client thread keeps one connection and sends alternating SET and GET requests in pipelines of 1 and 16,
+ * waiting for every reply of a pipeline before sending the next. The server runs in-process on the memory backend,
+ * so the numbers are the network path's. System calls are the ones the server's loops make, as counted by RespServer::stats.
+ * The io_uring rows are skipped where the kernel does not allow rings.
+ */
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "resp_server.h"
+
+const std::string SET_REQUEST = "*3\r\n$3\r\nSET\r\n$8\r\nbench:00\r\n$5\r\nvalue\r\n";
+const std::string GET_REQUEST = "*2\r\n$3\r\nGET\r\n$8\r\nbench:00\r\n";
+const size_t SET_REPLY = 5;  // +OK\r\n
+const size_t GET_REPLY = 11; // $5\r\nvalue\r\n
+
+void client(const uint16_t port, const size_t requests, const size_t pipeline) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) < 0) {
+        std::cerr << "connect failed" << std::endl;
+        std::exit(1);
+    }
+
+    std::string batch;
+    size_t replyBytes = 0;
+    for (size_t i = 0; i < pipeline; ++i) {
+        batch += i % 2 == 0 ? SET_REQUEST : GET_REQUEST;
+        replyBytes += i % 2 == 0 ? SET_REPLY : GET_REPLY;
+    }
+
+    char buffer[64 * 1024];
+    for (size_t sent = 0; sent < requests; sent += pipeline) {
+        send(fd, batch.data(), batch.size(), 0);
+        for (size_t received = 0; received < replyBytes;) {
+            auto n = recv(fd, buffer, sizeof buffer, 0);
+            if (n <= 0) {
+                std::cerr << "connection lost" << std::endl;
+                std::exit(1);
+            }
+            received += n;
+        }
+    }
+    close(fd);
+}
+
+void run(const IoBackend io, const std::string& name, const size_t clients, const size_t requests, const size_t loops, const size_t pipeline) {
+    KeyValueStore store(StorageBackend::MEMORY);
+    std::unique_ptr<RespServer> server;
+    try {
+        server = std::make_unique<RespServer>(store, RespServerOptions{"127.0.0.1", 0, loops, io});
+    } catch (const std::system_error& e) {
+        std::cerr << name << " unavailable: " << e.what() << std::endl;
+        return;
+    }
+    std::thread serving([&server] { server->run(); });
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < clients; ++c) {
+        threads.emplace_back(client, server->port(), requests, pipeline);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    server->stop();
+    serving.join();
+    auto stats = server->stats();
+    std::cout << name << "," << clients << "," << loops << "," << pipeline << ","
+              << static_cast<size_t>(stats.requests / elapsed.count()) << ","
+              << static_cast<double>(stats.syscalls) / stats.requests << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t clients = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 32;
+    size_t requests = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 20'000;
+    size_t loops = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 2;
+
+    std::cout << "backend,clients,loops,pipeline,requests_per_sec,syscalls_per_request" << std::endl;
+    for (size_t pipeline : {1, 16}) {
+        run(IoBackend::EPOLL, "epoll", clients, requests, loops, pipeline);
+        run(IoBackend::IO_URING, "io_uring", clients, requests, loops, pipeline);
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file restart_benchmark.cpp
+ * @brief Compare the ways the in-memory engine gets its data back after a restart: replaying the append-only log or loading a snapshot.
+ *
+ * Usage: restart_benchmark [keys] [valueBytes] [directory]
+ * One store is filled with keys strings of valueBytes each, with the log on, then saved to a snapshot. The times reported are
+ * how long saveSnapshot blocked writers (the fork), how long the background save took, and how long a fresh engine took to
+ * replay the log and to load the snapshot. Files go to directory, the system temp directory by default.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "in_memory_engine.h"
+
+double secondsSince(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    size_t keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+    size_t valueBytes = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100;
+    std::filesystem::path directory = argc > 3 ? argv[3] : std::filesystem::temp_directory_path();
+    auto logPath = (directory / "restart_benchmark.aof").string();
+    auto snapshotPath = (directory / "restart_benchmark.snapshot").string();
+    std::filesystem::remove(logPath);
+
+    std::string value(valueBytes, 'v');
+    {
+        InMemoryEngine engine;
+        engine.enableLog(AppendOnlyLogOptions{logPath, FsyncPolicy::OS});
+        engine.setEvictionConfig(0, EvictionConfig{"lru", 2 * keys}); // room for keys that hash unevenly across shards
+        std::vector<std::string> batchKeys;
+        for (size_t i = 0; i < keys; ++i) {
+            batchKeys.push_back("key:" + std::to_string(i));
+            if (batchKeys.size() == 1000 || i + 1 == keys) {
+                engine.insertStrings(0, batchKeys, std::vector<std::string>(batchKeys.size(), value));
+                batchKeys.clear();
+            }
+        }
+        engine.flush();
+
+        auto start = std::chrono::steady_clock::now();
+        engine.saveSnapshot(snapshotPath);
+        auto fork = secondsSince(start);
+        if (!engine.waitForSnapshot()) {
+            std::cerr << "snapshot failed" << std::endl;
+            return 1;
+        }
+        std::cout << "save: " << fork * 1000 << " ms blocked, " << secondsSince(start) << " s in the background" << std::endl;
+    }
+    std::cout << "log: " << std::filesystem::file_size(logPath) / (1 << 20) << " MiB, snapshot: "
+              << std::filesystem::file_size(snapshotPath) / (1 << 20) << " MiB" << std::endl;
+
+    {
+        InMemoryEngine engine;
+        auto start = std::chrono::steady_clock::now();
+        engine.enableLog(AppendOnlyLogOptions{logPath, FsyncPolicy::OS});
+        std::cout << "replay log: " << secondsSince(start) << " s, " << engine.memoryStats(0)->keys << " keys" << std::endl;
+        engine.disableLog();
+    }
+    {
+        InMemoryEngine engine;
+        auto start = std::chrono::steady_clock::now();
+        engine.loadSnapshot(snapshotPath);
+        std::cout << "load snapshot: " << secondsSince(start) << " s, " << engine.memoryStats(0)->keys << " keys" << std::endl;
+    }
+
+    std::filesystem::remove(logPath);
+    std::filesystem::remove(snapshotPath);
+    return 0;
+}
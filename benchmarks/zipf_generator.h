@@ -0,0 +1,40 @@
+/**
+ * @file zipf_generator.h
+ * @brief Draw item ranks from a Zipfian distribution for benchmark traces.
+ *
+ * Rank 0 is the most popular item. The cumulative distribution is precomputed, so each draw is a binary search.
+ */
+
+#ifndef ZIPF_GENERATOR_H
+#define ZIPF_GENERATOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+class ZipfGenerator {
+    public:
+        ZipfGenerator(size_t items, double skew) : cdf(items) {
+            double sum = 0;
+            for (size_t i = 0; i < items; ++i) {
+                sum += 1.0 / std::pow(static_cast<double>(i + 1), skew);
+                cdf[i] = sum;
+            }
+            for (auto& c : cdf) {
+                c /= sum;
+            }
+        }
+
+        template <typename Rng>
+        size_t operator()(Rng& rng) {
+            double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+            auto it = std::lower_bound(cdf.begin(), cdf.end(), u);
+            return std::min(static_cast<size_t>(it - cdf.begin()), cdf.size() - 1);
+        }
+
+    private:
+        std::vector<double> cdf;
+};
+
+#endif
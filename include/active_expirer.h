@@ -0,0 +1,93 @@
+/**
+ * @file active_expirer.h
+ * @brief Define a background expirer that deletes keys once their TTL has passed, without waiting for them to be read.
+ *
+ * TTLs are tracked in a hierarchical timing wheel. Every tick the expirer moves the wheel forward, queues the keys that came due,
+ * and reaps at most maxBatchesPerTick batches of batchSize keys, so a burst of expirations is spread over several ticks
+ * instead of stalling the store. Keys that stay queued are reported as the backlog.
+ * Each key has at most one timer, so the wheel grows with the number of keys with a TTL rather than with the EXPIRE calls:
+ * a new TTL replaces the key's timer, and PERSIST and DEL cancel it. A SET that overwrites the key leaves it in place, and a timer
+ * may be scheduled just after a concurrent PERSIST, so the reap function must still only delete keys that really have expired.
+ *
+ * The wheel only knows TTLs set through this process. Every scanInterval the expirer also asks the scan function for keys that
+ * have already expired, which picks up TTLs set by other app servers or before a restart.
+ */
+
+#ifndef ACTIVE_EXPIRER_H
+#define ACTIVE_EXPIRER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "expiration.h"
+#include "timing_wheel.h"
+
+struct ActiveExpirerOptions {
+    std::chrono::milliseconds tick{100};
+    size_t batchSize = 100;
+    size_t maxBatchesPerTick = 10;
+    std::chrono::milliseconds scanInterval{1000};
+};
+
+struct ExpirationMetrics {
+    size_t scheduled = 0; // TTLs in the wheel that are not due yet
+    size_t backlog = 0;   // due keys waiting to be reaped
+    size_t checked = 0;   // due keys passed to the reap function
+    size_t reaped = 0;    // keys the reap function deleted
+    size_t failures = 0;  // batches that threw and were retried
+    double reapRate = 0;  // keys deleted per second, smoothed over about a second
+};
+
+// (store_id, key)
+using ExpiringKey = std::pair<size_t, std::string>;
+
+struct ExpiringKeyHash {
+    size_t operator()(const ExpiringKey& key) const {
+        return std::hash<std::string>()(key.second) ^ (key.first * 0x9E3779B97F4A7C15ull);
+    }
+};
+
+class ActiveExpirer {
+    public:
+        // reapFn deletes those of the given keys of one store that have expired and returns how many it deleted
+        using ReapFn = std::function<size_t(const size_t storeId, const std::vector<std::string>& keys)>;
+        // scanFn returns up to limit keys that have already expired
+        using ScanFn = std::function<std::vector<ExpiringKey>(const size_t limit)>;
+
+        ActiveExpirer(const ActiveExpirerOptions& options, ReapFn reapFn, ScanFn scanFn = nullptr);
+        ~ActiveExpirer();
+
+        // replaces the key's timer, if it has one
+        void schedule(const size_t storeId, const std::string& key, const ExpirationTime& expiration);
+        // drops the timers of keys that no longer have a TTL
+        void cancel(const size_t storeId, const std::vector<std::string>& keys);
+        ExpirationMetrics metrics() const;
+
+    private:
+        uint64_t tickOf(const std::chrono::steady_clock::time_point& time) const;
+        size_t reap(const std::vector<ExpiringKey>& batch);
+        void run();
+
+        ActiveExpirerOptions options;
+        ReapFn reapFn;
+        ScanFn scanFn;
+        std::chrono::steady_clock::time_point start;
+
+        mutable std::mutex mutex;
+        std::condition_variable wake;
+        TimingWheel<ExpiringKey> wheel;
+        std::unordered_map<ExpiringKey, TimingWheel<ExpiringKey>::Handle, ExpiringKeyHash> timers; // the wheel's timer of each key
+        std::deque<ExpiringKey> due;
+        ExpirationMetrics counters;
+        bool stopping = false;
+
+        std::thread reaper;
+};
+
+#endif
@@ -0,0 +1,182 @@
+/**
+ * @file append_only_log.h
+ * @brief Define an append-only log of mutations that the in-memory engine replays on startup, with group-commit fsync.
+ *
+ * Each record is framed as a 4-byte payload length and a 4-byte CRC-32C of the payload, both in host byte order, then the payload.
+ * Writers append a framed record to an in-memory buffer under one short lock and return; a background thread writes whatever
+ * has accumulated with one write call and, depending on the fsync policy, one fdatasync. Writers that need their record durable
+ * wait for the fsync that covers it, so concurrent writers share fsyncs instead of paying for one each.
+ *
+ * On open every intact record is replayed in order. A record cut short at the end of the file, as a crash during a write leaves it,
+ * is truncated away, as long as it is no longer than 16 MiB and no intact record follows its start; a record that fails
+ * its CRC anywhere else, or a length that would swallow the records after it, means the log is corrupt and the open throws.
+ *
+ * A rewrite replaces the log with a compact one that recreates the current state. The owner copies its state into the new file
+ * partition by partition while writers go on appending; records appended meanwhile are kept aside with their partition, and those
+ * the copy of their partition does not already reflect are added to the end of the new file before it is renamed over the log.
+ */
+
+#ifndef APPEND_ONLY_LOG_H
+#define APPEND_ONLY_LOG_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+enum class FsyncPolicy {
+    ALWAYS,   // a write returns once its record is on disk, and throws if it could not be put there
+    INTERVAL, // records are written at once and fsynced every fsyncInterval; a machine crash loses up to that much
+    OS        // records are written at once and the kernel decides when they reach the disk
+};
+
+struct AppendOnlyLogOptions {
+    std::string path;
+    FsyncPolicy fsync = FsyncPolicy::INTERVAL;
+    std::chrono::milliseconds fsyncInterval{1000};
+    // rewrite automatically once the log has grown by rewriteGrowth percent since the last rewrite (0 never),
+    // but not while it is smaller than rewriteMinSize bytes
+    size_t rewriteGrowth = 100;
+    size_t rewriteMinSize = 64 * 1024 * 1024;
+};
+
+// fixed-width integers in host byte order and length-prefixed byte strings, the fields of a record payload
+inline void putInteger(std::string& out, const uint64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof value);
+}
+
+inline void putBytes(std::string& out, std::string_view bytes) {
+    auto size = static_cast<uint32_t>(bytes.size());
+    out.append(reinterpret_cast<const char*>(&size), sizeof size);
+    out.append(bytes);
+}
+
+class LogReader {
+    public:
+        explicit LogReader(std::string_view payload) : rest(payload) {}
+
+        uint64_t integer() {
+            uint64_t value;
+            std::memcpy(&value, take(sizeof value).data(), sizeof value);
+            return value;
+        }
+
+        std::string_view bytes() {
+            uint32_t size;
+            std::memcpy(&size, take(sizeof size).data(), sizeof size);
+            return take(size);
+        }
+
+        bool done() const { return rest.empty(); }
+
+    private:
+        std::string_view take(const size_t n) {
+            if (rest.size() < n) {
+                throw std::runtime_error("malformed append-only log record.");
+            }
+            auto ret = rest.substr(0, n);
+            rest.remove_prefix(n);
+            return ret;
+        }
+
+        std::string_view rest;
+};
+
+class AppendOnlyLog {
+    public:
+        // opens the log at options.path, creating it if needed, and calls apply with the payload of every record in it
+        AppendOnlyLog(const AppendOnlyLogOptions& options, const std::function<void(std::string_view)>& apply,
+                      std::function<void()> rewriteDue = nullptr);
+        // writes and fsyncs everything appended before closing the file
+        ~AppendOnlyLog();
+
+        AppendOnlyLog(const AppendOnlyLog&) = delete;
+        AppendOnlyLog& operator=(const AppendOnlyLog&) = delete;
+
+        const AppendOnlyLogOptions& options() const { return config; }
+
+        // queue a record and return its sequence number; partition only matters during a rewrite
+        uint64_t append(const size_t partition, std::string_view payload);
+        // the sequence number the next record will get
+        uint64_t nextSequence() const;
+        // throws the error of the last failed write or fsync, until a later one succeeds
+        void throwIfFailed() const;
+        // with FsyncPolicy::ALWAYS, block until record seq is on disk, and throw if writing it failed; otherwise return at once
+        void waitForSync(const uint64_t seq);
+        // block until every record appended so far is written and fsynced, whatever the policy; throws if that failed
+        void flush();
+        size_t size() const;
+
+        // a rewrite: begin, write the owner's state as framed records, then finish with the sequence number each partition's
+        // copy was taken at (nextSequence() under that partition's lock), or abort. One rewrite at a time.
+        void beginRewrite();
+        void writeRewrite(std::string_view records);
+        void finishRewrite(const std::vector<uint64_t>& cutoffs);
+        void abortRewrite();
+
+        static void frame(std::string& out, std::string_view payload);
+        static uint32_t crc32c(std::string_view bytes);
+
+    private:
+        // a record appended during a rewrite, at offset in the rewrite's copy of such records
+        struct CapturedRecord {
+            size_t partition;
+            uint64_t seq;
+            size_t offset;
+            size_t size;
+        };
+
+        struct Rewrite {
+            int fd;
+            std::string path;
+            size_t size;
+            std::string records;
+            std::vector<CapturedRecord> captured;
+        };
+
+        void replay(const std::function<void(std::string_view)>& apply);
+        std::string takeCaptured(const std::vector<uint64_t>& cutoffs);
+        void swapIn(std::unique_lock<std::mutex>& lock);
+        void run();
+
+        AppendOnlyLogOptions config;
+        std::function<void()> rewriteDue;
+        int fd;
+
+        mutable std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable synced;
+        std::condition_variable swapped;
+        std::string pending;
+        std::string inFlight; // taken by the flusher
+        uint64_t appendedSeq = 0;
+        uint64_t writtenSeq = 0;
+        uint64_t syncedSeq = 0;
+        size_t fileSize = 0;
+        size_t rewrittenSize = 0; // the log's size after the last rewrite, or when it was opened
+        std::chrono::steady_clock::time_point nextSync;
+        bool syncRequested = false;
+        bool stopping = false;
+        std::exception_ptr writeError;
+        std::atomic<bool> failed = false;
+
+        std::unique_ptr<Rewrite> rewrite;
+        std::vector<uint64_t> swapCutoffs;
+        bool swapRequested = false;
+        bool rewriteTriggered = false;
+        std::exception_ptr swapError;
+
+        std::thread flusher;
+};
+
+#endif
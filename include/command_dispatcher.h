@@ -0,0 +1,46 @@
+/**
+ * @file command_dispatcher.h
+ * @brief Map RESP commands onto KeyValueStore calls and encode their replies.
+ *
+ * Commands are looked up case-insensitively in a static table that gives each one its arity in the Redis convention
+ * (n: exactly n words counting the name, -n: at least n) and a handler. Stores stand in for Redis databases:
+ * a session starts on DEFAULT_STORE_ID and SELECT switches it. A TypeMismatchError is answered with a WRONGTYPE error
+ * and any other exception with an ERR error, so a failing command never takes the connection down.
+ *
+ * A pipeline is run as a batch. Consecutive GETs become one MGET and consecutive SETs one MSET, so a burst of them costs
+ * one database statement instead of one transaction each; everything else runs one command at a time, in order.
+ */
+
+#ifndef COMMAND_DISPATCHER_H
+#define COMMAND_DISPATCHER_H
+
+#include <span>
+#include <string>
+#include <vector>
+#include "key_value_store.h"
+
+constexpr size_t DEFAULT_STORE_ID = 0;
+
+// per-connection state
+struct Session {
+    size_t storeId = DEFAULT_STORE_ID;
+    bool closing = false; // set by QUIT: close the connection once the replies so far are written
+};
+
+class CommandDispatcher {
+    public:
+        explicit CommandDispatcher(KeyValueStore& store) : store(store) {}
+
+        // run one command and append its reply to out
+        void execute(Session& session, const std::vector<std::string>& args, std::string& out);
+        // run pipelined commands and append their replies to out, in order
+        void execute(Session& session, std::span<const std::vector<std::string>> batch, std::string& out);
+
+    private:
+        KeyValueStore& store;
+
+        void getAll(Session& session, std::span<const std::vector<std::string>> gets, std::string& out);
+        void setAll(Session& session, std::span<const std::vector<std::string>> sets, std::string& out);
+};
+
+#endif
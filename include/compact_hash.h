@@ -0,0 +1,53 @@
+/**
+ * @file compact_hash.h
+ * @brief Define a field/value map that is stored as one packed buffer while it is small.
+ *
+ * A small hash keeps its entries back to back in a single string as [field length][field][value length][value],
+ * with one-byte lengths, and finds a field by scanning the buffer. For the few dozen short fields of a typical object
+ * the scan stays within a couple of cache lines and the hash costs one allocation instead of a node and two strings per field.
+ * Once it holds more than MAX_PACKED_ENTRIES fields, or a field or value longer than MAX_PACKED_LENGTH,
+ * it converts to an unordered_map for good.
+ */
+
+#ifndef COMPACT_HASH_H
+#define COMPACT_HASH_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+class CompactHash {
+    public:
+        static constexpr size_t MAX_PACKED_ENTRIES = 128;
+        static constexpr size_t MAX_PACKED_LENGTH = 64; // must stay below 256 to fit the one-byte lengths
+
+        size_t size() const;
+        std::optional<std::string> get(std::string_view field) const;
+        // true if the field is new, false if an existing value was replaced
+        bool set(const std::string& field, const std::string& value);
+        bool remove(const std::string& field);
+        std::vector<std::pair<std::string, std::string>> entries() const;
+
+        bool isPacked() const { return std::holds_alternative<Packed>(encoding); }
+
+        // heap bytes held by the encoding, in O(1)
+        size_t memoryUsage() const;
+
+    private:
+        struct Packed {
+            std::string buffer;
+            size_t count; // zero: the variant value-initializes its first alternative
+        };
+
+        static size_t find(const Packed& packed, std::string_view field);
+        void convert();
+
+        std::variant<Packed, std::unordered_map<std::string, std::string>> encoding;
+        size_t stringBytes = 0; // heap bytes of the fields and values in the unordered_map encoding
+};
+
+#endif
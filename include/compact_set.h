@@ -0,0 +1,68 @@
+/**
+ * @file compact_set.h
+ * @brief Define a set of strings that is stored as a packed array of integers while all its members are small integers.
+ *
+ * IntSet keeps its members sorted in one contiguous array of the narrowest width (16, 32 or 64 bits) that holds all of them,
+ * and widens the whole array when a larger member arrives. A lookup is a binary search down to a short window followed by
+ * a branch-free count over the window, which the compiler turns into SIMD compares. A member costs 2 to 8 bytes
+ * instead of a hash node holding a std::string.
+ * CompactSet starts out as an IntSet and converts to an unordered_set of strings, for good, once it is given a member
+ * that is not an integer in canonical form or it grows past MAX_INTSET_ENTRIES.
+ */
+
+#ifndef COMPACT_SET_H
+#define COMPACT_SET_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+
+class IntSet {
+    public:
+        size_t size() const;
+        bool contains(const int64_t value) const;
+        bool add(const int64_t value);
+        bool remove(const int64_t value);
+
+        // members in ascending order
+        std::vector<int64_t> values() const;
+
+        size_t memoryUsage() const;
+
+    private:
+        std::variant<std::vector<int16_t>, std::vector<int32_t>, std::vector<int64_t>> packed;
+};
+
+class CompactSet {
+    public:
+        static constexpr size_t MAX_INTSET_ENTRIES = 512;
+
+        size_t size() const;
+        bool contains(const std::string& member) const;
+        bool add(const std::string& member);
+        bool remove(const std::string& member);
+        std::vector<std::string> members() const;
+
+        bool isIntSet() const { return std::holds_alternative<IntSet>(encoding); }
+
+        // heap bytes held by the encoding, in O(1)
+        size_t memoryUsage() const;
+
+    private:
+        void convert();
+
+        std::variant<IntSet, std::unordered_set<std::string>> encoding;
+        size_t memberBytes = 0; // heap bytes of the strings in the unordered_set encoding
+};
+
+/*
+    The integer a member stands for, if it is written exactly as std::to_string would write it,
+    so converting an IntSet back to strings gives the members that were added.
+*/
+std::optional<int64_t> toCanonicalInteger(std::string_view member);
+
+#endif
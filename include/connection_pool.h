@@ -0,0 +1,77 @@
+/**
+ * @file connection_pool.h
+ * @brief Define a bounded, thread-safe pool of Postgres connections.
+ *
+ * Threads check a connection out for the duration of one operation and return it when the Lease goes out of scope.
+ * Connections are opened lazily up to the pool size. A connection that is found closed on checkout or return is
+ * replaced, so a database restart heals without restarting the process.
+ */
+
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include <pqxx/pqxx>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+constexpr size_t DEFAULT_POOL_SIZE = 8;
+
+struct PoolMetrics {
+    size_t size;        // maximum number of connections
+    size_t open;        // connections currently open
+    size_t inUse;       // connections currently checked out
+    size_t checkouts;   // total checkouts
+    size_t waits;       // checkouts that had to wait for a connection to be returned
+    size_t reconnects;  // connections replaced after being found closed
+    std::chrono::microseconds totalWait;
+    std::chrono::microseconds maxWait;
+};
+
+class ConnectionPool {
+    public:
+        class Lease {
+            public:
+                Lease(ConnectionPool& pool, std::unique_ptr<pqxx::connection> conn);
+                Lease(Lease&& other) noexcept;
+                Lease(const Lease&) = delete;
+                Lease& operator=(const Lease&) = delete;
+                Lease& operator=(Lease&&) = delete;
+                ~Lease();
+
+                pqxx::connection& operator*() { return *conn; }
+                pqxx::connection* operator->() { return conn.get(); }
+
+            private:
+                ConnectionPool* pool;
+                std::unique_ptr<pqxx::connection> conn;
+        };
+
+        ConnectionPool(const std::string& connectionString, const size_t size,
+                       std::function<void(pqxx::connection&)> onConnect,
+                       const std::chrono::milliseconds& checkoutTimeout = std::chrono::seconds(5));
+
+        Lease acquire();
+        PoolMetrics metrics() const;
+
+    private:
+        std::unique_ptr<pqxx::connection> open();
+        void release(std::unique_ptr<pqxx::connection> conn);
+
+        std::string connectionString;
+        size_t size;
+        std::function<void(pqxx::connection&)> onConnect;
+        std::chrono::milliseconds checkoutTimeout;
+
+        mutable std::mutex mutex;
+        std::condition_variable returned;
+        std::vector<std::unique_ptr<pqxx::connection>> idle;
+        size_t opened = 0; // idle + checked out
+        PoolMetrics stats{};
+};
+
+#endif
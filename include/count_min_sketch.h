@@ -0,0 +1,94 @@
+/**
+ * @file count_min_sketch.h
+ * @brief Define and implement a Count-Min Sketch of 4-bit counters with periodic halving.
+ *
+ * The sketch estimates how often a key was seen using a fixed amount of memory, independent of the number of distinct keys.
+ * Each key maps to one counter in each of DEPTH rows and the estimate is the minimum of those counters, so it never under-counts.
+ * Counters saturate at 15. After sampleSize increments every counter is halved, so the popularity of old keys decays over time.
+ */
+
+#ifndef COUNT_MIN_SKETCH_H
+#define COUNT_MIN_SKETCH_H
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+#include "key.h"
+
+class CountMinSketch {
+    public:
+        /*
+            expectedKeys sizes the rows to roughly two counters per key; the counters are reset after 10 * expectedKeys increments.
+        */
+        explicit CountMinSketch(size_t expectedKeys)
+            : width(std::bit_ceil(std::max<size_t>(expectedKeys * 2, 64))),
+              sampleSize(std::max<size_t>(expectedKeys, 1) * 10),
+              additions(0),
+              table(DEPTH * width / COUNTERS_PER_WORD, 0) {}
+
+        void increment(const KeyView key) {
+            uint64_t hash = key.hash();
+            bool added = false;
+            for (size_t row = 0; row < DEPTH; ++row) {
+                size_t idx = indexOf(hash, row);
+                uint64_t& word = table[idx / COUNTERS_PER_WORD];
+                size_t shift = (idx % COUNTERS_PER_WORD) * 4;
+                if (((word >> shift) & 0xF) != 0xF) {
+                    word += uint64_t{1} << shift;
+                    added = true;
+                }
+            }
+
+            if (added && ++additions >= sampleSize) {
+                halve();
+            }
+        }
+
+        size_t estimate(const KeyView key) const {
+            uint64_t hash = key.hash();
+            size_t ret = 0xF;
+            for (size_t row = 0; row < DEPTH; ++row) {
+                size_t idx = indexOf(hash, row);
+                size_t count = (table[idx / COUNTERS_PER_WORD] >> ((idx % COUNTERS_PER_WORD) * 4)) & 0xF;
+                ret = std::min(ret, count);
+            }
+            return ret;
+        }
+
+        /*
+            Halve every counter. Shifting a whole word right by one and masking off the bit that crossed
+            into each neighbouring counter halves 16 counters at once.
+        */
+        void halve() {
+            for (auto& word : table) {
+                word = (word >> 1) & 0x7777777777777777ULL;
+            }
+            additions /= 2;
+        }
+
+        size_t memoryUsage() const {
+            return table.capacity() * sizeof(uint64_t);
+        }
+
+    private:
+        static constexpr size_t DEPTH = 4;
+        static constexpr size_t COUNTERS_PER_WORD = 16;
+
+        // Rows are laid out back to back; each row derives its own index from the key hash with a different odd multiplier.
+        size_t indexOf(uint64_t hash, size_t row) const {
+            static constexpr uint64_t SEEDS[DEPTH] = {
+                0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL
+            };
+            uint64_t h = (hash ^ (hash >> 29)) * SEEDS[row];
+            h ^= h >> 32;
+            return row * width + (h & (width - 1));
+        }
+
+        size_t width;
+        size_t sampleSize;
+        size_t additions;
+        std::vector<uint64_t> table;
+};
+
+#endif
@@ -6,37 +6,98 @@
 #include <iostream>
 #include <chrono>
 #include <optional>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+#include <unordered_map>
+#include "connection_pool.h"
+#include "quicklist.h"
+#include "storage_engine.h"
+#include "write_behind_queue.h"
 
 constexpr std::string_view STRING_TABLE = "strings";
 constexpr std::string_view LIST_TABLE = "lists";
 constexpr std::string_view SET_TABLE = "sets";
+constexpr std::string_view HASH_TABLE = "hashes";
 constexpr std::string_view EVICTION_TABLE = "eviction";
 
-class DatabaseManager {
+class DatabaseManager : public StorageEngine {
 public:
-    DatabaseManager(const std::string& connectionString);
-    ~DatabaseManager();
+    DatabaseManager(const std::string& connectionString, const size_t poolSize = DEFAULT_POOL_SIZE);
+    ~DatabaseManager() override;
+
+    bool cacheable() const override { return true; }
 
     void connect();
     void disconnect();
-    void deleteKey(const size_t storeId, const std::string& key);
-    void clearStore(const size_t storeId);
+    PoolMetrics poolMetrics() const;
+
+    void enableWriteBehind(const WriteBehindOptions& options);
+    void disableWriteBehind();
+    void flush() override;
 
-    size_t changePolicy(const size_t storeId, const std::string& policy);
+    void deleteKey(const size_t storeId, const std::string& key) override;
+    void clearStore(const size_t storeId) override;
+
+    size_t changePolicy(const size_t storeId, const std::string& policy) override;
+    std::optional<EvictionConfig> getEvictionConfig(const size_t storeId) override;
+    void setMaxMemory(const size_t storeId, const size_t bytes) override;
+    std::optional<size_t> memoryUsage(const size_t storeId, const std::string& key) override;
+    // the postgres backend keeps keys in the database; KeyValueStore reports its cache instead
+    std::optional<MemoryStats> memoryStats(const size_t) override { return std::nullopt; }
     // bool exceedsCapacity(const size_t storeId);
     // std::string evictLRU(const size_t storeId);
     
 
-    size_t setExpiration(const size_t storeId, const std::string& key, const std::chrono::seconds& sec);
-    std::optional<std::chrono::steady_clock::time_point> getExpiration(const size_t storeId, const std::string& key, const std::string& type);
+    size_t setExpiration(const size_t storeId, const std::string& key, const ExpirationTime& expiration) override;
+    size_t clearExpiration(const size_t storeId, const std::string& key) override;
+    std::optional<std::optional<ExpirationTime>> getExpiration(const size_t storeId, const std::string& key) override;
     
-    void insertString(const size_t storeId, const std::string& key, const std::string& value);
+    void insertString(const size_t storeId, const std::string& key, const std::string& value) override;
     void deleteString(const size_t storeId, const std::string& key);
     std::optional<std::string> fetchString(const size_t storeId, const std::string& key);
+    std::optional<StringEntry> fetchLiveString(const size_t storeId, const std::string& key) override;
+
+    std::vector<std::optional<StringEntry>> fetchLiveStrings(const size_t storeId, const std::vector<std::string>& keys) override;
+    void insertStrings(const size_t storeId, const std::vector<std::string>& keys, const std::vector<std::string>& values) override;
+    size_t deleteKeys(const size_t storeId, const std::vector<std::string>& keys) override;
+    size_t deleteExpiredStrings(const size_t storeId, const std::vector<std::string>& keys) override;
+    std::vector<std::pair<size_t, std::string>> fetchExpiredKeys(const size_t limit) override;
+
+    void deleteList(const size_t storeId, const std::string& key);
+    size_t listPush(const size_t storeId, const std::string& key, const std::vector<std::string>& values, const ListEnd end) override;
+    std::vector<std::string> listPop(const size_t storeId, const std::string& key, const size_t count, const ListEnd end) override;
+    std::vector<std::string> listRange(const size_t storeId, const std::string& key, const std::int64_t start, const std::int64_t stop) override;
+    size_t listLength(const size_t storeId, const std::string& key) override;
+
+    void deleteSet(const size_t storeId, const std::string& key);
+    size_t setAdd(const size_t storeId, const std::string& key, const std::vector<std::string>& members) override;
+    size_t setRemove(const size_t storeId, const std::string& key, const std::vector<std::string>& members) override;
+    std::vector<std::string> setMembers(const size_t storeId, const std::string& key) override;
+    bool setContains(const size_t storeId, const std::string& key, const std::string& member) override;
+    size_t setSize(const size_t storeId, const std::string& key) override;
+    std::vector<std::string> setCombine(const size_t storeId, const std::vector<std::string>& keys, const SetOperation operation) override;
+
+    void deleteHash(const size_t storeId, const std::string& key);
+    size_t hashSet(const size_t storeId, const std::string& key, const std::vector<std::pair<std::string, std::string>>& fields) override;
+    std::vector<std::optional<std::string>> hashGet(const size_t storeId, const std::string& key, const std::vector<std::string>& fields) override;
+    std::vector<std::pair<std::string, std::string>> hashGetAll(const size_t storeId, const std::string& key) override;
+    size_t hashDelete(const size_t storeId, const std::string& key, const std::vector<std::string>& fields) override;
+    size_t hashLength(const size_t storeId, const std::string& key) override;
 
 private:
+    static void prepareStatements(pqxx::connection& connection);
+    void writeBatch(const PendingWrites& writes);
+    void settle(const size_t storeId, const std::string& key);
+    std::optional<std::optional<std::string>> pending(const size_t storeId, const std::string& key) const;
+    bool writeBehindEnabled() const;
+
     std::string connectionString;
-    pqxx::connection* conn;
+    size_t poolSize;
+    std::unique_ptr<ConnectionPool> pool;
+    // shared by calls using writeBehind, exclusive while it is replaced; never held across a call to another method that takes it
+    mutable std::shared_mutex writeBehindMutex;
+    std::unique_ptr<WriteBehindQueue> writeBehind;
 };
 
 #endif
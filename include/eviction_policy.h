@@ -1,15 +1,38 @@
 #ifndef EVICTION_POLICY_H
 #define EVICTION_POLICY_H
 
+#include <functional>
 #include <string>
+#include <string_view>
 #include <optional>
+#include <memory>
+#include "key.h"
 
+/*
+    Policies do not copy or rehash keys. The first keyAccessed for a key keeps the view it was given as the key's handle,
+    so the caller must pass a view of its own stored copy and keep those bytes alive and unchanged until the key
+    leaves through keyRemoved or evict. If the caller moves its copy, it calls keyMoved with the new location
+    while the old bytes are still readable. Any view with the right contents will do for a key that is already tracked.
+*/
 class EvictionPolicy {
     public:
-        virtual void keyAccessed(const std::string& key) = 0;
-        virtual void keyRemoved(const std::string& key) = 0;
-        virtual std::string evict() = 0;
+        virtual void keyAccessed(const KeyView key) = 0;
+        virtual void keyRemoved(const KeyView key) = 0;
+        virtual void keyMoved(const KeyView key) = 0;
+        // a view of the caller's copy of the evicted key, which the caller still owns
+        virtual KeyView evict() = 0;
+        // heap bytes of the policy's own bookkeeping, not counting the keys it refers to
+        virtual size_t memoryUsage() const = 0;
+
+        // every key from the next to be evicted to the last, with the access count the policy keeps for it (0 if it keeps none)
+        virtual void forEachByRank(const std::function<void(const KeyView, const size_t)>& f) const = 0;
+        // track a new key as the most recently used, with the given access count. Restoring keys in forEachByRank order,
+        // as a snapshot does, rebuilds the order they were in. The same handle rules apply as for keyAccessed.
+        virtual void keyRestored(const KeyView key, const size_t count) = 0;
         virtual ~EvictionPolicy() = default;
 };      
 
+// Create the eviction policy named in the eviction table ('lru', 'lfu' or 'tinylfu').
+std::unique_ptr<EvictionPolicy> makeEvictionPolicy(const std::string& policy, const size_t capacity);
+
 #endif
\ No newline at end of file
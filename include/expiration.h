@@ -0,0 +1,49 @@
+/**
+ * @file expiration.h
+ * @brief Define how key expirations are represented.
+ *
+ * An expiration is an absolute wall-clock time with millisecond precision, persisted as Unix epoch milliseconds.
+ * Unlike a steady_clock reading it means the same thing after a restart and on every app server sharing the database.
+ */
+
+#ifndef EXPIRATION_H
+#define EXPIRATION_H
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <optional>
+
+using ExpirationTime = std::chrono::sys_time<std::chrono::milliseconds>;
+
+inline ExpirationTime currentTime() {
+    return std::chrono::floor<std::chrono::milliseconds>(std::chrono::system_clock::now());
+}
+
+inline std::int64_t toUnixMilliseconds(const ExpirationTime& time) {
+    return time.time_since_epoch().count();
+}
+
+inline ExpirationTime fromUnixMilliseconds(const std::int64_t milliseconds) {
+    return ExpirationTime(std::chrono::milliseconds(milliseconds));
+}
+
+/*
+    The time amount units of unitMilliseconds after base, or std::nullopt if it does not fit in Unix epoch milliseconds.
+    Checked before any arithmetic, so an EXPIRE argument that is too large is rejected instead of wrapping around into the past.
+*/
+inline std::optional<ExpirationTime> expirationAfter(const ExpirationTime& base, const std::int64_t amount, const std::int64_t unitMilliseconds) {
+    constexpr auto max = std::numeric_limits<std::int64_t>::max();
+    constexpr auto min = std::numeric_limits<std::int64_t>::min();
+    if (amount > max / unitMilliseconds || amount < min / unitMilliseconds) {
+        return std::nullopt;
+    }
+    auto milliseconds = amount * unitMilliseconds;
+    auto since = toUnixMilliseconds(base);
+    if (milliseconds > 0 ? since > max - milliseconds : since < min - milliseconds) {
+        return std::nullopt;
+    }
+    return fromUnixMilliseconds(since + milliseconds);
+}
+
+#endif
@@ -0,0 +1,232 @@
+/**
+ * @file in_memory_engine.h
+ * @brief Define a storage engine that keeps every store in process memory.
+ *
+ * The keyspace is split into a power-of-two number of shards by a hash of (store id, key), and each shard has its own lock,
+ * so operations on different keys run in parallel on different cores. Within a shard each store is a RecordTable of strings
+ * and maps of QuickLists, CompactSets and CompactHashes, with its own eviction policy instance covering all of them.
+ * A store holds any number of keys until its eviction config sets a capacity, since the engine is the store and not a cache of it.
+ * A capacity holds for the whole store: its parts share an atomic count of its keys, and a write that takes the count over
+ * capacity evicts from the shard it wrote to, or from another shard once that part is down to the key just written. Victims are ranked within a shard, so LRU and LFU pick the least recently or frequently used key of that shard.
+ * A store's byte budget (maxMemory) holds for the whole store the same way, against a shared count of the bytes its parts hold,
+ * records, collections, map nodes and policy bookkeeping included (see memory_usage.h). Lowering the budget, or loading a store
+ * that does not fit, evicts from every part in turn instead.
+ * Each public method hashes its key once into a KeyView, and that hash picks the shard and is reused by every table and policy below.
+ *
+ * Without a log the data lives as long as the KeyValueStore that owns the engine. With enableLog every mutation is logged before
+ * it is applied, under the same shard lock, so each shard's records are in the order its changes happened; deletions the log
+ * could not derive from earlier records (evictions, expired keys) are logged as DEL. Replay applies the records with eviction
+ * and expiry turned off, which makes it reproduce the logged state exactly, and then evicts whatever no longer fits.
+ * Eviction policy state is not logged: after a restart the policies start over from the order keys were replayed in.
+ *
+ * A snapshot (see snapshot.h) is the faster way back: saveSnapshot forks while holding every lock, and the child writes the
+ * copy-on-write image of the stores, with their TTLs and eviction order, while the parent goes on serving. The parent
+ * only pays for the fork and for the pages it writes to before the child is done. loadSnapshot maps the file and copies
+ * each section into its shard, one thread per section, without rehashing keys or re-encoding lists.
+ */
+
+#ifndef IN_MEMORY_ENGINE_H
+#define IN_MEMORY_ENGINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "append_only_log.h"
+#include "compact_hash.h"
+#include "compact_set.h"
+#include "eviction_policy.h"
+#include "key.h"
+#include "quicklist.h"
+#include "record_table.h"
+#include "snapshot.h"
+#include "storage_engine.h"
+
+class InMemoryEngine : public StorageEngine {
+    public:
+        // the capacity of a store whose eviction config has not set one: no limit on its keys
+        static constexpr size_t NO_CAPACITY = SIZE_MAX;
+
+        // shardCount is rounded up to a power of two; 0 picks one from the number of hardware threads
+        explicit InMemoryEngine(const size_t shardCount = 0);
+        ~InMemoryEngine() override;
+
+        bool cacheable() const override { return false; }
+        // with a log, blocks until every logged write is on disk
+        void flush() override;
+
+        size_t shardCount() const { return shards.size(); }
+
+        // replay the log at options.path, then log every mutation to it. The engine takes the shard count the log was written with.
+        // Call on an empty engine, before it is shared between threads; throws if the log cannot be opened or is corrupt.
+        void enableLog(const AppendOnlyLogOptions& options);
+        // flush the log and stop logging
+        void disableLog();
+        // compact the log in the background; false if there is no log or a rewrite is already running
+        bool rewriteLog();
+
+        // write a snapshot of every store to path from a forked child; false if a save is already running
+        bool saveSnapshot(const std::string& path);
+        // block until the running save, if any, is done; true if the last save succeeded
+        bool waitForSnapshot();
+        // Unix epoch milliseconds of the data in the last snapshot saved or loaded, 0 if none
+        int64_t lastSnapshot();
+        // load the snapshot at path, taking its shard count. Call on an empty engine without a log, before it is shared
+        // between threads; throws if the file is missing, incomplete or corrupt, and leaves the engine empty then.
+        void loadSnapshot(const std::string& path);
+
+        // the in-memory counterpart of a store's row in the eviction table; clears the store
+        void setEvictionConfig(const size_t storeId, const EvictionConfig& config);
+
+        void clearStore(const size_t storeId) override;
+        size_t changePolicy(const size_t storeId, const std::string& policy) override;
+        std::optional<EvictionConfig> getEvictionConfig(const size_t storeId) override;
+        // unlike a policy change, keeps the store and evicts from it until it fits
+        void setMaxMemory(const size_t storeId, const size_t bytes) override;
+        std::optional<size_t> memoryUsage(const size_t storeId, const std::string& key) override;
+        std::optional<MemoryStats> memoryStats(const size_t storeId) override;
+
+        void deleteKey(const size_t storeId, const std::string& key) override;
+        size_t setExpiration(const size_t storeId, const std::string& key, const ExpirationTime& expiration) override;
+        size_t clearExpiration(const size_t storeId, const std::string& key) override;
+        std::optional<std::optional<ExpirationTime>> getExpiration(const size_t storeId, const std::string& key) override;
+
+        void insertString(const size_t storeId, const std::string& key, const std::string& value) override;
+        std::optional<StringEntry> fetchLiveString(const size_t storeId, const std::string& key) override;
+        std::vector<std::optional<StringEntry>> fetchLiveStrings(const size_t storeId, const std::vector<std::string>& keys) override;
+        void insertStrings(const size_t storeId, const std::vector<std::string>& keys, const std::vector<std::string>& values) override;
+        size_t deleteKeys(const size_t storeId, const std::vector<std::string>& keys) override;
+
+        size_t listPush(const size_t storeId, const std::string& key, const std::vector<std::string>& values, const ListEnd end) override;
+        std::vector<std::string> listPop(const size_t storeId, const std::string& key, const size_t count, const ListEnd end) override;
+        std::vector<std::string> listRange(const size_t storeId, const std::string& key, const int64_t start, const int64_t stop) override;
+        size_t listLength(const size_t storeId, const std::string& key) override;
+
+        size_t setAdd(const size_t storeId, const std::string& key, const std::vector<std::string>& members) override;
+        size_t setRemove(const size_t storeId, const std::string& key, const std::vector<std::string>& members) override;
+        std::vector<std::string> setMembers(const size_t storeId, const std::string& key) override;
+        bool setContains(const size_t storeId, const std::string& key, const std::string& member) override;
+        size_t setSize(const size_t storeId, const std::string& key) override;
+        std::vector<std::string> setCombine(const size_t storeId, const std::vector<std::string>& keys, const SetOperation operation) override;
+
+        size_t hashSet(const size_t storeId, const std::string& key, const std::vector<std::pair<std::string, std::string>>& fields) override;
+        std::vector<std::optional<std::string>> hashGet(const size_t storeId, const std::string& key, const std::vector<std::string>& fields) override;
+        std::vector<std::pair<std::string, std::string>> hashGetAll(const size_t storeId, const std::string& key) override;
+        size_t hashDelete(const size_t storeId, const std::string& key, const std::vector<std::string>& fields) override;
+        size_t hashLength(const size_t storeId, const std::string& key) override;
+
+        size_t deleteExpiredStrings(const size_t storeId, const std::vector<std::string>& keys) override;
+        std::vector<std::pair<size_t, std::string>> fetchExpiredKeys(const size_t limit) override;
+
+    private:
+        // the keys and bytes of a store over every shard, shared by its parts
+        struct StoreTotals {
+            std::atomic<size_t> keys = 0;
+            std::atomic<size_t> bytes = 0;
+        };
+
+        // one store's keys within one shard
+        struct Store {
+            Store(const size_t id, const size_t shard, const EvictionConfig& config, const size_t expectedKeys,
+                  std::shared_ptr<StoreTotals> totals);
+            ~Store();
+
+            Store(const Store&) = delete;
+            Store& operator=(const Store&) = delete;
+
+            size_t id;
+            size_t shard; // index of the shard it is in, which is its partition in the log
+            size_t capacity; // keys in the whole store
+            size_t maxMemory; // bytes in the whole store, 0 for no limit
+            std::shared_ptr<StoreTotals> totals;
+            size_t countedKeys = 0; // this part's keys as last added to totals
+            size_t countedBytes = 0; // this part's bytes as last added to totals
+            size_t collectionBytes = 0; // lists, sets and hashes with their map nodes and keys
+            std::unique_ptr<EvictionPolicy> evictionPolicy;
+            RecordTable records;
+            KeyMap<QuickList> lists;
+            KeyMap<CompactSet> sets;
+            KeyMap<CompactHash> hashes;
+        };
+
+        // aligned to a cache line so threads locking neighbouring shards do not contend on the same line
+        struct alignas(64) Shard {
+            std::mutex mutex; // guards stores
+            std::unordered_map<size_t, Store> stores;
+        };
+
+        Shard& shardFor(const size_t storeId, const KeyView key);
+        Store& storeIn(Shard& shard, const size_t storeId);
+        void resetStore(const size_t storeId);
+        EvictionConfig configFor(const size_t storeId);
+
+        Record* findLive(Store& store, const KeyView key);
+        QuickList* findList(Store& store, const KeyView key);
+        CompactSet* findSet(Store& store, const KeyView key);
+        CompactHash* findHash(Store& store, const KeyView key);
+        static bool holdsCollection(const Store& store, const KeyView key);
+        void putString(const size_t storeId, const std::string& key, const std::string& value);
+        void insert(Store& store, const KeyView key, const std::string& value);
+        void accessed(Store& store, const KeyView key);
+        static bool remove(Store& store, const KeyView key);
+        bool logAndRemove(Store& store, const KeyView key);
+        static void eraseKey(Store& store, const KeyView key);
+        static size_t keyCount(const Store& store);
+        static void recount(Store& store);
+        static size_t usedMemory(const Store& store);
+        static bool overBudget(const Store& store);
+        void evictOne(Store& store);
+        void evictOverBudget(Store& store);
+        void evictToFit(const size_t storeId);
+        void evictStoresToFit();
+
+        // log records; defined with the engine
+        enum class LogOp : uint8_t;
+        template <typename... Args>
+        void log(const size_t partition, const LogOp op, const size_t storeId, const Args&... args);
+        void applyLogRecord(std::string_view payload);
+        static void dumpStore(std::string& out, const Store& store);
+        void runRewrite();
+
+        // snapshots; the writers run in the forked child
+        SnapshotHeader writeSnapshot(SnapshotWriter& out, const int64_t savedAt) const;
+        static size_t writeSnapshotEntries(SnapshotWriter& out, const Store& store);
+        void loadSnapshotSection(const SnapshotFile& file, const SnapshotSection& section, const int64_t now,
+                                 std::vector<std::pair<int64_t, std::pair<size_t, std::string>>>& expirations);
+
+        std::vector<Shard> shards;
+        unsigned shardBits;
+
+        // lock order: storeWideMutex, then a shard's mutex, then configMutex
+        std::mutex storeWideMutex; // held by operations on a whole store, and by a log rewrite while it copies the stores
+        std::mutex configMutex; // guards configs and totals
+        std::unordered_map<size_t, EvictionConfig> configs;
+        std::unordered_map<size_t, std::shared_ptr<StoreTotals>> totals;
+
+        std::unique_ptr<AppendOnlyLog> appendLog;
+        bool loading = false; // replaying the log: no eviction or expiry
+        std::vector<std::pair<int64_t, std::pair<size_t, std::string>>> loadedExpirations; // TTLs replayed from the log
+
+        std::mutex rewriteMutex; // guards rewriter, rewriting, detaching, and appendLog against the log's own thread
+        std::thread rewriter;
+        bool rewriting = false;
+        bool detaching = false;
+
+        // TTLs from before a restart, soonest first, handed to the active expirer through fetchExpiredKeys
+        std::mutex restoredMutex; // guards restoredExpirations
+        std::multimap<int64_t, std::pair<size_t, std::string>> restoredExpirations;
+
+        std::mutex snapshotMutex; // guards saver, saving, snapshotSucceeded and snapshotTime
+        std::condition_variable snapshotDone;
+        std::thread saver; // waits for the child
+        bool saving = false;
+        bool snapshotSucceeded = false;
+        int64_t snapshotTime = 0;
+};
+
+#endif
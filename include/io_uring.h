@@ -0,0 +1,96 @@
+/**
+ * @file io_uring.h
+ * @brief Define a minimal io_uring ring on the raw system calls, without liburing.
+ *
+ * Operations are queued as submission queue entries and sent to the kernel together, in the same io_uring_enter call that
+ * waits for completions, so one system call starts and reaps any number of operations. A ring belongs to one thread.
+ * Receives draw their buffer from a ring of provided buffers registered with the kernel. The kernel picks a buffer only
+ * once data arrives, so an idle connection holds no buffer while its receive is pending.
+ * Only built where <linux/io_uring.h> has the 5.19 additions used here (HAVE_IO_URING); the constructor throws std::system_error where the kernel
+ * refuses rings (before 5.19, or io_uring disabled by sysctl or seccomp), and callers fall back to epoll.
+ */
+
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#ifdef HAVE_IO_URING
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <vector>
+
+class IoUring {
+    public:
+        // throws std::system_error if the kernel does not support io_uring with provided buffer rings
+        explicit IoUring(const unsigned entries);
+        ~IoUring();
+
+        IoUring(const IoUring&) = delete;
+        IoUring& operator=(const IoUring&) = delete;
+
+        // register count buffers of size bytes each as buffer group 0, for prepareRecv; count must be a power of 2
+        void provideBuffers(const size_t count, const size_t size);
+        const char* buffer(const uint16_t id) const { return buffers.data() + id * bufferSize; }
+        // hand a buffer that a receive completed into back to the kernel
+        void recycle(const uint16_t id);
+
+        void prepareAccept(const int fd, const uint64_t userData);
+        // receive into a provided buffer; the completion's flags carry its id (bufferId)
+        void prepareRecv(const int fd, const uint64_t userData);
+        void prepareRead(const int fd, void* buffer, const size_t length, const uint64_t userData);
+        // msg and the buffers it points to must stay valid until the completion
+        void prepareSendmsg(const int fd, const msghdr* msg, const uint64_t userData);
+
+        // submit everything prepared and wait until at least waitFor operations have completed
+        void submitAndWait(const unsigned waitFor);
+
+        // call f(const io_uring_cqe&) for every completion that has arrived; returns how many there were
+        template <typename F>
+        size_t forEachCompletion(F&& f) {
+            auto head = *cqHead;
+            auto tail = std::atomic_ref<unsigned>(*cqTail).load(std::memory_order_acquire);
+            for (auto i = head; i != tail; ++i) {
+                f(cqes[i & cqMask]);
+            }
+            // the kernel may reuse the entries once the head moves past them
+            std::atomic_ref<unsigned>(*cqHead).store(tail, std::memory_order_release);
+            return tail - head;
+        }
+
+        static bool hasBuffer(const io_uring_cqe& cqe) { return cqe.flags & IORING_CQE_F_BUFFER; }
+        static uint16_t bufferId(const io_uring_cqe& cqe) { return cqe.flags >> IORING_CQE_BUFFER_SHIFT; }
+
+    private:
+        io_uring_sqe& prepare(const uint8_t opcode, const int fd, const uint64_t userData);
+
+        int ringFd;
+        unsigned entries;
+
+        void* sqRing;
+        size_t sqRingSize;
+        void* cqRing;
+        size_t cqRingSize;
+        io_uring_sqe* sqes;
+
+        unsigned* sqHead;
+        unsigned* sqTail;
+        unsigned sqMask;
+        unsigned sqLocalTail; // entries prepared, published to sqTail on submit
+        unsigned* cqHead;
+        unsigned* cqTail;
+        unsigned cqMask;
+        io_uring_cqe* cqes;
+
+        io_uring_buf_ring* bufferRing;
+        size_t bufferRingSize;
+        unsigned bufferMask;
+        size_t bufferSize;
+        std::vector<char> buffers;
+};
+
+#endif
+
+#endif
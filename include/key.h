@@ -0,0 +1,144 @@
+/**
+ * @file key.h
+ * @brief Define the key types of the in-memory hot path, which carry their hash with them.
+ *
+ * A key is hashed once, where it enters the engine or a cache, and the hash travels with it from then on:
+ * shard selection, the record table, the collection maps and the eviction policies all reuse it instead of
+ * rehashing the bytes, and two keys with different hashes are told apart without comparing bytes.
+ * KeyView refers to bytes owned elsewhere. Key owns its bytes and keeps up to INLINE_CAPACITY of them inside the object,
+ * so copying a typical short key into a map, or out of a policy before erasing it, does not allocate.
+ */
+
+#ifndef KEY_H
+#define KEY_H
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+inline uint64_t hashKey(std::string_view bytes) {
+    return std::hash<std::string_view>{}(bytes);
+}
+
+class KeyView {
+    public:
+        KeyView(std::string_view bytes) : data(bytes), hashValue(hashKey(bytes)) {}
+        KeyView(const std::string& bytes) : KeyView(std::string_view(bytes)) {}
+        KeyView(const char* bytes) : KeyView(std::string_view(bytes)) {}
+        // for bytes whose hash is already known, such as a stored copy of a key that was hashed on the way in
+        KeyView(std::string_view bytes, const uint64_t hash) noexcept : data(bytes), hashValue(hash) {}
+
+        std::string_view bytes() const noexcept { return data; }
+        uint64_t hash() const noexcept { return hashValue; }
+
+        friend bool operator==(const KeyView& a, const KeyView& b) noexcept {
+            return a.hashValue == b.hashValue && a.data == b.data;
+        }
+
+    private:
+        std::string_view data;
+        uint64_t hashValue;
+};
+
+class Key {
+    public:
+        static constexpr size_t INLINE_CAPACITY = 23;
+
+        explicit Key(const KeyView key) : hashValue(key.hash()) {
+            auto bytes = key.bytes();
+            if (bytes.size() <= INLINE_CAPACITY) {
+                std::memcpy(storage, bytes.data(), bytes.size());
+                storage[TAG] = static_cast<char>(bytes.size());
+                return;
+            }
+            char* heap = new char[bytes.size()];
+            std::memcpy(heap, bytes.data(), bytes.size());
+            size_t size = bytes.size();
+            std::memcpy(storage, &heap, sizeof heap);
+            std::memcpy(storage + sizeof heap, &size, sizeof size);
+            storage[TAG] = HEAP;
+        }
+
+        Key(const Key& other) : Key(other.view()) {}
+
+        Key(Key&& other) noexcept : hashValue(other.hashValue) {
+            std::memcpy(storage, other.storage, sizeof storage);
+            other.storage[TAG] = 0; // the heap buffer, if any, now belongs to this key
+        }
+
+        Key& operator=(const Key& other) {
+            if (this != &other) {
+                *this = Key(other);
+            }
+            return *this;
+        }
+
+        Key& operator=(Key&& other) noexcept {
+            if (this != &other) {
+                release();
+                hashValue = other.hashValue;
+                std::memcpy(storage, other.storage, sizeof storage);
+                other.storage[TAG] = 0;
+            }
+            return *this;
+        }
+
+        ~Key() { release(); }
+
+        std::string_view bytes() const noexcept {
+            if (storage[TAG] != HEAP) {
+                return {storage, static_cast<size_t>(storage[TAG])};
+            }
+            const char* heap;
+            size_t size;
+            std::memcpy(&heap, storage, sizeof heap);
+            std::memcpy(&size, storage + sizeof heap, sizeof size);
+            return {heap, size};
+        }
+
+        uint64_t hash() const noexcept { return hashValue; }
+        // bytes allocated outside the object, for memory accounting
+        size_t heapBytes() const noexcept { return storage[TAG] == HEAP ? bytes().size() : 0; }
+        KeyView view() const noexcept { return KeyView(bytes(), hashValue); }
+        operator KeyView() const noexcept { return view(); }
+
+    private:
+        static constexpr size_t TAG = INLINE_CAPACITY; // last byte of storage: the inline size, or HEAP
+        static constexpr char HEAP = static_cast<char>(0xFF);
+
+        void release() {
+            if (storage[TAG] == HEAP) {
+                char* heap;
+                std::memcpy(&heap, storage, sizeof heap);
+                delete[] heap;
+            }
+        }
+
+        uint64_t hashValue;
+        // inline: the bytes, then the size in the last byte. On the heap: the pointer and the size, then HEAP in the last byte.
+        alignas(char*) char storage[INLINE_CAPACITY + 1];
+};
+
+static_assert(sizeof(Key) == 32);
+
+/*
+    Hash and equality for containers of Key or KeyView. Both are transparent, so a map keyed by Key can be searched
+    with a KeyView, and neither touches the bytes to hash them.
+*/
+struct KeyHash {
+    using is_transparent = void;
+    size_t operator()(const KeyView& key) const noexcept { return key.hash(); }
+};
+
+struct KeyEqual {
+    using is_transparent = void;
+    bool operator()(const KeyView& a, const KeyView& b) const noexcept { return a == b; }
+};
+
+template <typename T>
+using KeyMap = std::unordered_map<Key, T, KeyHash, KeyEqual>;
+
+#endif
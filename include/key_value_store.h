@@ -6,43 +6,96 @@
 #include <optional>
 #include <stdexcept>
 #include <deque>
+#include <mutex>
+#include "active_expirer.h"
 #include "eviction_policy.h"
 #include "lru.h"
 #include "lfu.h"
+#include "tiny_lfu.h"
 #include "database_manager.h"
+#include "in_memory_engine.h"
+#include "store_cache.h"
 
 const std::string CONNECTION_STRING = "dbname=key_value_store user=staceylee password=Stacey2002* host=db port=5432";
 class KeyValueStore {
     public:
         KeyValueStore();
+        explicit KeyValueStore(const size_t poolSize);
+        explicit KeyValueStore(const StorageBackend backend, const size_t poolSize = DEFAULT_POOL_SIZE);
+
+        PoolMetrics poolMetrics() const;
+        ExpirationMetrics expirationMetrics() const;
 
         // size_t setCapacity(const size_t newCapacity);
         size_t useLRU(const size_t storeId);
         size_t useLFU(const size_t storeId);
+        size_t useTinyLFU(const size_t storeId);
+
+        // memory
+        std::string setMaxMemory(const size_t storeId, const size_t bytes);
+        std::optional<size_t> memoryUsage(const size_t storeId, const std::string& key);
+        MemoryStats memoryStats(const size_t storeId);
+
+        // write-behind
+        void enableWriteBehind(const size_t maxPending, const std::chrono::milliseconds& durabilityWindow);
+        void disableWriteBehind();
+        void flush();
+
+        // append-only log
+        void enableAppendOnlyLog(const std::string& path, const FsyncPolicy fsync, const std::chrono::milliseconds& fsyncInterval);
+        void disableAppendOnlyLog();
+        std::string rewriteAppendOnlyLog();
+
+        // snapshots
+        bool useSnapshot(const std::string& path, const bool load = true);
+        std::string bgSave();
+        std::string save();
+        int64_t lastSave();
 
         // expiration
         size_t expire(const size_t storeId, const std::string& key, const std::chrono::seconds& sec);
-        // size_t persist(const std::string& key);
+        size_t pExpire(const size_t storeId, const std::string& key, const std::chrono::milliseconds& ms);
+        size_t expireAt(const size_t storeId, const std::string& key, const int64_t unixSeconds);
+        size_t pExpireAt(const size_t storeId, const std::string& key, const int64_t unixMilliseconds);
+        size_t persist(const size_t storeId, const std::string& key);
+        int64_t ttl(const size_t storeId, const std::string& key);
+        int64_t pTTL(const size_t storeId, const std::string& key);
 
         // strings
         std::string set(const size_t storeId, const std::string& key, const std::string& val);
         std::optional<std::string> get(const size_t storeId, const std::string& key);
         size_t del(const size_t storeId, const std::string& key);
+        size_t del(const size_t storeId, const std::vector<std::string>& keys);
+        std::vector<std::optional<std::string>> mget(const size_t storeId, const std::vector<std::string>& keys);
+        std::string mset(const size_t storeId, const std::vector<std::pair<std::string, std::string>>& pairs);
 
-        // // lists
-        // size_t lPush(const std::string& key, const std::string& val);
-        // size_t rPush(const std::string& key, const std::string& val);
-        // std::optional<std::string> lPop(const std::string& key);
-        // std::optional<std::string> rPop(const std::string& key);
-        // std::optional<std::deque<std::string>> lRange(const std::string& key, const int& start, const int& end);
-        // size_t lLen(const std::string& key);
+        // lists
+        size_t lPush(const size_t storeId, const std::string& key, const std::vector<std::string>& vals);
+        size_t rPush(const size_t storeId, const std::string& key, const std::vector<std::string>& vals);
+        std::optional<std::string> lPop(const size_t storeId, const std::string& key);
+        std::vector<std::string> lPop(const size_t storeId, const std::string& key, const size_t count);
+        std::optional<std::string> rPop(const size_t storeId, const std::string& key);
+        std::vector<std::string> rPop(const size_t storeId, const std::string& key, const size_t count);
+        std::vector<std::string> lRange(const size_t storeId, const std::string& key, const int64_t start, const int64_t stop);
+        size_t lLen(const size_t storeId, const std::string& key);
         
-        // // sets
-        // size_t sAdd(const std::string& key, const std::string& val);
-        // size_t sRem(const std::string& key, const std::string& val);
-        // std::unordered_set<std::string> sMembers(const std::string& key);
-        // size_t sIsMember(const std::string& key, const std::string& val);
-        // size_t sCard(const std::string& key);
+        // sets
+        size_t sAdd(const size_t storeId, const std::string& key, const std::vector<std::string>& members);
+        size_t sRem(const size_t storeId, const std::string& key, const std::vector<std::string>& members);
+        std::vector<std::string> sMembers(const size_t storeId, const std::string& key);
+        size_t sIsMember(const size_t storeId, const std::string& key, const std::string& member);
+        size_t sCard(const size_t storeId, const std::string& key);
+        std::vector<std::string> sInter(const size_t storeId, const std::vector<std::string>& keys);
+        std::vector<std::string> sUnion(const size_t storeId, const std::vector<std::string>& keys);
+        std::vector<std::string> sDiff(const size_t storeId, const std::vector<std::string>& keys);
+
+        // hashes
+        size_t hSet(const size_t storeId, const std::string& key, const std::vector<std::pair<std::string, std::string>>& fieldValues);
+        std::optional<std::string> hGet(const size_t storeId, const std::string& key, const std::string& field);
+        std::vector<std::optional<std::string>> hMGet(const size_t storeId, const std::string& key, const std::vector<std::string>& fields);
+        std::vector<std::pair<std::string, std::string>> hGetAll(const size_t storeId, const std::string& key);
+        size_t hDel(const size_t storeId, const std::string& key, const std::vector<std::string>& fields);
+        size_t hLen(const size_t storeId, const std::string& key);
 
     private:
         // std::unordered_map<std::string, Value> store;
@@ -50,15 +103,31 @@ class KeyValueStore {
         // size_t capacity;
         // std::unique_ptr<EvictionPolicy> evictionPolicy;
 
-        DatabaseManager dbManager;
+        std::unique_ptr<StorageEngine> engine;
+        DatabaseManager* dbManager; // engine, if it is the postgres backend; nullptr otherwise
+        InMemoryEngine* memoryEngine; // engine, if it is the memory backend; nullptr otherwise
+        std::string snapshotPath; // where SAVE and BGSAVE write, empty for nowhere
 
-        // helpers
-        bool isExpired(const size_t storeId, const std::string& key, const std::string& type);
-};
+        std::mutex cacheMutex; // guards caches and cacheEpoch
+        std::unordered_map<size_t, StoreCache> caches; // hot tier in front of a cacheable engine, one per store
+        size_t cacheEpoch;
 
-class TypeMismatchError : public std::runtime_error {
-    public:
-        explicit TypeMismatchError(const std::string& key, const std::string& type);
+        // declared last so that its thread stops before the engine and caches it reaps from are destroyed
+        std::unique_ptr<ActiveExpirer> expirer;
+
+        // helpers
+        StoreCache& cacheFor(const size_t storeId);
+        void dropCache(const size_t storeId);
+        std::optional<CacheEntry> cachedEntry(const size_t storeId, const std::string& key, size_t& epoch);
+        std::vector<std::optional<CacheEntry>> cachedEntries(const size_t storeId, const std::vector<std::string>& keys, size_t& epoch);
+        void fillCache(const size_t storeId, const std::string& key, const CacheEntry& entry, const size_t epoch);
+        void fillCache(const size_t storeId, const std::vector<std::string>& keys, const std::vector<std::optional<StringEntry>>& entries, const size_t epoch);
+        size_t beginWrite(const size_t storeId, const std::string& key);
+        size_t beginWrite(const size_t storeId, const std::vector<std::string>& keys);
+        void endWrite(const size_t storeId, const std::string& key, const size_t epoch, const std::optional<CacheEntry>& entry);
+        void endWrite(const size_t storeId, const std::vector<std::string>& keys, const size_t epoch, const std::vector<std::string>& values);
+        size_t reapExpired(const size_t storeId, const std::vector<std::string>& keys);
+        size_t expireAtTime(const size_t storeId, const std::string& key, const std::optional<ExpirationTime>& time);
 };
 
 #endif
\ No newline at end of file
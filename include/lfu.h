@@ -1,63 +1,147 @@
 /**
  * @file lfu.h
  * @brief Define and implement a Least Frequently Used (LFU) cache.
- * 
+ *
  * The cache evicts the least frequently used items when the capacity is exceeded.
- * Note that when the cache is at its capacity and all items have access count more than 1, no new items could be added. 
- * The above note is implemented in key_value_store.cpp where the item is added before eviction. 
- * When multiple items have the same minimum count, the least recently used item is evicted. 
- * 
+ * Note that when the cache is at its capacity and all items have access count more than 1, no new items could be added.
+ * The above note is implemented in key_value_store.cpp where the item is added before eviction.
+ * When multiple items have the same minimum count, the least recently used item is evicted.
+ *
+ * Keys are grouped into frequency buckets kept in ascending order, and each bucket lists its keys from most to least recently used.
+ * The least frequently used bucket is always at the front, so keyAccessed, keyRemoved and evict are all O(1).
+ * Keys are held as views of the caller's copies; the buckets point at the views in the index.
  */
 
 #ifndef LFU_H
 #define LFU_H
 
+#include <algorithm>
 #include <unordered_map>
 #include <list>
+#include <stdexcept>
 #include "eviction_policy.h"
+#include "memory_usage.h"
 
 class LFU : public EvictionPolicy {
-    public: 
-        void keyAccessed(const std::string& key) override {
-            ++freq[key];
+    public:
+        void keyAccessed(const KeyView key) override {
+            auto [it, inserted] = nodes.try_emplace(key);
+            Node& node = it->second;
 
-            auto it = std::find(keys.begin(), keys.end(), key);
-            if (it != keys.end()) {
-                keys.erase(it);
+            if (inserted) {
+                if (buckets.empty() || buckets.front().freq != 1) {
+                    buckets.emplace_front(1);
+                }
+                auto bucket = buckets.begin();
+                bucket->keys.push_front(&it->first);
+                node.bucket = bucket;
+                node.pos = bucket->keys.begin();
+                return;
+            }
+
+            auto oldBucket = node.bucket;
+            auto nextBucket = std::next(oldBucket);
+            if (nextBucket == buckets.end() || nextBucket->freq != oldBucket->freq + 1) {
+                nextBucket = buckets.emplace(nextBucket, oldBucket->freq + 1);
+            }
+
+            nextBucket->keys.splice(nextBucket->keys.begin(), oldBucket->keys, node.pos);
+            node.bucket = nextBucket;
+            if (oldBucket->keys.empty()) {
+                buckets.erase(oldBucket);
             }
-            keys.push_front(key);
         }
 
-        void keyRemoved(const std::string& key) override {
-            freq.erase(key);
-            
-            auto it = std::find(keys.begin(), keys.end(), key);
-            if (it != keys.end()) {
-                keys.erase(it);
+        void keyRemoved(const KeyView key) override {
+            auto it = nodes.find(key);
+            if (it == nodes.end()) {
+                return;
             }
+
+            detach(it->second);
+            nodes.erase(it);
         }
 
-        std::string evict() override {
-            auto minItRev = keys.rbegin();
-            size_t minAccess = freq[*keys.rbegin()];
+        void keyMoved(const KeyView key) override {
+            auto node = nodes.extract(key);
+            if (node.empty()) {
+                return;
+            }
+            // the node itself stays put, so the bucket's pointer to its key remains valid
+            node.key() = key;
+            nodes.insert(std::move(node));
+        }
 
-            for(auto it = keys.rbegin(); it != keys.rend(); ++it) {
-                if (freq[*it] < minAccess) {
-                    minAccess = freq[*it];
-                    minItRev = it;
-                }
+        KeyView evict() override {
+            if (buckets.empty()) {
+                throw std::runtime_error("evict from empty cache.");
             }
-            auto minIt = minItRev.base();
-            std::string ret = *(--minIt);
 
-            freq.erase(ret);
-            keys.erase(minIt);
+            KeyView ret = *buckets.front().keys.back();
+            auto it = nodes.find(ret);
+            detach(it->second);
+            nodes.erase(it);
             return ret;
         }
 
+        void forEachByRank(const std::function<void(const KeyView, const size_t)>& f) const override {
+            for (const auto& bucket : buckets) {
+                for (auto it = bucket.keys.rbegin(); it != bucket.keys.rend(); ++it) {
+                    f(**it, bucket.freq);
+                }
+            }
+        }
+
+        /*
+            Keys restored in rank order arrive in ascending count, so the bucket is found at or near the back.
+        */
+        void keyRestored(const KeyView key, const size_t count) override {
+            auto [it, inserted] = nodes.try_emplace(key);
+            if (!inserted) {
+                return;
+            }
+            auto freq = std::max<size_t>(count, 1);
+            auto bucket = buckets.end();
+            while (bucket != buckets.begin() && std::prev(bucket)->freq >= freq) {
+                --bucket;
+            }
+            if (bucket == buckets.end() || bucket->freq != freq) {
+                bucket = buckets.emplace(bucket, freq);
+            }
+            bucket->keys.push_front(&it->first);
+            it->second.bucket = bucket;
+            it->second.pos = bucket->keys.begin();
+        }
+
+        // every key also has a node in its bucket's list, and every bucket a node in the bucket list
+        size_t memoryUsage() const override {
+            constexpr size_t LIST_LINKS = 2 * sizeof(void*);
+            return bucketBytes(nodes) + nodes.size() * (hashNodeBytes<std::pair<const KeyView, Node>>() + LIST_LINKS + sizeof(const KeyView*))
+                + buckets.size() * (LIST_LINKS + sizeof(Bucket));
+        }
+
     private:
-        std::unordered_map<std::string, size_t> freq;
-        std::list<std::string> keys; 
+        struct Bucket {
+            explicit Bucket(size_t f) : freq(f) {}
+
+            size_t freq;
+            std::list<const KeyView*> keys; // most recently used first
+        };
+
+        struct Node {
+            std::list<Bucket>::iterator bucket;
+            std::list<const KeyView*>::iterator pos;
+        };
+
+        void detach(Node& node) {
+            node.bucket->keys.erase(node.pos);
+            if (node.bucket->keys.empty()) {
+                buckets.erase(node.bucket);
+            }
+        }
+
+        std::unordered_map<KeyView, Node, KeyHash, KeyEqual> nodes;
+        std::list<Bucket> buckets; // ascending by freq, so front() holds the minimum count
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,41 +1,120 @@
 /**
  * @file lru.h
  * @brief Define and implement a Least Recently Used (LRU) cache.
- * 
+ *
  * The cache evicts the least recently used items when the capacity is exceeded.
+ * Keys are kept in a hash index whose nodes are linked into an intrusive recency list,
+ * so keyAccessed, keyRemoved and evict are all O(1). The index holds views of the caller's keys rather than copies.
  */
 
 #ifndef LRU_H
 #define LRU_H
 
-#include <list>
+#include <unordered_map>
+#include <stdexcept>
 #include "eviction_policy.h"
+#include "memory_usage.h"
 
 class LRU : public EvictionPolicy {
     public:
-        void keyAccessed(const std::string& key) override {
-            auto it = std::find(keys.begin(), keys.end(), key);
-            if (it != keys.end()) {
-                keys.erase(it);
+        LRU() {
+            head.prev = &head;
+            head.next = &head;
+        }
+
+        // nodes link to each other by address, so the policy is neither copyable nor movable
+        LRU(const LRU&) = delete;
+        LRU& operator=(const LRU&) = delete;
+
+        void keyAccessed(const KeyView key) override {
+            auto [it, inserted] = nodes.try_emplace(key);
+            Node& node = it->second;
+            if (inserted) {
+                node.key = &it->first;
+            } else {
+                unlink(node);
+            }
+            pushFront(node);
+        }
+
+        void keyRemoved(const KeyView key) override {
+            auto it = nodes.find(key);
+            if (it == nodes.end()) {
+                return;
             }
-            keys.push_front(key);
+            unlink(it->second);
+            nodes.erase(it);
         }
 
-        void keyRemoved(const std::string& key) override {
-            auto it = std::find(keys.begin(), keys.end(), key);
-            if (it != keys.end()) {
-                keys.erase(it);
+        void keyMoved(const KeyView key) override {
+            auto node = nodes.extract(key);
+            if (node.empty()) {
+                return;
             }
+            // the node itself stays put, so the recency links and its key pointer remain valid
+            node.key() = key;
+            nodes.insert(std::move(node));
         }
 
-        std::string evict() override {
-            auto ret = std::move(keys.back());
-            keys.pop_back();
+        KeyView evict() override {
+            if (head.prev == &head) {
+                throw std::runtime_error("evict from empty cache.");
+            }
+
+            Node* victim = head.prev;
+            unlink(*victim);
+            KeyView ret = *victim->key;
+            nodes.erase(ret);
             return ret;
         }
 
-    private: 
-        std::list<std::string> keys;
+        /*
+            The key evict() would return next, without removing it. The cache must not be empty.
+        */
+        KeyView leastRecent() const {
+            return *head.prev->key;
+        }
+
+        bool contains(const KeyView key) const {
+            return nodes.contains(key);
+        }
+
+        void forEachByRank(const std::function<void(const KeyView, const size_t)>& f) const override {
+            for (const Node* node = head.prev; node != &head; node = node->prev) {
+                f(*node->key, 0);
+            }
+        }
+
+        void keyRestored(const KeyView key, const size_t) override {
+            keyAccessed(key);
+        }
+
+        size_t memoryUsage() const override {
+            return bucketBytes(nodes) + nodes.size() * hashNodeBytes<std::pair<const KeyView, Node>>();
+        }
+
+    private:
+        struct Node {
+            const KeyView* key = nullptr;
+            Node* prev = nullptr;
+            Node* next = nullptr;
+        };
+
+        void unlink(Node& node) {
+            node.prev->next = node.next;
+            node.next->prev = node.prev;
+        }
+
+        void pushFront(Node& node) {
+            node.prev = &head;
+            node.next = head.next;
+            head.next->prev = &node;
+            head.next = &node;
+        }
+
+        // unordered_map nodes are address-stable, so the recency list threads through them directly
+        std::unordered_map<KeyView, Node, KeyHash, KeyEqual> nodes;
+        Node head; // sentinel: head.next is the most recently used, head.prev the least
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,45 @@
+/**
+ * @file memory_usage.h
+ * @brief Estimate the heap bytes behind standard containers, for maxmemory accounting.
+ *
+ * The estimates follow libstdc++: a std::string keeps up to SSO_CAPACITY bytes inside the object, an unordered container
+ * allocates one bucket pointer per bucket plus one node per element holding a next pointer, the element and the cached hash,
+ * and a deque allocates fixed 512-byte blocks. Allocator rounding and headers are ignored, so the figures run slightly low,
+ * but they are stable enough to enforce a budget with and cheap enough to keep up to date on every write.
+ */
+
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <string>
+
+constexpr size_t SSO_CAPACITY = 15;
+
+// bytes a string owns outside its own object
+inline size_t heapBytes(const std::string& s) {
+    return s.capacity() > SSO_CAPACITY ? s.capacity() + 1 : 0;
+}
+
+// one node of an unordered container holding Value
+template <typename Value>
+constexpr size_t hashNodeBytes() {
+    return sizeof(void*) + sizeof(Value) + sizeof(size_t);
+}
+
+template <typename Container>
+size_t bucketBytes(const Container& c) {
+    return c.bucket_count() * sizeof(void*);
+}
+
+// the blocks in use, plus a map of at least 8 block pointers
+template <typename T>
+size_t dequeBytes(const std::deque<T>& d) {
+    constexpr size_t PER_BLOCK = sizeof(T) < 512 ? 512 / sizeof(T) : 1;
+    size_t blocks = d.size() / PER_BLOCK + 1;
+    return blocks * PER_BLOCK * sizeof(T) + std::max<size_t>(8, blocks + 2) * sizeof(void*);
+}
+
+#endif
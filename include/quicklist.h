@@ -0,0 +1,89 @@
+/**
+ * @file quicklist.h
+ * @brief Define a list stored as a sequence of packed nodes (a quicklist).
+ *
+ * A ListNode packs up to about MAX_BYTES of elements back to back in one buffer. Every element is stored as
+ * [length][bytes][length]: the length is one byte below 128 and four bytes otherwise, and it is repeated after the bytes
+ * so the node can be walked and popped from either end. Walking a range is a sequential scan of a few contiguous buffers
+ * instead of chasing one heap node per element, and small elements cost two bytes of overhead.
+ * QuickList keeps the nodes in a deque, adding a node only when the end node is full, and keeps a running total of
+ * the node buffers' heap bytes so memoryUsage() is O(1).
+ * The node encoding is also the persistent format: DatabaseManager stores one row per node in the lists table,
+ * and a snapshot copies the nodes as they are.
+ */
+
+#ifndef QUICKLIST_H
+#define QUICKLIST_H
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class ListNode {
+    public:
+        static constexpr size_t MAX_BYTES = 8192;
+
+        ListNode() = default;
+        ListNode(std::string bytes, const size_t count) : buffer(std::move(bytes)), count(count) {}
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        const std::string& bytes() const { return buffer; }
+
+        // an empty node takes any element, so elements larger than MAX_BYTES get a node of their own
+        bool fits(const size_t length) const { return count == 0 || buffer.size() + encodedSize(length) <= MAX_BYTES; }
+
+        void pushFront(std::string_view value);
+        void pushBack(std::string_view value);
+        std::string popFront();
+        std::string popBack();
+
+        // append elements [first, first + n) to out
+        void copy(const size_t first, const size_t n, std::vector<std::string>& out) const;
+
+    private:
+        static size_t encodedSize(const size_t length) { return length + 2 * lengthSize(length); }
+        static size_t lengthSize(const size_t length) { return length < 128 ? 1 : 4; }
+        static std::string encode(std::string_view value);
+
+        std::string buffer;
+        size_t count = 0;
+};
+
+class QuickList {
+    public:
+        size_t size() const { return length; }
+        bool empty() const { return length == 0; }
+
+        void pushFront(std::string_view value);
+        void pushBack(std::string_view value);
+        std::optional<std::string> popFront();
+        std::optional<std::string> popBack();
+
+        // elements first..last inclusive; last must be below size()
+        std::vector<std::string> range(const size_t first, const size_t last) const;
+
+        // the packed nodes from head to tail, and adding one at the tail, so a snapshot copies a list without unpacking it
+        const std::deque<ListNode>& packedNodes() const { return nodes; }
+        void appendNode(ListNode node);
+
+        // heap bytes held by the nodes and their buffers
+        size_t memoryUsage() const;
+
+    private:
+        std::deque<ListNode> nodes;
+        size_t length = 0;
+        size_t bufferBytes = 0;
+};
+
+/*
+    Resolve LRANGE-style start and stop indexes, where negative indexes count from the end, against a list of the given length.
+    Returns the inclusive range of positions, or std::nullopt if it is empty.
+*/
+std::optional<std::pair<size_t, size_t>> resolveListRange(int64_t start, int64_t stop, const size_t length);
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * @file record_table.h
+ * @brief Define an open-addressing hash table of compact key/value records.
+ *
+ * Each record is a single slab chunk holding the expiration, the key and the value back to back,
+ * instead of two std::string objects plus a map node. Every table owns a SlabAllocator for its records.
+ * The table is a flat array of (hash, record) slots probed linearly. The slot keeps the key's full hash, taken from the KeyView
+ * the caller passes in, so the table never hashes a key itself and most mismatches are rejected without touching the record.
+ * Deletion shifts later entries of the probe run back instead of leaving tombstones, so lookups never slow down under churn.
+ */
+
+#ifndef RECORD_TABLE_H
+#define RECORD_TABLE_H
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+#include "expiration.h"
+#include "key.h"
+#include "slab_allocator.h"
+
+struct Record {
+    static constexpr int64_t NO_EXPIRATION = INT64_MAX;
+
+    int64_t expiration; // Unix epoch milliseconds, or NO_EXPIRATION
+    uint32_t keySize;
+    uint32_t valueSize;
+    // followed by keySize bytes of key and valueSize bytes of value
+
+    std::string_view key() const { return {reinterpret_cast<const char*>(this + 1), keySize}; }
+    std::string_view value() const { return {reinterpret_cast<const char*>(this + 1) + keySize, valueSize}; }
+    size_t size() const { return sizeof(Record) + keySize + valueSize; }
+
+    bool expired(const ExpirationTime& now) const {
+        return expiration != NO_EXPIRATION && toUnixMilliseconds(now) >= expiration;
+    }
+
+    static Record* create(SlabAllocator& allocator, std::string_view key, std::string_view value, const int64_t expiration = NO_EXPIRATION);
+    static void destroy(SlabAllocator& allocator, Record* record);
+};
+
+class RecordTable {
+    public:
+        RecordTable();
+        ~RecordTable();
+
+        RecordTable(const RecordTable&) = delete;
+        RecordTable& operator=(const RecordTable&) = delete;
+        RecordTable(RecordTable&& other) noexcept;
+        RecordTable& operator=(RecordTable&& other) noexcept;
+
+        Record* find(const KeyView key) const;
+
+        /*
+            Insert or replace the record for key. Returns true if the key was not present.
+            A replacement that fits the old record's chunk is written in place, so the key keeps its address.
+            Otherwise the record is reallocated and moved is called with the new record while the old one is still intact.
+        */
+        bool upsert(const KeyView key, std::string_view value, const int64_t expiration = Record::NO_EXPIRATION,
+                    const std::function<void(const Record&)>& moved = {});
+        bool erase(const KeyView key);
+        void clear();
+
+        size_t size() const { return count; }
+        const SlabAllocator& allocator() const { return slab; }
+
+        // the slot array plus the chunks of every record
+        size_t memoryUsage() const { return slots.size() * sizeof(Slot) + slab.bytesInUse(); }
+        // what one record costs the table: its chunk and a slot
+        static size_t memoryUsage(const Record& record) { return sizeof(Slot) + SlabAllocator::chunkSize(record.size()); }
+
+        template <typename F>
+        void forEach(F&& f) const {
+            for (const auto& slot : slots) {
+                if (slot.record) f(*slot.record);
+            }
+        }
+
+    private:
+        struct Slot {
+            uint64_t hash = 0;
+            Record* record = nullptr;
+        };
+
+        size_t indexOf(const KeyView key) const; // slot holding key, or the empty slot ending its probe run
+        void grow();
+
+        std::vector<Slot> slots; // size is a power of two
+        size_t count;
+        SlabAllocator slab;
+};
+
+#endif
@@ -0,0 +1,46 @@
+/**
+ * @file resp.h
+ * @brief Parse client requests and encode replies in RESP, the Redis serialization protocol.
+ *
+ * A request is an array of bulk strings (*<n>\r\n then $<len>\r\n<bytes>\r\n per argument), which is what redis-cli and
+ * redis-benchmark send, or an inline command: one line of space-separated words, for typing into telnet.
+ * The parser is stateless. It is handed everything buffered for a connection and returns how many bytes make up the next
+ * complete request, or 0 if the request is still incomplete, so a partial request is simply re-parsed when more bytes arrive.
+ * Re-parsing skips over bulk payloads by their length and never scans them.
+ */
+
+#ifndef RESP_H
+#define RESP_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class RespError : public std::runtime_error {
+    public:
+        explicit RespError(const std::string& message) : std::runtime_error("Protocol error: " + message) {}
+};
+
+constexpr size_t MAX_BULK_LENGTH = 512 * 1024 * 1024;
+constexpr size_t MAX_ARGUMENTS = 1024 * 1024;
+constexpr size_t MAX_INLINE_LENGTH = 64 * 1024;
+
+/*
+    Parse the request at the start of input into args. Returns the number of bytes it took up, or 0 if input does not hold
+    a complete request yet (args is then unspecified). Throws RespError if the bytes cannot be a valid request.
+    An empty inline line is consumed with no arguments.
+*/
+size_t parseRequest(std::string_view input, std::vector<std::string>& args);
+
+void appendSimpleString(std::string& out, std::string_view value);
+// message should start with an error code such as ERR or WRONGTYPE
+void appendError(std::string& out, std::string_view message);
+void appendInteger(std::string& out, const int64_t value);
+void appendBulkString(std::string& out, std::string_view value);
+void appendNull(std::string& out);
+void appendArrayHeader(std::string& out, const size_t length);
+void appendNullArray(std::string& out);
+
+#endif
@@ -0,0 +1,138 @@
+/**
+ * @file resp_server.h
+ * @brief Define a TCP server that speaks RESP and calls KeyValueStore directly, without the HTTP and Python layers.
+ *
+ * The server runs one event loop per thread, each with its own epoll instance. Every loop watches the shared listening
+ * socket with EPOLLEXCLUSIVE, so a new connection wakes one loop, and that loop owns the connection until it closes:
+ * connections are never shared between threads and need no locking. A loop reads whatever a socket has and runs the
+ * complete requests in it as pipelined batches (see CommandDispatcher), each batch's replies encoded into one buffer.
+ * The buffers are written back together with one sendmsg, so a pipeline costs a read and a write, not a pair per request.
+ * While a client is not reading its replies the loop stops reading its requests, so a slow client cannot make the server
+ * buffer without bound.
+ * Where io_uring is available the loops are completion-based instead: each loop keeps an accept, and a receive and a send
+ * per connection, in flight on its own ring, and one io_uring_enter both submits the next operations and reaps the
+ * finished ones. Under load that is one system call per loop iteration, however many connections it served, against
+ * epoll's wait plus a receive and a send per connection. The server falls back to epoll where rings cannot be set up.
+ * Store calls run on the loop thread. With the postgres backend a loop waits for each call's database round trip,
+ * so there should be at least as many loops as connections that are expected to wait at the same time.
+ */
+
+#ifndef RESP_SERVER_H
+#define RESP_SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "command_dispatcher.h"
+#include "io_uring.h"
+#include "key_value_store.h"
+
+enum class IoBackend {
+    AUTO,    // io_uring if the kernel allows it, epoll otherwise
+    EPOLL,
+    IO_URING // fail rather than fall back
+};
+
+struct RespServerOptions {
+    std::string host = "0.0.0.0";
+    uint16_t port = 6379; // 0 picks a free port, see RespServer::port
+    size_t threads = 0;   // event loops; 0 picks the number of hardware threads
+    IoBackend io = IoBackend::AUTO;
+};
+
+struct ServerStats {
+    uint64_t requests = 0;
+    uint64_t syscalls = 0; // made by the loops, for comparing backends
+};
+
+class RespServer {
+    public:
+        // binds and listens right away; throws std::system_error if it cannot
+        RespServer(KeyValueStore& store, const RespServerOptions& options);
+        ~RespServer();
+
+        RespServer(const RespServer&) = delete;
+        RespServer& operator=(const RespServer&) = delete;
+
+        uint16_t port() const { return boundPort; }
+        // EPOLL or IO_URING, never AUTO
+        IoBackend backend() const { return ioBackend; }
+        // totals over all loops; read once run() has returned
+        ServerStats stats() const;
+
+        // serve until stop() is called; the calling thread runs one of the loops
+        void run();
+        // safe to call from any thread, and before or after run()
+        void stop();
+
+    private:
+        struct Connection {
+            int fd;
+            std::string input{}; // received bytes not yet parsed into a complete request
+            std::deque<std::string> output{}; // replies not yet written, one buffer per batch
+            size_t written = 0; // bytes of the first output buffer already sent
+            size_t pending = 0; // bytes of output not yet sent
+            bool writing = false; // epoll: waiting for the socket to become writable
+            Session session{};
+
+            // io_uring: operations in flight, and the send's arguments, which must outlive it
+            bool receiving = false;
+            bool sending = false;
+            bool closed = false; // shut down, and released once nothing is in flight
+            msghdr message{};
+            std::vector<iovec> sendBuffers{};
+
+            // point buffers at the unsent output, at most count of them; returns how many were used
+            size_t gather(iovec* buffers, const size_t count) const;
+            // drop bytes that were sent from the front of output
+            void consume(size_t bytes);
+        };
+
+        struct EventLoop {
+            int epollFd = -1;
+            int wakeFd = -1; // eventfd that stop() writes to
+            std::unordered_map<int, Connection> connections;
+            std::vector<std::vector<std::string>> batch; // parsed requests, reused so their strings keep their capacity
+            uint64_t requests = 0;
+            uint64_t syscalls = 0;
+#ifdef HAVE_IO_URING
+            std::unique_ptr<IoUring> ring;
+            uint64_t wakeValue = 0;
+#endif
+        };
+
+        bool execute(EventLoop& eventLoop, Connection& connection);
+
+        // epoll
+        void loop(EventLoop& eventLoop);
+        void watch(EventLoop& eventLoop, const int op, const int fd, const uint32_t events);
+        void accept(EventLoop& eventLoop);
+        bool readable(EventLoop& eventLoop, Connection& connection);
+        bool process(EventLoop& eventLoop, Connection& connection);
+        bool flush(EventLoop& eventLoop, Connection& connection);
+        void close(EventLoop& eventLoop, Connection& connection);
+
+#ifdef HAVE_IO_URING
+        void ringLoop(EventLoop& eventLoop);
+        void completed(EventLoop& eventLoop, const io_uring_cqe& cqe);
+        void resume(EventLoop& eventLoop, Connection& connection);
+        void shut(EventLoop& eventLoop, Connection& connection);
+        void release(EventLoop& eventLoop, Connection& connection);
+#endif
+
+        CommandDispatcher dispatcher;
+        int listenFd;
+        uint16_t boundPort;
+        IoBackend ioBackend;
+        std::atomic<bool> stopping;
+        std::vector<std::unique_ptr<EventLoop>> loops;
+};
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * @file slab_allocator.h
+ * @brief Define a size-class slab allocator for small, short-lived blocks such as key/value records.
+ *
+ * Each request is rounded up to one of CLASS_COUNT size classes: 8-byte steps up to 128 bytes, then four steps per
+ * doubling up to MAX_CHUNK_SIZE. A class carves fixed SLAB_SIZE slabs into equal chunks and keeps freed chunks on an
+ * intrusive free list, so a block costs its rounded size with no per-allocation header, and churn reuses chunks of
+ * the same class instead of fragmenting the heap. Larger requests go to ::operator new.
+ * Slabs are only returned when the allocator is destroyed or reset. The allocator is not thread-safe.
+ */
+
+#ifndef SLAB_ALLOCATOR_H
+#define SLAB_ALLOCATOR_H
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class SlabAllocator {
+    public:
+        static constexpr size_t SLAB_SIZE = 64 * 1024;
+        static constexpr size_t MAX_CHUNK_SIZE = 4096;
+        static constexpr size_t CLASS_COUNT = 36;
+
+        SlabAllocator() = default;
+        SlabAllocator(const SlabAllocator&) = delete;
+        SlabAllocator& operator=(const SlabAllocator&) = delete;
+        SlabAllocator(SlabAllocator&& other) noexcept;
+        SlabAllocator& operator=(SlabAllocator&& other) noexcept;
+
+        // the block is 8-byte aligned and must be given back with the same size
+        void* allocate(const size_t size);
+        void deallocate(void* block, const size_t size);
+
+        // drop every slab at once; blocks larger than MAX_CHUNK_SIZE must already have been deallocated
+        void reset();
+
+        // the number of bytes actually set aside for a request of size bytes
+        static size_t chunkSize(const size_t size);
+
+        size_t bytesInUse() const { return inUse; }
+        size_t bytesReserved() const { return slabs.size() * SLAB_SIZE + largeBytes; }
+
+    private:
+        struct FreeChunk {
+            FreeChunk* next;
+        };
+
+        struct SizeClass {
+            FreeChunk* freeList = nullptr;
+            std::byte* cursor = nullptr; // next never-used chunk in the newest slab of this class
+            std::byte* end = nullptr;
+        };
+
+        static size_t classOf(const size_t size);
+
+        std::array<SizeClass, CLASS_COUNT> classes{};
+        std::vector<std::unique_ptr<std::byte[]>> slabs;
+        size_t inUse = 0;
+        size_t largeBytes = 0;
+};
+
+#endif
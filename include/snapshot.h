@@ -0,0 +1,179 @@
+/**
+ * @file snapshot.h
+ * @brief Define the snapshot file: a point-in-time copy of the in-memory engine, laid out so a restart maps it and copies entries straight in.
+ *
+ * The file is, in order:
+ *   a SnapshotHeader, written last, once everything after it is in place;
+ *   one section per store per shard, holding that store's keys in the shard as a run of entries in eviction order, next to evict first;
+ *   the eviction config of every store that has one, as a SnapshotConfig and the policy name;
+ *   the section table, one SnapshotSection per section.
+ * An entry is a fixed SnapshotEntry, the key, and the value: a string's bytes, a list's nodes in their packed encoding
+ * (see quicklist.h) each after its element count and byte length, or a set's members or a hash's fields and values,
+ * each as [u32 length][bytes]. Entries, the config table and the section table start on 8-byte boundaries.
+ *
+ * Integers are in host byte order, and each entry carries its key's hash. The header records the byte order and the hash of a
+ * probe string, so a snapshot is refused on a machine of the other byte order and its hashes are recomputed by a build whose
+ * hash function differs. Loading checks every length against the bounds of its section, but takes list nodes as they are,
+ * as DatabaseManager does with the nodes it stores.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "key.h"
+
+constexpr char SNAPSHOT_MAGIC[8] = {'K', 'V', 'S', 'S', 'N', 'A', 'P', '1'};
+constexpr uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+constexpr std::string_view SNAPSHOT_HASH_PROBE = "key_value_store";
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t shardCount;
+    uint64_t hashProbe; // hashKey(SNAPSHOT_HASH_PROBE) on the machine that wrote the file
+    int64_t savedAt;    // Unix epoch milliseconds of the instant the snapshot captures
+    uint64_t fileSize;
+    uint64_t configOffset;
+    uint64_t configCount;
+    uint64_t sectionOffset;
+    uint64_t sectionCount;
+};
+
+struct SnapshotSection {
+    uint64_t storeId;
+    uint64_t shard;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t entries;
+};
+
+// followed by the policy name as [u32 length][bytes]
+struct SnapshotConfig {
+    uint64_t storeId;
+    uint64_t capacity;
+    uint64_t maxMemory;
+};
+
+enum class SnapshotType : uint8_t {
+    STRING,
+    LIST,
+    SET,
+    HASH
+};
+
+struct SnapshotEntry {
+    uint64_t hash;
+    int64_t expiration; // a string's, as in Record; no other type expires
+    uint64_t size;      // bytes of value after the key
+    uint32_t keySize;
+    uint32_t count;     // list nodes, set members or hash fields; 0 for a string
+    uint32_t frequency; // the access count the eviction policy keeps for the key
+    SnapshotType type;
+    uint8_t reserved[3];
+};
+
+// writes a file front to back through a buffer, keeping track of the offset
+class SnapshotWriter {
+    public:
+        SnapshotWriter(const int fd, std::string path) : fd(fd), path(std::move(path)) {}
+
+        size_t offset() const { return written + buffer.size(); }
+
+        void write(std::string_view bytes);
+
+        template <typename T>
+        void put(const T& value) {
+            write(std::string_view(reinterpret_cast<const char*>(&value), sizeof value));
+        }
+
+        void putBytes(std::string_view bytes) {
+            put(static_cast<uint32_t>(bytes.size()));
+            write(bytes);
+        }
+
+        // pad to the next 8-byte boundary
+        void align();
+        void flush();
+
+    private:
+        int fd;
+        std::string path;
+        std::string buffer;
+        size_t written = 0;
+};
+
+// reads fields from a range of a mapped file; throws if a field would run past the end of the range
+class SnapshotReader {
+    public:
+        SnapshotReader(std::string_view file, const size_t offset, const size_t size) : file(file), position(offset), end(offset + size) {}
+
+        size_t offset() const { return position; }
+        bool done() const { return position == end; }
+
+        template <typename T>
+        T get() {
+            T value;
+            std::memcpy(&value, take(sizeof value).data(), sizeof value);
+            return value;
+        }
+
+        std::string_view bytes(const size_t size) { return take(size); }
+        std::string_view bytes() { return take(get<uint32_t>()); }
+
+        void align() {
+            take((8 - position % 8) % 8);
+        }
+
+    private:
+        std::string_view take(const size_t size) {
+            if (end - position < size) {
+                throw std::runtime_error("corrupt snapshot: a field runs past the end of its section.");
+            }
+            auto ret = file.substr(position, size);
+            position += size;
+            return ret;
+        }
+
+        std::string_view file;
+        size_t position;
+        size_t end;
+};
+
+// a snapshot file mapped into memory, with its header and section table checked
+class SnapshotFile {
+    public:
+        explicit SnapshotFile(const std::string& path);
+        ~SnapshotFile();
+
+        SnapshotFile(const SnapshotFile&) = delete;
+        SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+        const SnapshotHeader& header() const { return head; }
+        const std::vector<SnapshotSection>& sections() const { return table; }
+        // false if the stored key hashes were computed by another hash function and have to be recomputed
+        bool sameHash() const { return head.hashProbe == hashKey(SNAPSHOT_HASH_PROBE); }
+
+        SnapshotReader configs() const;
+        SnapshotReader section(const SnapshotSection& section) const;
+
+    private:
+        std::string path;
+        std::string_view data;
+        SnapshotHeader head;
+        std::vector<SnapshotSection> table;
+};
+
+/*
+    Write a snapshot to path + ".tmp" with write, which returns the header once it has written everything after it,
+    then fsync it and rename it over path. The file at path is either the old snapshot or the new one, never a partial one.
+*/
+void writeSnapshotFile(const std::string& path, const std::function<SnapshotHeader(SnapshotWriter&)>& write);
+
+#endif
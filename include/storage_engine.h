@@ -0,0 +1,127 @@
+/**
+ * @file storage_engine.h
+ * @brief Define the interface KeyValueStore uses to persist keys, and the backends that implement it.
+ *
+ * DatabaseManager stores everything in Postgres. InMemoryEngine keeps everything in process memory and needs no database.
+ * The backend is chosen when the KeyValueStore is constructed.
+ */
+
+#ifndef STORAGE_ENGINE_H
+#define STORAGE_ENGINE_H
+
+#include <chrono>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "expiration.h"
+
+constexpr size_t DEFAULT_CAPACITY = 1000;
+
+enum class StorageBackend {
+    POSTGRES,
+    MEMORY
+};
+
+enum class ListEnd {
+    HEAD,
+    TAIL
+};
+
+enum class SetOperation {
+    INTERSECTION,
+    UNION,
+    DIFFERENCE
+};
+
+class TypeMismatchError : public std::runtime_error {
+    public:
+        explicit TypeMismatchError(const std::string& key, const std::string& type)
+            : std::runtime_error("The value at key " + key + " is not a " + type + ".") {}
+};
+
+struct StringEntry {
+    std::string value;
+    std::optional<ExpirationTime> expiration;
+};
+
+struct EvictionConfig {
+    std::string policy;
+    size_t capacity;
+    size_t maxMemory = 0; // bytes, 0 for no limit
+};
+
+// how much process memory a store takes up, as counted against its maxMemory
+struct MemoryStats {
+    size_t usedMemory;
+    size_t maxMemory;
+    size_t keys;
+};
+
+class StorageEngine {
+    public:
+        virtual ~StorageEngine() = default;
+
+        // true if reads are slow enough that KeyValueStore should keep a hot tier in front of the engine
+        virtual bool cacheable() const = 0;
+
+        // block until every acknowledged write is durable in the engine
+        virtual void flush() = 0;
+
+        virtual void clearStore(const size_t storeId) = 0;
+        virtual size_t changePolicy(const size_t storeId, const std::string& policy) = 0;
+        virtual std::optional<EvictionConfig> getEvictionConfig(const size_t storeId) = 0;
+        // a byte budget for the store on top of its key capacity; 0 removes it. Keys are evicted by the store's policy until it fits.
+        virtual void setMaxMemory(const size_t storeId, const size_t bytes) = 0;
+        // bytes the key, its value and their bookkeeping take up in the engine, or std::nullopt if the key does not exist
+        virtual std::optional<size_t> memoryUsage(const size_t storeId, const std::string& key) = 0;
+        // std::nullopt if the engine keeps no keys in process memory
+        virtual std::optional<MemoryStats> memoryStats(const size_t storeId) = 0;
+
+        virtual void deleteKey(const size_t storeId, const std::string& key) = 0;
+
+        // expirations only apply to live keys: the calls below treat an expired key as missing
+        virtual size_t setExpiration(const size_t storeId, const std::string& key, const ExpirationTime& expiration) = 0;
+        virtual size_t clearExpiration(const size_t storeId, const std::string& key) = 0;
+        // std::nullopt if the key does not exist, otherwise its expiration (which itself is std::nullopt if it has none)
+        virtual std::optional<std::optional<ExpirationTime>> getExpiration(const size_t storeId, const std::string& key) = 0;
+
+        virtual void insertString(const size_t storeId, const std::string& key, const std::string& value) = 0;
+        virtual std::optional<StringEntry> fetchLiveString(const size_t storeId, const std::string& key) = 0;
+        // a key holding another type is std::nullopt, as in MGET
+        virtual std::vector<std::optional<StringEntry>> fetchLiveStrings(const size_t storeId, const std::vector<std::string>& keys) = 0;
+        virtual void insertStrings(const size_t storeId, const std::vector<std::string>& keys, const std::vector<std::string>& values) = 0;
+        // delete keys of any type; returns the number of keys that existed
+        virtual size_t deleteKeys(const size_t storeId, const std::vector<std::string>& keys) = 0;
+
+        // lists; operations on a key holding another type throw TypeMismatchError
+        virtual size_t listPush(const size_t storeId, const std::string& key, const std::vector<std::string>& values, const ListEnd end) = 0;
+        virtual std::vector<std::string> listPop(const size_t storeId, const std::string& key, const size_t count, const ListEnd end) = 0;
+        virtual std::vector<std::string> listRange(const size_t storeId, const std::string& key, const int64_t start, const int64_t stop) = 0;
+        virtual size_t listLength(const size_t storeId, const std::string& key) = 0;
+
+        // sets; operations on a key holding another type throw TypeMismatchError
+        virtual size_t setAdd(const size_t storeId, const std::string& key, const std::vector<std::string>& members) = 0;
+        virtual size_t setRemove(const size_t storeId, const std::string& key, const std::vector<std::string>& members) = 0;
+        virtual std::vector<std::string> setMembers(const size_t storeId, const std::string& key) = 0;
+        virtual bool setContains(const size_t storeId, const std::string& key, const std::string& member) = 0;
+        virtual size_t setSize(const size_t storeId, const std::string& key) = 0;
+        // a missing key is an empty set; for DIFFERENCE the first key is the one the others are subtracted from. Keys must be distinct.
+        virtual std::vector<std::string> setCombine(const size_t storeId, const std::vector<std::string>& keys, const SetOperation operation) = 0;
+
+        // hashes; operations on a key holding another type throw TypeMismatchError
+        // fields must be distinct; returns the number of fields that were added rather than updated
+        virtual size_t hashSet(const size_t storeId, const std::string& key, const std::vector<std::pair<std::string, std::string>>& fields) = 0;
+        virtual std::vector<std::optional<std::string>> hashGet(const size_t storeId, const std::string& key, const std::vector<std::string>& fields) = 0;
+        virtual std::vector<std::pair<std::string, std::string>> hashGetAll(const size_t storeId, const std::string& key) = 0;
+        virtual size_t hashDelete(const size_t storeId, const std::string& key, const std::vector<std::string>& fields) = 0;
+        virtual size_t hashLength(const size_t storeId, const std::string& key) = 0;
+
+        // delete those of keys whose expiration has passed, leaving live keys alone; returns the number deleted
+        virtual size_t deleteExpiredStrings(const size_t storeId, const std::vector<std::string>& keys) = 0;
+        // up to limit (store_id, key) pairs whose expiration has passed, soonest expired first
+        virtual std::vector<std::pair<size_t, std::string>> fetchExpiredKeys(const size_t limit) = 0;
+};
+
+#endif
@@ -0,0 +1,57 @@
+/**
+ * @file store_cache.h
+ * @brief Define an in-process cache of string values for one store.
+ *
+ * The cache holds at most `capacity` keys and, if it has a byte budget, at most maxMemory bytes of entries, map and policy
+ * bookkeeping (counted as in memory_usage.h), and evicts through the store's EvictionPolicy.
+ * It does not talk to the database; KeyValueStore reads through it and keeps it coherent on every write.
+ * Each call hashes its key once; the map and the policy both reuse that hash.
+ * It is not thread-safe; KeyValueStore serializes access to it.
+ */
+
+#ifndef STORE_CACHE_H
+#define STORE_CACHE_H
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include "eviction_policy.h"
+#include "expiration.h"
+#include "key.h"
+#include "storage_engine.h"
+
+struct CacheEntry {
+    std::string value;
+    std::optional<ExpirationTime> expiration;
+};
+
+class StoreCache {
+    public:
+        StoreCache(const std::string& policy, const size_t capacity, const size_t maxMemory = 0);
+
+        const CacheEntry* find(const KeyView key);
+        void put(const KeyView key, const std::string& value, const std::optional<ExpirationTime>& expiration);
+        void erase(const KeyView key);
+
+        // 0 removes the budget; a lower budget evicts immediately
+        void setMaxMemory(const size_t bytes);
+        MemoryStats memoryStats() const;
+
+        // epoch of the most recent write to the store, see KeyValueStore::cacheFor
+        size_t lastWrite() const { return lastWriteEpoch; }
+        void recordWrite(const size_t epoch) { lastWriteEpoch = epoch; }
+
+    private:
+        size_t memoryUsage() const;
+        void evictOverBudget();
+
+        size_t capacity;
+        size_t maxMemory;
+        size_t entryBytes = 0; // running total of the entries' map nodes, long keys and values
+        size_t lastWriteEpoch = 0;
+        std::unique_ptr<EvictionPolicy> evictionPolicy;
+        KeyMap<CacheEntry> entries;
+};
+
+#endif
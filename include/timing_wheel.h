@@ -0,0 +1,188 @@
+/**
+ * @file timing_wheel.h
+ * @brief Define and implement a hierarchical timing wheel.
+ *
+ * Timers are kept in LEVELS wheels of SLOTS slots each. Level L covers deadlines up to SLOTS^(L+1) ticks ahead,
+ * with every slot spanning SLOTS^L ticks. Scheduling and cancelling are O(1): each slot is an intrusive doubly linked list,
+ * so a timer is unlinked through the handle schedule returned without knowing which slot it has moved to.
+ * Advancing one tick fires one level-0 slot, and at each level boundary it cascades the matching higher-level slot down to
+ * the finer levels, so every timer moves at most LEVELS times.
+ * Deadlines beyond the top level are parked in its furthest slot and re-placed when it cascades.
+ * A timer never fires before its deadline tick.
+ */
+
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+template <typename T>
+class TimingWheel {
+    private:
+        struct Link {
+            Link* prev;
+            Link* next;
+        };
+
+        struct Timer : Link {
+            uint64_t deadline;
+            T value;
+        };
+
+    public:
+        static constexpr unsigned BITS = 6;
+        static constexpr size_t SLOTS = size_t(1) << BITS;
+        static constexpr size_t LEVELS = 4;
+
+        // a scheduled timer, valid until it fires or is cancelled
+        using Handle = Timer*;
+
+        explicit TimingWheel(const uint64_t startTick = 0) : current(startTick), count(0) {
+            for (auto& wheel : wheels) {
+                for (auto& slot : wheel) {
+                    clear(slot);
+                }
+            }
+            clear(overdue);
+        }
+
+        ~TimingWheel() {
+            for (auto& wheel : wheels) {
+                for (auto& slot : wheel) {
+                    destroy(slot);
+                }
+            }
+            destroy(overdue);
+        }
+
+        // the slots link to themselves
+        TimingWheel(const TimingWheel&) = delete;
+        TimingWheel& operator=(const TimingWheel&) = delete;
+
+        uint64_t currentTick() const { return current; }
+
+        // number of timers that have not fired yet
+        size_t size() const { return count; }
+
+        /*
+            Add a timer. A deadline at or before the current tick fires on the next advance.
+        */
+        Handle schedule(const uint64_t deadline, T value) {
+            ++count;
+            auto timer = new Timer{{nullptr, nullptr}, deadline, std::move(value)};
+            place(timer);
+            return timer;
+        }
+
+        /*
+            Remove a timer that has not fired yet.
+        */
+        void cancel(const Handle timer) {
+            unlink(timer);
+            delete timer;
+            --count;
+        }
+
+        /*
+            Move the wheel forward to tick and append the value of every timer due by then to due.
+        */
+        void advance(const uint64_t tick, std::vector<T>& due) {
+            fire(overdue, due);
+            if (count == 0 && tick > current) {
+                current = tick;
+                return;
+            }
+
+            while (current < tick) {
+                ++current;
+                for (size_t level = LEVELS - 1; level > 0; --level) {
+                    if ((current & ((uint64_t(1) << (BITS * level)) - 1)) == 0) {
+                        cascade(level);
+                    }
+                }
+                fire(wheels[0][current & (SLOTS - 1)], due);
+                fire(overdue, due);
+            }
+        }
+
+    private:
+        // each slot is the sentinel of a circular list of its timers
+        using Slot = Link;
+
+        static void clear(Slot& slot) {
+            slot.prev = slot.next = &slot;
+        }
+
+        static void link(Slot& slot, Timer* timer) {
+            timer->prev = slot.prev;
+            timer->next = &slot;
+            slot.prev->next = timer;
+            slot.prev = timer;
+        }
+
+        static void unlink(Timer* timer) {
+            timer->prev->next = timer->next;
+            timer->next->prev = timer->prev;
+        }
+
+        static void destroy(Slot& slot) {
+            for (Link* link = slot.next; link != &slot;) {
+                auto timer = static_cast<Timer*>(link);
+                link = link->next;
+                delete timer;
+            }
+            clear(slot);
+        }
+
+        void place(Timer* timer) {
+            if (timer->deadline <= current) {
+                link(overdue, timer);
+                return;
+            }
+
+            uint64_t delta = timer->deadline - current;
+            for (size_t level = 0; level < LEVELS; ++level) {
+                if (delta < (uint64_t(1) << (BITS * (level + 1)))) {
+                    link(wheels[level][(timer->deadline >> (BITS * level)) & (SLOTS - 1)], timer);
+                    return;
+                }
+            }
+
+            // beyond the wheel: park in the furthest top-level slot, which cascades before the deadline
+            uint64_t horizon = current + (uint64_t(1) << (BITS * LEVELS)) - 1;
+            link(wheels[LEVELS - 1][(horizon >> (BITS * (LEVELS - 1))) & (SLOTS - 1)], timer);
+        }
+
+        void cascade(const size_t level) {
+            auto& slot = wheels[level][(current >> (BITS * level)) & (SLOTS - 1)];
+            Link* link = slot.next;
+            clear(slot);
+            while (link != &slot) {
+                auto timer = static_cast<Timer*>(link);
+                link = link->next;
+                place(timer);
+            }
+        }
+
+        void fire(Slot& slot, std::vector<T>& due) {
+            Link* link = slot.next;
+            clear(slot);
+            while (link != &slot) {
+                auto timer = static_cast<Timer*>(link);
+                link = link->next;
+                due.push_back(std::move(timer->value));
+                delete timer;
+                --count;
+            }
+        }
+
+        std::array<std::array<Slot, SLOTS>, LEVELS> wheels;
+        Slot overdue; // timers whose deadline had already passed when they were placed
+        uint64_t current;
+        size_t count;
+};
+
+#endif
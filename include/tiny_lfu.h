@@ -0,0 +1,80 @@
+/**
+ * @file tiny_lfu.h
+ * @brief Define and implement an approximate LFU cache with TinyLFU admission.
+ *
+ * Access frequencies are tracked in a Count-Min Sketch instead of an exact per-key map.
+ * The sketch also remembers keys that are no longer cached, and its counters are halved periodically so old hot keys fade out.
+ * Resident keys are ordered by recency. As with LFU, key_value_store.cpp adds the new item before evicting.
+ * On eviction the newly added key (the candidate) is compared with the least recently used key (the victim):
+ * the victim is evicted only if the candidate has been seen strictly more often, otherwise the candidate itself is rejected.
+ */
+
+#ifndef TINY_LFU_H
+#define TINY_LFU_H
+
+#include <optional>
+#include "eviction_policy.h"
+#include "count_min_sketch.h"
+#include "lru.h"
+
+class TinyLFU : public EvictionPolicy {
+    public:
+        explicit TinyLFU(size_t capacity = 1000) : sketch(capacity) {}
+
+        void keyAccessed(const KeyView key) override {
+            sketch.increment(key);
+            if (!recency.contains(key)) {
+                candidate = key;
+            }
+            recency.keyAccessed(key);
+        }
+
+        void keyRemoved(const KeyView key) override {
+            if (candidate == key) {
+                candidate.reset();
+            }
+            recency.keyRemoved(key);
+        }
+
+        void keyMoved(const KeyView key) override {
+            if (candidate == key) {
+                candidate = key;
+            }
+            recency.keyMoved(key);
+        }
+
+        KeyView evict() override {
+            auto newcomer = std::move(candidate);
+            candidate.reset();
+
+            if (newcomer && *newcomer != recency.leastRecent()
+                && sketch.estimate(*newcomer) <= sketch.estimate(recency.leastRecent())) {
+                recency.keyRemoved(*newcomer);
+                return *newcomer;
+            }
+            return recency.evict();
+        }
+
+        size_t memoryUsage() const override {
+            return sketch.memoryUsage() + recency.memoryUsage();
+        }
+
+        // the count is the sketch's estimate, which a restore feeds back in as that many increments
+        void forEachByRank(const std::function<void(const KeyView, const size_t)>& f) const override {
+            recency.forEachByRank([this, &f](const KeyView key, const size_t) { f(key, sketch.estimate(key)); });
+        }
+
+        void keyRestored(const KeyView key, const size_t count) override {
+            for (size_t i = 0; i < count; ++i) {
+                sketch.increment(key);
+            }
+            recency.keyRestored(key, 0);
+        }
+
+    private:
+        CountMinSketch sketch;
+        LRU recency;
+        std::optional<KeyView> candidate; // most recently added key that has not been through an eviction yet
+};
+
+#endif
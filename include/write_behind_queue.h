@@ -0,0 +1,66 @@
+/**
+ * @file write_behind_queue.h
+ * @brief Define a write-behind queue that coalesces string mutations and flushes them in batches from a background thread.
+ *
+ * Mutations are keyed by (store_id, key), so only the last write to a key within a batch reaches the database.
+ * A batch is flushed when maxPending keys are queued or when the oldest queued write is durabilityWindow old, whichever comes first.
+ * Writes in a batch are committed together in one transaction by the flush function.
+ */
+
+#ifndef WRITE_BEHIND_QUEUE_H
+#define WRITE_BEHIND_QUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+struct WriteBehindOptions {
+    size_t maxPending = 1000;
+    std::chrono::milliseconds durabilityWindow{100};
+};
+
+// (store_id, key) -> value to upsert, or std::nullopt to delete
+using PendingWrites = std::map<std::pair<size_t, std::string>, std::optional<std::string>>;
+
+class WriteBehindQueue {
+    public:
+        WriteBehindQueue(const WriteBehindOptions& options, std::function<void(const PendingWrites&)> flushFn);
+        ~WriteBehindQueue();
+
+        void put(const size_t storeId, const std::string& key, const std::string& value);
+        void remove(const size_t storeId, const std::string& key);
+
+        // std::nullopt if nothing is queued for the key, otherwise the queued write (which itself is std::nullopt for a delete)
+        std::optional<std::optional<std::string>> pending(const size_t storeId, const std::string& key) const;
+
+        void flush();
+
+    private:
+        void enqueue(const size_t storeId, const std::string& key, std::optional<std::string> value);
+        void run();
+
+        WriteBehindOptions options;
+        std::function<void(const PendingWrites&)> flushFn;
+
+        mutable std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable flushed;
+        PendingWrites queued;
+        PendingWrites inFlight; // taken by the flusher, visible to reads until committed
+        std::chrono::steady_clock::time_point oldestQueued;
+        size_t enqueuedSeq = 0;
+        size_t committedSeq = 0;
+        bool flushRequested = false;
+        bool stopping = false;
+        std::exception_ptr flushError;
+
+        std::thread flusher;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include "active_expirer.h"
+
+ActiveExpirer::ActiveExpirer(const ActiveExpirerOptions& options, ReapFn reapFn, ScanFn scanFn)
+    : options(options), reapFn(std::move(reapFn)), scanFn(std::move(scanFn)), start(std::chrono::steady_clock::now()), reaper(&ActiveExpirer::run, this) {}
+
+ActiveExpirer::~ActiveExpirer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    reaper.join();
+}
+
+/*
+    Helper function to convert a time to a wheel tick, rounding up so that a timer never fires before its deadline.
+*/
+uint64_t ActiveExpirer::tickOf(const std::chrono::steady_clock::time_point& time) const {
+    if (time <= start) {
+        return 0;
+    }
+    auto elapsed = time - start;
+    return (elapsed + options.tick - std::chrono::steady_clock::duration(1)) / options.tick;
+}
+
+/*
+    The wheel runs on steady_clock, so the wall-clock expiration is converted to a steady deadline as of now. 
+    If the wall clock is later set back, the timer fires early and the reap function finds the key still live; it is then left to lazy expiry.
+    A TTL of centuries would overflow steady_clock, so it is cut short the same way.
+*/
+void ActiveExpirer::schedule(const size_t storeId, const std::string& key, const ExpirationTime& expiration) {
+    auto remaining = std::min<std::chrono::milliseconds>(expiration - currentTime(), std::chrono::years(100));
+    auto deadline = std::chrono::steady_clock::now() + remaining;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto [it, added] = timers.try_emplace(ExpiringKey{storeId, key});
+    if (!added) {
+        wheel.cancel(it->second);
+    }
+    it->second = wheel.schedule(tickOf(deadline), it->first);
+}
+
+/*
+    A key that already came due stays queued; the reap function finds it live and leaves it.
+*/
+void ActiveExpirer::cancel(const size_t storeId, const std::vector<std::string>& keys) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& key : keys) {
+        auto it = timers.find(ExpiringKey{storeId, key});
+        if (it != timers.end()) {
+            wheel.cancel(it->second);
+            timers.erase(it);
+        }
+    }
+}
+
+ExpirationMetrics ActiveExpirer::metrics() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto ret = counters;
+    ret.scheduled = wheel.size();
+    ret.backlog = due.size();
+    return ret;
+}
+
+/*
+    Helper function to reap one batch, with one call to reapFn per store in the batch.
+*/
+size_t ActiveExpirer::reap(const std::vector<ExpiringKey>& batch) {
+    std::map<size_t, std::vector<std::string>> byStore;
+    for (const auto& [storeId, key] : batch) {
+        byStore[storeId].push_back(key);
+    }
+
+    size_t reaped = 0;
+    for (const auto& [storeId, keys] : byStore) {
+        reaped += reapFn(storeId, keys);
+    }
+    return reaped;
+}
+
+void ActiveExpirer::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto nextTick = std::chrono::steady_clock::now() + options.tick;
+    auto nextScan = std::chrono::steady_clock::now();
+    double tickSeconds = std::chrono::duration<double>(options.tick).count();
+    double smoothing = std::min(1.0, tickSeconds);
+
+    while (true) {
+        if (wake.wait_until(lock, nextTick, [&] { return stopping; })) {
+            return;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        nextTick = std::max(nextTick + options.tick, now);
+
+        std::vector<ExpiringKey> fired;
+        wheel.advance((now - start) / options.tick, fired); // rounded down: only ticks that have fully elapsed
+        for (const auto& key : fired) {
+            timers.erase(key);
+        }
+        std::move(fired.begin(), fired.end(), std::back_inserter(due));
+
+        // only scan when the wheel's own keys fit in this tick's budget, so a backlog is never made worse
+        auto budget = options.batchSize * options.maxBatchesPerTick;
+        if (scanFn && now >= nextScan && due.size() < budget) {
+            nextScan = now + options.scanInterval;
+            lock.unlock();
+            std::vector<ExpiringKey> scanned;
+            try {
+                scanned = scanFn(budget - due.size());
+            } catch (const std::exception& e) {
+                std::cerr << "active expirer: scan failed: " << e.what() << std::endl;
+            }
+            lock.lock();
+            std::move(scanned.begin(), scanned.end(), std::back_inserter(due));
+        }
+
+        size_t reapedThisTick = 0;
+        for (size_t i = 0; i < options.maxBatchesPerTick && !due.empty() && !stopping; ++i) {
+            auto size = std::min(options.batchSize, due.size());
+            std::vector<ExpiringKey> batch(std::make_move_iterator(due.begin()), std::make_move_iterator(due.begin() + size));
+            due.erase(due.begin(), due.begin() + size);
+
+            lock.unlock();
+            size_t reaped = 0;
+            bool failed = false;
+            try {
+                reaped = reap(batch);
+            } catch (const std::exception& e) {
+                std::cerr << "active expirer: reap failed, retrying next tick: " << e.what() << std::endl;
+                failed = true;
+            }
+            lock.lock();
+
+            if (failed) {
+                ++counters.failures;
+                due.insert(due.begin(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+                break;
+            }
+            counters.checked += batch.size();
+            counters.reaped += reaped;
+            reapedThisTick += reaped;
+        }
+
+        counters.reapRate += smoothing * (reapedThisTick / tickSeconds - counters.reapRate);
+    }
+}
@@ -0,0 +1,480 @@
+#include <array>
+#include <cerrno>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include "append_only_log.h"
+
+constexpr std::string_view HEADER = "KVSAOF1\n";
+constexpr size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t); // payload length, CRC
+constexpr auto RETRY_DELAY = std::chrono::milliseconds(100);
+constexpr size_t CATCH_UP_BYTES = 64 * 1024; // left for the flusher to copy while writers wait
+constexpr size_t CATCH_UP_ROUNDS = 4;
+constexpr size_t MAX_TORN_TAIL = 16 * 1024 * 1024; // the most replay truncates as a record torn by a crash
+
+// the Castagnoli polynomial, reflected
+static constexpr auto CRC_TABLE = [] {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}();
+
+static std::system_error systemError(const std::string& what) {
+    return std::system_error(errno, std::generic_category(), what);
+}
+
+static void writeFully(const int fd, std::string_view bytes, const std::string& path) {
+    while (!bytes.empty()) {
+        auto n = write(fd, bytes.data(), bytes.size());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw systemError("write " + path);
+        }
+        bytes.remove_prefix(n);
+    }
+}
+
+/*
+    Helper function to make a rename durable: the new directory entry only survives a crash once the directory is fsynced.
+*/
+static void syncDirectory(const std::string& path) {
+    auto directory = std::filesystem::path(path).parent_path();
+    int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        throw systemError("open " + directory.string());
+    }
+    auto result = fsync(fd);
+    close(fd);
+    if (result < 0) {
+        throw systemError("fsync " + directory.string());
+    }
+}
+
+uint32_t AppendOnlyLog::crc32c(std::string_view bytes) {
+    uint32_t crc = ~0u;
+    for (unsigned char byte : bytes) {
+        crc = CRC_TABLE[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void AppendOnlyLog::frame(std::string& out, std::string_view payload) {
+    uint32_t header[2] = {static_cast<uint32_t>(payload.size()), crc32c(payload)};
+    out.append(reinterpret_cast<const char*>(header), sizeof header);
+    out.append(payload);
+}
+
+AppendOnlyLog::AppendOnlyLog(const AppendOnlyLogOptions& options, const std::function<void(std::string_view)>& apply,
+                             std::function<void()> rewriteDue)
+    : config(options), rewriteDue(std::move(rewriteDue)), nextSync(std::chrono::steady_clock::now() + options.fsyncInterval) {
+    fd = open(config.path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw systemError("open " + config.path);
+    }
+    try {
+        replay(apply);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    rewrittenSize = fileSize;
+    flusher = std::thread(&AppendOnlyLog::run, this);
+}
+
+AppendOnlyLog::~AppendOnlyLog() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    flusher.join();
+    abortRewrite();
+    close(fd);
+}
+
+/*
+    Helper function to tell a torn tail from a damaged length field: a record torn by a crash is the last thing in the file,
+    so no intact record can start after its first byte. Payloads are never empty, so an empty record does not count.
+*/
+static bool holdsIntactRecord(std::string_view tail) {
+    for (size_t offset = 1; offset + RECORD_HEADER_SIZE <= tail.size(); ++offset) {
+        uint32_t header[2];
+        std::memcpy(header, tail.data() + offset, sizeof header);
+        if (header[0] != 0 && header[0] <= tail.size() - offset - RECORD_HEADER_SIZE
+            && AppendOnlyLog::crc32c(tail.substr(offset + RECORD_HEADER_SIZE, header[0])) == header[1]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    The file is mapped rather than read, so replay parses records in place without copying the log into the heap first.
+*/
+void AppendOnlyLog::replay(const std::function<void(std::string_view)>& apply) {
+    struct stat status;
+    if (fstat(fd, &status) < 0) {
+        throw systemError("stat " + config.path);
+    }
+    size_t size = status.st_size;
+    // empty, or a crash while it was being created
+    if (size < HEADER.size()) {
+        if (ftruncate(fd, 0) < 0) {
+            throw systemError("truncate " + config.path);
+        }
+        writeFully(fd, HEADER, config.path);
+        if (fdatasync(fd) < 0) {
+            throw systemError("fdatasync " + config.path);
+        }
+        fileSize = HEADER.size();
+        return;
+    }
+
+    auto map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        throw systemError("mmap " + config.path);
+    }
+    std::unique_ptr<void, std::function<void(void*)>> unmap(map, [size](void* p) { munmap(p, size); });
+    std::string_view data(static_cast<const char*>(map), size);
+    if (!data.starts_with(HEADER)) {
+        throw std::runtime_error(config.path + " is not an append-only log.");
+    }
+
+    auto corrupt = [this](const size_t offset) {
+        return std::runtime_error("append-only log " + config.path + " is corrupt at byte " + std::to_string(offset) + ".");
+    };
+    size_t offset = HEADER.size();
+    while (data.size() - offset >= RECORD_HEADER_SIZE) {
+        uint32_t header[2];
+        std::memcpy(header, data.data() + offset, sizeof header);
+        if (header[0] > data.size() - offset - RECORD_HEADER_SIZE) {
+            break; // runs past the end: torn, if nothing intact follows
+        }
+        auto payload = data.substr(offset + RECORD_HEADER_SIZE, header[0]);
+        auto end = offset + RECORD_HEADER_SIZE + header[0];
+        if (crc32c(payload) != header[1]) {
+            if (end == data.size()) {
+                break; // the last record, torn by a crash in the middle of writing it, if nothing intact is inside it
+            }
+            throw corrupt(offset);
+        }
+        apply(payload);
+        offset = end;
+    }
+
+    // a damaged length field can make the rest of the log look like one torn record; that is corruption, not something to cut off
+    if (size - offset > MAX_TORN_TAIL || holdsIntactRecord(data.substr(offset))) {
+        throw corrupt(offset);
+    }
+    if (offset < size) {
+        std::cerr << "append-only log: truncating an incomplete record of " << size - offset << " bytes at the end of "
+                  << config.path << "." << std::endl;
+        if (ftruncate(fd, offset) < 0) {
+            throw systemError("truncate " + config.path);
+        }
+    }
+    fileSize = offset;
+}
+
+/*
+    The CRC is computed before taking the lock, so writers only hold it to copy the record.
+*/
+uint64_t AppendOnlyLog::append(const size_t partition, std::string_view payload) {
+    uint32_t header[2] = {static_cast<uint32_t>(payload.size()), crc32c(payload)};
+    std::lock_guard<std::mutex> lock(mutex);
+    bool first = pending.empty();
+    pending.append(reinterpret_cast<const char*>(header), sizeof header);
+    pending.append(payload);
+    auto seq = ++appendedSeq;
+    if (rewrite) {
+        rewrite->captured.push_back(CapturedRecord{partition, seq, rewrite->records.size(), sizeof header + payload.size()});
+        rewrite->records.append(reinterpret_cast<const char*>(header), sizeof header);
+        rewrite->records.append(payload);
+    }
+    // the flusher only needs waking when the buffer fills up from empty; otherwise it is busy and takes the record next
+    if (first) {
+        wake.notify_one();
+    }
+    return seq;
+}
+
+uint64_t AppendOnlyLog::nextSequence() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return appendedSeq + 1;
+}
+
+void AppendOnlyLog::throwIfFailed() const {
+    if (!failed.load(std::memory_order_relaxed)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (writeError) {
+        std::rethrow_exception(writeError);
+    }
+}
+
+void AppendOnlyLog::waitForSync(const uint64_t seq) {
+    if (config.fsync != FsyncPolicy::ALWAYS) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    // the flusher writes and fsyncs everything before it stops, so stopping is no reason to give up waiting
+    synced.wait(lock, [&] { return syncedSeq >= seq || writeError; });
+    if (syncedSeq < seq) {
+        std::rethrow_exception(writeError);
+    }
+}
+
+void AppendOnlyLog::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto target = appendedSeq;
+    if (syncedSeq >= target && !writeError) {
+        return;
+    }
+    syncRequested = true;
+    wake.notify_one();
+    synced.wait(lock, [&] { return syncedSeq >= target || writeError; });
+    if (writeError) {
+        std::rethrow_exception(writeError);
+    }
+}
+
+size_t AppendOnlyLog::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return fileSize;
+}
+
+void AppendOnlyLog::beginRewrite() {
+    auto path = config.path + ".rewrite";
+    int rewriteFd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (rewriteFd < 0) {
+        throw systemError("open " + path);
+    }
+    try {
+        writeFully(rewriteFd, HEADER, path);
+    } catch (...) {
+        close(rewriteFd);
+        unlink(path.c_str());
+        throw;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    rewrite = std::make_unique<Rewrite>(Rewrite{rewriteFd, path, HEADER.size(), {}, {}});
+}
+
+/*
+    Called from the rewriting thread only, so the file needs no lock.
+*/
+void AppendOnlyLog::writeRewrite(std::string_view records) {
+    writeFully(rewrite->fd, records, rewrite->path);
+    rewrite->size += records.size();
+}
+
+/*
+    Helper function to take the records captured so far that their partition's copy does not reflect: those appended at or after its cutoff.
+    A partition without a cutoff keeps all of them. Must be called with the mutex held.
+*/
+std::string AppendOnlyLog::takeCaptured(const std::vector<uint64_t>& cutoffs) {
+    std::string ret;
+    for (const auto& record : rewrite->captured) {
+        if (record.partition >= cutoffs.size() || record.seq >= cutoffs[record.partition]) {
+            ret.append(rewrite->records, record.offset, record.size);
+        }
+    }
+    rewrite->captured.clear();
+    rewrite->records.clear();
+    return ret;
+}
+
+/*
+    Most records appended during the copy are moved to the new file here, while writers go on appending;
+    the flusher then adds the last few and swaps the files between two of its own writes.
+*/
+void AppendOnlyLog::finishRewrite(const std::vector<uint64_t>& cutoffs) {
+    for (size_t round = 0; round < CATCH_UP_ROUNDS; ++round) {
+        std::string tail;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tail = takeCaptured(cutoffs);
+        }
+        writeRewrite(tail);
+        if (tail.size() <= CATCH_UP_BYTES) break;
+    }
+    if (fdatasync(rewrite->fd) < 0) {
+        throw systemError("fdatasync " + rewrite->path);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    swapCutoffs = cutoffs;
+    swapRequested = true;
+    wake.notify_one();
+    swapped.wait(lock, [this] { return !swapRequested; });
+    if (swapError) {
+        auto error = swapError;
+        swapError = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void AppendOnlyLog::abortRewrite() {
+    std::lock_guard<std::mutex> lock(mutex);
+    rewriteTriggered = false;
+    if (!rewrite) {
+        return;
+    }
+    close(rewrite->fd);
+    unlink(rewrite->path.c_str());
+    rewrite.reset();
+}
+
+/*
+    Helper function for the flusher to put the rewritten log in place of the current one. Called with the mutex held.
+    Every record appended so far is reflected in the copy or among the captured ones, so whatever is still pending for the old file is dropped,
+    and from here on records are written to the new file. If the swap fails the old file stays, and the pending records are written to it after all.
+*/
+void AppendOnlyLog::swapIn(std::unique_lock<std::mutex>& lock) {
+    auto tail = takeCaptured(swapCutoffs);
+    auto dropped = std::move(pending);
+    pending.clear();
+    auto seq = appendedSeq;
+    auto target = std::move(rewrite);
+    swapRequested = false;
+    rewriteTriggered = false;
+    lock.unlock();
+
+    std::exception_ptr error;
+    try {
+        writeFully(target->fd, tail, target->path);
+        if (fdatasync(target->fd) < 0) {
+            throw systemError("fdatasync " + target->path);
+        }
+        if (rename(target->path.c_str(), config.path.c_str()) < 0) {
+            throw systemError("rename " + target->path);
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    if (!error) {
+        try {
+            syncDirectory(config.path);
+        } catch (const std::exception& e) {
+            // the new log is in place either way; a crash before the directory reaches the disk brings back the old one
+            std::cerr << "append-only log: " << e.what() << std::endl;
+        }
+    }
+
+    lock.lock();
+    if (error) {
+        close(target->fd);
+        unlink(target->path.c_str());
+        dropped += pending;
+        pending = std::move(dropped);
+        swapError = error;
+    } else {
+        close(fd);
+        fd = target->fd;
+        fileSize = rewrittenSize = target->size + tail.size();
+        writtenSeq = syncedSeq = seq;
+        writeError = nullptr;
+        failed = false;
+        synced.notify_all();
+    }
+    swapped.notify_all();
+}
+
+/*
+    Group commit: every record appended while the previous batch was being written goes out in the next write, and its fdatasync
+    covers all of them. A failed batch goes back in front of the buffer and is retried after RETRY_DELAY.
+*/
+void AppendOnlyLog::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        if (swapRequested) {
+            swapIn(lock);
+            continue;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        bool intervalDue = config.fsync == FsyncPolicy::INTERVAL && now >= nextSync;
+        bool unsynced = syncedSeq < writtenSeq;
+        if (pending.empty() && !(unsynced && (syncRequested || stopping || intervalDue))) {
+            syncRequested = false;
+            if (stopping) {
+                return;
+            }
+            auto ready = [this] { return stopping || swapRequested || syncRequested || !pending.empty(); };
+            if (unsynced && config.fsync == FsyncPolicy::INTERVAL) {
+                wake.wait_until(lock, nextSync, ready);
+            } else {
+                wake.wait(lock, ready);
+            }
+            continue;
+        }
+
+        inFlight.swap(pending);
+        auto batchSeq = appendedSeq;
+        bool sync = config.fsync == FsyncPolicy::ALWAYS || syncRequested || stopping || intervalDue;
+        syncRequested = false;
+
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            writeFully(fd, inFlight, config.path);
+            if (sync && fdatasync(fd) < 0) {
+                throw systemError("fdatasync " + config.path);
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        if (error) {
+            // a partial write is cut off, so the retry does not leave half a record in front of it
+            if (ftruncate(fd, fileSize) < 0) {
+                std::cerr << "append-only log: " << systemError("truncate " + config.path).what() << std::endl;
+            }
+            inFlight += pending;
+            pending.swap(inFlight);
+            inFlight.clear();
+            writeError = error;
+            failed = true;
+            synced.notify_all();
+            if (stopping) {
+                std::cerr << "append-only log: dropping " << pending.size() << " unwritten bytes on shutdown." << std::endl;
+                return;
+            }
+            wake.wait_for(lock, RETRY_DELAY, [this] { return stopping; });
+            continue;
+        }
+
+        fileSize += inFlight.size();
+        inFlight.clear();
+        writtenSeq = batchSeq;
+        if (sync) {
+            syncedSeq = batchSeq;
+            nextSync = now + config.fsyncInterval;
+        }
+        writeError = nullptr;
+        failed = false;
+        synced.notify_all();
+
+        bool rewriteNeeded = rewriteDue && config.rewriteGrowth && !rewrite && !rewriteTriggered && !stopping
+            && fileSize >= config.rewriteMinSize && fileSize >= rewrittenSize + rewrittenSize * config.rewriteGrowth / 100;
+        if (rewriteNeeded) {
+            rewriteTriggered = true;
+            lock.unlock();
+            rewriteDue();
+            lock.lock();
+        }
+    }
+}
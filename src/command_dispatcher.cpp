@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <charconv>
+#include <unordered_map>
+#include "command_dispatcher.h"
+#include "resp.h"
+
+// an error whose message is sent to the client as is
+class CommandError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+};
+
+using Args = std::vector<std::string>;
+using Handler = void (*)(KeyValueStore& store, Session& session, const Args& args, std::string& out);
+
+struct Command {
+    int arity;
+    Handler handler;
+};
+
+/*
+    Helper functions to read arguments and write the common reply shapes.
+*/
+static int64_t toInteger(const std::string& arg) {
+    int64_t value;
+    auto [end, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), value);
+    if (ec != std::errc() || end != arg.data() + arg.size()) {
+        throw CommandError("ERR value is not an integer or out of range");
+    }
+    return value;
+}
+
+static size_t toCount(const std::string& arg) {
+    auto value = toInteger(arg);
+    if (value < 0) {
+        throw CommandError("ERR value is out of range, must be positive");
+    }
+    return static_cast<size_t>(value);
+}
+
+static std::string lowercase(std::string word) {
+    std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+    return word;
+}
+
+/*
+    Helper function to read the time argument of the EXPIRE family, in units of unitMilliseconds, after now or after the epoch.
+    A time that does not fit in Unix epoch milliseconds is an error, as in Redis, rather than wrapping around into the past.
+*/
+static int64_t toExpireTime(const Args& args, const int64_t unitMilliseconds, const bool relative) {
+    auto value = toInteger(args[2]);
+    if (!expirationAfter(relative ? currentTime() : ExpirationTime(), value, unitMilliseconds)) {
+        throw CommandError("ERR invalid expire time in '" + lowercase(args[0]) + "' command");
+    }
+    return value;
+}
+
+static Args slice(const Args& args, const size_t first) {
+    return Args(args.begin() + first, args.end());
+}
+
+static void appendOptional(std::string& out, const std::optional<std::string>& value) {
+    value ? appendBulkString(out, *value) : appendNull(out);
+}
+
+static void appendStrings(std::string& out, const std::vector<std::string>& values) {
+    appendArrayHeader(out, values.size());
+    for (const auto& value : values) {
+        appendBulkString(out, value);
+    }
+}
+
+static void appendOptionals(std::string& out, const std::vector<std::optional<std::string>>& values) {
+    appendArrayHeader(out, values.size());
+    for (const auto& value : values) {
+        appendOptional(out, value);
+    }
+}
+
+// a missing list pops nothing, which Redis answers with a null array when a count was given
+static void appendPopped(std::string& out, const std::vector<std::string>& values) {
+    values.empty() ? appendNullArray(out) : appendStrings(out, values);
+}
+
+static std::vector<std::pair<std::string, std::string>> toPairs(const Args& args, const size_t first) {
+    if ((args.size() - first) % 2 != 0) {
+        throw CommandError("ERR wrong number of arguments for '" + lowercase(args[0]) + "' command");
+    }
+    std::vector<std::pair<std::string, std::string>> ret;
+    for (size_t i = first; i < args.size(); i += 2) {
+        ret.emplace_back(args[i], args[i + 1]);
+    }
+    return ret;
+}
+
+static void usePolicy(KeyValueStore& store, const size_t storeId, const std::string& name) {
+    auto policy = lowercase(name);
+    if (policy == "allkeys-lru" || policy == "lru") {
+        store.useLRU(storeId);
+    } else if (policy == "allkeys-lfu" || policy == "lfu") {
+        store.useLFU(storeId);
+    } else if (policy == "tinylfu") {
+        store.useTinyLFU(storeId);
+    } else {
+        throw CommandError("ERR unsupported maxmemory-policy '" + name + "'");
+    }
+}
+
+/*
+    Every supported command. Handlers run with the arity already checked.
+*/
+static const std::unordered_map<std::string, Command> COMMANDS = {
+    // connection
+    {"ping", {-1, [](KeyValueStore&, Session&, const Args& args, std::string& out) {
+        if (args.size() > 2) throw CommandError("ERR wrong number of arguments for 'ping' command");
+        args.size() == 2 ? appendBulkString(out, args[1]) : appendSimpleString(out, "PONG");
+    }}},
+    {"echo", {2, [](KeyValueStore&, Session&, const Args& args, std::string& out) {
+        appendBulkString(out, args[1]);
+    }}},
+    {"select", {2, [](KeyValueStore&, Session& session, const Args& args, std::string& out) {
+        session.storeId = toCount(args[1]);
+        appendSimpleString(out, "OK");
+    }}},
+    {"quit", {1, [](KeyValueStore&, Session& session, const Args&, std::string& out) {
+        session.closing = true;
+        appendSimpleString(out, "OK");
+    }}},
+    // redis-cli asks for command docs on startup; an empty reply makes it fall back to no hints
+    {"command", {-1, [](KeyValueStore&, Session&, const Args&, std::string& out) {
+        appendArrayHeader(out, 0);
+    }}},
+    // CONFIG GET answers the parameters the store has, and an empty array for the rest (redis-benchmark asks for some)
+    {"config", {-2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        auto subcommand = lowercase(args[1]);
+        if (subcommand == "get" && args.size() == 3) {
+            if (lowercase(args[2]) != "maxmemory") {
+                appendArrayHeader(out, 0);
+                return;
+            }
+            appendArrayHeader(out, 2);
+            appendBulkString(out, "maxmemory");
+            appendBulkString(out, std::to_string(store.memoryStats(session.storeId).maxMemory));
+        } else if (subcommand == "set" && args.size() == 4) {
+            auto parameter = lowercase(args[2]);
+            if (parameter == "maxmemory") {
+                store.setMaxMemory(session.storeId, toCount(args[3]));
+            } else if (parameter == "maxmemory-policy") {
+                usePolicy(store, session.storeId, args[3]);
+            } else {
+                throw CommandError("ERR unsupported CONFIG parameter: " + args[2]);
+            }
+            appendSimpleString(out, "OK");
+        } else {
+            throw CommandError("ERR unknown subcommand or wrong number of arguments for CONFIG " + args[1]);
+        }
+    }}},
+    {"memory", {-2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        auto subcommand = lowercase(args[1]);
+        if (subcommand == "usage" && args.size() == 3) {
+            auto bytes = store.memoryUsage(session.storeId, args[2]);
+            bytes ? appendInteger(out, static_cast<int64_t>(*bytes)) : appendNull(out);
+        } else if (subcommand == "stats" && args.size() == 2) {
+            auto stats = store.memoryStats(session.storeId);
+            appendArrayHeader(out, 6);
+            appendBulkString(out, "used_memory");
+            appendInteger(out, static_cast<int64_t>(stats.usedMemory));
+            appendBulkString(out, "maxmemory");
+            appendInteger(out, static_cast<int64_t>(stats.maxMemory));
+            appendBulkString(out, "keys.count");
+            appendInteger(out, static_cast<int64_t>(stats.keys));
+        } else {
+            throw CommandError("ERR unknown subcommand or wrong number of arguments for MEMORY " + args[1]);
+        }
+    }}},
+
+    {"bgrewriteaof", {1, [](KeyValueStore& store, Session&, const Args&, std::string& out) {
+        appendSimpleString(out, store.rewriteAppendOnlyLog());
+    }}},
+    {"bgsave", {1, [](KeyValueStore& store, Session&, const Args&, std::string& out) {
+        appendSimpleString(out, store.bgSave());
+    }}},
+    {"save", {1, [](KeyValueStore& store, Session&, const Args&, std::string& out) {
+        appendSimpleString(out, store.save());
+    }}},
+    {"lastsave", {1, [](KeyValueStore& store, Session&, const Args&, std::string& out) {
+        appendInteger(out, store.lastSave());
+    }}},
+
+    // expiration
+    {"expire", {3, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.expire(session.storeId, args[1], std::chrono::seconds(toExpireTime(args, 1000, true))));
+    }}},
+    {"pexpire", {3, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.pExpire(session.storeId, args[1], std::chrono::milliseconds(toExpireTime(args, 1, true))));
+    }}},
+    {"expireat", {3, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.expireAt(session.storeId, args[1], toExpireTime(args, 1000, false)));
+    }}},
+    {"pexpireat", {3, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.pExpireAt(session.storeId, args[1], toExpireTime(args, 1, false)));
+    }}},
+    {"persist", {2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.persist(session.storeId, args[1]));
+    }}},
+    {"ttl", {2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.ttl(session.storeId, args[1]));
+    }}},
+    {"pttl", {2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.pTTL(session.storeId, args[1]));
+    }}},
+
+    // strings
+    {"get", {2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendOptional(out, store.get(session.storeId, args[1]));
+    }}},
+    {"set", {3, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendSimpleString(out, store.set(session.storeId, args[1], args[2]));
+    }}},
+    {"del", {-2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.del(session.storeId, slice(args, 1)));
+    }}},
+    {"mget", {-2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendOptionals(out, store.mget(session.storeId, slice(args, 1)));
+    }}},
+    {"mset", {-3, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendSimpleString(out, store.mset(session.storeId, toPairs(args, 1)));
+    }}},
+
+    // lists
+    {"lpush", {-3, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.lPush(session.storeId, args[1], slice(args, 2)));
+    }}},
+    {"rpush", {-3, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.rPush(session.storeId, args[1], slice(args, 2)));
+    }}},
+    {"lpop", {-2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        if (args.size() > 3) throw CommandError("ERR wrong number of arguments for 'lpop' command");
+        args.size() == 3 ? appendPopped(out, store.lPop(session.storeId, args[1], toCount(args[2])))
+                         : appendOptional(out, store.lPop(session.storeId, args[1]));
+    }}},
+    {"rpop", {-2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        if (args.size() > 3) throw CommandError("ERR wrong number of arguments for 'rpop' command");
+        args.size() == 3 ? appendPopped(out, store.rPop(session.storeId, args[1], toCount(args[2])))
+                         : appendOptional(out, store.rPop(session.storeId, args[1]));
+    }}},
+    {"lrange", {4, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendStrings(out, store.lRange(session.storeId, args[1], toInteger(args[2]), toInteger(args[3])));
+    }}},
+    {"llen", {2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.lLen(session.storeId, args[1]));
+    }}},
+
+    // sets
+    {"sadd", {-3, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.sAdd(session.storeId, args[1], slice(args, 2)));
+    }}},
+    {"srem", {-3, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.sRem(session.storeId, args[1], slice(args, 2)));
+    }}},
+    {"smembers", {2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendStrings(out, store.sMembers(session.storeId, args[1]));
+    }}},
+    {"sismember", {3, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.sIsMember(session.storeId, args[1], args[2]));
+    }}},
+    {"scard", {2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.sCard(session.storeId, args[1]));
+    }}},
+    {"sinter", {-2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendStrings(out, store.sInter(session.storeId, slice(args, 1)));
+    }}},
+    {"sunion", {-2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendStrings(out, store.sUnion(session.storeId, slice(args, 1)));
+    }}},
+    {"sdiff", {-2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendStrings(out, store.sDiff(session.storeId, slice(args, 1)));
+    }}},
+
+    // hashes
+    {"hset", {-4, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.hSet(session.storeId, args[1], toPairs(args, 2)));
+    }}},
+    {"hget", {3, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendOptional(out, store.hGet(session.storeId, args[1], args[2]));
+    }}},
+    {"hmget", {-3, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendOptionals(out, store.hMGet(session.storeId, args[1], slice(args, 2)));
+    }}},
+    {"hgetall", {2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        auto fields = store.hGetAll(session.storeId, args[1]);
+        appendArrayHeader(out, 2 * fields.size());
+        for (const auto& [field, value] : fields) {
+            appendBulkString(out, field);
+            appendBulkString(out, value);
+        }
+    }}},
+    {"hdel", {-3, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.hDel(session.storeId, args[1], slice(args, 2)));
+    }}},
+    {"hlen", {2, [](KeyValueStore& store, Session& session, const Args& args, std::string& out) {
+        appendInteger(out, store.hLen(session.storeId, args[1]));
+    }}},
+};
+
+/*
+    A reply is appended for every command, errors included. An empty request gets no reply, as in Redis.
+*/
+void CommandDispatcher::execute(Session& session, const std::vector<std::string>& args, std::string& out) {
+    if (args.empty()) {
+        return;
+    }
+
+    auto name = lowercase(args[0]);
+    auto it = COMMANDS.find(name);
+    if (it == COMMANDS.end()) {
+        appendError(out, "ERR unknown command '" + args[0] + "'");
+        return;
+    }
+    auto arity = it->second.arity;
+    if ((arity > 0 && args.size() != static_cast<size_t>(arity)) || (arity < 0 && args.size() < static_cast<size_t>(-arity))) {
+        appendError(out, "ERR wrong number of arguments for '" + name + "' command");
+        return;
+    }
+
+    // a handler failing halfway leaves no partial reply behind
+    auto mark = out.size();
+    try {
+        it->second.handler(store, session, args, out);
+    } catch (const CommandError& e) {
+        out.resize(mark);
+        appendError(out, e.what());
+    } catch (const TypeMismatchError&) {
+        out.resize(mark);
+        appendError(out, "WRONGTYPE Operation against a key holding the wrong kind of value");
+    } catch (const std::exception& e) {
+        out.resize(mark);
+        appendError(out, std::string("ERR ") + e.what());
+    }
+}
+
+/*
+    Helper functions to find runs of the same command in a batch, comparing names without copying them.
+*/
+static bool isCommand(const Args& args, std::string_view name, const size_t words) {
+    return args.size() == words && std::equal(args[0].begin(), args[0].end(), name.begin(), name.end(),
+        [](const char a, const char b) { return ::tolower(static_cast<unsigned char>(a)) == b; });
+}
+
+static size_t runEnd(std::span<const Args> batch, const size_t first, std::string_view name, const size_t words) {
+    auto end = first;
+    while (end < batch.size() && isCommand(batch[end], name, words)) {
+        ++end;
+    }
+    return end;
+}
+
+/*
+    Commands after a QUIT are not run, as in Redis.
+*/
+void CommandDispatcher::execute(Session& session, std::span<const Args> batch, std::string& out) {
+    size_t i = 0;
+    while (i < batch.size() && !session.closing) {
+        auto end = runEnd(batch, i, "get", 2);
+        if (end - i > 1) {
+            getAll(session, batch.subspan(i, end - i), out);
+            i = end;
+            continue;
+        }
+        end = runEnd(batch, i, "set", 3);
+        if (end - i > 1) {
+            setAll(session, batch.subspan(i, end - i), out);
+            i = end;
+            continue;
+        }
+        execute(session, batch[i], out);
+        ++i;
+    }
+}
+
+/*
+    A run of GETs as one MGET. As in MGET, a key in the run that holds a collection is answered with nil rather than WRONGTYPE.
+    If the MGET fails, every GET in the run gets its error.
+*/
+void CommandDispatcher::getAll(Session& session, std::span<const Args> gets, std::string& out) {
+    std::vector<std::string> keys;
+    keys.reserve(gets.size());
+    for (const auto& args : gets) {
+        keys.push_back(args[1]);
+    }
+
+    std::vector<std::optional<std::string>> values;
+    try {
+        values = store.mget(session.storeId, keys);
+    } catch (const std::exception& e) {
+        for (size_t i = 0; i < gets.size(); ++i) {
+            appendError(out, std::string("ERR ") + e.what());
+        }
+        return;
+    }
+    for (const auto& value : values) {
+        appendOptional(out, value);
+    }
+}
+
+/*
+    A run of SETs as one MSET, which keeps the last value of a repeated key just as the SETs in order would.
+    MSET is a single statement, so if it fails nothing was written and the run is replayed one SET at a time.
+*/
+void CommandDispatcher::setAll(Session& session, std::span<const Args> sets, std::string& out) {
+    std::vector<std::pair<std::string, std::string>> pairs;
+    pairs.reserve(sets.size());
+    for (const auto& args : sets) {
+        pairs.emplace_back(args[1], args[2]);
+    }
+
+    try {
+        store.mset(session.storeId, pairs);
+    } catch (const std::exception&) {
+        for (const auto& args : sets) {
+            execute(session, args, out);
+        }
+        return;
+    }
+    for (size_t i = 0; i < sets.size(); ++i) {
+        appendSimpleString(out, "OK");
+    }
+}
@@ -0,0 +1,150 @@
+#include "compact_hash.h"
+#include "memory_usage.h"
+
+/*
+    Helper functions to walk a packed buffer. An entry at pos is [field length][field][value length][value].
+*/
+static std::string_view fieldAt(const std::string& buffer, const size_t pos) {
+    return std::string_view(buffer).substr(pos + 1, static_cast<unsigned char>(buffer[pos]));
+}
+
+static size_t valueOffset(const std::string& buffer, const size_t pos) {
+    return pos + 1 + static_cast<unsigned char>(buffer[pos]);
+}
+
+static std::string_view valueAt(const std::string& buffer, const size_t pos) {
+    auto offset = valueOffset(buffer, pos);
+    return std::string_view(buffer).substr(offset + 1, static_cast<unsigned char>(buffer[offset]));
+}
+
+static size_t nextEntry(const std::string& buffer, const size_t pos) {
+    auto offset = valueOffset(buffer, pos);
+    return offset + 1 + static_cast<unsigned char>(buffer[offset]);
+}
+
+static void appendPacked(std::string& buffer, std::string_view bytes) {
+    buffer.push_back(static_cast<char>(bytes.size()));
+    buffer.append(bytes);
+}
+
+size_t CompactHash::find(const Packed& packed, std::string_view field) {
+    for (size_t pos = 0; pos < packed.buffer.size(); pos = nextEntry(packed.buffer, pos)) {
+        if (fieldAt(packed.buffer, pos) == field) {
+            return pos;
+        }
+    }
+    return std::string::npos;
+}
+
+size_t CompactHash::size() const {
+    if (auto packed = std::get_if<Packed>(&encoding)) {
+        return packed->count;
+    }
+    return std::get<std::unordered_map<std::string, std::string>>(encoding).size();
+}
+
+std::optional<std::string> CompactHash::get(std::string_view field) const {
+    if (auto packed = std::get_if<Packed>(&encoding)) {
+        auto pos = find(*packed, field);
+        if (pos == std::string::npos) {
+            return std::nullopt;
+        }
+        return std::string(valueAt(packed->buffer, pos));
+    }
+
+    const auto& fields = std::get<std::unordered_map<std::string, std::string>>(encoding);
+    auto it = fields.find(std::string(field));
+    if (it == fields.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+bool CompactHash::set(const std::string& field, const std::string& value) {
+    if (auto packed = std::get_if<Packed>(&encoding)) {
+        auto pos = find(*packed, field);
+        if (value.size() <= MAX_PACKED_LENGTH) {
+            if (pos != std::string::npos) {
+                // rewrite the value in place, shifting only the entries after it
+                auto offset = valueOffset(packed->buffer, pos);
+                std::string encoded;
+                appendPacked(encoded, value);
+                packed->buffer.replace(offset, 1 + static_cast<unsigned char>(packed->buffer[offset]), encoded);
+                return false;
+            }
+            if (field.size() <= MAX_PACKED_LENGTH && packed->count < MAX_PACKED_ENTRIES) {
+                appendPacked(packed->buffer, field);
+                appendPacked(packed->buffer, value);
+                ++packed->count;
+                return true;
+            }
+        }
+        convert();
+    }
+
+    auto& fields = std::get<std::unordered_map<std::string, std::string>>(encoding);
+    auto it = fields.find(field);
+    if (it != fields.end()) {
+        stringBytes -= heapBytes(it->second);
+        it->second = value;
+        stringBytes += heapBytes(it->second);
+        return false;
+    }
+    it = fields.emplace(field, value).first;
+    stringBytes += heapBytes(it->first) + heapBytes(it->second);
+    return true;
+}
+
+bool CompactHash::remove(const std::string& field) {
+    if (auto packed = std::get_if<Packed>(&encoding)) {
+        auto pos = find(*packed, field);
+        if (pos == std::string::npos) {
+            return false;
+        }
+        packed->buffer.erase(pos, nextEntry(packed->buffer, pos) - pos);
+        --packed->count;
+        return true;
+    }
+    auto& fields = std::get<std::unordered_map<std::string, std::string>>(encoding);
+    auto it = fields.find(field);
+    if (it == fields.end()) {
+        return false;
+    }
+    stringBytes -= heapBytes(it->first) + heapBytes(it->second);
+    fields.erase(it);
+    return true;
+}
+
+std::vector<std::pair<std::string, std::string>> CompactHash::entries() const {
+    std::vector<std::pair<std::string, std::string>> ret;
+    if (auto packed = std::get_if<Packed>(&encoding)) {
+        ret.reserve(packed->count);
+        for (size_t pos = 0; pos < packed->buffer.size(); pos = nextEntry(packed->buffer, pos)) {
+            ret.emplace_back(fieldAt(packed->buffer, pos), valueAt(packed->buffer, pos));
+        }
+        return ret;
+    }
+
+    const auto& fields = std::get<std::unordered_map<std::string, std::string>>(encoding);
+    ret.assign(fields.begin(), fields.end());
+    return ret;
+}
+
+size_t CompactHash::memoryUsage() const {
+    if (auto packed = std::get_if<Packed>(&encoding)) {
+        return heapBytes(packed->buffer);
+    }
+    const auto& fields = std::get<std::unordered_map<std::string, std::string>>(encoding);
+    return bucketBytes(fields) + fields.size() * hashNodeBytes<std::pair<const std::string, std::string>>() + stringBytes;
+}
+
+void CompactHash::convert() {
+    std::unordered_map<std::string, std::string> fields;
+    const auto& packed = std::get<Packed>(encoding);
+    fields.reserve(packed.count + 1);
+    for (size_t pos = 0; pos < packed.buffer.size(); pos = nextEntry(packed.buffer, pos)) {
+        auto it = fields.emplace(fieldAt(packed.buffer, pos), valueAt(packed.buffer, pos)).first;
+        stringBytes += heapBytes(it->first) + heapBytes(it->second);
+    }
+    encoding = std::move(fields);
+}
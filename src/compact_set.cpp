@@ -0,0 +1,192 @@
+#include <charconv>
+#include <limits>
+#include <type_traits>
+#include "compact_set.h"
+#include "memory_usage.h"
+
+// the binary search stops halving at this many elements and counts the rest
+static constexpr size_t SCAN_WINDOW = 16;
+
+/*
+    Position of the first element not less than value. The final count over the window has no branches,
+    so it compiles to a few vector compares instead of mispredicted jumps.
+*/
+template <typename T>
+static size_t lowerBound(const std::vector<T>& values, const T value) {
+    size_t first = 0;
+    size_t last = values.size();
+    while (last - first > SCAN_WINDOW) {
+        auto mid = first + (last - first) / 2;
+        if (values[mid] < value) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+
+    size_t less = 0;
+    for (size_t i = first; i < last; ++i) {
+        less += values[i] < value;
+    }
+    return first + less;
+}
+
+template <typename T>
+static bool fits(const int64_t value) {
+    return value >= std::numeric_limits<T>::min() && value <= std::numeric_limits<T>::max();
+}
+
+size_t IntSet::size() const {
+    return std::visit([](const auto& values) { return values.size(); }, packed);
+}
+
+bool IntSet::contains(const int64_t value) const {
+    return std::visit([value](const auto& values) {
+        using T = typename std::decay_t<decltype(values)>::value_type;
+        if (!fits<T>(value)) {
+            return false;
+        }
+        auto pos = lowerBound(values, static_cast<T>(value));
+        return pos < values.size() && values[pos] == value;
+    }, packed);
+}
+
+/*
+    A value that does not fit the current width widens every member first. The set never narrows again.
+*/
+bool IntSet::add(const int64_t value) {
+    if (auto narrow = std::get_if<std::vector<int16_t>>(&packed); narrow && !fits<int16_t>(value)) {
+        packed = std::vector<int32_t>(narrow->begin(), narrow->end());
+    }
+    if (auto narrow = std::get_if<std::vector<int32_t>>(&packed); narrow && !fits<int32_t>(value)) {
+        packed = std::vector<int64_t>(narrow->begin(), narrow->end());
+    }
+
+    return std::visit([value](auto& values) {
+        using T = typename std::decay_t<decltype(values)>::value_type;
+        auto pos = lowerBound(values, static_cast<T>(value));
+        if (pos < values.size() && values[pos] == value) {
+            return false;
+        }
+        values.insert(values.begin() + pos, static_cast<T>(value));
+        return true;
+    }, packed);
+}
+
+bool IntSet::remove(const int64_t value) {
+    return std::visit([value](auto& values) {
+        using T = typename std::decay_t<decltype(values)>::value_type;
+        if (!fits<T>(value)) {
+            return false;
+        }
+        auto pos = lowerBound(values, static_cast<T>(value));
+        if (pos == values.size() || values[pos] != value) {
+            return false;
+        }
+        values.erase(values.begin() + pos);
+        return true;
+    }, packed);
+}
+
+std::vector<int64_t> IntSet::values() const {
+    return std::visit([](const auto& values) { return std::vector<int64_t>(values.begin(), values.end()); }, packed);
+}
+
+size_t IntSet::memoryUsage() const {
+    return std::visit([](const auto& values) { return values.capacity() * sizeof(values[0]); }, packed);
+}
+
+std::optional<int64_t> toCanonicalInteger(std::string_view member) {
+    if (member.empty() || member.size() > 20) {
+        return std::nullopt;
+    }
+
+    int64_t value;
+    auto [end, ec] = std::from_chars(member.data(), member.data() + member.size(), value);
+    if (ec != std::errc() || end != member.data() + member.size()) {
+        return std::nullopt;
+    }
+
+    // from_chars also accepts leading zeros and -0, which would not round-trip
+    auto digits = member.front() == '-' ? member.substr(1) : member;
+    if ((digits.size() > 1 && digits.front() == '0') || member == "-0") {
+        return std::nullopt;
+    }
+    return value;
+}
+
+size_t CompactSet::size() const {
+    return std::visit([](const auto& set) { return set.size(); }, encoding);
+}
+
+bool CompactSet::contains(const std::string& member) const {
+    if (auto ints = std::get_if<IntSet>(&encoding)) {
+        auto value = toCanonicalInteger(member);
+        return value && ints->contains(*value);
+    }
+    return std::get<std::unordered_set<std::string>>(encoding).contains(member);
+}
+
+bool CompactSet::add(const std::string& member) {
+    if (auto ints = std::get_if<IntSet>(&encoding)) {
+        auto value = toCanonicalInteger(member);
+        if (value && (ints->size() < MAX_INTSET_ENTRIES || ints->contains(*value))) {
+            return ints->add(*value);
+        }
+        convert();
+    }
+    auto [it, inserted] = std::get<std::unordered_set<std::string>>(encoding).insert(member);
+    if (inserted) {
+        memberBytes += heapBytes(*it);
+    }
+    return inserted;
+}
+
+bool CompactSet::remove(const std::string& member) {
+    if (auto ints = std::get_if<IntSet>(&encoding)) {
+        auto value = toCanonicalInteger(member);
+        return value && ints->remove(*value);
+    }
+    auto& strings = std::get<std::unordered_set<std::string>>(encoding);
+    auto it = strings.find(member);
+    if (it == strings.end()) {
+        return false;
+    }
+    memberBytes -= heapBytes(*it);
+    strings.erase(it);
+    return true;
+}
+
+std::vector<std::string> CompactSet::members() const {
+    std::vector<std::string> ret;
+    if (auto ints = std::get_if<IntSet>(&encoding)) {
+        auto values = ints->values();
+        ret.reserve(values.size());
+        for (auto value : values) {
+            ret.push_back(std::to_string(value));
+        }
+        return ret;
+    }
+
+    const auto& strings = std::get<std::unordered_set<std::string>>(encoding);
+    ret.assign(strings.begin(), strings.end());
+    return ret;
+}
+
+size_t CompactSet::memoryUsage() const {
+    if (auto ints = std::get_if<IntSet>(&encoding)) {
+        return ints->memoryUsage();
+    }
+    const auto& strings = std::get<std::unordered_set<std::string>>(encoding);
+    return bucketBytes(strings) + strings.size() * hashNodeBytes<std::string>() + memberBytes;
+}
+
+void CompactSet::convert() {
+    auto values = std::get<IntSet>(encoding).values();
+    std::unordered_set<std::string> strings;
+    strings.reserve(values.size() + 1);
+    for (auto value : values) {
+        memberBytes += heapBytes(*strings.insert(std::to_string(value)).first);
+    }
+    encoding = std::move(strings);
+}
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include "connection_pool.h"
+
+ConnectionPool::Lease::Lease(ConnectionPool& pool, std::unique_ptr<pqxx::connection> conn)
+    : pool(&pool), conn(std::move(conn)) {}
+
+ConnectionPool::Lease::Lease(Lease&& other) noexcept
+    : pool(other.pool), conn(std::move(other.conn)) {}
+
+ConnectionPool::Lease::~Lease() {
+    if (conn) {
+        pool->release(std::move(conn));
+    }
+}
+
+/*
+    onConnect runs on every connection the pool opens, e.g. to prepare statements.
+*/
+ConnectionPool::ConnectionPool(const std::string& connectionString, const size_t size,
+                               std::function<void(pqxx::connection&)> onConnect,
+                               const std::chrono::milliseconds& checkoutTimeout)
+    : connectionString(connectionString), size(std::max<size_t>(size, 1)), onConnect(std::move(onConnect)), checkoutTimeout(checkoutTimeout) {
+    stats.size = this->size;
+}
+
+std::unique_ptr<pqxx::connection> ConnectionPool::open() {
+    auto conn = std::make_unique<pqxx::connection>(connectionString);
+    if (onConnect) {
+        onConnect(*conn);
+    }
+    return conn;
+}
+
+/*
+    Check out a connection, opening one if the pool is not full yet, otherwise waiting for one to be returned.
+    Throws std::runtime_error if none is returned within the checkout timeout.
+*/
+ConnectionPool::Lease ConnectionPool::acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    ++stats.checkouts;
+
+    if (idle.empty() && opened >= size) {
+        ++stats.waits;
+        auto start = std::chrono::steady_clock::now();
+        bool available = returned.wait_for(lock, checkoutTimeout, [&] { return !idle.empty() || opened < size; });
+        auto waited = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        stats.totalWait += waited;
+        stats.maxWait = std::max(stats.maxWait, waited);
+        if (!available) {
+            throw std::runtime_error("connection pool exhausted.");
+        }
+    }
+
+    if (!idle.empty()) {
+        auto conn = std::move(idle.back());
+        idle.pop_back();
+        ++stats.inUse;
+        if (conn->is_open()) {
+            return Lease(*this, std::move(conn));
+        }
+        ++stats.reconnects;
+        conn.reset();
+        --opened;
+        --stats.inUse;
+    }
+
+    // open outside the lock; the slot is reserved so other threads cannot overshoot the pool size
+    ++opened;
+    ++stats.inUse;
+    lock.unlock();
+    try {
+        return Lease(*this, open());
+    } catch (...) {
+        lock.lock();
+        --opened;
+        --stats.inUse;
+        returned.notify_one();
+        throw;
+    }
+}
+
+/*
+    Return a connection. Closed connections are dropped so the next checkout opens a fresh one.
+*/
+void ConnectionPool::release(std::unique_ptr<pqxx::connection> conn) {
+    bool healthy = conn->is_open();
+    if (!healthy) {
+        conn.reset();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        --stats.inUse;
+        if (healthy) {
+            idle.push_back(std::move(conn));
+        } else {
+            --opened;
+            ++stats.reconnects;
+        }
+    }
+    returned.notify_one();
+}
+
+PoolMetrics ConnectionPool::metrics() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    PoolMetrics ret = stats;
+    ret.open = opened;
+    return ret;
+}
@@ -1,67 +1,480 @@
+#include <algorithm>
 #include "database_manager.h"
 
-DatabaseManager::DatabaseManager(const std::string& connStr) : connectionString(connStr), conn(nullptr) {}
+// Names of the statements prepared on every connection. 
+const std::string CLEAR_STRINGS = "clear_strings";
+const std::string SELECT_POLICY = "select_policy";
+const std::string UPDATE_POLICY = "update_policy";
+const std::string SELECT_EVICTION_CONFIG = "select_eviction_config";
+const std::string UPSERT_MAXMEMORY = "upsert_maxmemory";
+const std::string KEY_MEMORY = "key_memory";
+const std::string SET_EXPIRATION = "set_expiration";
+const std::string GET_EXPIRATION = "get_expiration";
+const std::string CLEAR_EXPIRATION = "clear_expiration";
+const std::string INSERT_STRING = "insert_string";
+const std::string DELETE_STRING = "delete_string";
+const std::string FETCH_STRING = "fetch_string";
+const std::string FETCH_LIVE_STRING = "fetch_live_string";
+const std::string DELETE_STRINGS = "delete_strings";
+const std::string UPSERT_STRINGS = "upsert_strings";
+const std::string FETCH_LIVE_STRINGS = "fetch_live_strings";
+const std::string DELETE_LIVE_KEYS = "delete_live_keys";
+const std::string DELETE_EXPIRED_STRINGS = "delete_expired_strings";
+const std::string FETCH_EXPIRED_KEYS = "fetch_expired_keys";
+const std::string CLEAR_LISTS = "clear_lists";
+const std::string LOCK_KEY = "lock_key";
+const std::string KEY_TYPE = "key_type";
+const std::string LIST_LENGTH = "list_length";
+const std::string COUNT_COLLECTIONS = "count_collections";
+const std::string DELETE_LIST = "delete_list";
+const std::string LIST_HEAD_NODE = "list_head_node";
+const std::string LIST_TAIL_NODE = "list_tail_node";
+const std::string LIST_HEAD_NODES = "list_head_nodes";
+const std::string LIST_TAIL_NODES = "list_tail_nodes";
+const std::string LIST_RANGE_NODES = "list_range_nodes";
+const std::string UPSERT_LIST_NODES = "upsert_list_nodes";
+const std::string DELETE_LIST_NODES = "delete_list_nodes";
+const std::string CLEAR_SETS = "clear_sets";
+const std::string DELETE_SET = "delete_set";
+const std::string ADD_SET_MEMBERS = "add_set_members";
+const std::string REMOVE_SET_MEMBERS = "remove_set_members";
+const std::string SET_MEMBERS = "set_members";
+const std::string SET_CONTAINS = "set_contains";
+const std::string SET_SIZE = "set_size";
+const std::string NON_SET_KEY = "non_set_key";
+const std::string SET_INTERSECTION = "set_intersection";
+const std::string SET_UNION = "set_union";
+const std::string SET_DIFFERENCE = "set_difference";
+const std::string CLEAR_HASHES = "clear_hashes";
+const std::string DELETE_HASH = "delete_hash";
+const std::string UPSERT_HASH_FIELDS = "upsert_hash_fields";
+const std::string FETCH_HASH_FIELDS = "fetch_hash_fields";
+const std::string FETCH_HASH = "fetch_hash";
+const std::string DELETE_HASH_FIELDS = "delete_hash_fields";
+const std::string HASH_LENGTH = "hash_length";
+
+/*
+    Every query DatabaseManager runs. They are parsed and planned once per connection by prepareStatements 
+    and executed with exec_prepared, so requests only send parameters.
+*/
+static const std::vector<std::pair<std::string, std::string>> PREPARED_STATEMENTS = {
+    {CLEAR_STRINGS, "DELETE FROM " + std::string(STRING_TABLE) + " WHERE store_id = $1"},
+    {SELECT_POLICY, "SELECT policy FROM " + std::string(EVICTION_TABLE) + " WHERE store_id = $1"},
+    {UPDATE_POLICY, "UPDATE " + std::string(EVICTION_TABLE) + " SET policy = $1 WHERE store_id = $2"},
+    {SELECT_EVICTION_CONFIG, "SELECT policy, capacity, maxmemory FROM " + std::string(EVICTION_TABLE) + " WHERE store_id = $1"},
+    // a store without a row gets the default policy, as it would have had anyway
+    {UPSERT_MAXMEMORY, "INSERT INTO " + std::string(EVICTION_TABLE) + " (store_id, policy, maxmemory) VALUES ($1, 'lru', $2) "
+                       "ON CONFLICT (store_id) DO UPDATE SET maxmemory = excluded.maxmemory"},
+    // payload bytes of a live key of any type: the key plus its value, list nodes, set members or hash fields and values; NULL if it does not exist
+    {KEY_MEMORY, "SELECT COALESCE("
+                 "(SELECT octet_length(key) + COALESCE(octet_length(value), 0) FROM " + std::string(STRING_TABLE) + 
+                 " WHERE store_id = $1 AND key = $2 AND (expiration IS NULL OR expiration > $3)), "
+                 "(SELECT octet_length($2::text) + sum(octet_length(node)) FROM " + std::string(LIST_TABLE) + " WHERE store_id = $1 AND key = $2), "
+                 "(SELECT octet_length($2::text) + sum(octet_length(member)) FROM " + std::string(SET_TABLE) + " WHERE store_id = $1 AND key = $2), "
+                 "(SELECT octet_length($2::text) + sum(octet_length(field) + octet_length(value)) FROM " + std::string(HASH_TABLE) + 
+                 " WHERE store_id = $1 AND key = $2))"},
+    {SET_EXPIRATION, "UPDATE " + std::string(STRING_TABLE) + " SET expiration = $1 "
+                     "WHERE store_id = $2 AND key = $3 AND (expiration IS NULL OR expiration > $4)"},
+    {CLEAR_EXPIRATION, "UPDATE " + std::string(STRING_TABLE) + " SET expiration = NULL "
+                       "WHERE store_id = $1 AND key = $2 AND expiration > $3"},
+    {GET_EXPIRATION, "SELECT expiration FROM " + std::string(STRING_TABLE) + 
+                     " WHERE store_id = $1 AND key = $2 AND (expiration IS NULL OR expiration > $3)"},
+    // will clear expiration on update
+    // SET overwrites a key of any type, so a list, set or hash at the key is dropped in the same statement
+    {INSERT_STRING, "WITH dropped AS (DELETE FROM " + std::string(LIST_TABLE) + " WHERE store_id = $1 AND key = $2), "
+                    "dropped_set AS (DELETE FROM " + std::string(SET_TABLE) + " WHERE store_id = $1 AND key = $2), "
+                    "dropped_hash AS (DELETE FROM " + std::string(HASH_TABLE) + " WHERE store_id = $1 AND key = $2) "
+                    "INSERT INTO " + std::string(STRING_TABLE) + " (store_id, key, value) VALUES ($1, $2, $3) "
+                    "ON CONFLICT (store_id, key) DO UPDATE "
+                    "SET value = excluded.value, "
+                    "expiration = NULL"},
+    {DELETE_STRING, "DELETE FROM " + std::string(STRING_TABLE) + " WHERE store_id = $1 AND key = $2"},
+    {FETCH_STRING, "SELECT value FROM " + std::string(STRING_TABLE) + " WHERE store_id = $1 AND key = $2"},
+    {FETCH_LIVE_STRING, "WITH expired AS ("
+                        "DELETE FROM " + std::string(STRING_TABLE) + " WHERE store_id = $1 AND key = $2 AND expiration <= $3"
+                        ") "
+                        "SELECT value, expiration FROM " + std::string(STRING_TABLE) + 
+                        " WHERE store_id = $1 AND key = $2 AND (expiration IS NULL OR expiration > $3)"},
+    {DELETE_STRINGS, "WITH dropped AS (DELETE FROM " + std::string(LIST_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[])), "
+                     "dropped_sets AS (DELETE FROM " + std::string(SET_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[])), "
+                     "dropped_hashes AS (DELETE FROM " + std::string(HASH_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[])) "
+                     "DELETE FROM " + std::string(STRING_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[])"},
+    {UPSERT_STRINGS, "WITH dropped AS (DELETE FROM " + std::string(LIST_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[])), "
+                     "dropped_sets AS (DELETE FROM " + std::string(SET_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[])), "
+                     "dropped_hashes AS (DELETE FROM " + std::string(HASH_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[])) "
+                     "INSERT INTO " + std::string(STRING_TABLE) + " (store_id, key, value) "
+                     "SELECT $1::int, k, v FROM unnest($2::text[], $3::text[]) AS t(k, v) "
+                     "ON CONFLICT (store_id, key) DO UPDATE "
+                     "SET value = excluded.value, "
+                     "expiration = NULL"},
+    {FETCH_LIVE_STRINGS, "WITH expired AS ("
+                         "DELETE FROM " + std::string(STRING_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[]) AND expiration <= $3"
+                         ") "
+                         "SELECT key, value, expiration FROM " + std::string(STRING_TABLE) + 
+                         " WHERE store_id = $1 AND key = ANY($2::text[]) AND (expiration IS NULL OR expiration > $3)"},
+    // DEL removes keys of any type
+    {DELETE_LIVE_KEYS, "WITH deleted AS ("
+                       "DELETE FROM " + std::string(STRING_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[]) RETURNING expiration"
+                       "), deleted_lists AS ("
+                       "DELETE FROM " + std::string(LIST_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[]) RETURNING key"
+                       "), deleted_sets AS ("
+                       "DELETE FROM " + std::string(SET_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[]) RETURNING key"
+                       "), deleted_hashes AS ("
+                       "DELETE FROM " + std::string(HASH_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[]) RETURNING key"
+                       ") "
+                       "SELECT (SELECT count(*) FROM deleted WHERE expiration IS NULL OR expiration > $3) "
+                       "+ (SELECT count(DISTINCT key) FROM deleted_lists) "
+                       "+ (SELECT count(DISTINCT key) FROM deleted_sets) "
+                       "+ (SELECT count(DISTINCT key) FROM deleted_hashes)"},
+    {DELETE_EXPIRED_STRINGS, "DELETE FROM " + std::string(STRING_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[]) AND expiration <= $3"},
+    // a range scan of the partial index on expiration (see README), never a table scan
+    {FETCH_EXPIRED_KEYS, "SELECT store_id, key FROM " + std::string(STRING_TABLE) + 
+                         " WHERE expiration <= $1 ORDER BY expiration LIMIT $2"},
+
+    // lists: one row per quicklist node, ordered by seq; see quicklist.h for the node encoding
+    {CLEAR_LISTS, "DELETE FROM " + std::string(LIST_TABLE) + " WHERE store_id = $1"},
+    // serializes writers of one key for the rest of the transaction, including the first push to a new list
+    {LOCK_KEY, "SELECT pg_advisory_xact_lock($1::int, hashtext($2))"},
+    // the type of a live key: no row if it does not exist
+    {KEY_TYPE, "SELECT 'string' FROM " + std::string(STRING_TABLE) + 
+               " WHERE store_id = $1 AND key = $2 AND (expiration IS NULL OR expiration > $3) "
+               "UNION ALL (SELECT 'list' FROM " + std::string(LIST_TABLE) + " WHERE store_id = $1 AND key = $2 LIMIT 1) "
+               "UNION ALL (SELECT 'set' FROM " + std::string(SET_TABLE) + " WHERE store_id = $1 AND key = $2 LIMIT 1) "
+               "UNION ALL (SELECT 'hash' FROM " + std::string(HASH_TABLE) + " WHERE store_id = $1 AND key = $2 LIMIT 1)"},
+    {LIST_LENGTH, "SELECT COALESCE(SUM(count), 0) FROM " + std::string(LIST_TABLE) + " WHERE store_id = $1 AND key = $2"},
+    {COUNT_COLLECTIONS, "SELECT (SELECT count(DISTINCT key) FROM " + std::string(LIST_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[])) "
+                        "+ (SELECT count(DISTINCT key) FROM " + std::string(SET_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[])) "
+                        "+ (SELECT count(DISTINCT key) FROM " + std::string(HASH_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[]))"},
+    {DELETE_LIST, "DELETE FROM " + std::string(LIST_TABLE) + " WHERE store_id = $1 AND key = $2"},
+    {LIST_HEAD_NODE, "SELECT seq, count, node FROM " + std::string(LIST_TABLE) + 
+                     " WHERE store_id = $1 AND key = $2 ORDER BY seq LIMIT 1"},
+    {LIST_TAIL_NODE, "SELECT seq, count, node FROM " + std::string(LIST_TABLE) + 
+                     " WHERE store_id = $1 AND key = $2 ORDER BY seq DESC LIMIT 1"},
+    // the nodes holding the first $3 elements from each end
+    {LIST_HEAD_NODES, "SELECT seq, count, node FROM ("
+                      "SELECT seq, count, node, SUM(count) OVER (ORDER BY seq) - count AS before FROM " + std::string(LIST_TABLE) + 
+                      " WHERE store_id = $1 AND key = $2"
+                      ") AS t WHERE before < $3 ORDER BY seq"},
+    {LIST_TAIL_NODES, "SELECT seq, count, node FROM ("
+                      "SELECT seq, count, node, SUM(count) OVER (ORDER BY seq DESC) - count AS after FROM " + std::string(LIST_TABLE) + 
+                      " WHERE store_id = $1 AND key = $2"
+                      ") AS t WHERE after < $3 ORDER BY seq DESC"},
+    // the nodes overlapping positions $3..$4, with the position of their first element
+    {LIST_RANGE_NODES, "SELECT before, count, node FROM ("
+                       "SELECT seq, count, node, SUM(count) OVER (ORDER BY seq) - count AS before FROM " + std::string(LIST_TABLE) + 
+                       " WHERE store_id = $1 AND key = $2"
+                       ") AS t WHERE before <= $4 AND before + count > $3 ORDER BY seq"},
+    {UPSERT_LIST_NODES, "INSERT INTO " + std::string(LIST_TABLE) + " (store_id, key, seq, count, node) "
+                        "SELECT $1::int, $2::text, s, c, n FROM unnest($3::bigint[], $4::int[], $5::bytea[]) AS t(s, c, n) "
+                        "ON CONFLICT (store_id, key, seq) DO UPDATE "
+                        "SET count = excluded.count, node = excluded.node"},
+    {DELETE_LIST_NODES, "DELETE FROM " + std::string(LIST_TABLE) + " WHERE store_id = $1 AND key = $2 AND seq = ANY($3::bigint[])"},
+
+    // sets: one row per member
+    {CLEAR_SETS, "DELETE FROM " + std::string(SET_TABLE) + " WHERE store_id = $1"},
+    {DELETE_SET, "DELETE FROM " + std::string(SET_TABLE) + " WHERE store_id = $1 AND key = $2"},
+    // members already present, including repeats within $3, are skipped, so the affected rows are the members added
+    {ADD_SET_MEMBERS, "INSERT INTO " + std::string(SET_TABLE) + " (store_id, key, member) "
+                      "SELECT $1::int, $2::text, m FROM unnest($3::text[]) AS t(m) "
+                      "ON CONFLICT (store_id, key, member) DO NOTHING"},
+    {REMOVE_SET_MEMBERS, "DELETE FROM " + std::string(SET_TABLE) + " WHERE store_id = $1 AND key = $2 AND member = ANY($3::text[])"},
+    {SET_MEMBERS, "SELECT member FROM " + std::string(SET_TABLE) + " WHERE store_id = $1 AND key = $2"},
+    {SET_CONTAINS, "SELECT 1 FROM " + std::string(SET_TABLE) + " WHERE store_id = $1 AND key = $2 AND member = $3"},
+    {SET_SIZE, "SELECT count(*) FROM " + std::string(SET_TABLE) + " WHERE store_id = $1 AND key = $2"},
+    // the first of keys that holds another type, which makes a multi-key set command a type error
+    {NON_SET_KEY, "SELECT key FROM " + std::string(STRING_TABLE) + 
+                  " WHERE store_id = $1 AND key = ANY($2::text[]) AND (expiration IS NULL OR expiration > $3) "
+                  "UNION ALL (SELECT key FROM " + std::string(LIST_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[]) LIMIT 1) "
+                  "UNION ALL (SELECT key FROM " + std::string(HASH_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[]) LIMIT 1) "
+                  "LIMIT 1"},
+    // $3 is the number of keys: a member is in the intersection if every key has a row for it
+    {SET_INTERSECTION, "SELECT member FROM " + std::string(SET_TABLE) + 
+                       " WHERE store_id = $1 AND key = ANY($2::text[]) GROUP BY member HAVING count(*) = $3"},
+    {SET_UNION, "SELECT DISTINCT member FROM " + std::string(SET_TABLE) + " WHERE store_id = $1 AND key = ANY($2::text[])"},
+    {SET_DIFFERENCE, "SELECT member FROM " + std::string(SET_TABLE) + " WHERE store_id = $1 AND key = $2 "
+                     "EXCEPT SELECT member FROM " + std::string(SET_TABLE) + " WHERE store_id = $1 AND key = ANY($3::text[])"},
+
+    // hashes: one row per field, so HSET writes only the fields it changes
+    {CLEAR_HASHES, "DELETE FROM " + std::string(HASH_TABLE) + " WHERE store_id = $1"},
+    {DELETE_HASH, "DELETE FROM " + std::string(HASH_TABLE) + " WHERE store_id = $1 AND key = $2"},
+    // xmax is 0 only for a freshly inserted row, so the result counts the fields that are new
+    {UPSERT_HASH_FIELDS, "WITH written AS ("
+                         "INSERT INTO " + std::string(HASH_TABLE) + " (store_id, key, field, value) "
+                         "SELECT $1::int, $2::text, f, v FROM unnest($3::text[], $4::text[]) AS t(f, v) "
+                         "ON CONFLICT (store_id, key, field) DO UPDATE SET value = excluded.value "
+                         "RETURNING (xmax = 0) AS inserted"
+                         ") "
+                         "SELECT count(*) FILTER (WHERE inserted) FROM written"},
+    {FETCH_HASH_FIELDS, "SELECT field, value FROM " + std::string(HASH_TABLE) + 
+                        " WHERE store_id = $1 AND key = $2 AND field = ANY($3::text[])"},
+    {FETCH_HASH, "SELECT field, value FROM " + std::string(HASH_TABLE) + " WHERE store_id = $1 AND key = $2"},
+    {DELETE_HASH_FIELDS, "DELETE FROM " + std::string(HASH_TABLE) + " WHERE store_id = $1 AND key = $2 AND field = ANY($3::text[])"},
+    {HASH_LENGTH, "SELECT count(*) FROM " + std::string(HASH_TABLE) + " WHERE store_id = $1 AND key = $2"},
+};
+
+void DatabaseManager::prepareStatements(pqxx::connection& connection) {
+    for (const auto& [name, sql] : PREPARED_STATEMENTS) {
+        connection.prepare(name, sql);
+    }
+}
+
+DatabaseManager::DatabaseManager(const std::string& connStr, const size_t poolSize) : connectionString(connStr), poolSize(poolSize) {}
 
 DatabaseManager::~DatabaseManager() {
-    if (conn) {
+    disableWriteBehind();
+    if (pool) {
         disconnect();
     }
 }
 
+/*
+    Create the connection pool. Connections are opened on first use, up to poolSize, 
+    and every one of them gets the prepared statements.
+*/
 void DatabaseManager::connect() {
-    if (!conn) {
-        conn = new pqxx::connection(connectionString);
+    if (!pool) {
+        pool = std::make_unique<ConnectionPool>(connectionString, poolSize, prepareStatements);
+        pool->acquire(); // fail fast if the database is unreachable
     }
 }
 
 void DatabaseManager::disconnect() {
-    if (conn) {
-        delete conn;
-        conn = nullptr;
+    pool.reset();
+}
+
+PoolMetrics DatabaseManager::poolMetrics() const {
+    return pool->metrics();
+}
+
+/*
+    Format values as a Postgres text[] literal, e.g. {"a","b\"c"}, to bind as one parameter.
+*/
+static std::string toArrayLiteral(const std::vector<std::string>& values) {
+    std::string ret = "{";
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i > 0) ret += ',';
+        ret += '"';
+        for (char c : values[i]) {
+            if (c == '"' || c == '\\') ret += '\\';
+            ret += c;
+        }
+        ret += '"';
+    }
+    ret += '}';
+    return ret;
+}
+
+/*
+    The expiration column holds Unix epoch milliseconds, compared against the app server's wall clock.
+*/
+static std::int64_t nowMilliseconds() {
+    return toUnixMilliseconds(currentTime());
+}
+
+static std::optional<ExpirationTime> toExpiration(const pqxx::field& expiration) {
+    if (expiration.is_null()) {
+        return std::nullopt;
+    }
+    return fromUnixMilliseconds(expiration.as<std::int64_t>());
+}
+
+static StringEntry toStringEntry(const pqxx::field& value, const pqxx::field& expiration) {
+    return StringEntry{value.c_str(), toExpiration(expiration)};
+}
+
+static ListNode toListNode(const pqxx::field& count, const pqxx::field& node) {
+    return ListNode(pqxx::binarystring(node).str(), count.as<size_t>());
+}
+
+/*
+    Format bytes as a bytea hex literal, e.g. \x0161, to bind as an element of a bytea[] array literal.
+*/
+static std::string toByteaLiteral(const std::string& bytes) {
+    static constexpr char digits[] = "0123456789abcdef";
+    std::string ret = "\\x";
+    ret.reserve(2 + 2 * bytes.size());
+    for (unsigned char c : bytes) {
+        ret += digits[c >> 4];
+        ret += digits[c & 0xf];
+    }
+    return ret;
+}
+
+/*
+    Write the given nodes of one list with a single multi-row upsert.
+*/
+static void writeListNodes(pqxx::work& txn, const size_t storeId, const std::string& key, const std::vector<std::pair<std::int64_t, ListNode>>& nodes) {
+    std::vector<std::string> seqs, counts, bytes;
+    for (const auto& [seq, node] : nodes) {
+        seqs.push_back(std::to_string(seq));
+        counts.push_back(std::to_string(node.size()));
+        bytes.push_back(toByteaLiteral(node.bytes()));
+    }
+    txn.exec_prepared(UPSERT_LIST_NODES, storeId, key, toArrayLiteral(seqs), toArrayLiteral(counts), toArrayLiteral(bytes));
+}
+
+/*
+    Throw if key holds a type other than the one the command works on. A missing key passes.
+*/
+static void ensureType(pqxx::work& txn, const size_t storeId, const std::string& key, const std::string& type) {
+    for (const auto& row : txn.exec_prepared(KEY_TYPE, storeId, key, nowMilliseconds())) {
+        if (row[0].as<std::string>() != type) {
+            throw TypeMismatchError(key, type);
+        }
+    }
+}
+
+/*
+    Queue SET/DEL instead of committing each one. 
+    Writes to the same key are coalesced and flushed in one transaction per batch, 
+    at most options.durabilityWindow after they were queued or once options.maxPending keys are queued. 
+    Reads through this manager see queued writes; other connections see them only after the flush. 
+    The flusher checks a connection out of the pool for each batch.
+*/
+void DatabaseManager::enableWriteBehind(const WriteBehindOptions& options) {
+    std::unique_lock<std::shared_mutex> lock(writeBehindMutex);
+    writeBehind.reset(); // the old queue is flushed before the new one takes writes
+    writeBehind = std::make_unique<WriteBehindQueue>(options, [this](const PendingWrites& writes) { writeBatch(writes); });
+}
+
+/*
+    Flush any queued writes and go back to committing every SET/DEL immediately.
+    Waits for calls still using the queue, and holds new ones back until the flush is done, so none of them commits ahead of it.
+*/
+void DatabaseManager::disableWriteBehind() {
+    std::unique_lock<std::shared_mutex> lock(writeBehindMutex);
+    writeBehind.reset();
+}
+
+/*
+    Block until every write queued so far is committed. No-op when write-behind is disabled.
+*/
+void DatabaseManager::flush() {
+    std::shared_lock<std::shared_mutex> lock(writeBehindMutex);
+    if (writeBehind) {
+        writeBehind->flush();
     }
 }
 
+/*
+    Group commit: apply a coalesced batch with one multi-row upsert and one multi-key delete per store, in a single transaction.
+*/
+void DatabaseManager::writeBatch(const PendingWrites& writes) {
+    std::map<size_t, std::vector<std::string>> upsertKeys, upsertValues, deleteKeys;
+    for (const auto& [id, value] : writes) {
+        const auto& [storeId, key] = id;
+        if (value) {
+            upsertKeys[storeId].push_back(key);
+            upsertValues[storeId].push_back(*value);
+        } else {
+            deleteKeys[storeId].push_back(key);
+        }
+    }
+
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    for (const auto& [storeId, keys] : deleteKeys) {
+        txn.exec_prepared(DELETE_STRINGS, storeId, toArrayLiteral(keys));
+    }
+    for (const auto& [storeId, keys] : upsertKeys) {
+        txn.exec_prepared(UPSERT_STRINGS, storeId, toArrayLiteral(keys), toArrayLiteral(upsertValues[storeId]));
+    }
+    txn.commit();
+}
+
+/*
+    A key of any type goes in one statement, which deletes it from the string, list, set and hash tables alike. 
+    A queued delete does the same when it is flushed.
+*/
 void DatabaseManager::deleteKey(const size_t storeId, const std::string& key) {
-    deleteString(storeId, key);
-    // deleteList(storeId, key);
-    // deleteSet(storeId, key);
+    {
+        std::shared_lock<std::shared_mutex> lock(writeBehindMutex);
+        if (writeBehind) {
+            writeBehind->remove(storeId, key);
+            return;
+        }
+    }
+
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    txn.exec_prepared(DELETE_STRINGS, storeId, toArrayLiteral(std::vector<std::string>{key}));
+    txn.commit();
 }
 
 void DatabaseManager::clearStore(const size_t storeId) {
+    flush();
+    auto conn = pool->acquire();
     pqxx::work txn(*conn);
-    std::string sqlString = "DELETE FROM " + std::string(STRING_TABLE) + " WHERE store_id = $1";
-    // std::string sqlList = "DELETE FROM " + std::string(LIST_TABLE) + " WHERE store_id = $1";
-    // std::string sqlSet = "DELETE FROM " + std::string(SET_TABLE) + " WHERE store_id = $1";
-
-    txn.exec_params(sqlString, storeId);
-    // txn.exec_params(sqlList, storeId);
-    // txn.exec_params(sqlSet, storeId);
+    txn.exec_prepared(CLEAR_STRINGS, storeId);
+    txn.exec_prepared(CLEAR_LISTS, storeId);
+    txn.exec_prepared(CLEAR_SETS, storeId);
+    txn.exec_prepared(CLEAR_HASHES, storeId);
     txn.commit();
 }
 
 size_t DatabaseManager::changePolicy(const size_t storeId, const std::string& policy) {
     std::string newPolicy = policy;
     std::transform(newPolicy.begin(), newPolicy.end(), newPolicy.begin(), ::tolower);
-    if (newPolicy != "lfu" && newPolicy != "lru") {
+    if (newPolicy != "lfu" && newPolicy != "lru" && newPolicy != "tinylfu") {
         throw std::runtime_error("change to nonexist policy.");
     }
     
-    pqxx::work txn(*conn);
-    std::string sql = "SELECT policy FROM eviction WHERE store_id = $1";
-    pqxx::result res = txn.exec_params(sql, storeId);
-    
-    auto oldPolicy = res[0][0].as<std::string>();
+    {
+        auto conn = pool->acquire();
+        pqxx::work txn(*conn);
+        pqxx::result res = txn.exec_prepared(SELECT_POLICY, storeId);
+        
+        auto oldPolicy = res[0][0].as<std::string>();
 
-    if (oldPolicy == policy) return 0;
+        if (oldPolicy == policy) return 0;
 
-    std::string updateSql = "UPDATE eviction SET policy = $1 WHERE store_id = $2";
-    txn.exec_params(updateSql, newPolicy, storeId);
-    txn.commit();
+        txn.exec_prepared(UPDATE_POLICY, newPolicy, storeId);
+        txn.commit();
+    } // return the connection before clearStore checks out its own
 
     clearStore(storeId); // only clear store if new policy is different from current policy
     return 1;
 }   
 
+std::optional<EvictionConfig> DatabaseManager::getEvictionConfig(const size_t storeId) {
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec_prepared(SELECT_EVICTION_CONFIG, storeId);
+
+    if (res.empty()) {
+        return std::nullopt;
+    }
+
+    auto capacity = res[0][1].is_null() ? DEFAULT_CAPACITY : res[0][1].as<size_t>();
+    auto maxMemory = res[0][2].is_null() ? 0 : res[0][2].as<size_t>();
+    return EvictionConfig{res[0][0].as<std::string>(), capacity, maxMemory};
+}
+
+/*
+    Only saves the budget. The budget bounds the store's cache, which KeyValueStore keeps; the database itself is not limited.
+*/
+void DatabaseManager::setMaxMemory(const size_t storeId, const size_t bytes) {
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    txn.exec_prepared(UPSERT_MAXMEMORY, storeId, bytes);
+    txn.commit();
+}
+
+/*
+    The bytes of key and value data the key holds in its rows, without Postgres' own row and index overhead.
+*/
+std::optional<size_t> DatabaseManager::memoryUsage(const size_t storeId, const std::string& key) {
+    settle(storeId, key);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    auto res = txn.exec_prepared(KEY_MEMORY, storeId, key, nowMilliseconds());
+    txn.commit();
+    if (res[0][0].is_null()) {
+        return std::nullopt;
+    }
+    return res[0][0].as<size_t>();
+}
+
 // bool DatabaseManager::exceedsCapacity(const size_t storeId) {
 //     pqxx::work txn(*conn);
 //     pqxx::result capacity_res = txn.exec_params(
@@ -120,14 +533,11 @@ size_t DatabaseManager::changePolicy(const size_t storeId, const std::string& po
 //     return keyEvicted;
 // }
 
-size_t DatabaseManager::setExpiration(const size_t storeId, const std::string& key, const std::chrono::seconds& sec) {
+size_t DatabaseManager::setExpiration(const size_t storeId, const std::string& key, const ExpirationTime& expiration) {
+    flush(); // the row must be committed, and a queued SET would otherwise clear the expiration afterwards
+    auto conn = pool->acquire();
     pqxx::work txn(*conn);
-    
-    auto expirationTime = std::chrono::steady_clock::now() + sec;
-    auto expirationSeconds = std::chrono::duration_cast<std::chrono::seconds>(expirationTime.time_since_epoch()).count();
-    
-    std::string sql = "UPDATE strings SET expiration = $1 WHERE store_id = $2 AND key = $3";
-    pqxx::result res = txn.exec_params(sql, expirationSeconds, storeId, key);
+    pqxx::result res = txn.exec_prepared(SET_EXPIRATION, toUnixMilliseconds(expiration), storeId, key, nowMilliseconds());
     txn.commit();
     
     if (res.affected_rows() == 0) {
@@ -136,52 +546,77 @@ size_t DatabaseManager::setExpiration(const size_t storeId, const std::string& k
     return 1;
 }
 
-std::optional<std::chrono::steady_clock::time_point> DatabaseManager::getExpiration(const size_t storeId, const std::string& key, const std::string& type) {
+/*
+    Integer reply: 1 if the key was live and had an expiration, which is now removed; 0 otherwise.
+*/
+size_t DatabaseManager::clearExpiration(const size_t storeId, const std::string& key) {
+    flush(); // a queued SET has already cleared the expiration, but its row must be committed before the update
+    auto conn = pool->acquire();
     pqxx::work txn(*conn);
+    pqxx::result res = txn.exec_prepared(CLEAR_EXPIRATION, storeId, key, nowMilliseconds());
+    txn.commit();
+    return res.affected_rows() == 0 ? 0 : 1;
+}
 
-    std::string sql = "SELECT expiration FROM strings WHERE store_id = $1 AND key = $2";
-    pqxx::result res = txn.exec_params(sql, storeId, key);
-
-    if (res.empty() || res[0][0].is_null()) {
-        return std::nullopt;
+std::optional<std::optional<ExpirationTime>> DatabaseManager::getExpiration(const size_t storeId, const std::string& key) {
+    if (auto queued = pending(storeId, key)) {
+        // a queued SET clears the expiration and a queued DEL removes the key
+        if (!*queued) return std::nullopt;
+        return std::make_optional(std::optional<ExpirationTime>());
     }
 
-    auto expirationSeconds = res[0][0].as<std::int64_t>();
-    auto expirationDuration = std::chrono::seconds(expirationSeconds);
-    auto expirationTime = std::chrono::steady_clock::time_point(expirationDuration);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec_prepared(GET_EXPIRATION, storeId, key, nowMilliseconds());
+    txn.commit();
 
-    return expirationTime;
+    if (res.empty()) {
+        return std::nullopt;
+    }
+    return toExpiration(res[0][0]);
 }
 
 // will clear expiration on update
 void DatabaseManager::insertString(const size_t storeId, const std::string& key, const std::string& value) {
+    {
+        std::shared_lock<std::shared_mutex> lock(writeBehindMutex);
+        if (writeBehind) {
+            writeBehind->put(storeId, key, value);
+            return;
+        }
+    }
+
+    auto conn = pool->acquire();
     pqxx::work txn(*conn);
-    txn.exec0("INSERT INTO strings (store_id, key, value) VALUES (" 
-                + std::to_string(storeId) + ", "
-                + txn.quote(key) + ", "
-                + txn.quote(value) + ") "
-                "ON CONFLICT (store_id, key) DO UPDATE "
-                "SET value = excluded.value, "
-                "expiration = NULL;");
+    txn.exec_prepared(INSERT_STRING, storeId, key, value);
     txn.commit();
 }
 
 void DatabaseManager::deleteString(const size_t storeId, const std::string& key) {
+    {
+        std::shared_lock<std::shared_mutex> lock(writeBehindMutex);
+        if (writeBehind) {
+            writeBehind->remove(storeId, key);
+            return;
+        }
+    }
+
+    auto conn = pool->acquire();
     pqxx::work txn(*conn);
-    std::string sql_string = "DELETE FROM " + std::string(STRING_TABLE) + " WHERE store_id = $1 AND key = $2;";
     // TODO: delete from eviction
 
-    txn.exec_params(sql_string, storeId, key);
+    txn.exec_prepared(DELETE_STRING, storeId, key);
     txn.commit();
 }
 
 std::optional<std::string> DatabaseManager::fetchString(const size_t storeId, const std::string& key) {
+    if (auto queued = pending(storeId, key)) {
+        return *queued;
+    }
+
+    auto conn = pool->acquire();
     pqxx::work txn(*conn);
-    pqxx::result res = txn.exec(
-        "SELECT value FROM " + std::string(STRING_TABLE) + 
-        " WHERE store_id = " + std::to_string(storeId) + 
-        " AND key = " + txn.quote(key)
-    );
+    pqxx::result res = txn.exec_prepared(FETCH_STRING, storeId, key);
     txn.commit();
     if (!res.empty()) {
         return res[0][0].c_str();
@@ -189,3 +624,534 @@ std::optional<std::string> DatabaseManager::fetchString(const size_t storeId, co
         return std::nullopt;
     }
 }
+
+/*
+    Fetch a value and its expiration in one round trip. 
+    Expired rows are filtered out by the server and deleted in the same statement, 
+    so the caller never sees an expired key and does not need a separate DELETE.
+*/
+std::optional<StringEntry> DatabaseManager::fetchLiveString(const size_t storeId, const std::string& key) {
+    if (auto queued = pending(storeId, key)) {
+        if (!*queued) return std::nullopt;
+        return StringEntry{**queued, std::nullopt};
+    }
+
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec_prepared(FETCH_LIVE_STRING, storeId, key, nowMilliseconds());
+    txn.commit();
+
+    if (res.empty()) {
+        return std::nullopt;
+    }
+    return toStringEntry(res[0][0], res[0][1]);
+}
+
+/*
+    Batch version of fetchLiveString: one round trip for all keys, results in the order of keys.
+*/
+std::vector<std::optional<StringEntry>> DatabaseManager::fetchLiveStrings(const size_t storeId, const std::vector<std::string>& keys) {
+    std::vector<std::optional<StringEntry>> ret(keys.size());
+    std::unordered_map<std::string, std::vector<size_t>> positions;
+    std::vector<std::string> missing;
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (auto queued = pending(storeId, keys[i])) {
+            if (*queued) ret[i] = StringEntry{**queued, std::nullopt};
+            continue;
+        }
+
+        auto& keyPositions = positions[keys[i]];
+        if (keyPositions.empty()) missing.push_back(keys[i]);
+        keyPositions.push_back(i);
+    }
+
+    if (missing.empty()) {
+        return ret;
+    }
+
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec_prepared(FETCH_LIVE_STRINGS, storeId, toArrayLiteral(missing), nowMilliseconds());
+    txn.commit();
+
+    for (const auto& row : res) {
+        auto entry = toStringEntry(row[1], row[2]);
+        for (auto i : positions[row[0].c_str()]) {
+            ret[i] = entry;
+        }
+    }
+    return ret;
+}
+
+/*
+    Batch version of insertString: one multi-row upsert for all pairs. Keys must be distinct.
+*/
+void DatabaseManager::insertStrings(const size_t storeId, const std::vector<std::string>& keys, const std::vector<std::string>& values) {
+    {
+        std::shared_lock<std::shared_mutex> lock(writeBehindMutex);
+        if (writeBehind) {
+            for (size_t i = 0; i < keys.size(); ++i) {
+                writeBehind->put(storeId, keys[i], values[i]);
+            }
+            return;
+        }
+    }
+
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    txn.exec_prepared(UPSERT_STRINGS, storeId, toArrayLiteral(keys), toArrayLiteral(values));
+    txn.commit();
+}
+
+/*
+    DEL: keys of every type in one statement for all keys. Keys must be distinct. 
+    Returns the number of keys that existed, not counting keys that had already expired.
+*/
+size_t DatabaseManager::deleteKeys(const size_t storeId, const std::vector<std::string>& keys) {
+    if (writeBehindEnabled()) {
+        // a queued DEL drops lists, sets and hashes along with strings when it is flushed (see DELETE_STRINGS)
+        auto existing = fetchLiveStrings(storeId, keys);
+        size_t collections;
+        {
+            auto conn = pool->acquire();
+            pqxx::work txn(*conn);
+            collections = txn.exec_prepared(COUNT_COLLECTIONS, storeId, toArrayLiteral(keys))[0][0].as<size_t>();
+            txn.commit();
+        }
+        for (const auto& key : keys) {
+            deleteKey(storeId, key); // deleted at once instead if write-behind was disabled meanwhile
+        }
+        return collections + std::count_if(existing.begin(), existing.end(), [](const auto& entry) { return entry.has_value(); });
+    }
+
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec_prepared(DELETE_LIVE_KEYS, storeId, toArrayLiteral(keys), nowMilliseconds());
+    txn.commit();
+    return res[0][0].as<size_t>();
+}
+
+/*
+    Used by the active expirer. The expiration is checked in the same statement, so a key that was overwritten, 
+    deleted or given a later TTL since its timer was set is left alone. 
+    A queued write-behind SET to an expired key still lands after this delete, so queued writes need no special handling.
+*/
+size_t DatabaseManager::deleteExpiredStrings(const size_t storeId, const std::vector<std::string>& keys) {
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec_prepared(DELETE_EXPIRED_STRINGS, storeId, toArrayLiteral(keys), nowMilliseconds());
+    txn.commit();
+    return res.affected_rows();
+}
+
+std::vector<std::pair<size_t, std::string>> DatabaseManager::fetchExpiredKeys(const size_t limit) {
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec_prepared(FETCH_EXPIRED_KEYS, nowMilliseconds(), limit);
+    txn.commit();
+
+    std::vector<std::pair<size_t, std::string>> ret;
+    ret.reserve(res.size());
+    for (const auto& row : res) {
+        ret.emplace_back(row[0].as<size_t>(), row[1].as<std::string>());
+    }
+    return ret;
+}
+
+/*
+    List, set and hash commands see queued write-behind SET/DEL to their key, which would replace or delete the value, only after a flush.
+*/
+void DatabaseManager::settle(const size_t storeId, const std::string& key) {
+    if (pending(storeId, key)) {
+        flush();
+    }
+}
+
+/*
+    Helper function to read the write queued for a key, if write-behind is enabled. Each call takes writeBehindMutex on its own,
+    so methods that go on to call others (which take it again) never hold it themselves.
+*/
+std::optional<std::optional<std::string>> DatabaseManager::pending(const size_t storeId, const std::string& key) const {
+    std::shared_lock<std::shared_mutex> lock(writeBehindMutex);
+    return writeBehind ? writeBehind->pending(storeId, key) : std::nullopt;
+}
+
+bool DatabaseManager::writeBehindEnabled() const {
+    std::shared_lock<std::shared_mutex> lock(writeBehindMutex);
+    return writeBehind != nullptr;
+}
+
+void DatabaseManager::deleteList(const size_t storeId, const std::string& key) {
+    {
+        std::shared_lock<std::shared_mutex> lock(writeBehindMutex);
+        if (writeBehind) {
+            writeBehind->remove(storeId, key);
+            return;
+        }
+    }
+
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    txn.exec_prepared(DELETE_LIST, storeId, key);
+    txn.commit();
+}
+
+/*
+    Only the end node is read. Values go into it while they fit and then into new nodes beyond it, 
+    and every node that changed is written back with one upsert. Returns the length after the push.
+*/
+size_t DatabaseManager::listPush(const size_t storeId, const std::string& key, const std::vector<std::string>& values, const ListEnd end) {
+    settle(storeId, key);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    txn.exec_prepared(LOCK_KEY, storeId, key);
+    pqxx::result res = txn.exec_prepared(end == ListEnd::HEAD ? LIST_HEAD_NODE : LIST_TAIL_NODE, storeId, key);
+
+    std::vector<std::pair<std::int64_t, ListNode>> nodes;
+    size_t untouched = 0;
+    if (res.empty()) {
+        ensureType(txn, storeId, key, "list");
+        nodes.emplace_back(0, ListNode());
+    } else {
+        nodes.emplace_back(res[0][0].as<std::int64_t>(), toListNode(res[0][1], res[0][2]));
+        untouched = nodes.back().second.size();
+    }
+
+    const std::int64_t step = end == ListEnd::HEAD ? -1 : 1;
+    for (const auto& value : values) {
+        if (!nodes.back().second.fits(value.size())) {
+            auto seq = nodes.back().first + step;
+            nodes.emplace_back(seq, ListNode());
+        }
+        if (end == ListEnd::HEAD) {
+            nodes.back().second.pushFront(value);
+        } else {
+            nodes.back().second.pushBack(value);
+        }
+    }
+
+    if (nodes.front().second.size() == untouched) {
+        nodes.erase(nodes.begin());
+    }
+    writeListNodes(txn, storeId, key, nodes);
+    pqxx::result length = txn.exec_prepared(LIST_LENGTH, storeId, key);
+    txn.commit();
+    return length[0][0].as<size_t>();
+}
+
+/*
+    Reads only the nodes holding the popped elements. Emptied nodes are deleted and a partly popped one is rewritten, 
+    so the key disappears with its last element.
+*/
+std::vector<std::string> DatabaseManager::listPop(const size_t storeId, const std::string& key, const size_t count, const ListEnd end) {
+    settle(storeId, key);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    txn.exec_prepared(LOCK_KEY, storeId, key);
+    pqxx::result res = txn.exec_prepared(end == ListEnd::HEAD ? LIST_HEAD_NODES : LIST_TAIL_NODES, storeId, key, count);
+
+    std::vector<std::string> ret;
+    if (res.empty()) {
+        ensureType(txn, storeId, key, "list");
+        txn.commit();
+        return ret;
+    }
+
+    std::vector<std::string> emptied;
+    std::vector<std::pair<std::int64_t, ListNode>> changed;
+    for (const auto& row : res) {
+        auto node = toListNode(row[1], row[2]);
+        while (ret.size() < count && !node.empty()) {
+            ret.push_back(end == ListEnd::HEAD ? node.popFront() : node.popBack());
+        }
+        if (node.empty()) {
+            emptied.push_back(row[0].c_str());
+        } else {
+            changed.emplace_back(row[0].as<std::int64_t>(), std::move(node));
+        }
+    }
+
+    if (!emptied.empty()) {
+        txn.exec_prepared(DELETE_LIST_NODES, storeId, key, toArrayLiteral(emptied));
+    }
+    if (!changed.empty()) {
+        writeListNodes(txn, storeId, key, changed);
+    }
+    txn.commit();
+    return ret;
+}
+
+/*
+    Reads only the nodes overlapping the range, in order, and copies the wanted elements out of each.
+*/
+std::vector<std::string> DatabaseManager::listRange(const size_t storeId, const std::string& key, const std::int64_t start, const std::int64_t stop) {
+    settle(storeId, key);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    auto length = txn.exec_prepared(LIST_LENGTH, storeId, key)[0][0].as<size_t>();
+
+    std::vector<std::string> ret;
+    if (length == 0) {
+        ensureType(txn, storeId, key, "list");
+        txn.commit();
+        return ret;
+    }
+
+    auto range = resolveListRange(start, stop, length);
+    if (!range) {
+        txn.commit();
+        return ret;
+    }
+    auto [first, last] = *range;
+    pqxx::result res = txn.exec_prepared(LIST_RANGE_NODES, storeId, key, first, last);
+    txn.commit();
+
+    ret.reserve(last - first + 1);
+    for (const auto& row : res) {
+        auto before = row[0].as<size_t>();
+        auto node = toListNode(row[1], row[2]);
+        auto from = std::max(first, before);
+        auto to = std::min(last, before + node.size() - 1);
+        node.copy(from - before, to - from + 1, ret);
+    }
+    return ret;
+}
+
+size_t DatabaseManager::listLength(const size_t storeId, const std::string& key) {
+    settle(storeId, key);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    auto length = txn.exec_prepared(LIST_LENGTH, storeId, key)[0][0].as<size_t>();
+    if (length == 0) {
+        ensureType(txn, storeId, key, "list");
+    }
+    txn.commit();
+    return length;
+}
+
+void DatabaseManager::deleteSet(const size_t storeId, const std::string& key) {
+    {
+        std::shared_lock<std::shared_mutex> lock(writeBehindMutex);
+        if (writeBehind) {
+            writeBehind->remove(storeId, key);
+            return;
+        }
+    }
+
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    txn.exec_prepared(DELETE_SET, storeId, key);
+    txn.commit();
+}
+
+/*
+    All members are inserted with one statement. Members are stored as plain rows: 
+    the packed integer encoding only pays off in memory, where it replaces a hash node per member.
+*/
+size_t DatabaseManager::setAdd(const size_t storeId, const std::string& key, const std::vector<std::string>& members) {
+    settle(storeId, key);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    txn.exec_prepared(LOCK_KEY, storeId, key);
+    ensureType(txn, storeId, key, "set");
+    pqxx::result res = txn.exec_prepared(ADD_SET_MEMBERS, storeId, key, toArrayLiteral(members));
+    txn.commit();
+    return res.affected_rows();
+}
+
+size_t DatabaseManager::setRemove(const size_t storeId, const std::string& key, const std::vector<std::string>& members) {
+    settle(storeId, key);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec_prepared(REMOVE_SET_MEMBERS, storeId, key, toArrayLiteral(members));
+    if (res.affected_rows() == 0) {
+        ensureType(txn, storeId, key, "set");
+    }
+    txn.commit();
+    return res.affected_rows();
+}
+
+std::vector<std::string> DatabaseManager::setMembers(const size_t storeId, const std::string& key) {
+    settle(storeId, key);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec_prepared(SET_MEMBERS, storeId, key);
+    if (res.empty()) {
+        ensureType(txn, storeId, key, "set");
+    }
+    txn.commit();
+
+    std::vector<std::string> ret;
+    ret.reserve(res.size());
+    for (const auto& row : res) {
+        ret.push_back(row[0].as<std::string>());
+    }
+    return ret;
+}
+
+bool DatabaseManager::setContains(const size_t storeId, const std::string& key, const std::string& member) {
+    settle(storeId, key);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec_prepared(SET_CONTAINS, storeId, key, member);
+    if (res.empty()) {
+        ensureType(txn, storeId, key, "set");
+    }
+    txn.commit();
+    return !res.empty();
+}
+
+size_t DatabaseManager::setSize(const size_t storeId, const std::string& key) {
+    settle(storeId, key);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    auto size = txn.exec_prepared(SET_SIZE, storeId, key)[0][0].as<size_t>();
+    if (size == 0) {
+        ensureType(txn, storeId, key, "set");
+    }
+    txn.commit();
+    return size;
+}
+
+/*
+    Computed by the server in one statement, so no member crosses the network unless it is in the result. 
+    The planner picks the join order from the table statistics, in place of the smallest-first walk of InMemoryEngine.
+*/
+std::vector<std::string> DatabaseManager::setCombine(const size_t storeId, const std::vector<std::string>& keys, const SetOperation operation) {
+    std::vector<std::string> ret;
+    if (keys.empty()) {
+        return ret;
+    }
+    for (const auto& key : keys) {
+        settle(storeId, key);
+    }
+
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    pqxx::result wrongType = txn.exec_prepared(NON_SET_KEY, storeId, toArrayLiteral(keys), nowMilliseconds());
+    if (!wrongType.empty()) {
+        throw TypeMismatchError(wrongType[0][0].as<std::string>(), "set");
+    }
+
+    pqxx::result res;
+    if (operation == SetOperation::INTERSECTION) {
+        res = txn.exec_prepared(SET_INTERSECTION, storeId, toArrayLiteral(keys), keys.size());
+    } else if (operation == SetOperation::UNION) {
+        res = txn.exec_prepared(SET_UNION, storeId, toArrayLiteral(keys));
+    } else {
+        std::vector<std::string> others(keys.begin() + 1, keys.end());
+        res = txn.exec_prepared(SET_DIFFERENCE, storeId, keys.front(), toArrayLiteral(others));
+    }
+    txn.commit();
+
+    ret.reserve(res.size());
+    for (const auto& row : res) {
+        ret.push_back(row[0].as<std::string>());
+    }
+    return ret;
+}
+
+void DatabaseManager::deleteHash(const size_t storeId, const std::string& key) {
+    {
+        std::shared_lock<std::shared_mutex> lock(writeBehindMutex);
+        if (writeBehind) {
+            writeBehind->remove(storeId, key);
+            return;
+        }
+    }
+
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    txn.exec_prepared(DELETE_HASH, storeId, key);
+    txn.commit();
+}
+
+/*
+    Only the given fields are written, with one multi-row upsert, instead of rewriting the whole object.
+*/
+size_t DatabaseManager::hashSet(const size_t storeId, const std::string& key, const std::vector<std::pair<std::string, std::string>>& fields) {
+    std::vector<std::string> names, values;
+    for (const auto& [field, value] : fields) {
+        names.push_back(field);
+        values.push_back(value);
+    }
+
+    settle(storeId, key);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    txn.exec_prepared(LOCK_KEY, storeId, key);
+    ensureType(txn, storeId, key, "hash");
+    auto added = txn.exec_prepared(UPSERT_HASH_FIELDS, storeId, key, toArrayLiteral(names), toArrayLiteral(values))[0][0].as<size_t>();
+    txn.commit();
+    return added;
+}
+
+/*
+    All fields are fetched in one round trip, results in the order of fields.
+*/
+std::vector<std::optional<std::string>> DatabaseManager::hashGet(const size_t storeId, const std::string& key, const std::vector<std::string>& fields) {
+    settle(storeId, key);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec_prepared(FETCH_HASH_FIELDS, storeId, key, toArrayLiteral(fields));
+    if (res.empty()) {
+        ensureType(txn, storeId, key, "hash");
+    }
+    txn.commit();
+
+    std::unordered_map<std::string, std::string> values;
+    for (const auto& row : res) {
+        values.emplace(row[0].as<std::string>(), row[1].as<std::string>());
+    }
+    std::vector<std::optional<std::string>> ret(fields.size());
+    for (size_t i = 0; i < fields.size(); ++i) {
+        auto it = values.find(fields[i]);
+        if (it != values.end()) {
+            ret[i] = it->second;
+        }
+    }
+    return ret;
+}
+
+std::vector<std::pair<std::string, std::string>> DatabaseManager::hashGetAll(const size_t storeId, const std::string& key) {
+    settle(storeId, key);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec_prepared(FETCH_HASH, storeId, key);
+    if (res.empty()) {
+        ensureType(txn, storeId, key, "hash");
+    }
+    txn.commit();
+
+    std::vector<std::pair<std::string, std::string>> ret;
+    ret.reserve(res.size());
+    for (const auto& row : res) {
+        ret.emplace_back(row[0].as<std::string>(), row[1].as<std::string>());
+    }
+    return ret;
+}
+
+size_t DatabaseManager::hashDelete(const size_t storeId, const std::string& key, const std::vector<std::string>& fields) {
+    settle(storeId, key);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec_prepared(DELETE_HASH_FIELDS, storeId, key, toArrayLiteral(fields));
+    if (res.affected_rows() == 0) {
+        ensureType(txn, storeId, key, "hash");
+    }
+    txn.commit();
+    return res.affected_rows();
+}
+
+size_t DatabaseManager::hashLength(const size_t storeId, const std::string& key) {
+    settle(storeId, key);
+    auto conn = pool->acquire();
+    pqxx::work txn(*conn);
+    auto length = txn.exec_prepared(HASH_LENGTH, storeId, key)[0][0].as<size_t>();
+    if (length == 0) {
+        ensureType(txn, storeId, key, "hash");
+    }
+    txn.commit();
+    return length;
+}
@@ -0,0 +1,14 @@
+#include "eviction_policy.h"
+#include "lru.h"
+#include "lfu.h"
+#include "tiny_lfu.h"
+
+std::unique_ptr<EvictionPolicy> makeEvictionPolicy(const std::string& policy, const size_t capacity) {
+    if (policy == "lfu") {
+        return std::make_unique<LFU>();
+    }
+    if (policy == "tinylfu") {
+        return std::make_unique<TinyLFU>(capacity);
+    }
+    return std::make_unique<LRU>();
+}
@@ -0,0 +1,1682 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include "in_memory_engine.h"
+#include "memory_usage.h"
+
+enum class InMemoryEngine::LogOp : uint8_t {
+    SHARDS,    // shard count
+    CONFIG,    // policy, capacity, maxMemory
+    RESET,     // shard: the store's part of it was dropped
+    SET,       // key, value
+    DEL,       // key
+    EXPIRE_AT, // key, Unix epoch milliseconds
+    PERSIST,   // key
+    PUSH_HEAD, // key, values
+    PUSH_TAIL,
+    POP_HEAD,  // key, count
+    POP_TAIL,
+    SADD,      // key, members
+    SREM,
+    HSET,      // key, field/value pairs
+    HDEL,      // key, fields
+};
+
+constexpr size_t REWRITE_BATCH = 512; // elements per record when a rewrite copies out a collection
+
+static void put(std::string& out, const uint64_t value) {
+    putInteger(out, value);
+}
+
+static void put(std::string& out, std::string_view bytes) {
+    putBytes(out, bytes);
+}
+
+static void put(std::string& out, const std::vector<std::string>& values) {
+    putInteger(out, values.size());
+    for (const auto& value : values) {
+        putBytes(out, value);
+    }
+}
+
+static void put(std::string& out, const std::vector<std::pair<std::string, std::string>>& pairs) {
+    putInteger(out, pairs.size());
+    for (const auto& [first, second] : pairs) {
+        putBytes(out, first);
+        putBytes(out, second);
+    }
+}
+
+/*
+    Helper function to build a record payload: the operation, the store and the operation's arguments.
+*/
+template <typename Op, typename... Args>
+static void encode(std::string& out, const Op op, const size_t storeId, const Args&... args) {
+    out.push_back(static_cast<char>(op));
+    putInteger(out, storeId);
+    (put(out, args), ...);
+}
+
+static std::vector<std::string> readStrings(LogReader& reader) {
+    std::vector<std::string> ret(reader.integer());
+    for (auto& value : ret) {
+        value = reader.bytes();
+    }
+    return ret;
+}
+
+static std::vector<std::pair<std::string, std::string>> readPairs(LogReader& reader) {
+    std::vector<std::pair<std::string, std::string>> ret(reader.integer());
+    for (auto& [first, second] : ret) {
+        first = reader.bytes();
+        second = reader.bytes();
+    }
+    return ret;
+}
+
+// the sequence number of the last record this thread logged
+static thread_local uint64_t loggedSeq = 0;
+
+/*
+    Declared before a mutating method takes its shard lock. Refuses the write up front while the log is failing,
+    and with FsyncPolicy::ALWAYS, commit waits until every record the method logged is on disk and throws if writing them failed,
+    so the caller never reports a write that is not durable. Writers waiting at once share the same fsync, which is what makes
+    the commit a group commit; a method that returns early, before logging anything, does not need to commit.
+*/
+class DurableWrite {
+    public:
+        explicit DurableWrite(AppendOnlyLog* log) : log(log) {
+            loggedSeq = 0;
+            if (log) log->throwIfFailed();
+        }
+
+        void commit() {
+            if (log && loggedSeq) log->waitForSync(loggedSeq);
+        }
+
+        // releases the shard lock first, so writers to the same shard do not queue behind the fsync
+        void commit(std::unique_lock<std::mutex>& lock) {
+            lock.unlock();
+            commit();
+        }
+
+    private:
+        AppendOnlyLog* log;
+};
+
+/*
+    The policy is sized for the keys one shard is expected to hold, expectedKeys.
+*/
+InMemoryEngine::Store::Store(const size_t id, const size_t shard, const EvictionConfig& config, const size_t expectedKeys,
+                             std::shared_ptr<StoreTotals> totals)
+    : id(id), shard(shard), capacity(config.capacity), maxMemory(config.maxMemory), totals(std::move(totals)),
+      evictionPolicy(makeEvictionPolicy(config.policy, expectedKeys)) {}
+
+InMemoryEngine::Store::~Store() {
+    totals->keys -= countedKeys;
+    totals->bytes -= countedBytes;
+}
+
+/*
+    Defaults to twice the number of hardware threads, so two threads rarely want the same shard.
+*/
+InMemoryEngine::InMemoryEngine(const size_t shardCount)
+    : shards(std::bit_ceil(shardCount ? shardCount : 2 * std::max(1u, std::thread::hardware_concurrency()))),
+      shardBits(std::countr_zero(shards.size())) {}
+
+InMemoryEngine::~InMemoryEngine() {
+    disableLog();
+    // a save that is still running is finished, not abandoned
+    if (saver.joinable()) {
+        saver.join();
+    }
+}
+
+/*
+    Helper function to log a mutation. Must be called before the mutation is applied, with its shard locked;
+    store-wide records (partition shards.size()) are logged with configMutex held instead.
+*/
+template <typename... Args>
+void InMemoryEngine::log(const size_t partition, const LogOp op, const size_t storeId, const Args&... args) {
+    if (!appendLog) {
+        return;
+    }
+    thread_local std::string payload;
+    payload.clear();
+    encode(payload, op, storeId, args...);
+    loggedSeq = appendLog->append(partition, payload);
+}
+
+/*
+    Helper function to pick the shard of a key. 
+    RecordTable indexes slots with the low bits of the key hash, so the shard is taken from the high bits of a 
+    Fibonacci-mixed hash instead; otherwise every key in a shard would share its low bits and crowd the same slots.
+*/
+InMemoryEngine::Shard& InMemoryEngine::shardFor(const size_t storeId, const KeyView key) {
+    if (shardBits == 0) {
+        return shards[0];
+    }
+    uint64_t hash = (key.hash() ^ storeId) * 0x9E3779B97F4A7C15ull;
+    return shards[hash >> (64 - shardBits)];
+}
+
+/*
+    The config of a store until its policy or budget is changed: LRU with no key capacity. Unlike the postgres backend's cache,
+    the engine is the store itself, so a capacity would evict data rather than cached copies of it.
+*/
+static EvictionConfig defaultConfig() {
+    return EvictionConfig{"lru", InMemoryEngine::NO_CAPACITY};
+}
+
+/*
+    Helper function to get the eviction config of a store.
+*/
+EvictionConfig InMemoryEngine::configFor(const size_t storeId) {
+    std::lock_guard<std::mutex> lock(configMutex);
+    auto it = configs.find(storeId);
+    return it != configs.end() ? it->second : defaultConfig();
+}
+
+/*
+    Helper function to get a store's part of a shard, creating it on first use with the store's config and its totals over
+    every shard. Must be called with the shard's mutex held.
+*/
+InMemoryEngine::Store& InMemoryEngine::storeIn(Shard& shard, const size_t storeId) {
+    auto it = shard.stores.find(storeId);
+    if (it == shard.stores.end()) {
+        auto config = configFor(storeId);
+        std::shared_ptr<StoreTotals> storeTotals;
+        {
+            std::lock_guard<std::mutex> lock(configMutex);
+            auto& total = totals[storeId];
+            if (!total) {
+                total = std::make_shared<StoreTotals>();
+            }
+            storeTotals = total;
+        }
+        // a store without a capacity is sized for the default one, and its tables grow from there
+        auto expectedKeys = (config.capacity != NO_CAPACITY ? config.capacity : DEFAULT_CAPACITY) / shards.size() + 1;
+        it = shard.stores.try_emplace(storeId, storeId, &shard - shards.data(), config, expectedKeys, std::move(storeTotals)).first;
+    }
+    return it->second;
+}
+
+/*
+    Helper function to drop every key of a store. Each shard recreates its part from the current config on next use.
+*/
+void InMemoryEngine::resetStore(const size_t storeId) {
+    for (size_t i = 0; i < shards.size(); ++i) {
+        std::lock_guard<std::mutex> lock(shards[i].mutex);
+        if (shards[i].stores.contains(storeId)) {
+            log(i, LogOp::RESET, storeId, i);
+            shards[i].stores.erase(storeId);
+        }
+    }
+}
+
+static std::optional<ExpirationTime> toExpiration(const Record& record) {
+    if (record.expiration == Record::NO_EXPIRATION) {
+        return std::nullopt;
+    }
+    return fromUnixMilliseconds(record.expiration);
+}
+
+static StringEntry toStringEntry(const Record& record) {
+    return StringEntry{std::string(record.value()), toExpiration(record)};
+}
+
+/*
+    Helper function to find a key that has not expired. An expired key is removed as part of the lookup.
+    While the log is replayed nothing expires: the log has a DEL wherever a key did.
+*/
+Record* InMemoryEngine::findLive(Store& store, const KeyView key) {
+    auto record = store.records.find(key);
+    if (record && !loading && record->expired(currentTime())) {
+        logAndRemove(store, key);
+        return nullptr;
+    }
+    return record;
+}
+
+/*
+    Helper function to set a key, clearing any expiration. 
+    A new key is added before eviction, so with LFU or TinyLFU a full store may evict the key just inserted.
+*/
+void InMemoryEngine::insert(Store& store, const KeyView key, const std::string& value) {
+    // SET overwrites a key of any type
+    if (holdsCollection(store, key)) {
+        remove(store, key);
+    }
+
+    bool inserted = store.records.upsert(key, value, Record::NO_EXPIRATION, [&store, &key](const Record& moved) {
+        store.evictionPolicy->keyMoved(KeyView(moved.key(), key.hash()));
+    });
+    accessed(store, inserted ? KeyView(store.records.find(key)->key(), key.hash()) : key);
+}
+
+/*
+    Helper function to record an access to a key of any type, evicting keys if the store is now over capacity or over budget.
+    For a new key, key must view the store's own copy of it: the policy keeps that view as the key's handle.
+*/
+void InMemoryEngine::accessed(Store& store, const KeyView key) {
+    store.evictionPolicy->keyAccessed(key);
+    evictOverBudget(store);
+}
+
+size_t InMemoryEngine::keyCount(const Store& store) {
+    return store.records.size() + store.lists.size() + store.sets.size() + store.hashes.size();
+}
+
+/*
+    Helper function to bring the store-wide key and byte counts up to date with this part. Called wherever the part may have
+    grown or shrunk; the part's own counts are exact, so the store-wide ones are off only between a change and the next recount.
+    Each difference wraps around for a part that shrank, which the atomic addition undoes.
+*/
+void InMemoryEngine::recount(Store& store) {
+    auto count = keyCount(store);
+    store.totals->keys += count - store.countedKeys;
+    store.countedKeys = count;
+    auto bytes = usedMemory(store);
+    store.totals->bytes += bytes - store.countedBytes;
+    store.countedBytes = bytes;
+}
+
+size_t InMemoryEngine::usedMemory(const Store& store) {
+    return store.records.memoryUsage() + store.collectionBytes + bucketBytes(store.lists) + bucketBytes(store.sets)
+        + bucketBytes(store.hashes) + store.evictionPolicy->memoryUsage();
+}
+
+/*
+    Helper function to check the store-wide counts, as of the last recount, against the store's capacity and byte budget.
+*/
+bool InMemoryEngine::overBudget(const Store& store) {
+    return store.totals->keys > store.capacity || (store.maxMemory && store.totals->bytes > store.maxMemory);
+}
+
+/*
+    Helper function to evict the key the store's policy picks. Must be called with the store's shard locked.
+*/
+void InMemoryEngine::evictOne(Store& store) {
+    // copied out first, since the view points into the entry being erased; a short key stays inline
+    Key victim(store.evictionPolicy->evict());
+    log(store.shard, LogOp::DEL, store.id, victim.bytes());
+    eraseKey(store, victim);
+    recount(store);
+}
+
+/*
+    Helper function to evict until the whole store is within its capacity and byte budget, after a write to this part.
+    Keys are evicted from this part while it holds more than the key just written, then from the other shards that are
+    not locked at the moment; a shard lock is only tried, never waited for, while this one is held, so the lock order is kept.
+    If every other shard was tried and the store is still over, the key just written does not fit on its own and goes too;
+    if some were busy, the next write to the store evicts the rest.
+    Tables do not shrink, so a budget below what an empty store costs evicts every key and then gives up.
+*/
+void InMemoryEngine::evictOverBudget(Store& store) {
+    recount(store);
+    if (loading) {
+        return;
+    }
+    while (overBudget(store) && keyCount(store) > (store.capacity ? 1 : 0)) {
+        evictOne(store);
+    }
+    bool skipped = false;
+    for (size_t i = 1; i < shards.size() && overBudget(store); ++i) {
+        auto& other = shards[(store.shard + i) & (shards.size() - 1)];
+        std::unique_lock<std::mutex> lock(other.mutex, std::try_to_lock);
+        if (!lock) {
+            skipped = true;
+            continue;
+        }
+        auto it = other.stores.find(store.id);
+        if (it == other.stores.end()) {
+            continue;
+        }
+        recount(it->second);
+        while (keyCount(it->second) > 0 && overBudget(store)) {
+            evictOne(it->second);
+        }
+    }
+    while (!skipped && overBudget(store) && keyCount(store) > 0) {
+        evictOne(store);
+    }
+}
+
+/*
+    Helper function to evict from every part of a store, one key per shard in turn, until the whole store fits: for a budget
+    lowered at once, or a store loaded over it. Must be called with no shard locked.
+*/
+void InMemoryEngine::evictToFit(const size_t storeId) {
+    for (bool evicted = true; evicted;) {
+        evicted = false;
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.stores.find(storeId);
+            if (it == shard.stores.end()) {
+                continue;
+            }
+            recount(it->second);
+            if (keyCount(it->second) > 0 && overBudget(it->second)) {
+                evictOne(it->second);
+                evicted = true;
+            }
+        }
+    }
+}
+
+void InMemoryEngine::evictStoresToFit() {
+    std::vector<size_t> storeIds;
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        for (const auto& [storeId, storeTotals] : totals) {
+            storeIds.push_back(storeId);
+        }
+    }
+    for (auto storeId : storeIds) {
+        evictToFit(storeId);
+    }
+}
+
+/*
+    Helper function to delete a key of any type. The policy lets go of the key before the store frees its copy.
+*/
+bool InMemoryEngine::remove(Store& store, const KeyView key) {
+    if (!store.records.find(key) && !holdsCollection(store, key)) {
+        return false;
+    }
+    store.evictionPolicy->keyRemoved(key);
+    eraseKey(store, key);
+    recount(store);
+    return true;
+}
+
+/*
+    Helper function to delete a key and log it, for deletions the log cannot derive from the operation that caused them:
+    deletes, and keys that expired. A collection emptied by a pop or remove needs no record of its own.
+*/
+bool InMemoryEngine::logAndRemove(Store& store, const KeyView key) {
+    if (!store.records.find(key) && !holdsCollection(store, key)) {
+        return false;
+    }
+    log(store.shard, LogOp::DEL, store.id, key.bytes());
+    return remove(store, key);
+}
+
+/*
+    Helper function to get the bytes a collection takes up: its map node, a key too long to stay inline, and its contents.
+*/
+template <typename T>
+static size_t entryBytes(const std::pair<const Key, T>& entry) {
+    return hashNodeBytes<std::pair<const Key, T>>() + entry.first.heapBytes() + entry.second.memoryUsage();
+}
+
+template <typename T>
+static bool eraseFrom(KeyMap<T>& collections, const KeyView key, size_t& collectionBytes) {
+    auto it = collections.find(key);
+    if (it == collections.end()) {
+        return false;
+    }
+    collectionBytes -= entryBytes(*it);
+    collections.erase(it);
+    return true;
+}
+
+void InMemoryEngine::eraseKey(Store& store, const KeyView key) {
+    if (!store.records.erase(key) && !eraseFrom(store.lists, key, store.collectionBytes)
+        && !eraseFrom(store.sets, key, store.collectionBytes)) {
+        eraseFrom(store.hashes, key, store.collectionBytes);
+    }
+}
+
+bool InMemoryEngine::holdsCollection(const Store& store, const KeyView key) {
+    return store.lists.contains(key) || store.sets.contains(key) || store.hashes.contains(key);
+}
+
+/*
+    Helper function to add an empty collection at key. Returns it together with a view of the key as stored in the map,
+    which is what the eviction policy has to be given for the new key.
+*/
+template <typename T>
+static std::pair<T*, KeyView> emplaceCollection(KeyMap<T>& collections, const KeyView key, size_t& collectionBytes) {
+    auto it = collections.try_emplace(Key(key)).first;
+    collectionBytes += entryBytes(*it);
+    return {&it->second, it->first.view()};
+}
+
+/*
+    Helper function to find the list at key. Throws if key holds another type.
+*/
+QuickList* InMemoryEngine::findList(Store& store, const KeyView key) {
+    auto it = store.lists.find(key);
+    if (it != store.lists.end()) {
+        return &it->second;
+    }
+    if (holdsCollection(store, key) || findLive(store, key)) {
+        throw TypeMismatchError(std::string(key.bytes()), "list");
+    }
+    return nullptr;
+}
+
+/*
+    Helper function to find the set at key. Throws if key holds another type.
+*/
+CompactSet* InMemoryEngine::findSet(Store& store, const KeyView key) {
+    auto it = store.sets.find(key);
+    if (it != store.sets.end()) {
+        return &it->second;
+    }
+    if (holdsCollection(store, key) || findLive(store, key)) {
+        throw TypeMismatchError(std::string(key.bytes()), "set");
+    }
+    return nullptr;
+}
+
+/*
+    Helper function to find the hash at key. Throws if key holds another type.
+*/
+CompactHash* InMemoryEngine::findHash(Store& store, const KeyView key) {
+    auto it = store.hashes.find(key);
+    if (it != store.hashes.end()) {
+        return &it->second;
+    }
+    if (holdsCollection(store, key) || findLive(store, key)) {
+        throw TypeMismatchError(std::string(key.bytes()), "hash");
+    }
+    return nullptr;
+}
+
+void InMemoryEngine::clearStore(const size_t storeId) {
+    DurableWrite durable(appendLog.get());
+    {
+        std::lock_guard<std::mutex> storeWide(storeWideMutex);
+        resetStore(storeId);
+    }
+    durable.commit();
+}
+
+size_t InMemoryEngine::changePolicy(const size_t storeId, const std::string& policy) {
+    std::string newPolicy = policy;
+    std::transform(newPolicy.begin(), newPolicy.end(), newPolicy.begin(), ::tolower);
+    if (newPolicy != "lfu" && newPolicy != "lru" && newPolicy != "tinylfu") {
+        throw std::runtime_error("change to nonexist policy.");
+    }
+
+    DurableWrite durable(appendLog.get());
+    std::unique_lock<std::mutex> storeWide(storeWideMutex);
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        auto& config = configs.try_emplace(storeId, defaultConfig()).first->second;
+        if (config.policy == newPolicy) return 0;
+        config.policy = newPolicy;
+        log(shards.size(), LogOp::CONFIG, storeId, config.policy, config.capacity, config.maxMemory);
+    } // released before locking shards, to keep the lock order
+
+    resetStore(storeId); // only clear store if new policy is different from current policy
+    durable.commit(storeWide);
+    return 1;
+}
+
+void InMemoryEngine::setEvictionConfig(const size_t storeId, const EvictionConfig& config) {
+    DurableWrite durable(appendLog.get());
+    std::unique_lock<std::mutex> storeWide(storeWideMutex);
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        configs.insert_or_assign(storeId, config);
+        log(shards.size(), LogOp::CONFIG, storeId, config.policy, config.capacity, config.maxMemory);
+    }
+    resetStore(storeId);
+    durable.commit(storeWide);
+}
+
+std::optional<EvictionConfig> InMemoryEngine::getEvictionConfig(const size_t storeId) {
+    return configFor(storeId);
+}
+
+void InMemoryEngine::setMaxMemory(const size_t storeId, const size_t bytes) {
+    DurableWrite durable(appendLog.get());
+    std::unique_lock<std::mutex> storeWide(storeWideMutex);
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        auto& config = configs.try_emplace(storeId, defaultConfig()).first->second;
+        config.maxMemory = bytes;
+        log(shards.size(), LogOp::CONFIG, storeId, config.policy, config.capacity, config.maxMemory);
+    } // released before locking shards, to keep the lock order
+
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.stores.find(storeId);
+        if (it != shard.stores.end()) {
+            it->second.maxMemory = bytes;
+        }
+    }
+    evictToFit(storeId);
+    durable.commit(storeWide);
+}
+
+/*
+    Like MEMORY USAGE: the key's record and slot, or its collection with the map node and contents. 
+    The eviction policy's share is not included, and the lookup does not count as an access.
+*/
+std::optional<size_t> InMemoryEngine::memoryUsage(const size_t storeId, const std::string& key) {
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    if (auto record = findLive(store, hashedKey)) {
+        return RecordTable::memoryUsage(*record);
+    }
+    if (auto it = store.lists.find(hashedKey); it != store.lists.end()) {
+        return entryBytes(*it);
+    }
+    if (auto it = store.sets.find(hashedKey); it != store.sets.end()) {
+        return entryBytes(*it);
+    }
+    if (auto it = store.hashes.find(hashedKey); it != store.hashes.end()) {
+        return entryBytes(*it);
+    }
+    return std::nullopt;
+}
+
+/*
+    Totals over every shard's part of the store. The shards are locked one at a time, so under writes the total is approximate.
+*/
+std::optional<MemoryStats> InMemoryEngine::memoryStats(const size_t storeId) {
+    MemoryStats stats{0, configFor(storeId).maxMemory, 0};
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.stores.find(storeId);
+        if (it != shard.stores.end()) {
+            stats.usedMemory += usedMemory(it->second);
+            stats.keys += keyCount(it->second);
+        }
+    }
+    return stats;
+}
+
+void InMemoryEngine::deleteKey(const size_t storeId, const std::string& key) {
+    DurableWrite durable(appendLog.get());
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    logAndRemove(storeIn(shard, storeId), hashedKey);
+    durable.commit(lock);
+}
+
+size_t InMemoryEngine::setExpiration(const size_t storeId, const std::string& key, const ExpirationTime& expiration) {
+    DurableWrite durable(appendLog.get());
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    auto record = findLive(store, hashedKey);
+    if (!record) {
+        return 0;
+    }
+    log(store.shard, LogOp::EXPIRE_AT, storeId, key, toUnixMilliseconds(expiration));
+    record->expiration = toUnixMilliseconds(expiration);
+    durable.commit(lock);
+    return 1;
+}
+
+size_t InMemoryEngine::clearExpiration(const size_t storeId, const std::string& key) {
+    DurableWrite durable(appendLog.get());
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    auto record = findLive(store, hashedKey);
+    if (!record || record->expiration == Record::NO_EXPIRATION) {
+        return 0;
+    }
+    log(store.shard, LogOp::PERSIST, storeId, key);
+    record->expiration = Record::NO_EXPIRATION;
+    durable.commit(lock);
+    return 1;
+}
+
+std::optional<std::optional<ExpirationTime>> InMemoryEngine::getExpiration(const size_t storeId, const std::string& key) {
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto record = findLive(storeIn(shard, storeId), hashedKey);
+    if (!record) {
+        return std::nullopt;
+    }
+    return toExpiration(*record);
+}
+
+void InMemoryEngine::insertString(const size_t storeId, const std::string& key, const std::string& value) {
+    DurableWrite durable(appendLog.get());
+    putString(storeId, key, value);
+    durable.commit();
+}
+
+void InMemoryEngine::putString(const size_t storeId, const std::string& key, const std::string& value) {
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    log(store.shard, LogOp::SET, storeId, key, value);
+    insert(store, hashedKey, value);
+}
+
+/*
+    Reads count as accesses for the eviction policy.
+*/
+std::optional<StringEntry> InMemoryEngine::fetchLiveString(const size_t storeId, const std::string& key) {
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    auto record = findLive(store, hashedKey);
+    if (!record) {
+        if (holdsCollection(store, hashedKey)) {
+            throw TypeMismatchError(key, "string");
+        }
+        return std::nullopt;
+    }
+    store.evictionPolicy->keyAccessed(hashedKey);
+    return toStringEntry(*record);
+}
+
+/*
+    The multi-key operations lock one shard at a time, so they are not atomic across keys.
+    Like MGET, and unlike a single GET, a key holding a collection reads as missing rather than throwing.
+*/
+std::vector<std::optional<StringEntry>> InMemoryEngine::fetchLiveStrings(const size_t storeId, const std::vector<std::string>& keys) {
+    std::vector<std::optional<StringEntry>> ret;
+    ret.reserve(keys.size());
+    for (const auto& key : keys) {
+        KeyView hashedKey(key);
+        auto& shard = shardFor(storeId, hashedKey);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto& store = storeIn(shard, storeId);
+        auto record = findLive(store, hashedKey);
+        if (!record) {
+            ret.emplace_back();
+            continue;
+        }
+        store.evictionPolicy->keyAccessed(hashedKey);
+        ret.push_back(toStringEntry(*record));
+    }
+    return ret;
+}
+
+/*
+    With FsyncPolicy::ALWAYS the call waits once, for the fsync that covers all of its keys.
+*/
+void InMemoryEngine::insertStrings(const size_t storeId, const std::vector<std::string>& keys, const std::vector<std::string>& values) {
+    DurableWrite durable(appendLog.get());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        putString(storeId, keys[i], values[i]);
+    }
+    durable.commit();
+}
+
+/*
+    Integer reply: the number of keys that were removed. Expired keys are removed but not counted.
+*/
+size_t InMemoryEngine::deleteKeys(const size_t storeId, const std::vector<std::string>& keys) {
+    DurableWrite durable(appendLog.get());
+    size_t removed = 0;
+    for (const auto& key : keys) {
+        KeyView hashedKey(key);
+        auto& shard = shardFor(storeId, hashedKey);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto& store = storeIn(shard, storeId);
+        if ((findLive(store, hashedKey) || holdsCollection(store, hashedKey)) && logAndRemove(store, hashedKey)) {
+            ++removed;
+        }
+    }
+    durable.commit();
+    return removed;
+}
+
+size_t InMemoryEngine::listPush(const size_t storeId, const std::string& key, const std::vector<std::string>& values, const ListEnd end) {
+    DurableWrite durable(appendLog.get());
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    auto list = findList(store, hashedKey);
+    log(store.shard, end == ListEnd::HEAD ? LogOp::PUSH_HEAD : LogOp::PUSH_TAIL, storeId, key, values);
+    KeyView tracked = hashedKey; // an existing key is already tracked, so any view of it will do
+    if (!list) {
+        std::tie(list, tracked) = emplaceCollection(store.lists, hashedKey, store.collectionBytes);
+    }
+
+    auto before = list->memoryUsage();
+    for (const auto& value : values) {
+        end == ListEnd::HEAD ? list->pushFront(value) : list->pushBack(value);
+    }
+    store.collectionBytes += list->memoryUsage() - before;
+    auto length = list->size();
+    accessed(store, tracked); // may evict the list itself
+    durable.commit(lock);
+    return length;
+}
+
+std::vector<std::string> InMemoryEngine::listPop(const size_t storeId, const std::string& key, const size_t count, const ListEnd end) {
+    DurableWrite durable(appendLog.get());
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    auto list = findList(store, hashedKey);
+    if (!list) {
+        return {};
+    }
+    log(store.shard, end == ListEnd::HEAD ? LogOp::POP_HEAD : LogOp::POP_TAIL, storeId, key, count);
+
+    std::vector<std::string> ret;
+    auto before = list->memoryUsage();
+    while (ret.size() < count && !list->empty()) {
+        ret.push_back(*(end == ListEnd::HEAD ? list->popFront() : list->popBack()));
+    }
+    store.collectionBytes += list->memoryUsage() - before;
+    if (list->empty()) {
+        remove(store, hashedKey); // a list is deleted with its last element
+    } else {
+        store.evictionPolicy->keyAccessed(hashedKey);
+        recount(store);
+    }
+    durable.commit(lock);
+    return ret;
+}
+
+std::vector<std::string> InMemoryEngine::listRange(const size_t storeId, const std::string& key, const int64_t start, const int64_t stop) {
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    auto list = findList(store, hashedKey);
+    if (!list) {
+        return {};
+    }
+
+    store.evictionPolicy->keyAccessed(hashedKey);
+    auto range = resolveListRange(start, stop, list->size());
+    if (!range) {
+        return {};
+    }
+    return list->range(range->first, range->second);
+}
+
+size_t InMemoryEngine::listLength(const size_t storeId, const std::string& key) {
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto list = findList(storeIn(shard, storeId), hashedKey);
+    return list ? list->size() : 0;
+}
+
+size_t InMemoryEngine::setAdd(const size_t storeId, const std::string& key, const std::vector<std::string>& members) {
+    DurableWrite durable(appendLog.get());
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    auto set = findSet(store, hashedKey);
+    log(store.shard, LogOp::SADD, storeId, key, members);
+    KeyView tracked = hashedKey; // an existing key is already tracked, so any view of it will do
+    if (!set) {
+        std::tie(set, tracked) = emplaceCollection(store.sets, hashedKey, store.collectionBytes);
+    }
+
+    size_t added = 0;
+    auto before = set->memoryUsage();
+    for (const auto& member : members) {
+        added += set->add(member);
+    }
+    store.collectionBytes += set->memoryUsage() - before;
+    accessed(store, tracked); // may evict the set itself
+    durable.commit(lock);
+    return added;
+}
+
+size_t InMemoryEngine::setRemove(const size_t storeId, const std::string& key, const std::vector<std::string>& members) {
+    DurableWrite durable(appendLog.get());
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    auto set = findSet(store, hashedKey);
+    if (!set) {
+        return 0;
+    }
+    log(store.shard, LogOp::SREM, storeId, key, members);
+
+    size_t removed = 0;
+    auto before = set->memoryUsage();
+    for (const auto& member : members) {
+        removed += set->remove(member);
+    }
+    store.collectionBytes += set->memoryUsage() - before;
+    if (set->size() == 0) {
+        remove(store, hashedKey); // a set is deleted with its last member
+    } else {
+        store.evictionPolicy->keyAccessed(hashedKey);
+        recount(store);
+    }
+    durable.commit(lock);
+    return removed;
+}
+
+std::vector<std::string> InMemoryEngine::setMembers(const size_t storeId, const std::string& key) {
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    auto set = findSet(store, hashedKey);
+    if (!set) {
+        return {};
+    }
+    store.evictionPolicy->keyAccessed(hashedKey);
+    return set->members();
+}
+
+bool InMemoryEngine::setContains(const size_t storeId, const std::string& key, const std::string& member) {
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    auto set = findSet(store, hashedKey);
+    if (!set) {
+        return false;
+    }
+    store.evictionPolicy->keyAccessed(hashedKey);
+    return set->contains(member);
+}
+
+size_t InMemoryEngine::setSize(const size_t storeId, const std::string& key) {
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto set = findSet(storeIn(shard, storeId), hashedKey);
+    return set ? set->size() : 0;
+}
+
+/*
+    Every shard holding one of the keys is locked, in shard order, so the result is computed from one consistent view. 
+    An intersection walks the smallest set and probes the others from smallest to largest, 
+    so it costs the size of the smallest set and stops probing a member at the first set that lacks it.
+*/
+std::vector<std::string> InMemoryEngine::setCombine(const size_t storeId, const std::vector<std::string>& keys, const SetOperation operation) {
+    std::vector<KeyView> hashedKeys(keys.begin(), keys.end());
+    std::vector<Shard*> keyShards;
+    for (const auto& key : hashedKeys) {
+        keyShards.push_back(&shardFor(storeId, key));
+    }
+    auto lockOrder = keyShards;
+    std::sort(lockOrder.begin(), lockOrder.end());
+    lockOrder.erase(std::unique(lockOrder.begin(), lockOrder.end()), lockOrder.end());
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (auto shard : lockOrder) {
+        locks.emplace_back(shard->mutex);
+    }
+
+    std::vector<const CompactSet*> sets;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto& store = storeIn(*keyShards[i], storeId);
+        auto set = findSet(store, hashedKeys[i]);
+        if (set) {
+            store.evictionPolicy->keyAccessed(hashedKeys[i]);
+        }
+        sets.push_back(set);
+    }
+
+    std::vector<std::string> ret;
+    if (operation == SetOperation::INTERSECTION) {
+        if (sets.empty() || std::find(sets.begin(), sets.end(), nullptr) != sets.end()) {
+            return ret;
+        }
+        std::sort(sets.begin(), sets.end(), [](const CompactSet* a, const CompactSet* b) { return a->size() < b->size(); });
+        for (auto& member : sets.front()->members()) {
+            if (std::all_of(sets.begin() + 1, sets.end(), [&member](const CompactSet* set) { return set->contains(member); })) {
+                ret.push_back(std::move(member));
+            }
+        }
+    } else if (operation == SetOperation::UNION) {
+        std::unordered_set<std::string> seen;
+        for (auto set : sets) {
+            if (!set) continue;
+            for (auto& member : set->members()) {
+                if (seen.insert(member).second) {
+                    ret.push_back(std::move(member));
+                }
+            }
+        }
+    } else {
+        if (sets.empty() || !sets.front()) {
+            return ret;
+        }
+        for (auto& member : sets.front()->members()) {
+            if (std::none_of(sets.begin() + 1, sets.end(), [&member](const CompactSet* set) { return set && set->contains(member); })) {
+                ret.push_back(std::move(member));
+            }
+        }
+    }
+    return ret;
+}
+
+size_t InMemoryEngine::hashSet(const size_t storeId, const std::string& key, const std::vector<std::pair<std::string, std::string>>& fields) {
+    DurableWrite durable(appendLog.get());
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    auto hash = findHash(store, hashedKey);
+    log(store.shard, LogOp::HSET, storeId, key, fields);
+    KeyView tracked = hashedKey; // an existing key is already tracked, so any view of it will do
+    if (!hash) {
+        std::tie(hash, tracked) = emplaceCollection(store.hashes, hashedKey, store.collectionBytes);
+    }
+
+    size_t added = 0;
+    auto before = hash->memoryUsage();
+    for (const auto& [field, value] : fields) {
+        added += hash->set(field, value);
+    }
+    store.collectionBytes += hash->memoryUsage() - before;
+    accessed(store, tracked); // may evict the hash itself
+    durable.commit(lock);
+    return added;
+}
+
+std::vector<std::optional<std::string>> InMemoryEngine::hashGet(const size_t storeId, const std::string& key, const std::vector<std::string>& fields) {
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    std::vector<std::optional<std::string>> ret(fields.size());
+    auto hash = findHash(store, hashedKey);
+    if (!hash) {
+        return ret;
+    }
+
+    store.evictionPolicy->keyAccessed(hashedKey);
+    for (size_t i = 0; i < fields.size(); ++i) {
+        ret[i] = hash->get(fields[i]);
+    }
+    return ret;
+}
+
+std::vector<std::pair<std::string, std::string>> InMemoryEngine::hashGetAll(const size_t storeId, const std::string& key) {
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    auto hash = findHash(store, hashedKey);
+    if (!hash) {
+        return {};
+    }
+    store.evictionPolicy->keyAccessed(hashedKey);
+    return hash->entries();
+}
+
+size_t InMemoryEngine::hashDelete(const size_t storeId, const std::string& key, const std::vector<std::string>& fields) {
+    DurableWrite durable(appendLog.get());
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto& store = storeIn(shard, storeId);
+    auto hash = findHash(store, hashedKey);
+    if (!hash) {
+        return 0;
+    }
+    log(store.shard, LogOp::HDEL, storeId, key, fields);
+
+    size_t removed = 0;
+    auto before = hash->memoryUsage();
+    for (const auto& field : fields) {
+        removed += hash->remove(field);
+    }
+    store.collectionBytes += hash->memoryUsage() - before;
+    if (hash->size() == 0) {
+        remove(store, hashedKey); // a hash is deleted with its last field
+    } else {
+        store.evictionPolicy->keyAccessed(hashedKey);
+        recount(store);
+    }
+    durable.commit(lock);
+    return removed;
+}
+
+size_t InMemoryEngine::hashLength(const size_t storeId, const std::string& key) {
+    KeyView hashedKey(key);
+    auto& shard = shardFor(storeId, hashedKey);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto hash = findHash(storeIn(shard, storeId), hashedKey);
+    return hash ? hash->size() : 0;
+}
+
+size_t InMemoryEngine::deleteExpiredStrings(const size_t storeId, const std::vector<std::string>& keys) {
+    auto now = currentTime();
+    size_t removed = 0;
+    for (const auto& key : keys) {
+        KeyView hashedKey(key);
+        auto& shard = shardFor(storeId, hashedKey);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto& store = storeIn(shard, storeId);
+        auto record = store.records.find(hashedKey);
+        if (record && record->expired(now) && logAndRemove(store, hashedKey)) {
+            ++removed;
+        }
+    }
+    return removed;
+}
+
+/*
+    Every other TTL on this engine was set through this process, so the active expirer's timing wheel already tracks it;
+    only the TTLs replayed from the log have to be handed over here.
+*/
+std::vector<std::pair<size_t, std::string>> InMemoryEngine::fetchExpiredKeys(const size_t limit) {
+    std::vector<std::pair<size_t, std::string>> ret;
+    auto now = toUnixMilliseconds(currentTime());
+    std::lock_guard<std::mutex> lock(restoredMutex);
+    auto it = restoredExpirations.begin();
+    while (it != restoredExpirations.end() && ret.size() < limit && it->first <= now) {
+        ret.push_back(std::move(it->second));
+        it = restoredExpirations.erase(it);
+    }
+    return ret;
+}
+
+
+void InMemoryEngine::flush() {
+    if (appendLog) {
+        appendLog->flush();
+    }
+}
+
+/*
+    The log starts every session with the shard count, and a later replay adopts it, so each RESET record names the same shard
+    it did when it was logged. Stores that the replay left over capacity or budget by their current config give up keys at the end.
+*/
+void InMemoryEngine::enableLog(const AppendOnlyLogOptions& options) {
+    disableLog();
+    loading = true;
+    std::unique_ptr<AppendOnlyLog> log;
+    try {
+        log = std::make_unique<AppendOnlyLog>(options, [this](std::string_view payload) { applyLogRecord(payload); },
+                                              [this] { rewriteLog(); });
+    } catch (...) {
+        loading = false;
+        loadedExpirations.clear();
+        throw;
+    }
+    loading = false;
+    {
+        std::lock_guard<std::mutex> lock(rewriteMutex);
+        appendLog = std::move(log);
+    }
+    {
+        std::lock_guard<std::mutex> lock(restoredMutex);
+        for (auto& [expiration, key] : loadedExpirations) {
+            restoredExpirations.emplace(expiration, std::move(key));
+        }
+    }
+    loadedExpirations.clear();
+
+    this->log(shards.size(), LogOp::SHARDS, 0, shards.size());
+    evictStoresToFit();
+}
+
+/*
+    A running rewrite is finished first.
+*/
+void InMemoryEngine::disableLog() {
+    std::thread finishing;
+    {
+        std::lock_guard<std::mutex> lock(rewriteMutex);
+        finishing = std::move(rewriter);
+        detaching = true; // no new rewrite can start from here on
+    }
+    if (finishing.joinable()) {
+        finishing.join();
+    }
+
+    std::unique_ptr<AppendOnlyLog> log;
+    {
+        std::lock_guard<std::mutex> lock(rewriteMutex);
+        log = std::move(appendLog);
+        detaching = false;
+    }
+    // destroyed without the lock, since the log's thread may be asking for a rewrite meanwhile
+    log.reset();
+}
+
+bool InMemoryEngine::rewriteLog() {
+    std::lock_guard<std::mutex> lock(rewriteMutex);
+    if (!appendLog || rewriting || detaching) {
+        return false;
+    }
+    if (rewriter.joinable()) {
+        rewriter.join(); // finished: rewriting is cleared as its last step
+    }
+    rewriting = true;
+    rewriter = std::thread(&InMemoryEngine::runRewrite, this);
+    return true;
+}
+
+/*
+    Helper function to write the records that recreate one shard's part of a store. Collections are split into records of
+    at most REWRITE_BATCH elements, so replaying a large one does not need one huge record in memory.
+*/
+void InMemoryEngine::dumpStore(std::string& out, const Store& store) {
+    std::string payload;
+    auto add = [&](const LogOp op, const auto&... args) {
+        payload.clear();
+        encode(payload, op, store.id, args...);
+        AppendOnlyLog::frame(out, payload);
+    };
+    auto addBatches = [&](const LogOp op, std::string_view key, const auto& elements) {
+        for (size_t first = 0; first < elements.size(); first += REWRITE_BATCH) {
+            auto last = std::min(first + REWRITE_BATCH, elements.size());
+            add(op, key, std::decay_t<decltype(elements)>(elements.begin() + first, elements.begin() + last));
+        }
+    };
+
+    store.records.forEach([&](const Record& record) {
+        add(LogOp::SET, record.key(), record.value());
+        if (record.expiration != Record::NO_EXPIRATION) {
+            add(LogOp::EXPIRE_AT, record.key(), record.expiration);
+        }
+    });
+    for (const auto& [key, list] : store.lists) {
+        addBatches(LogOp::PUSH_TAIL, key.bytes(), list.range(0, list.size() - 1));
+    }
+    for (const auto& [key, set] : store.sets) {
+        addBatches(LogOp::SADD, key.bytes(), set.members());
+    }
+    for (const auto& [key, hash] : store.hashes) {
+        addBatches(LogOp::HSET, key.bytes(), hash.entries());
+    }
+}
+
+/*
+    Runs on its own thread. Store-wide operations wait until every shard is copied, so a shard's copy and the records that follow it
+    agree on its config. Each shard is locked only while its keys are encoded, and the file is written with it unlocked.
+    A failed rewrite leaves the current log in place.
+*/
+void InMemoryEngine::runRewrite() {
+    try {
+        appendLog->beginRewrite();
+        std::vector<uint64_t> cutoffs(shards.size() + 1); // one per shard, then the store-wide records
+        {
+            std::lock_guard<std::mutex> storeWide(storeWideMutex);
+            std::string records;
+            std::string payload;
+            encode(payload, LogOp::SHARDS, 0, shards.size());
+            AppendOnlyLog::frame(records, payload);
+            {
+                std::lock_guard<std::mutex> lock(configMutex);
+                cutoffs.back() = appendLog->nextSequence();
+                for (const auto& [storeId, config] : configs) {
+                    payload.clear();
+                    encode(payload, LogOp::CONFIG, storeId, config.policy, config.capacity, config.maxMemory);
+                    AppendOnlyLog::frame(records, payload);
+                }
+            }
+            for (size_t i = 0; i < shards.size(); ++i) {
+                {
+                    std::lock_guard<std::mutex> lock(shards[i].mutex);
+                    cutoffs[i] = appendLog->nextSequence();
+                    for (const auto& [storeId, store] : shards[i].stores) {
+                        dumpStore(records, store);
+                    }
+                }
+                appendLog->writeRewrite(records);
+                records.clear();
+            }
+        }
+        appendLog->finishRewrite(cutoffs);
+    } catch (const std::exception& e) {
+        appendLog->abortRewrite();
+        std::cerr << "append-only log: rewrite failed: " << e.what() << std::endl;
+    }
+    std::lock_guard<std::mutex> lock(rewriteMutex);
+    rewriting = false;
+}
+
+/*
+    Helper function to apply one replayed record. Key records go through the public methods, which neither log (the log is not
+    attached yet) nor evict or expire keys (loading is set).
+*/
+void InMemoryEngine::applyLogRecord(std::string_view payload) {
+    if (payload.empty()) {
+        throw std::runtime_error("malformed append-only log record.");
+    }
+    auto op = static_cast<LogOp>(payload[0]);
+    LogReader reader(payload.substr(1));
+    auto storeId = reader.integer();
+
+    switch (op) {
+        case LogOp::SHARDS: {
+            auto count = reader.integer();
+            if (count == shards.size()) break;
+            for (auto& shard : shards) {
+                if (!shard.stores.empty()) {
+                    throw std::runtime_error("append-only log changes the shard count of an engine that holds keys.");
+                }
+            }
+            shards = std::vector<Shard>(count);
+            shardBits = std::countr_zero(count);
+            break;
+        }
+        case LogOp::CONFIG: {
+            EvictionConfig config{std::string(reader.bytes()), reader.integer(), reader.integer()};
+            {
+                std::lock_guard<std::mutex> lock(configMutex);
+                configs.insert_or_assign(storeId, config);
+            }
+            // a policy or capacity change is followed by RESET records; only a byte budget applies to the parts that stay
+            for (auto& shard : shards) {
+                auto it = shard.stores.find(storeId);
+                if (it != shard.stores.end()) {
+                    it->second.maxMemory = config.maxMemory;
+                }
+            }
+            break;
+        }
+        case LogOp::RESET:
+            shards.at(reader.integer()).stores.erase(storeId);
+            break;
+        case LogOp::SET: {
+            std::string key(reader.bytes());
+            insertString(storeId, key, std::string(reader.bytes()));
+            break;
+        }
+        case LogOp::DEL:
+            deleteKey(storeId, std::string(reader.bytes()));
+            break;
+        case LogOp::EXPIRE_AT: {
+            std::string key(reader.bytes());
+            auto expiration = static_cast<int64_t>(reader.integer());
+            if (setExpiration(storeId, key, fromUnixMilliseconds(expiration))) {
+                loadedExpirations.emplace_back(expiration, std::make_pair(storeId, std::move(key)));
+            }
+            break;
+        }
+        case LogOp::PERSIST:
+            clearExpiration(storeId, std::string(reader.bytes()));
+            break;
+        case LogOp::PUSH_HEAD:
+        case LogOp::PUSH_TAIL: {
+            std::string key(reader.bytes());
+            listPush(storeId, key, readStrings(reader), op == LogOp::PUSH_HEAD ? ListEnd::HEAD : ListEnd::TAIL);
+            break;
+        }
+        case LogOp::POP_HEAD:
+        case LogOp::POP_TAIL: {
+            std::string key(reader.bytes());
+            listPop(storeId, key, reader.integer(), op == LogOp::POP_HEAD ? ListEnd::HEAD : ListEnd::TAIL);
+            break;
+        }
+        case LogOp::SADD:
+        case LogOp::SREM: {
+            std::string key(reader.bytes());
+            auto members = readStrings(reader);
+            op == LogOp::SADD ? setAdd(storeId, key, members) : setRemove(storeId, key, members);
+            break;
+        }
+        case LogOp::HSET: {
+            std::string key(reader.bytes());
+            hashSet(storeId, key, readPairs(reader));
+            break;
+        }
+        case LogOp::HDEL: {
+            std::string key(reader.bytes());
+            hashDelete(storeId, key, readStrings(reader));
+            break;
+        }
+        default:
+            throw std::runtime_error("unknown append-only log record " + std::to_string(payload[0]) + ".");
+    }
+}
+
+/*
+    Every lock is held across the fork, in lock order, so the child's copy of memory is one instant of every store at once
+    and no shard is halfway through a change. The locks are released as soon as fork returns; with a large heap the fork
+    itself, which copies the page tables, is the pause writers see.
+*/
+bool InMemoryEngine::saveSnapshot(const std::string& path) {
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    if (saving) {
+        return false;
+    }
+    if (saver.joinable()) {
+        saver.join();
+    }
+
+    auto savedAt = toUnixMilliseconds(currentTime());
+    pid_t child;
+    {
+        std::lock_guard<std::mutex> storeWide(storeWideMutex);
+        std::vector<std::unique_lock<std::mutex>> shardLocks;
+        for (auto& shard : shards) {
+            shardLocks.emplace_back(shard.mutex);
+        }
+        std::lock_guard<std::mutex> config(configMutex);
+        child = fork();
+        if (child == 0) {
+            // the child has this thread only: nothing else changes its copy, and it leaves without unlocking or destroying anything
+            try {
+                writeSnapshotFile(path, [this, savedAt](SnapshotWriter& out) { return writeSnapshot(out, savedAt); });
+                _exit(0);
+            } catch (const std::exception& e) {
+                std::string message = "snapshot: save to " + path + " failed: " + e.what() + "\n";
+                ssize_t ignored = write(STDERR_FILENO, message.data(), message.size());
+                (void)ignored;
+                _exit(1);
+            }
+        }
+    }
+    if (child < 0) {
+        throw std::system_error(errno, std::generic_category(), "fork");
+    }
+
+    saving = true;
+    saver = std::thread([this, child, savedAt] {
+        int status = 0;
+        while (waitpid(child, &status, 0) < 0 && errno == EINTR) {}
+        bool succeeded = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        if (WIFSIGNALED(status)) {
+            std::cerr << "snapshot: the saving process was killed by signal " << WTERMSIG(status) << "." << std::endl;
+        }
+        {
+            std::lock_guard<std::mutex> lock(snapshotMutex);
+            saving = false;
+            snapshotSucceeded = succeeded;
+            if (succeeded) {
+                snapshotTime = savedAt;
+            }
+        }
+        snapshotDone.notify_all();
+    });
+    return true;
+}
+
+bool InMemoryEngine::waitForSnapshot() {
+    std::unique_lock<std::mutex> lock(snapshotMutex);
+    snapshotDone.wait(lock, [this] { return !saving; });
+    return snapshotSucceeded;
+}
+
+int64_t InMemoryEngine::lastSnapshot() {
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    return snapshotTime;
+}
+
+/*
+    Runs in the forked child. A section per store per shard, then the configs, then the section table.
+*/
+SnapshotHeader InMemoryEngine::writeSnapshot(SnapshotWriter& out, const int64_t savedAt) const {
+    SnapshotHeader header{};
+    header.shardCount = shards.size();
+    header.savedAt = savedAt;
+
+    std::vector<SnapshotSection> sections;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        for (const auto& [storeId, store] : shards[i].stores) {
+            if (keyCount(store) == 0) {
+                continue;
+            }
+            SnapshotSection section{storeId, i, out.offset(), 0, 0};
+            section.entries = writeSnapshotEntries(out, store);
+            section.size = out.offset() - section.offset;
+            sections.push_back(section);
+        }
+    }
+
+    header.configOffset = out.offset();
+    header.configCount = configs.size();
+    for (const auto& [storeId, config] : configs) {
+        out.put(SnapshotConfig{storeId, config.capacity, config.maxMemory});
+        out.putBytes(config.policy);
+        out.align();
+    }
+
+    header.sectionOffset = out.offset();
+    header.sectionCount = sections.size();
+    for (const auto& section : sections) {
+        out.put(section);
+    }
+    return header;
+}
+
+/*
+    Helper function to write one store's part of a shard in the order its eviction policy ranks the keys, so loading the
+    entries in file order rebuilds the policy. Strings are written straight from their records; a list's nodes are copied as they are.
+*/
+size_t InMemoryEngine::writeSnapshotEntries(SnapshotWriter& out, const Store& store) {
+    size_t written = 0;
+    std::string body;
+    auto putCount = [&body](const size_t count) {
+        auto value = static_cast<uint32_t>(count);
+        body.append(reinterpret_cast<const char*>(&value), sizeof value);
+    };
+
+    store.evictionPolicy->forEachByRank([&](const KeyView key, const size_t frequency) {
+        SnapshotEntry entry{};
+        entry.hash = key.hash();
+        entry.expiration = Record::NO_EXPIRATION;
+        entry.keySize = key.bytes().size();
+        entry.frequency = std::min<size_t>(frequency, UINT32_MAX);
+
+        if (auto record = store.records.find(key)) {
+            entry.type = SnapshotType::STRING;
+            entry.expiration = record->expiration;
+            entry.size = record->valueSize;
+            out.put(entry);
+            out.write(key.bytes());
+            out.write(record->value());
+            out.align();
+            ++written;
+            return;
+        }
+
+        body.clear();
+        if (auto it = store.lists.find(key); it != store.lists.end()) {
+            entry.type = SnapshotType::LIST;
+            entry.count = it->second.packedNodes().size();
+            for (const auto& node : it->second.packedNodes()) {
+                putCount(node.size());
+                putBytes(body, node.bytes());
+            }
+        } else if (auto it = store.sets.find(key); it != store.sets.end()) {
+            entry.type = SnapshotType::SET;
+            auto members = it->second.members();
+            entry.count = members.size();
+            for (const auto& member : members) {
+                putBytes(body, member);
+            }
+        } else if (auto it = store.hashes.find(key); it != store.hashes.end()) {
+            entry.type = SnapshotType::HASH;
+            auto fields = it->second.entries();
+            entry.count = fields.size();
+            for (const auto& [field, value] : fields) {
+                putBytes(body, field);
+                putBytes(body, value);
+            }
+        } else {
+            throw std::runtime_error("a key tracked by the eviction policy is missing from its store.");
+        }
+        entry.size = body.size();
+        out.put(entry);
+        out.write(key.bytes());
+        out.write(body);
+        out.align();
+        ++written;
+    });
+
+    if (written != keyCount(store)) {
+        throw std::runtime_error("the eviction policy does not track every key of a store.");
+    }
+    return written;
+}
+
+/*
+    Sections are loaded in parallel, one thread per section at a time, each locking only the shard it fills. A snapshot from
+    a build whose key hash differs is loaded by one thread, since the keys of a section then scatter across the shards.
+    Keys whose TTL passed while the engine was down are skipped, and the TTLs of the rest are handed to the active expirer.
+*/
+void InMemoryEngine::loadSnapshot(const std::string& path) {
+    if (appendLog) {
+        throw std::runtime_error("a snapshot cannot be loaded while the append-only log is on.");
+    }
+    for (const auto& shard : shards) {
+        if (!shard.stores.empty()) {
+            throw std::runtime_error("a snapshot can only be loaded into an empty engine.");
+        }
+    }
+
+    SnapshotFile file(path);
+    const auto& header = file.header();
+    if (header.shardCount != shards.size()) {
+        shards = std::vector<Shard>(header.shardCount);
+        shardBits = std::countr_zero(shards.size());
+    }
+
+    auto configReader = file.configs();
+    for (uint64_t i = 0; i < header.configCount; ++i) {
+        auto config = configReader.get<SnapshotConfig>();
+        EvictionConfig evictionConfig{std::string(configReader.bytes()), config.capacity, config.maxMemory};
+        configReader.align();
+        std::lock_guard<std::mutex> lock(configMutex);
+        configs.insert_or_assign(config.storeId, evictionConfig);
+    }
+
+    const auto& sections = file.sections();
+    auto now = toUnixMilliseconds(currentTime());
+    size_t threads = file.sameHash() ? std::min<size_t>(sections.size(), std::max(1u, std::thread::hardware_concurrency())) : 1;
+    std::atomic<size_t> next = 0;
+    std::vector<std::vector<std::pair<int64_t, std::pair<size_t, std::string>>>> expirations(threads);
+    std::vector<std::exception_ptr> errors(threads);
+    std::vector<std::thread> loaders;
+    for (size_t t = 0; t < threads; ++t) {
+        loaders.emplace_back([&, t] {
+            try {
+                for (size_t i = next++; i < sections.size(); i = next++) {
+                    loadSnapshotSection(file, sections[i], now, expirations[t]);
+                }
+            } catch (...) {
+                errors[t] = std::current_exception();
+                next = sections.size();
+            }
+        });
+    }
+    for (auto& loader : loaders) {
+        loader.join();
+    }
+    for (const auto& error : errors) {
+        if (error) {
+            for (auto& shard : shards) {
+                shard.stores.clear();
+            }
+            std::rethrow_exception(error);
+        }
+    }
+
+    // the sections are loaded without counting keys against the stores' totals, and each part of a store costs some bytes
+    // even when empty, so a store loaded with another shard count may no longer fit its budget
+    evictStoresToFit();
+    {
+        std::lock_guard<std::mutex> lock(restoredMutex);
+        for (auto& loaded : expirations) {
+            for (auto& [expiration, key] : loaded) {
+                restoredExpirations.emplace(expiration, std::move(key));
+            }
+        }
+    }
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    snapshotTime = header.savedAt;
+}
+
+/*
+    Helper function to load one section. Each entry is copied into its table or collection and then handed to the
+    eviction policy with its access count, in file order, which is the order the policy had it in.
+*/
+void InMemoryEngine::loadSnapshotSection(const SnapshotFile& file, const SnapshotSection& section, const int64_t now,
+                                         std::vector<std::pair<int64_t, std::pair<size_t, std::string>>>& expirations) {
+    auto reader = file.section(section);
+    auto sameHash = file.sameHash();
+    for (uint64_t i = 0; i < section.entries; ++i) {
+        auto entry = reader.get<SnapshotEntry>();
+        auto bytes = reader.bytes(entry.keySize);
+        KeyView key = sameHash ? KeyView(bytes, entry.hash) : KeyView(bytes);
+        auto& shard = sameHash ? shards[section.shard] : shardFor(section.storeId, key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto& store = storeIn(shard, section.storeId);
+
+        auto start = reader.offset();
+        std::optional<KeyView> tracked;
+        switch (entry.type) {
+            case SnapshotType::STRING: {
+                auto value = reader.bytes(entry.size);
+                if (entry.expiration != Record::NO_EXPIRATION && entry.expiration <= now) {
+                    break;
+                }
+                store.records.upsert(key, value, entry.expiration);
+                tracked = KeyView(store.records.find(key)->key(), key.hash());
+                if (entry.expiration != Record::NO_EXPIRATION) {
+                    expirations.emplace_back(entry.expiration, std::make_pair(section.storeId, std::string(bytes)));
+                }
+                break;
+            }
+            case SnapshotType::LIST: {
+                auto [list, view] = emplaceCollection(store.lists, key, store.collectionBytes);
+                auto before = list->memoryUsage();
+                for (uint32_t n = 0; n < entry.count; ++n) {
+                    auto count = reader.get<uint32_t>();
+                    list->appendNode(ListNode(std::string(reader.bytes()), count));
+                }
+                store.collectionBytes += list->memoryUsage() - before;
+                tracked = view;
+                break;
+            }
+            case SnapshotType::SET: {
+                auto [set, view] = emplaceCollection(store.sets, key, store.collectionBytes);
+                auto before = set->memoryUsage();
+                for (uint32_t n = 0; n < entry.count; ++n) {
+                    set->add(std::string(reader.bytes()));
+                }
+                store.collectionBytes += set->memoryUsage() - before;
+                tracked = view;
+                break;
+            }
+            case SnapshotType::HASH: {
+                auto [hash, view] = emplaceCollection(store.hashes, key, store.collectionBytes);
+                auto before = hash->memoryUsage();
+                for (uint32_t n = 0; n < entry.count; ++n) {
+                    std::string field(reader.bytes());
+                    hash->set(field, std::string(reader.bytes()));
+                }
+                store.collectionBytes += hash->memoryUsage() - before;
+                tracked = view;
+                break;
+            }
+            default:
+                throw std::runtime_error("corrupt snapshot: unknown entry type " + std::to_string(static_cast<int>(entry.type)) + ".");
+        }
+        if (reader.offset() - start != entry.size) {
+            throw std::runtime_error("corrupt snapshot: an entry's size does not match its contents.");
+        }
+        reader.align();
+        if (tracked) {
+            store.evictionPolicy->keyRestored(*tracked, entry.frequency);
+        }
+    }
+    if (!reader.done()) {
+        throw std::runtime_error("corrupt snapshot: a section holds more than its entries.");
+    }
+}
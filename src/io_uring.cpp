@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
+#include "io_uring.h"
+
+static std::system_error systemError(const std::string& what) {
+    return std::system_error(errno, std::generic_category(), what);
+}
+
+static void* mapRing(const size_t size, const int fd, const off_t offset) {
+    auto ret = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (ret == MAP_FAILED) {
+        auto error = systemError("mmap io_uring");
+        close(fd);
+        throw error;
+    }
+    return ret;
+}
+
+/*
+    Cooperative task running saves the kernel an interrupt per completion; it needs 5.19, and older kernels get a plain ring.
+*/
+IoUring::IoUring(const unsigned entries) : sqLocalTail(0), bufferRing(nullptr), bufferRingSize(0), bufferMask(0), bufferSize(0) {
+    io_uring_params params{};
+    params.flags = IORING_SETUP_COOP_TASKRUN;
+    ringFd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ringFd < 0 && errno == EINVAL) {
+        params = io_uring_params{};
+        ringFd = syscall(__NR_io_uring_setup, entries, &params);
+    }
+    if (ringFd < 0) {
+        throw systemError("io_uring_setup");
+    }
+    this->entries = params.sq_entries;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+    sqRing = mapRing(sqRingSize, ringFd, IORING_OFF_SQ_RING);
+    cqRing = singleMap ? sqRing : mapRing(cqRingSize, ringFd, IORING_OFF_CQ_RING);
+    sqes = static_cast<io_uring_sqe*>(mapRing(params.sq_entries * sizeof(io_uring_sqe), ringFd, IORING_OFF_SQES));
+
+    auto sq = static_cast<char*>(sqRing);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqLocalTail = *sqTail;
+    // submission slots map one to one onto entries, so the indirection array is filled once
+    auto sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; ++i) {
+        sqArray[i] = i;
+    }
+
+    auto cq = static_cast<char*>(cqRing);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+}
+
+IoUring::~IoUring() {
+    // closing the ring cancels whatever is still in flight
+    close(ringFd);
+    if (bufferRing) {
+        munmap(bufferRing, bufferRingSize);
+    }
+    munmap(sqes, entries * sizeof(io_uring_sqe));
+    if (cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    munmap(sqRing, sqRingSize);
+}
+
+void IoUring::provideBuffers(const size_t count, const size_t size) {
+    bufferRingSize = std::max<size_t>(count * sizeof(io_uring_buf), sysconf(_SC_PAGESIZE));
+    auto ring = mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        throw systemError("mmap buffer ring");
+    }
+    bufferRing = static_cast<io_uring_buf_ring*>(ring);
+
+    io_uring_buf_reg registration{};
+    registration.ring_addr = reinterpret_cast<uint64_t>(bufferRing);
+    registration.ring_entries = count;
+    registration.bgid = 0;
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        throw systemError("io_uring_register buffer ring");
+    }
+
+    bufferMask = count - 1;
+    bufferSize = size;
+    buffers.resize(count * size);
+    for (size_t id = 0; id < count; ++id) {
+        recycle(id);
+    }
+}
+
+void IoUring::recycle(const uint16_t id) {
+    // only this thread moves the tail; the release store publishes the entry to the kernel
+    // entries are indexed from the start of the ring: in C++ the uapi header's flexible array member sits 8 bytes further
+    auto tail = bufferRing->tail;
+    auto& entry = reinterpret_cast<io_uring_buf*>(bufferRing)[tail & bufferMask];
+    entry.addr = reinterpret_cast<uint64_t>(buffers.data() + id * bufferSize);
+    entry.len = bufferSize;
+    entry.bid = id;
+    std::atomic_ref<uint16_t>(bufferRing->tail).store(tail + 1, std::memory_order_release);
+}
+
+/*
+    A full submission queue is flushed to the kernel without waiting, so preparing never fails.
+*/
+io_uring_sqe& IoUring::prepare(const uint8_t opcode, const int fd, const uint64_t userData) {
+    if (sqLocalTail - std::atomic_ref<unsigned>(*sqHead).load(std::memory_order_acquire) == entries) {
+        submitAndWait(0);
+    }
+    auto& sqe = sqes[sqLocalTail & sqMask];
+    ++sqLocalTail;
+    std::memset(&sqe, 0, sizeof sqe);
+    sqe.opcode = opcode;
+    sqe.fd = fd;
+    sqe.user_data = userData;
+    return sqe;
+}
+
+void IoUring::prepareAccept(const int fd, const uint64_t userData) {
+    auto& sqe = prepare(IORING_OP_ACCEPT, fd, userData);
+    sqe.accept_flags = SOCK_CLOEXEC;
+}
+
+void IoUring::prepareRecv(const int fd, const uint64_t userData) {
+    auto& sqe = prepare(IORING_OP_RECV, fd, userData);
+    sqe.len = bufferSize;
+    sqe.flags = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = 0;
+}
+
+void IoUring::prepareRead(const int fd, void* buffer, const size_t length, const uint64_t userData) {
+    auto& sqe = prepare(IORING_OP_READ, fd, userData);
+    sqe.addr = reinterpret_cast<uint64_t>(buffer);
+    sqe.len = length;
+    sqe.off = static_cast<uint64_t>(-1); // current position, for files that have one
+}
+
+void IoUring::prepareSendmsg(const int fd, const msghdr* msg, const uint64_t userData) {
+    auto& sqe = prepare(IORING_OP_SENDMSG, fd, userData);
+    sqe.addr = reinterpret_cast<uint64_t>(msg);
+    sqe.len = 1;
+    sqe.msg_flags = MSG_NOSIGNAL;
+}
+
+/*
+    EINTR and EBUSY (completions backed up in the kernel) return early; the caller reaps and calls again.
+*/
+void IoUring::submitAndWait(const unsigned waitFor) {
+    std::atomic_ref<unsigned>(*sqTail).store(sqLocalTail, std::memory_order_release);
+    auto pending = sqLocalTail - std::atomic_ref<unsigned>(*sqHead).load(std::memory_order_acquire);
+    unsigned flags = waitFor ? IORING_ENTER_GETEVENTS : 0;
+    if (syscall(__NR_io_uring_enter, ringFd, pending, waitFor, flags, nullptr, 0) < 0 && errno != EINTR && errno != EBUSY) {
+        throw systemError("io_uring_enter");
+    }
+}
@@ -1,12 +1,55 @@
 #include <algorithm>
+#include <filesystem>
 #include "key_value_store.h"
 
-TypeMismatchError::TypeMismatchError(const std::string& key, const std::string& type)
-    : std::runtime_error("The value at key " + key + " is not a " + type + ".") {}
+KeyValueStore::KeyValueStore() : KeyValueStore(DEFAULT_POOL_SIZE) {}
 
-KeyValueStore::KeyValueStore()
-    : dbManager(DatabaseManager(CONNECTION_STRING)) {
-    dbManager.connect();
+KeyValueStore::KeyValueStore(const size_t poolSize) : KeyValueStore(StorageBackend::POSTGRES, poolSize) {}
+
+/*
+    backend selects where the keys live. 
+    POSTGRES keeps them in the database, with a per-store cache in front of it; poolSize bounds the number of database connections, 
+    and so the number of operations that reach the database concurrently. 
+    MEMORY keeps them in process memory only, with no database round trip per operation; the keys are lost when the store is destroyed. 
+    All methods may be called from multiple threads.
+*/
+KeyValueStore::KeyValueStore(const StorageBackend backend, const size_t poolSize) : dbManager(nullptr), memoryEngine(nullptr), cacheEpoch(0) {
+    if (backend == StorageBackend::MEMORY) {
+        auto memory = std::make_unique<InMemoryEngine>();
+        memoryEngine = memory.get();
+        engine = std::move(memory);
+    } else {
+        auto database = std::make_unique<DatabaseManager>(CONNECTION_STRING, poolSize);
+        database->connect();
+        dbManager = database.get();
+        engine = std::move(database);
+    }
+
+    expirer = std::make_unique<ActiveExpirer>(
+        ActiveExpirerOptions{},
+        [this](const size_t storeId, const std::vector<std::string>& keys) { return reapExpired(storeId, keys); },
+        [this](const size_t limit) { return engine->fetchExpiredKeys(limit); });
+}
+
+/*
+    Connection pool statistics. All zero for the in-memory backend.
+*/
+PoolMetrics KeyValueStore::poolMetrics() const {
+    return dbManager ? dbManager->poolMetrics() : PoolMetrics{};
+}
+
+/*
+    Keys deleted by the active expirer, keys it found already gone or renewed, the backlog of due keys and the reap rate.
+*/
+ExpirationMetrics KeyValueStore::expirationMetrics() const {
+    return expirer->metrics();
+}
+
+/*
+    Helper function to check if an expiration time has passed. 
+*/
+static bool isExpired(const std::optional<ExpirationTime>& expiration) {
+    return expiration && currentTime() >= *expiration;
 }
 
 // /*
@@ -27,41 +70,374 @@ KeyValueStore::KeyValueStore()
 // }
 
 /*
-    Clears the store if the eviction policy was LFU. 
+    Clears the store if the eviction policy was not LRU. 
     
     Integer reply: 0 if the eviction policy was already LRU. Keeps existing store unchanged.
     Integer reply: 1 if changed to LRU successfully. The store is cleared. 
 */
 size_t KeyValueStore::useLRU(const size_t storeId) {
-    return dbManager.changePolicy(storeId, "lru");
+    auto changed = engine->changePolicy(storeId, "lru");
+    if (changed) dropCache(storeId);
+    return changed;
 }
 
 /*
-    Clears the store if the eviction policy was LRU. 
+    Clears the store if the eviction policy was not LFU. 
     
     Integer reply: 0 if the eviction policy was already LFU. Keeps existing store unchanged.
     Integer reply: 1 if changed to LFU successfully. The store is cleared. 
 */
 size_t KeyValueStore::useLFU(const size_t storeId) {
-    return dbManager.changePolicy(storeId, "lfu");
+    auto changed = engine->changePolicy(storeId, "lfu");
+    if (changed) dropCache(storeId);
+    return changed;
+}
+
+/*
+    Clears the store if the eviction policy was not TinyLFU.
+    TinyLFU approximates LFU with a decaying frequency sketch and only admits a new key if it is used more often than the key it would evict.
+
+    Integer reply: 0 if the eviction policy was already TinyLFU. Keeps existing store unchanged.
+    Integer reply: 1 if changed to TinyLFU successfully. The store is cleared.
+*/
+size_t KeyValueStore::useTinyLFU(const size_t storeId) {
+    auto changed = engine->changePolicy(storeId, "tinylfu");
+    if (changed) dropCache(storeId);
+    return changed;
+}
+
+/*
+    Bound the memory a store takes up in this process, on top of its key capacity; 0 removes the bound. 
+    For the in-memory backend that is the store itself, for the postgres backend its cache. 
+    Unlike a policy change the store is kept: keys are evicted by the current policy until it fits, and from then on as it grows.
+    The budget is saved with the store's eviction config.
+
+    Simple string reply: OK.
+*/
+std::string KeyValueStore::setMaxMemory(const size_t storeId, const size_t bytes) {
+    engine->setMaxMemory(storeId, bytes);
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto it = caches.find(storeId);
+    if (it != caches.end()) {
+        it->second.setMaxMemory(bytes);
+    }
+    return "OK";
+}
+
+/*
+    Integer reply: the bytes the key and its value take up in the engine.
+    Nil reply: if the key does not exist.
+*/
+std::optional<size_t> KeyValueStore::memoryUsage(const size_t storeId, const std::string& key) {
+    return engine->memoryUsage(storeId, key);
+}
+
+/*
+    The bytes counted against the store's budget, the budget (0 if none) and the number of keys held in process memory:
+    the whole store for the in-memory backend, the cached keys for the postgres backend.
+*/
+MemoryStats KeyValueStore::memoryStats(const size_t storeId) {
+    if (auto stats = engine->memoryStats(storeId)) {
+        return *stats;
+    }
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return cacheFor(storeId).memoryStats();
+}
+
+/*
+    Queue SET and DEL in memory and write them to the database in batches from a background thread. 
+    A batch is flushed once maxPending keys are queued or durabilityWindow after its oldest write, 
+    so up to durabilityWindow of acknowledged writes can be lost if the process dies. 
+    Reads through this store always see their own writes. 
+    Enable or disable write-behind before the store is shared between threads.
+*/
+void KeyValueStore::enableWriteBehind(const size_t maxPending, const std::chrono::milliseconds& durabilityWindow) {
+    if (!dbManager) {
+        throw std::runtime_error("write-behind requires the postgres backend.");
+    }
+    dbManager->enableWriteBehind(WriteBehindOptions{maxPending, durabilityWindow});
+}
+
+/*
+    Flush queued writes and commit every SET and DEL immediately again.
+*/
+void KeyValueStore::disableWriteBehind() {
+    if (dbManager) dbManager->disableWriteBehind();
+}
+
+/*
+    Make the memory backend durable without a database: every write is appended to the log at path before it is applied, 
+    and the log is replayed into the store here, so a restart with the same path brings the keys back. 
+    fsync picks when the log reaches the disk: ALWAYS before each write returns (concurrent writes share one fsync), 
+    INTERVAL every fsyncInterval, so a machine crash loses at most that much, or OS whenever the kernel writes it back. 
+    The log is rewritten in the background once it has doubled in size since its last rewrite, and at least 64 MiB.
+    Enable or disable the log before the store is shared between threads.
+*/
+void KeyValueStore::enableAppendOnlyLog(const std::string& path, const FsyncPolicy fsync, const std::chrono::milliseconds& fsyncInterval) {
+    if (!memoryEngine) {
+        throw std::runtime_error("the append-only log requires the memory backend.");
+    }
+    AppendOnlyLogOptions options;
+    options.path = path;
+    options.fsync = fsync;
+    options.fsyncInterval = fsyncInterval;
+    memoryEngine->enableLog(options);
+}
+
+/*
+    Write and fsync everything logged so far, then stop logging.
+*/
+void KeyValueStore::disableAppendOnlyLog() {
+    if (memoryEngine) memoryEngine->disableLog();
 }
 
 /*
-    Helper function to check if a key expired. 
-    If expired, remove from the store, and remove from the cache and expiration map accordingly. 
+    BGREWRITEAOF: replace the log with the shortest one that recreates the store, in the background. Writes go on meanwhile.
+    Throws if there is no log or a rewrite is already running.
+
+    Simple string reply: Background append only file rewriting started.
 */
-bool KeyValueStore::isExpired(const size_t storeId, const std::string& key, const std::string& type) {
-    auto expirationTimeOpt = dbManager.getExpiration(storeId, key, type);
-    if (!expirationTimeOpt) {
+std::string KeyValueStore::rewriteAppendOnlyLog() {
+    if (!memoryEngine || !memoryEngine->rewriteLog()) {
+        throw std::runtime_error("no append-only log, or a rewrite is already in progress.");
+    }
+    return "Background append only file rewriting started";
+}
+
+/*
+    Use path as the snapshot file: load it now if load is set and the file exists, and write it on every later SAVE or BGSAVE.
+    Returns whether a snapshot was loaded. Call before the store is shared between threads. With the append-only log on,
+    the log is the complete record: pass load = false and enable the log instead.
+*/
+bool KeyValueStore::useSnapshot(const std::string& path, const bool load) {
+    if (!memoryEngine) {
+        throw std::runtime_error("snapshots require the memory backend.");
+    }
+    snapshotPath = path;
+    if (!load || !std::filesystem::exists(path)) {
         return false;
     }
+    memoryEngine->loadSnapshot(path);
+    return true;
+}
+
+/*
+    BGSAVE: write a snapshot of every store from a forked child, while the store goes on serving.
+    Throws if no snapshot file is set or a save is already running.
+
+    Simple string reply: Background saving started.
+*/
+std::string KeyValueStore::bgSave() {
+    if (!memoryEngine || snapshotPath.empty()) {
+        throw std::runtime_error("no snapshot file is set.");
+    }
+    if (!memoryEngine->saveSnapshot(snapshotPath)) {
+        throw std::runtime_error("a background save is already in progress.");
+    }
+    return "Background saving started";
+}
+
+/*
+    SAVE: like BGSAVE, but wait until the snapshot is on disk. A save already running is waited for first.
+    Throws if the snapshot could not be written.
+
+    Simple string reply: OK.
+*/
+std::string KeyValueStore::save() {
+    if (memoryEngine) {
+        memoryEngine->waitForSnapshot();
+    }
+    bgSave();
+    if (!memoryEngine->waitForSnapshot()) {
+        throw std::runtime_error("the snapshot could not be written.");
+    }
+    return "OK";
+}
+
+/*
+    LASTSAVE: the Unix time in seconds of the data in the last snapshot saved or loaded, 0 if there is none.
+*/
+int64_t KeyValueStore::lastSave() {
+    return memoryEngine ? memoryEngine->lastSnapshot() / 1000 : 0;
+}
+
+/*
+    Block until every SET and DEL issued so far is committed to the database. 
+    For the in-memory backend, block until every write is on disk in the append-only log; a no-op without one.
+*/
+void KeyValueStore::flush() {
+    engine->flush();
+}
+
+/*
+    Helper function to get the hot tier of a store. Must be called with cacheMutex held.
+    The cache is created on first use with the policy, capacity and byte budget from the eviction table 
+    (a one-off query per store, made under the lock), and dropped whenever the policy changes so that it is rebuilt with the new policy.
+
+    Coherence across threads: every write to a store, and the creation of its cache, stamps the cache with a new cacheEpoch. 
+    A reader that misses remembers the epoch before going to the database and only fills the cache if the store has not been written since, 
+    so a slow read can never overwrite the cache with a value older than a concurrent write.
+*/
+StoreCache& KeyValueStore::cacheFor(const size_t storeId) {
+    auto it = caches.find(storeId);
+    if (it != caches.end()) {
+        return it->second;
+    }
+
+    auto config = engine->getEvictionConfig(storeId);
+    auto policy = config ? config->policy : "lru";
+    auto capacity = config ? config->capacity : DEFAULT_CAPACITY;
+    auto maxMemory = config ? config->maxMemory : 0;
+    auto& cache = caches.try_emplace(storeId, policy, capacity, maxMemory).first->second;
+    cache.recordWrite(++cacheEpoch);
+    return cache;
+}
+
+void KeyValueStore::dropCache(const size_t storeId) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    caches.erase(storeId);
+}
+
+static std::optional<CacheEntry> lookup(StoreCache& cache, const KeyView key) {
+    auto entry = cache.find(key);
+    if (!entry) {
+        return std::nullopt;
+    }
+    if (isExpired(entry->expiration)) {
+        cache.erase(key);
+        return std::nullopt;
+    }
+    return *entry;
+}
+
+/*
+    Helper function to look a key up in the cache. Expired entries are dropped and reported as a miss. 
+    On a miss, epoch receives the token to pass to fillCache.
+*/
+std::optional<CacheEntry> KeyValueStore::cachedEntry(const size_t storeId, const std::string& key, size_t& epoch) {
+    if (!engine->cacheable()) {
+        return std::nullopt;
+    }
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto& cache = cacheFor(storeId);
+    epoch = cacheEpoch;
+    return lookup(cache, key);
+}
+
+std::vector<std::optional<CacheEntry>> KeyValueStore::cachedEntries(const size_t storeId, const std::vector<std::string>& keys, size_t& epoch) {
+    if (!engine->cacheable()) {
+        return std::vector<std::optional<CacheEntry>>(keys.size());
+    }
+
+    std::vector<std::optional<CacheEntry>> ret;
+    ret.reserve(keys.size());
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto& cache = cacheFor(storeId);
+    epoch = cacheEpoch;
+    for (const auto& key : keys) {
+        ret.push_back(lookup(cache, key));
+    }
+    return ret;
+}
+
+void KeyValueStore::fillCache(const size_t storeId, const std::string& key, const CacheEntry& entry, const size_t epoch) {
+    if (!engine->cacheable()) return;
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto& cache = cacheFor(storeId);
+    if (cache.lastWrite() <= epoch) {
+        cache.put(key, entry.value, entry.expiration);
+    }
+}
+
+void KeyValueStore::fillCache(const size_t storeId, const std::vector<std::string>& keys, const std::vector<std::optional<StringEntry>>& entries, const size_t epoch) {
+    if (!engine->cacheable()) return;
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto& cache = cacheFor(storeId);
+    if (cache.lastWrite() > epoch) {
+        return;
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (entries[i]) {
+            cache.put(keys[i], entries[i]->value, entries[i]->expiration);
+        }
+    }
+}
+
+/*
+    Helper functions to bracket a database write. 
+    beginWrite drops the cached key; endWrite caches the new entry if no other write to the store overlapped, and drops the key otherwise.
+    Like the other cache helpers, they do nothing when the engine is not cacheable.
+*/
+size_t KeyValueStore::beginWrite(const size_t storeId, const std::string& key) {
+    if (!engine->cacheable()) return 0;
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto& cache = cacheFor(storeId);
+    cache.erase(key);
+    cache.recordWrite(++cacheEpoch);
+    return cacheEpoch;
+}
+
+void KeyValueStore::endWrite(const size_t storeId, const std::string& key, const size_t epoch, const std::optional<CacheEntry>& entry) {
+    if (!engine->cacheable()) return;
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto& cache = cacheFor(storeId);
+    bool overlapped = cache.lastWrite() != epoch;
+    cache.recordWrite(++cacheEpoch);
+    if (entry && !overlapped) {
+        cache.put(key, entry->value, entry->expiration);
+    } else {
+        cache.erase(key);
+    }
+}
+
+size_t KeyValueStore::beginWrite(const size_t storeId, const std::vector<std::string>& keys) {
+    if (!engine->cacheable()) return 0;
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto& cache = cacheFor(storeId);
+    for (const auto& key : keys) {
+        cache.erase(key);
+    }
+    cache.recordWrite(++cacheEpoch);
+    return cacheEpoch;
+}
+
+/*
+    values holds the new persistent value of each key, or is empty if the keys were deleted.
+*/
+void KeyValueStore::endWrite(const size_t storeId, const std::vector<std::string>& keys, const size_t epoch, const std::vector<std::string>& values) {
+    if (!engine->cacheable()) return;
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto& cache = cacheFor(storeId);
+    bool overlapped = cache.lastWrite() != epoch;
+    cache.recordWrite(++cacheEpoch);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (!values.empty() && !overlapped) {
+            cache.put(keys[i], values[i], std::nullopt);
+        } else {
+            cache.erase(keys[i]);
+        }
+    }
+}
 
-    auto now = std::chrono::steady_clock::now();
-    if (now > *expirationTimeOpt) {
-        dbManager.deleteKey(storeId, key);
-        return true;
+/*
+    Helper function called by the active expirer with keys whose TTL has passed. 
+    The engine only deletes keys that are still expired, and the keys are dropped from the cache so they stop taking up its capacity. 
+    The visible contents of the store do not change, so the write epoch is left alone.
+*/
+size_t KeyValueStore::reapExpired(const size_t storeId, const std::vector<std::string>& keys) {
+    auto reaped = engine->deleteExpiredStrings(storeId, keys);
+    if (engine->cacheable()) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = caches.find(storeId);
+        if (it != caches.end()) {
+            for (const auto& key : keys) {
+                it->second.erase(key); // a key that was renewed just misses once
+            }
+        }
     }
-    return false;
+    return reaped;
 }
 
 /*
@@ -78,32 +454,133 @@ bool KeyValueStore::isExpired(const size_t storeId, const std::string& key, cons
     Integer reply: 1 if the timeout was set.
 */
 size_t KeyValueStore::expire(const size_t storeId, const std::string& key, const std::chrono::seconds& sec) {
-    if (sec <= std::chrono::seconds(0)) {
-        dbManager.deleteKey(storeId, key);
+    return expireAtTime(storeId, key, expirationAfter(currentTime(), sec.count(), 1000));
+}
+
+/*
+    PEXPIRE key milliseconds [NX | XX | GT | LT]
+
+    This command works exactly like EXPIRE but the time to live of the key is specified in milliseconds instead of seconds.
+
+    Integer reply: 0 if the timeout was not set. For example, if the key doesn't exist, or the operation skipped because of the provided arguments.
+    Integer reply: 1 if the timeout was set.
+*/
+size_t KeyValueStore::pExpire(const size_t storeId, const std::string& key, const std::chrono::milliseconds& ms) {
+    return expireAtTime(storeId, key, expirationAfter(currentTime(), ms.count(), 1));
+}
+
+/*
+    EXPIREAT key unix-time-seconds [NX | XX | GT | LT]
+
+    EXPIREAT has the same effect and semantic as EXPIRE, but instead of specifying the number of seconds representing the TTL (time to live), 
+    it takes an absolute Unix timestamp (seconds since January 1, 1970). A timestamp in the past will delete the key immediately.
+
+    Integer reply: 0 if the timeout was not set; for example, the key doesn't exist, or the operation was skipped because of the provided arguments.
+    Integer reply: 1 if the timeout was set.
+*/
+size_t KeyValueStore::expireAt(const size_t storeId, const std::string& key, const int64_t unixSeconds) {
+    return expireAtTime(storeId, key, expirationAfter(ExpirationTime(), unixSeconds, 1000));
+}
+
+/*
+    PEXPIREAT key unix-time-milliseconds [NX | XX | GT | LT]
+
+    PEXPIREAT has the same effect and semantic as EXPIREAT, but the Unix time at which the key will expire is specified in milliseconds instead of seconds.
+
+    Integer reply: 0 if the timeout was not set. For example, if the key doesn't exist, or the operation was skipped due to the provided arguments.
+    Integer reply: 1 if the timeout was set.
+*/
+size_t KeyValueStore::pExpireAt(const size_t storeId, const std::string& key, const int64_t unixMilliseconds) {
+    return expireAtTime(storeId, key, fromUnixMilliseconds(unixMilliseconds));
+}
+
+/*
+    Helper function behind the EXPIRE family. The expiration is stored as an absolute wall-clock time in milliseconds;
+    like Redis, a time that does not fit in them (std::nullopt) is rejected and leaves the key alone.
+*/
+size_t KeyValueStore::expireAtTime(const size_t storeId, const std::string& key, const std::optional<ExpirationTime>& time) {
+    if (!time) {
+        throw std::runtime_error("invalid expire time.");
+    }
+    auto expiration = *time;
+    auto epoch = beginWrite(storeId, key);
+    if (expiration <= currentTime()) {
+        engine->deleteKey(storeId, key);
+        endWrite(storeId, key, epoch, std::nullopt);
+        expirer->cancel(storeId, {key});
         return 0;
     }
 
-    return dbManager.setExpiration(storeId, key, sec);
+    // the next GET reloads the key together with its new expiration
+    auto updated = engine->setExpiration(storeId, key, expiration);
+    endWrite(storeId, key, epoch, std::nullopt);
+    if (updated) {
+        expirer->schedule(storeId, key, expiration);
+    }
+    return updated;
 }
 
-// /*
-//     PERSIST key
+/*
+    PERSIST key
 
-//     Remove the existing timeout on key, turning the key from volatile (a key with an expire set) to persistent (a key that will never expire as no timeout is associated).
+    Remove the existing timeout on key, turning the key from volatile (a key with an expire set) to persistent (a key that will never expire as no timeout is associated).
 
-//     Integer reply: 0 if key does not exist or does not have an associated timeout.
-//     Integer reply: 1 if the timeout has been removed.
-// */
-// size_t KeyValueStore::persist(const std::string& key) {
-//     auto store_it = store.find(key);
-//     if (store_it == store.end()) return 0;
+    Integer reply: 0 if key does not exist or does not have an associated timeout.
+    Integer reply: 1 if the timeout has been removed.
+*/
+size_t KeyValueStore::persist(const size_t storeId, const std::string& key) {
+    auto epoch = beginWrite(storeId, key);
+    auto cleared = engine->clearExpiration(storeId, key);
+    endWrite(storeId, key, epoch, std::nullopt);
+    if (cleared) {
+        expirer->cancel(storeId, {key});
+    }
+    return cleared;
+}
 
-//     auto expire_it = expiration.find(key);
-//     if (expire_it == expiration.end()) return 0;
+/*
+    PTTL key
 
-//     expiration.erase(key);
-//     return 1;
-// }
+    Like TTL this command returns the remaining time to live of a key that has an expire set, 
+    with the sole difference that TTL returns the amount of remaining time in seconds while PTTL returns it in milliseconds.
+    A cached key is answered from its cached expiration.
+
+    Integer reply: TTL in milliseconds.
+    Integer reply: -1 if the key exists but has no associated expiration.
+    Integer reply: -2 if the key does not exist.
+*/
+int64_t KeyValueStore::pTTL(const size_t storeId, const std::string& key) {
+    std::optional<std::optional<ExpirationTime>> expiration;
+    size_t epoch;
+    if (auto cached = cachedEntry(storeId, key, epoch)) {
+        expiration = cached->expiration;
+    } else {
+        expiration = engine->getExpiration(storeId, key);
+    }
+
+    if (!expiration) {
+        return -2;
+    }
+    if (!*expiration) {
+        return -1;
+    }
+    return std::max<int64_t>(0, (**expiration - currentTime()).count());
+}
+
+/*
+    TTL key
+
+    Returns the remaining time to live of a key that has a timeout. 
+    This introspection capability allows a Redis client to check how many seconds a given key will continue to be part of the dataset.
+
+    Integer reply: TTL in seconds.
+    Integer reply: -1 if the key exists but has no associated expiration.
+    Integer reply: -2 if the key does not exist.
+*/
+int64_t KeyValueStore::ttl(const size_t storeId, const std::string& key) {
+    auto ms = pTTL(storeId, key);
+    return ms < 0 ? ms : (ms + 500) / 1000;
+}
 
 /*
     SET key value [NX | XX] [GET] [EX seconds | PX milliseconds |
@@ -119,7 +596,9 @@ size_t KeyValueStore::expire(const size_t storeId, const std::string& key, const
     Bulk string reply: GET given: The previous value of the key.
 */
 std::string KeyValueStore::set(const size_t storeId, const std::string& key, const std::string& val) {
-    dbManager.insertString(storeId, key, val);
+    auto epoch = beginWrite(storeId, key);
+    engine->insertString(storeId, key, val);
+    endWrite(storeId, key, epoch, CacheEntry{val, std::nullopt});
     // evictionPolicy->keyAccessed(key);
     // if (dbManager.exceedsCapacity(storeId)) {
     //     auto evicted = dbManager.evict(storeId);
@@ -137,16 +616,26 @@ std::string KeyValueStore::set(const size_t storeId, const std::string& key, con
     If the key does not exist the special value nil is returned. 
     An error is returned if the value stored at key is not a string, because GET only handles string values.
 
+    Hits are served from the store's cache without touching the database. 
+    An expired cached key is treated as a miss, and the database removes it as part of the read.
+    Misses read the value and expiration from the database in one round trip and populate the cache.
+
     Bulk string reply: the value of the key.
     Nil reply: if the key does not exist.
 */
 std::optional<std::string> KeyValueStore::get(const size_t storeId, const std::string& key) {
-    if (isExpired(storeId, key, "string")) {
+    size_t epoch;
+    if (auto cached = cachedEntry(storeId, key, epoch)) {
+        return std::move(cached->value);
+    }
+
+    auto entry = engine->fetchLiveString(storeId, key);
+    if (!entry) {
         return std::nullopt;
     }
 
-    // evictionPolicy->keyAccessed(key);
-    return dbManager.fetchString(storeId, key);
+    fillCache(storeId, key, CacheEntry{entry->value, entry->expiration}, epoch);
+    return std::move(entry->value);
 }
 
 /* 
@@ -158,286 +647,421 @@ std::optional<std::string> KeyValueStore::get(const size_t storeId, const std::s
     Integer reply: the number of keys that were removed.
 */
 size_t KeyValueStore::del(const size_t storeId, const std::string& key) {
-    dbManager.deleteString(storeId, key);
-    return 1;
+    return del(storeId, std::vector<std::string>{key});
 }
 
-// /*
-//     LPUSH key element [element ...]
+/*
+    Helper function to drop repeated keys, keeping the first occurrence of each.
+*/
+static std::vector<std::string> distinctKeys(const std::vector<std::string>& keys) {
+    std::vector<std::string> distinct;
+    std::unordered_set<std::string> seen;
+    for (const auto& key : keys) {
+        if (seen.insert(key).second) {
+            distinct.push_back(key);
+        }
+    }
+    return distinct;
+}
 
-//     Insert all the specified values at the head of the list stored at key. 
-//     If key does not exist, it is created as empty list before performing the push operations. 
-//     When key holds a value that is not a list, an error is returned.
+size_t KeyValueStore::del(const size_t storeId, const std::vector<std::string>& keys) {
+    auto distinct = distinctKeys(keys);
+    auto epoch = beginWrite(storeId, distinct);
+    auto removed = engine->deleteKeys(storeId, distinct);
+    endWrite(storeId, distinct, epoch, {});
+    if (removed) {
+        expirer->cancel(storeId, distinct);
+    }
+    return removed;
+}
 
-//     It is possible to push multiple elements using a single command call just specifying multiple arguments at the end of the command. 
-//     Elements are inserted one after the other to the head of the list, from the leftmost element to the rightmost element. 
-//     So for instance the command LPUSH mylist a b c will result into a list containing c as first element, b as second element and a as third element.
+/*
+    MGET key [key ...]
 
-//     Integer reply: the length of the list after the push operation.
-// */
-// size_t KeyValueStore::lPush(const std::string& key, const std::string& val) {
-//     isExpired(key);
-//     auto [it, inserted] = store.emplace(key, std::deque<std::string>());
-    
-//     if (!inserted && !it->second.isList()) {
-//         throw TypeMismatchError(key, "list");
-//     }
+    Returns the values of all specified keys. 
+    For every key that does not hold a string value or does not exist, the special value nil is returned. 
+    Cached keys are served from memory and all remaining keys are fetched from the database in a single query.
 
-//     auto& lst = it->second.getList();
-//     lst.push_front(val);
-//     evictionPolicy->keyAccessed(key);
-//     if (store.size() > capacity) {
-//         auto evicted = evictionPolicy->evict();
-//         store.erase(evicted);
-//     }
-//     return lst.size();
-// }
+    Array reply: a list of values at the specified keys.
+*/
+std::vector<std::optional<std::string>> KeyValueStore::mget(const size_t storeId, const std::vector<std::string>& keys) {
+    size_t epoch;
+    auto cached = cachedEntries(storeId, keys, epoch);
+
+    std::vector<std::optional<std::string>> ret(keys.size());
+    std::vector<std::string> misses;
+    std::vector<size_t> missPositions;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (cached[i]) {
+            ret[i] = std::move(cached[i]->value);
+        } else {
+            misses.push_back(keys[i]);
+            missPositions.push_back(i);
+        }
+    }
 
-// /*
-//     RPUSH key element [element ...]
+    if (misses.empty()) {
+        return ret;
+    }
 
-//     Insert all the specified values at the tail of the list stored at key. 
-//     If key does not exist, it is created as empty list before performing the push operation. 
-//     When key holds a value that is not a list, an error is returned.
+    auto entries = engine->fetchLiveStrings(storeId, misses);
+    fillCache(storeId, misses, entries, epoch);
+    for (size_t i = 0; i < misses.size(); ++i) {
+        if (entries[i]) {
+            ret[missPositions[i]] = std::move(entries[i]->value);
+        }
+    }
+    return ret;
+}
 
-//     It is possible to push multiple elements using a single command call just specifying multiple arguments at the end of the command. 
-//     Elements are inserted one after the other to the tail of the list, from the leftmost element to the rightmost element. 
-//     So for instance the command RPUSH mylist a b c will result into a list containing a as first element, b as second element and c as third element.
+/*
+    MSET key value [key value ...]
 
-//     Integer reply: the length of the list after the push operation.
-// */
-// size_t KeyValueStore::rPush(const std::string& key, const std::string& val) {
-//     isExpired(key);
-//     auto [it, inserted] = store.emplace(key, std::deque<std::string>());
-    
-//     if (!inserted && !it->second.isList()) {
-//         throw TypeMismatchError(key, "list");
-//     }
+    Sets the given keys to their respective values. 
+    MSET replaces existing values with new values, just as regular SET. 
+    If the same key is given more than once, the last value wins. 
+    All keys are written to the database with a single statement.
 
-//     auto& lst = it->second.getList();
-//     lst.push_back(val);
-//     evictionPolicy->keyAccessed(key);
-//     if (store.size() > capacity) {
-//         auto evicted = evictionPolicy->evict();
-//         store.erase(evicted);
-//     }
-//     return lst.size();
-// }
+    Simple string reply: always OK because MSET can't fail.
+*/
+std::string KeyValueStore::mset(const size_t storeId, const std::vector<std::pair<std::string, std::string>>& pairs) {
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    std::unordered_map<std::string, size_t> positions;
+    for (const auto& [key, val] : pairs) {
+        auto [it, inserted] = positions.try_emplace(key, keys.size());
+        if (inserted) {
+            keys.push_back(key);
+            values.push_back(val);
+        } else {
+            values[it->second] = val;
+        }
+    }
 
-// /*
-//     LPOP key [count]
+    auto epoch = beginWrite(storeId, keys);
+    engine->insertStrings(storeId, keys, values);
+    endWrite(storeId, keys, epoch, values);
+    return "OK";
+}
 
-//     Removes and returns the first elements of the list stored at key.
-//     By default, the command pops a single element from the beginning of the list. 
-//     When provided with the optional count argument, the reply will consist of up to count elements, depending on the list's length.
+/*
+    LPUSH key element [element ...]
 
-//     Nil reply: if the key does not exist.
-//     Bulk string reply: when called without the count argument, the value of the first element.
-//     Array reply: when called with the count argument, a list of popped elements.
-// */
-// std::optional<std::string> KeyValueStore::lPop(const std::string& key) {
-//     isExpired(key);
-//     auto it = store.find(key);
-//     if (it == store.end() || !it->second.isList() || it->second.getList().empty()) {
-//         return std::nullopt;
-//     }
+    Insert all the specified values at the head of the list stored at key. 
+    If key does not exist, it is created as empty list before performing the push operations. 
+    When key holds a value that is not a list, an error is returned.
 
-//     auto& lst = it->second.getList();
-//     auto ret = std::move(lst.front());
-//     lst.pop_front();
-//     evictionPolicy->keyAccessed(key);
-//     return ret;
-// }
+    It is possible to push multiple elements using a single command call just specifying multiple arguments at the end of the command. 
+    Elements are inserted one after the other to the head of the list, from the leftmost element to the rightmost element. 
+    So for instance the command LPUSH mylist a b c will result into a list containing c as first element, b as second element and a as third element.
 
-// /*
-//     RPOP key [count]
+    Integer reply: the length of the list after the push operation.
+*/
+size_t KeyValueStore::lPush(const size_t storeId, const std::string& key, const std::vector<std::string>& vals) {
+    if (vals.empty()) {
+        throw std::runtime_error("wrong number of arguments for LPUSH.");
+    }
+    return engine->listPush(storeId, key, vals, ListEnd::HEAD);
+}
 
-//     Removes and returns the last elements of the list stored at key.
-//     By default, the command pops a single element from the end of the list.
-//     When provided with the optional count argument, the reply will consist of up to count elements, depending on the list's length.
+/*
+    RPUSH key element [element ...]
 
-//     Nil reply: if the key does not exist.
-//     Bulk string reply: when called without the count argument, the value of the last element.
-//     Array reply: when called with the count argument, a list of popped elements.
-// */
-// std::optional<std::string> KeyValueStore::rPop(const std::string& key) {
-//     isExpired(key);
-//     auto it = store.find(key);
-//     if (it == store.end() || !it->second.isList() || it->second.getList().empty()) {
-//         return std::nullopt;
-//     }
+    Insert all the specified values at the tail of the list stored at key. 
+    If key does not exist, it is created as empty list before performing the push operation. 
+    When key holds a value that is not a list, an error is returned.
 
-//     auto& lst = it->second.getList();
-//     auto ret = std::move(lst.back());
-//     lst.pop_back();
-//     evictionPolicy->keyAccessed(key);
-//     return ret;
-// }
+    It is possible to push multiple elements using a single command call just specifying multiple arguments at the end of the command. 
+    Elements are inserted one after the other to the tail of the list, from the leftmost element to the rightmost element. 
+    So for instance the command RPUSH mylist a b c will result into a list containing a as first element, b as second element and c as third element.
 
-// /*
-//     LRANGE key start stop
+    Integer reply: the length of the list after the push operation.
+*/
+size_t KeyValueStore::rPush(const size_t storeId, const std::string& key, const std::vector<std::string>& vals) {
+    if (vals.empty()) {
+        throw std::runtime_error("wrong number of arguments for RPUSH.");
+    }
+    return engine->listPush(storeId, key, vals, ListEnd::TAIL);
+}
 
-//     Returns the specified elements of the list stored at key. 
-//     The offsets start and stop are zero-based indexes, with 0 being the first element of the list (the head of the list), 1 being the next element and so on.
-//     These offsets can also be negative numbers indicating offsets starting at the end of the list. 
-//     For example, -1 is the last element of the list, -2 the penultimate, and so on.
-//     Note that right most element is included. 
+/*
+    LPOP key [count]
 
-//     Array reply: a list of elements in the specified range, or an empty array if the key doesn't exist.
-// */
-// std::optional<std::deque<std::string>> KeyValueStore::lRange(const std::string& key, const int& start, const int& end) {
-//     isExpired(key);
-//     if (start > end || start < 0 || end < 0) return std::nullopt;
-    
-//     auto it = store.find(key);
-//     if (it == store.end() || !it->second.isList()) return std::nullopt;
+    Removes and returns the first elements of the list stored at key.
+    By default, the command pops a single element from the beginning of the list. 
+    When provided with the optional count argument, the reply will consist of up to count elements, depending on the list's length.
+    The key is removed together with its last element.
 
-//     auto& lst = it->second.getList();
-//     if (start >= lst.size()) return std::nullopt;
+    Nil reply: if the key does not exist.
+    Bulk string reply: when called without the count argument, the value of the first element.
+    Array reply: when called with the count argument, a list of popped elements.
+*/
+std::optional<std::string> KeyValueStore::lPop(const size_t storeId, const std::string& key) {
+    auto popped = engine->listPop(storeId, key, 1, ListEnd::HEAD);
+    if (popped.empty()) {
+        return std::nullopt;
+    }
+    return std::move(popped.front());
+}
 
-//     evictionPolicy->keyAccessed(key);
-//     auto endIdx = std::min(static_cast<size_t>(end), lst.size()-1);
-//     return std::deque<std::string>(lst.begin()+start, lst.begin()+endIdx+1);
-// }
+std::vector<std::string> KeyValueStore::lPop(const size_t storeId, const std::string& key, const size_t count) {
+    return engine->listPop(storeId, key, count, ListEnd::HEAD);
+}
 
-// /*
-//     LLEN key
+/*
+    RPOP key [count]
 
-//     Returns the length of the list stored at key. 
-//     If key does not exist, it is interpreted as an empty list and 0 is returned. 
-//     An error is returned when the value stored at key is not a list.
+    Removes and returns the last elements of the list stored at key.
+    By default, the command pops a single element from the end of the list.
+    When provided with the optional count argument, the reply will consist of up to count elements, depending on the list's length.
+    The key is removed together with its last element.
 
-//     Integer reply: the length of the list.
-// */
-// size_t KeyValueStore::lLen(const std::string& key) {
-//     isExpired(key);
-//     auto it = store.find(key);
-//     if (it == store.end()) {
-//         return 0;
-//     }
+    Nil reply: if the key does not exist.
+    Bulk string reply: when called without the count argument, the value of the last element.
+    Array reply: when called with the count argument, a list of popped elements.
+*/
+std::optional<std::string> KeyValueStore::rPop(const size_t storeId, const std::string& key) {
+    auto popped = engine->listPop(storeId, key, 1, ListEnd::TAIL);
+    if (popped.empty()) {
+        return std::nullopt;
+    }
+    return std::move(popped.front());
+}
 
-//     if (!it->second.isList()) {
-//         throw TypeMismatchError(key, "list");
-//     }
-//     evictionPolicy->keyAccessed(key);
-//     return it->second.getList().size();
-// }
+std::vector<std::string> KeyValueStore::rPop(const size_t storeId, const std::string& key, const size_t count) {
+    return engine->listPop(storeId, key, count, ListEnd::TAIL);
+}
 
-// /*
-//     SADD key member [member ...]
+/*
+    LRANGE key start stop
 
-//     Add the specified members to the set stored at key. 
-//     Specified members that are already a member of this set are ignored. 
-//     If key does not exist, a new set is created before adding the specified members.
-//     An error is returned when the value stored at key is not a set.
+    Returns the specified elements of the list stored at key. 
+    The offsets start and stop are zero-based indexes, with 0 being the first element of the list (the head of the list), 1 being the next element and so on.
+    These offsets can also be negative numbers indicating offsets starting at the end of the list. 
+    For example, -1 is the last element of the list, -2 the penultimate, and so on.
+    Out of range indexes will not produce an error: they are clamped to the list.
 
-//     Integer reply: the number of elements that were added to the set, not including all the elements already present in the set.
-// */
-// size_t KeyValueStore::sAdd(const std::string& key, const std::string& val) {
-//     isExpired(key);
-//     auto [it, inserted] = store.emplace(key, std::unordered_set<std::string>());
-//     if (!inserted && !it->second.isSet()) {
-//         throw TypeMismatchError(key, "set");
-//     }
+    Array reply: a list of elements in the specified range, or an empty array if the key doesn't exist.
+*/
+std::vector<std::string> KeyValueStore::lRange(const size_t storeId, const std::string& key, const int64_t start, const int64_t stop) {
+    return engine->listRange(storeId, key, start, stop);
+}
 
-//     auto& set = it->second.getSet();
-//     set.insert(val);
-//     evictionPolicy->keyAccessed(key);
-//     if (store.size() > capacity) {
-//         auto evicted = evictionPolicy->evict();
-//         store.erase(evicted);
-//     }
-//     return 1;
-// }
+/*
+    LLEN key
 
-// /*
-//     SREM key member [member ...]
+    Returns the length of the list stored at key. 
+    If key does not exist, it is interpreted as an empty list and 0 is returned. 
+    An error is returned when the value stored at key is not a list.
 
-//     Remove the specified members from the set stored at key. 
-//     Specified members that are not a member of this set are ignored. 
-//     If key does not exist, it is treated as an empty set and this command returns 0.
-//     An error is returned when the value stored at key is not a set.
+    Integer reply: the length of the list.
+*/
+size_t KeyValueStore::lLen(const size_t storeId, const std::string& key) {
+    return engine->listLength(storeId, key);
+}
 
-//     Integer reply: the number of members that were removed from the set, not including non existing members.
-// */
-// size_t KeyValueStore::sRem(const std::string& key, const std::string& val) {
-//     isExpired(key);
-//     auto it = store.find(key);
-//     if (it == store.end()) {
-//         return 0;
-//     }
+/*
+    SADD key member [member ...]
 
-//     if (!it->second.isSet()) {
-//         throw TypeMismatchError(key, "set");
-//     }
+    Add the specified members to the set stored at key. 
+    Specified members that are already a member of this set are ignored. 
+    If key does not exist, a new set is created before adding the specified members.
+    An error is returned when the value stored at key is not a set.
 
-//     evictionPolicy->keyAccessed(key);
-//     return it->second.getSet().erase(val);
-// }
+    Integer reply: the number of elements that were added to the set, not including all the elements already present in the set.
+*/
+size_t KeyValueStore::sAdd(const size_t storeId, const std::string& key, const std::vector<std::string>& members) {
+    if (members.empty()) {
+        throw std::runtime_error("wrong number of arguments for SADD.");
+    }
+    return engine->setAdd(storeId, key, members);
+}
 
-// /*
-//     SMEMBERS key
+/*
+    SREM key member [member ...]
 
-//     Returns all the members of the set value stored at key.
-//     This has the same effect as running SINTER with one argument key.
+    Remove the specified members from the set stored at key. 
+    Specified members that are not a member of this set are ignored. 
+    If key does not exist, it is treated as an empty set and this command returns 0.
+    An error is returned when the value stored at key is not a set.
+    The key is removed together with its last member.
 
-//     Set reply: a set with all the members of the set.
-// */
-// std::unordered_set<std::string> KeyValueStore::sMembers(const std::string& key) {
-//     isExpired(key);
-//     auto it = store.find(key);
-//     if (it == store.end()) {
-//         return {};
-//     }
+    Integer reply: the number of members that were removed from the set, not including non existing members.
+*/
+size_t KeyValueStore::sRem(const size_t storeId, const std::string& key, const std::vector<std::string>& members) {
+    if (members.empty()) {
+        throw std::runtime_error("wrong number of arguments for SREM.");
+    }
+    return engine->setRemove(storeId, key, members);
+}
 
-//     if (!it->second.isSet()) {
-//         throw TypeMismatchError(key, "set");
-//     }
-//     evictionPolicy->keyAccessed(key);
-//     return it->second.getSet();
-// }
+/*
+    SMEMBERS key
 
-// /*
-//     SISMEMBER key member
+    Returns all the members of the set value stored at key.
+    This has the same effect as running SINTER with one argument key.
 
-//     Returns if member is a member of the set stored at key.
+    Array reply: all members of the set, in no particular order.
+*/
+std::vector<std::string> KeyValueStore::sMembers(const size_t storeId, const std::string& key) {
+    return engine->setMembers(storeId, key);
+}
 
-//     Integer reply: 0 if the element is not a member of the set, or when the key does not exist.
-//     Integer reply: 1 if the element is a member of the set.
-// */
-// size_t KeyValueStore::sIsMember(const std::string& key, const std::string& val) {
-//     isExpired(key);
-//     auto it = store.find(key);
-//     if (it == store.end()) {
-//         return 0;
-//     }
+/*
+    SISMEMBER key member
 
-//     if (!it->second.isSet()) {
-//         throw TypeMismatchError(key, "set");
-//     }
+    Returns if member is a member of the set stored at key.
 
-//     evictionPolicy->keyAccessed(key);
-//     const auto& set = it->second.getSet();
-//     return set.contains(val) ? 1 : 0;
-// }
+    Integer reply: 0 if the element is not a member of the set, or when the key does not exist.
+    Integer reply: 1 if the element is a member of the set.
+*/
+size_t KeyValueStore::sIsMember(const size_t storeId, const std::string& key, const std::string& member) {
+    return engine->setContains(storeId, key, member) ? 1 : 0;
+}
 
-// /*
-//     SCARD key
+/*
+    SCARD key
 
-//     Returns the set cardinality (number of elements) of the set stored at key.
+    Returns the set cardinality (number of elements) of the set stored at key.
 
-//     Integer reply: the cardinality (number of elements) of the set, or 0 if the key does not exist.
-// */
-// size_t KeyValueStore::sCard(const std::string& key) {
-//     isExpired(key);
-//     auto it = store.find(key);
-//     if (it == store.end()) {
-//         return 0;
-//     }
+    Integer reply: the cardinality (number of elements) of the set, or 0 if the key does not exist.
+*/
+size_t KeyValueStore::sCard(const size_t storeId, const std::string& key) {
+    return engine->setSize(storeId, key);
+}
 
-//     if (!it->second.isSet()) {
-//         throw TypeMismatchError(key, "set");
-//     }
-//     evictionPolicy->keyAccessed(key);
-//     return it->second.getSet().size();
-// }
\ No newline at end of file
+/*
+    SINTER key [key ...]
+
+    Returns the members of the set resulting from the intersection of all the given sets.
+    Keys that do not exist are considered to be empty sets, so with one of them the result is empty. 
+    The smallest set is walked and each member is looked up in the others, smallest first.
+
+    Array reply: a list with the members of the resulting set.
+*/
+std::vector<std::string> KeyValueStore::sInter(const size_t storeId, const std::vector<std::string>& keys) {
+    return engine->setCombine(storeId, distinctKeys(keys), SetOperation::INTERSECTION);
+}
+
+/*
+    SUNION key [key ...]
+
+    Returns the members of the set resulting from the union of all the given sets.
+    Keys that do not exist are considered to be empty sets.
+
+    Array reply: a list with the members of the resulting set.
+*/
+std::vector<std::string> KeyValueStore::sUnion(const size_t storeId, const std::vector<std::string>& keys) {
+    return engine->setCombine(storeId, distinctKeys(keys), SetOperation::UNION);
+}
+
+/*
+    SDIFF key [key ...]
+
+    Returns the members of the set resulting from the difference between the first set and all the successive sets.
+    Keys that do not exist are considered to be empty sets.
+
+    Array reply: a list with the members of the resulting set.
+*/
+std::vector<std::string> KeyValueStore::sDiff(const size_t storeId, const std::vector<std::string>& keys) {
+    if (keys.empty()) {
+        throw std::runtime_error("wrong number of arguments for SDIFF.");
+    }
+    auto ret = engine->setCombine(storeId, distinctKeys(keys), SetOperation::DIFFERENCE);
+    if (std::find(keys.begin() + 1, keys.end(), keys.front()) != keys.end()) {
+        ret.clear(); // the first set minus itself
+    }
+    return ret;
+}
+
+/*
+    HSET key field value [field value ...]
+
+    Sets the specified fields to their respective values in the hash stored at key.
+    This command overwrites the values of specified fields that exist in the hash.
+    If key doesn't exist, a new key holding a hash is created.
+    If the same field is given more than once, the last value wins.
+    Only the given fields are written, so updating one field of a large object does not rewrite the others.
+
+    Integer reply: the number of fields that were added.
+*/
+size_t KeyValueStore::hSet(const size_t storeId, const std::string& key, const std::vector<std::pair<std::string, std::string>>& fieldValues) {
+    if (fieldValues.empty()) {
+        throw std::runtime_error("wrong number of arguments for HSET.");
+    }
+
+    std::vector<std::pair<std::string, std::string>> fields;
+    std::unordered_map<std::string, size_t> positions;
+    for (const auto& [field, val] : fieldValues) {
+        auto [it, inserted] = positions.try_emplace(field, fields.size());
+        if (inserted) {
+            fields.emplace_back(field, val);
+        } else {
+            fields[it->second].second = val;
+        }
+    }
+    return engine->hashSet(storeId, key, fields);
+}
+
+/*
+    HGET key field
+
+    Returns the value associated with field in the hash stored at key.
+
+    Bulk string reply: The value associated with the field.
+    Nil reply: If the field is not present in the hash or key does not exist.
+*/
+std::optional<std::string> KeyValueStore::hGet(const size_t storeId, const std::string& key, const std::string& field) {
+    return std::move(engine->hashGet(storeId, key, {field}).front());
+}
+
+/*
+    HMGET key field [field ...]
+
+    Returns the values associated with the specified fields in the hash stored at key.
+    For every field that does not exist in the hash, a nil value is returned. 
+    Because non-existing keys are treated as empty hashes, running HMGET against a non-existing key will return a list of nil values.
+
+    Array reply: a list of values associated with the given fields, in the same order as they are requested.
+*/
+std::vector<std::optional<std::string>> KeyValueStore::hMGet(const size_t storeId, const std::string& key, const std::vector<std::string>& fields) {
+    return engine->hashGet(storeId, key, fields);
+}
+
+/*
+    HGETALL key
+
+    Returns all fields and values of the hash stored at key.
+
+    Array reply: a list of fields and their values stored in the hash, or an empty list when key does not exist.
+*/
+std::vector<std::pair<std::string, std::string>> KeyValueStore::hGetAll(const size_t storeId, const std::string& key) {
+    return engine->hashGetAll(storeId, key);
+}
+
+/*
+    HDEL key field [field ...]
+
+    Removes the specified fields from the hash stored at key. 
+    Specified fields that do not exist within this hash are ignored. 
+    Deletes the hash if no fields remain. If key does not exist, it is treated as an empty hash and this command returns 0.
+
+    Integer reply: the number of fields that were removed from the hash, excluding any specified but non-existing fields.
+*/
+size_t KeyValueStore::hDel(const size_t storeId, const std::string& key, const std::vector<std::string>& fields) {
+    if (fields.empty()) {
+        throw std::runtime_error("wrong number of arguments for HDEL.");
+    }
+    return engine->hashDelete(storeId, key, distinctKeys(fields));
+}
+
+/*
+    HLEN key
+
+    Returns the number of fields contained in the hash stored at key.
+
+    Integer reply: the number of fields in the hash, or 0 when the key does not exist.
+*/
+size_t KeyValueStore::hLen(const size_t storeId, const std::string& key) {
+    return engine->hashLength(storeId, key);
+}
@@ -5,28 +5,102 @@
 
 namespace py = pybind11;
 
+// Store calls may block on Postgres I/O, so every binding drops the GIL while it runs in C++ and other Python threads keep going.
+// KeyValueStore is thread-safe, enabling and disabling write-behind included (DatabaseManager guards its queue with a lock);
+// arguments and results are converted while the GIL is held.
+using ReleaseGil = py::call_guard<py::gil_scoped_release>;
+
 PYBIND11_MODULE(key_value_store_module, m) {
     py::register_exception<TypeMismatchError>(m, "TypeMismatchError");
 
+    py::class_<PoolMetrics>(m, "PoolMetrics")
+        .def_readonly("size", &PoolMetrics::size)
+        .def_readonly("open", &PoolMetrics::open)
+        .def_readonly("in_use", &PoolMetrics::inUse)
+        .def_readonly("checkouts", &PoolMetrics::checkouts)
+        .def_readonly("waits", &PoolMetrics::waits)
+        .def_readonly("reconnects", &PoolMetrics::reconnects)
+        .def_readonly("total_wait", &PoolMetrics::totalWait)
+        .def_readonly("max_wait", &PoolMetrics::maxWait);
+
+    py::class_<ExpirationMetrics>(m, "ExpirationMetrics")
+        .def_readonly("scheduled", &ExpirationMetrics::scheduled)
+        .def_readonly("backlog", &ExpirationMetrics::backlog)
+        .def_readonly("checked", &ExpirationMetrics::checked)
+        .def_readonly("reaped", &ExpirationMetrics::reaped)
+        .def_readonly("failures", &ExpirationMetrics::failures)
+        .def_readonly("reap_rate", &ExpirationMetrics::reapRate);
+
+    py::class_<MemoryStats>(m, "MemoryStats")
+        .def_readonly("used_memory", &MemoryStats::usedMemory)
+        .def_readonly("maxmemory", &MemoryStats::maxMemory)
+        .def_readonly("keys", &MemoryStats::keys);
+
+    py::enum_<StorageBackend>(m, "StorageBackend")
+        .value("POSTGRES", StorageBackend::POSTGRES)
+        .value("MEMORY", StorageBackend::MEMORY);
+
+    py::enum_<FsyncPolicy>(m, "FsyncPolicy")
+        .value("ALWAYS", FsyncPolicy::ALWAYS)
+        .value("INTERVAL", FsyncPolicy::INTERVAL)
+        .value("OS", FsyncPolicy::OS);
+
     py::class_<KeyValueStore>(m, "KeyValueStore")
-        .def(py::init())
-        .def("setcapacity", &KeyValueStore::setCapacity)
-        .def("uselru", &KeyValueStore::useLRU)
-        .def("uselfu", &KeyValueStore::useLFU)
-        .def("expire", &KeyValueStore::expire)
-        .def("persist", &KeyValueStore::persist)
-        .def("set", &KeyValueStore::set)
-        .def("get", &KeyValueStore::get)
-        .def("delete", &KeyValueStore::del)
-        .def("lpush", &KeyValueStore::lPush)
-        .def("rpush", &KeyValueStore::rPush)
-        .def("lpop", &KeyValueStore::lPop)
-        .def("rpop", &KeyValueStore::rPop)
-        .def("lrange", &KeyValueStore::lRange)
-        .def("llen", &KeyValueStore::lLen)
-        .def("sadd", &KeyValueStore::sAdd)
-        .def("srem", &KeyValueStore::sRem)
-        .def("smembers", &KeyValueStore::sMembers)
-        .def("sismember", &KeyValueStore::sIsMember)
-        .def("scard", &KeyValueStore::sCard);
+        .def(py::init(), ReleaseGil())
+        .def(py::init<size_t>(), ReleaseGil())
+        .def(py::init<StorageBackend, size_t>(), py::arg("backend"), py::arg("pool_size") = DEFAULT_POOL_SIZE, ReleaseGil())
+        .def("poolmetrics", &KeyValueStore::poolMetrics, ReleaseGil())
+        .def("expirationmetrics", &KeyValueStore::expirationMetrics, ReleaseGil())
+        .def("uselru", &KeyValueStore::useLRU, ReleaseGil())
+        .def("uselfu", &KeyValueStore::useLFU, ReleaseGil())
+        .def("usetinylfu", &KeyValueStore::useTinyLFU, ReleaseGil())
+        .def("setmaxmemory", &KeyValueStore::setMaxMemory, ReleaseGil())
+        .def("memoryusage", &KeyValueStore::memoryUsage, ReleaseGil())
+        .def("memorystats", &KeyValueStore::memoryStats, ReleaseGil())
+        .def("enablewritebehind", &KeyValueStore::enableWriteBehind, ReleaseGil())
+        .def("disablewritebehind", &KeyValueStore::disableWriteBehind, ReleaseGil())
+        .def("flush", &KeyValueStore::flush, ReleaseGil())
+        .def("enableappendonlylog", &KeyValueStore::enableAppendOnlyLog, ReleaseGil())
+        .def("disableappendonlylog", &KeyValueStore::disableAppendOnlyLog, ReleaseGil())
+        .def("bgrewriteaof", &KeyValueStore::rewriteAppendOnlyLog, ReleaseGil())
+        .def("usesnapshot", &KeyValueStore::useSnapshot, py::arg("path"), py::arg("load") = true, ReleaseGil())
+        .def("bgsave", &KeyValueStore::bgSave, ReleaseGil())
+        .def("save", &KeyValueStore::save, ReleaseGil())
+        .def("lastsave", &KeyValueStore::lastSave, ReleaseGil())
+        .def("expire", &KeyValueStore::expire, ReleaseGil())
+        .def("pexpire", &KeyValueStore::pExpire, ReleaseGil())
+        .def("expireat", &KeyValueStore::expireAt, ReleaseGil())
+        .def("pexpireat", &KeyValueStore::pExpireAt, ReleaseGil())
+        .def("persist", &KeyValueStore::persist, ReleaseGil())
+        .def("ttl", &KeyValueStore::ttl, ReleaseGil())
+        .def("pttl", &KeyValueStore::pTTL, ReleaseGil())
+        .def("set", &KeyValueStore::set, ReleaseGil())
+        .def("get", &KeyValueStore::get, ReleaseGil())
+        .def("delete", py::overload_cast<const size_t, const std::string&>(&KeyValueStore::del), ReleaseGil())
+        .def("delete", py::overload_cast<const size_t, const std::vector<std::string>&>(&KeyValueStore::del), ReleaseGil())
+        .def("mget", &KeyValueStore::mget, ReleaseGil())
+        .def("mset", &KeyValueStore::mset, ReleaseGil())
+        .def("lpush", &KeyValueStore::lPush, ReleaseGil())
+        .def("rpush", &KeyValueStore::rPush, ReleaseGil())
+        .def("lpop", py::overload_cast<const size_t, const std::string&>(&KeyValueStore::lPop), ReleaseGil())
+        .def("lpop", py::overload_cast<const size_t, const std::string&, const size_t>(&KeyValueStore::lPop), ReleaseGil())
+        .def("rpop", py::overload_cast<const size_t, const std::string&>(&KeyValueStore::rPop), ReleaseGil())
+        .def("rpop", py::overload_cast<const size_t, const std::string&, const size_t>(&KeyValueStore::rPop), ReleaseGil())
+        .def("lrange", &KeyValueStore::lRange, ReleaseGil())
+        .def("llen", &KeyValueStore::lLen, ReleaseGil())
+        .def("sadd", &KeyValueStore::sAdd, ReleaseGil())
+        .def("srem", &KeyValueStore::sRem, ReleaseGil())
+        .def("smembers", &KeyValueStore::sMembers, ReleaseGil())
+        .def("sismember", &KeyValueStore::sIsMember, ReleaseGil())
+        .def("scard", &KeyValueStore::sCard, ReleaseGil())
+        .def("sinter", &KeyValueStore::sInter, ReleaseGil())
+        .def("sunion", &KeyValueStore::sUnion, ReleaseGil())
+        .def("sdiff", &KeyValueStore::sDiff, ReleaseGil())
+        .def("hset", &KeyValueStore::hSet, ReleaseGil())
+        .def("hget", &KeyValueStore::hGet, ReleaseGil())
+        .def("hmget", &KeyValueStore::hMGet, ReleaseGil())
+        .def("hgetall", &KeyValueStore::hGetAll, ReleaseGil())
+        .def("hdel", &KeyValueStore::hDel, ReleaseGil())
+        .def("hlen", &KeyValueStore::hLen, ReleaseGil());
+        // .def("setcapacity", &KeyValueStore::setCapacity)
 }
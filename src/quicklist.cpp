@@ -0,0 +1,189 @@
+#include <algorithm>
+#include "memory_usage.h"
+#include "quicklist.h"
+
+/*
+    Encode one element as [length][bytes][length]. 
+    The leading length is read forwards: a byte below 128, or four bytes starting with the high bit set. 
+    The trailing copy is the same bytes reversed, so it can be read backwards from the end of the element.
+*/
+std::string ListNode::encode(std::string_view value) {
+    auto length = value.size();
+    std::string prefix;
+    if (length < 128) {
+        prefix.push_back(static_cast<char>(length));
+    } else {
+        prefix.push_back(static_cast<char>(0x80 | ((length >> 24) & 0x7f)));
+        prefix.push_back(static_cast<char>((length >> 16) & 0xff));
+        prefix.push_back(static_cast<char>((length >> 8) & 0xff));
+        prefix.push_back(static_cast<char>(length & 0xff));
+    }
+
+    std::string ret = prefix;
+    ret.append(value);
+    ret.append(prefix.rbegin(), prefix.rend());
+    return ret;
+}
+
+static size_t readForward(const std::string& buffer, size_t pos, size_t& headerSize) {
+    auto first = static_cast<unsigned char>(buffer[pos]);
+    if (first < 128) {
+        headerSize = 1;
+        return first;
+    }
+    headerSize = 4;
+    return (size_t(first & 0x7f) << 24) | (size_t(static_cast<unsigned char>(buffer[pos + 1])) << 16) |
+           (size_t(static_cast<unsigned char>(buffer[pos + 2])) << 8) | size_t(static_cast<unsigned char>(buffer[pos + 3]));
+}
+
+// end is one past the last byte of the element
+static size_t readBackward(const std::string& buffer, size_t end, size_t& headerSize) {
+    auto last = static_cast<unsigned char>(buffer[end - 1]);
+    if (last < 128) {
+        headerSize = 1;
+        return last;
+    }
+    headerSize = 4;
+    return (size_t(last & 0x7f) << 24) | (size_t(static_cast<unsigned char>(buffer[end - 2])) << 16) |
+           (size_t(static_cast<unsigned char>(buffer[end - 3])) << 8) | size_t(static_cast<unsigned char>(buffer[end - 4]));
+}
+
+void ListNode::pushFront(std::string_view value) {
+    buffer.insert(0, encode(value));
+    ++count;
+}
+
+void ListNode::pushBack(std::string_view value) {
+    buffer.append(encode(value));
+    ++count;
+}
+
+std::string ListNode::popFront() {
+    size_t headerSize;
+    auto length = readForward(buffer, 0, headerSize);
+    std::string ret = buffer.substr(headerSize, length);
+    buffer.erase(0, length + 2 * headerSize);
+    --count;
+    return ret;
+}
+
+std::string ListNode::popBack() {
+    size_t headerSize;
+    auto length = readBackward(buffer, buffer.size(), headerSize);
+    auto start = buffer.size() - length - 2 * headerSize;
+    std::string ret = buffer.substr(start + headerSize, length);
+    buffer.resize(start);
+    --count;
+    return ret;
+}
+
+void ListNode::copy(const size_t first, const size_t n, std::vector<std::string>& out) const {
+    size_t pos = 0;
+    for (size_t i = 0; i < first + n; ++i) {
+        size_t headerSize;
+        auto length = readForward(buffer, pos, headerSize);
+        if (i >= first) {
+            out.emplace_back(buffer, pos + headerSize, length);
+        }
+        pos += length + 2 * headerSize;
+    }
+}
+
+void QuickList::pushFront(std::string_view value) {
+    if (nodes.empty() || !nodes.front().fits(value.size())) {
+        nodes.emplace_front();
+    }
+    auto& node = nodes.front();
+    bufferBytes -= heapBytes(node.bytes());
+    node.pushFront(value);
+    bufferBytes += heapBytes(node.bytes());
+    ++length;
+}
+
+void QuickList::pushBack(std::string_view value) {
+    if (nodes.empty() || !nodes.back().fits(value.size())) {
+        nodes.emplace_back();
+    }
+    auto& node = nodes.back();
+    bufferBytes -= heapBytes(node.bytes());
+    node.pushBack(value);
+    bufferBytes += heapBytes(node.bytes());
+    ++length;
+}
+
+std::optional<std::string> QuickList::popFront() {
+    if (nodes.empty()) {
+        return std::nullopt;
+    }
+    auto& node = nodes.front();
+    bufferBytes -= heapBytes(node.bytes());
+    auto ret = node.popFront();
+    if (node.empty()) {
+        nodes.pop_front();
+    } else {
+        bufferBytes += heapBytes(node.bytes());
+    }
+    --length;
+    return ret;
+}
+
+std::optional<std::string> QuickList::popBack() {
+    if (nodes.empty()) {
+        return std::nullopt;
+    }
+    auto& node = nodes.back();
+    bufferBytes -= heapBytes(node.bytes());
+    auto ret = node.popBack();
+    if (node.empty()) {
+        nodes.pop_back();
+    } else {
+        bufferBytes += heapBytes(node.bytes());
+    }
+    --length;
+    return ret;
+}
+
+void QuickList::appendNode(ListNode node) {
+    if (node.empty()) {
+        return;
+    }
+    length += node.size();
+    bufferBytes += heapBytes(node.bytes());
+    nodes.push_back(std::move(node));
+}
+
+size_t QuickList::memoryUsage() const {
+    return dequeBytes(nodes) + bufferBytes;
+}
+
+std::vector<std::string> QuickList::range(const size_t first, const size_t last) const {
+    std::vector<std::string> ret;
+    ret.reserve(last - first + 1);
+
+    // skip whole nodes before the range, then copy node by node
+    size_t skip = first;
+    for (const auto& node : nodes) {
+        if (ret.size() > last - first) {
+            break;
+        }
+        if (skip >= node.size()) {
+            skip -= node.size();
+            continue;
+        }
+        auto n = std::min(node.size() - skip, last - first + 1 - ret.size());
+        node.copy(skip, n, ret);
+        skip = 0;
+    }
+    return ret;
+}
+
+std::optional<std::pair<size_t, size_t>> resolveListRange(int64_t start, int64_t stop, const size_t length) {
+    auto size = static_cast<int64_t>(length);
+    if (start < 0) start = std::max<int64_t>(0, size + start);
+    if (stop < 0) stop = size + stop;
+    stop = std::min(stop, size - 1);
+    if (start > stop) {
+        return std::nullopt;
+    }
+    return std::make_pair(static_cast<size_t>(start), static_cast<size_t>(stop));
+}
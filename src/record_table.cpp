@@ -0,0 +1,138 @@
+#include <cstring>
+#include <new>
+#include "record_table.h"
+
+constexpr size_t INITIAL_SLOTS = 16;
+
+Record* Record::create(SlabAllocator& allocator, std::string_view key, std::string_view value, const int64_t expiration) {
+    void* memory = allocator.allocate(sizeof(Record) + key.size() + value.size());
+    auto record = new (memory) Record{expiration, static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size())};
+    char* data = reinterpret_cast<char*>(record + 1);
+    std::memcpy(data, key.data(), key.size());
+    std::memcpy(data + key.size(), value.data(), value.size());
+    return record;
+}
+
+void Record::destroy(SlabAllocator& allocator, Record* record) {
+    allocator.deallocate(record, record->size());
+}
+
+RecordTable::RecordTable() : slots(INITIAL_SLOTS), count(0) {}
+
+RecordTable::~RecordTable() {
+    clear();
+}
+
+RecordTable::RecordTable(RecordTable&& other) noexcept
+    : slots(std::move(other.slots)), count(other.count), slab(std::move(other.slab)) {
+    other.slots.assign(INITIAL_SLOTS, Slot{});
+    other.count = 0;
+}
+
+RecordTable& RecordTable::operator=(RecordTable&& other) noexcept {
+    if (this != &other) {
+        clear();
+        slots.swap(other.slots);
+        count = other.count;
+        other.count = 0;
+        slab = std::move(other.slab);
+    }
+    return *this;
+}
+
+size_t RecordTable::indexOf(const KeyView key) const {
+    size_t mask = slots.size() - 1;
+    for (size_t i = key.hash() & mask;; i = (i + 1) & mask) {
+        const Slot& slot = slots[i];
+        if (!slot.record || (slot.hash == key.hash() && slot.record->key() == key.bytes())) {
+            return i;
+        }
+    }
+}
+
+Record* RecordTable::find(const KeyView key) const {
+    return slots[indexOf(key)].record;
+}
+
+bool RecordTable::upsert(const KeyView key, std::string_view value, const int64_t expiration,
+                         const std::function<void(const Record&)>& moved) {
+    // keep the load factor at or below 3/4 so probe runs stay short
+    if ((count + 1) * 4 > slots.size() * 3) {
+        grow();
+    }
+
+    Slot& slot = slots[indexOf(key)];
+    if (!slot.record) {
+        slot = Slot{key.hash(), Record::create(slab, key.bytes(), value, expiration)};
+        ++count;
+        return true;
+    }
+
+    Record* old = slot.record;
+    if (SlabAllocator::chunkSize(old->size()) == SlabAllocator::chunkSize(sizeof(Record) + key.bytes().size() + value.size())) {
+        old->expiration = expiration;
+        old->valueSize = static_cast<uint32_t>(value.size());
+        std::memcpy(reinterpret_cast<char*>(old + 1) + old->keySize, value.data(), value.size());
+        return false;
+    }
+
+    slot.record = Record::create(slab, key.bytes(), value, expiration);
+    if (moved) {
+        moved(*slot.record);
+    }
+    Record::destroy(slab, old);
+    return false;
+}
+
+/*
+    Backward-shift deletion: walk the probe run after the removed slot and move back every entry
+    whose home slot is at or before the hole, so no tombstone is needed.
+*/
+bool RecordTable::erase(const KeyView key) {
+    size_t mask = slots.size() - 1;
+    size_t hole = indexOf(key);
+    if (!slots[hole].record) {
+        return false;
+    }
+
+    Record::destroy(slab, slots[hole].record);
+    slots[hole] = Slot{};
+    --count;
+
+    for (size_t i = (hole + 1) & mask; slots[i].record; i = (i + 1) & mask) {
+        size_t home = slots[i].hash & mask;
+        // distance from home to i is at least the distance from home to the hole: the entry may move back
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            slots[hole] = slots[i];
+            slots[i] = Slot{};
+            hole = i;
+        }
+    }
+    return true;
+}
+
+void RecordTable::clear() {
+    for (auto& slot : slots) {
+        if (slot.record) {
+            Record::destroy(slab, slot.record);
+            slot = Slot{};
+        }
+    }
+    count = 0;
+    slab.reset(); // every chunk is free again, so hand the slabs back
+}
+
+void RecordTable::grow() {
+    std::vector<Slot> old(slots.size() * 2);
+    old.swap(slots);
+
+    size_t mask = slots.size() - 1;
+    for (const auto& slot : old) {
+        if (!slot.record) continue;
+        size_t i = slot.hash & mask;
+        while (slots[i].record) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+}
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <charconv>
+#include "resp.h"
+
+/*
+    Helper function to read the integer that ends at the next \r\n, starting at pos.
+    Returns false if the line is not complete yet; on success pos is moved past the \r\n.
+*/
+static bool readLength(std::string_view input, size_t& pos, int64_t& value) {
+    auto end = input.find("\r\n", pos);
+    if (end == std::string_view::npos) {
+        if (input.size() - pos > 32) {
+            throw RespError("length line too long");
+        }
+        return false;
+    }
+    auto [last, ec] = std::from_chars(input.data() + pos, input.data() + end, value);
+    if (ec != std::errc() || last != input.data() + end) {
+        throw RespError("invalid length");
+    }
+    pos = end + 2;
+    return true;
+}
+
+static size_t parseInline(std::string_view input, std::vector<std::string>& args) {
+    auto end = input.find('\n');
+    if (end == std::string_view::npos) {
+        if (input.size() > MAX_INLINE_LENGTH) {
+            throw RespError("too big inline request");
+        }
+        return 0;
+    }
+
+    auto line = input.substr(0, end);
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    args.clear();
+    size_t pos = 0;
+    while (pos < line.size()) {
+        auto start = line.find_first_not_of(' ', pos);
+        if (start == std::string_view::npos) {
+            break;
+        }
+        pos = std::min(line.find(' ', start), line.size());
+        args.emplace_back(line.substr(start, pos - start));
+    }
+    return end + 1;
+}
+
+size_t parseRequest(std::string_view input, std::vector<std::string>& args) {
+    if (input.empty()) {
+        return 0;
+    }
+    if (input.front() != '*') {
+        return parseInline(input, args);
+    }
+
+    size_t pos = 1;
+    int64_t count;
+    if (!readLength(input, pos, count)) {
+        return 0;
+    }
+    if (count < 0 || static_cast<uint64_t>(count) > MAX_ARGUMENTS) {
+        throw RespError("invalid multibulk length");
+    }
+
+    args.clear();
+    args.reserve(count);
+    for (int64_t i = 0; i < count; ++i) {
+        if (pos >= input.size()) {
+            return 0;
+        }
+        if (input[pos] != '$') {
+            throw RespError("expected '$', got '" + std::string(1, input[pos]) + "'");
+        }
+        ++pos;
+        int64_t length;
+        if (!readLength(input, pos, length)) {
+            return 0;
+        }
+        if (length < 0 || static_cast<uint64_t>(length) > MAX_BULK_LENGTH) {
+            throw RespError("invalid bulk length");
+        }
+        if (input.size() - pos < static_cast<size_t>(length) + 2) {
+            return 0;
+        }
+        if (input.compare(pos + length, 2, "\r\n") != 0) {
+            throw RespError("bulk string not terminated by CRLF");
+        }
+        args.emplace_back(input.substr(pos, length));
+        pos += length + 2;
+    }
+    return pos;
+}
+
+void appendSimpleString(std::string& out, std::string_view value) {
+    out.push_back('+');
+    out.append(value);
+    out.append("\r\n");
+}
+
+/*
+    Line breaks in the message would end the reply early, so they are sent as spaces.
+*/
+void appendError(std::string& out, std::string_view message) {
+    out.push_back('-');
+    auto start = out.size();
+    out.append(message);
+    std::replace_if(out.begin() + start, out.end(), [](char c) { return c == '\r' || c == '\n'; }, ' ');
+    out.append("\r\n");
+}
+
+/*
+    Helper function to write a type byte, a decimal number and \r\n without a temporary string.
+*/
+static void appendPrefixed(std::string& out, const char type, const int64_t value) {
+    char digits[24];
+    auto [end, ec] = std::to_chars(digits, digits + sizeof digits, value);
+    out.push_back(type);
+    out.append(digits, end);
+    out.append("\r\n");
+}
+
+void appendInteger(std::string& out, const int64_t value) {
+    appendPrefixed(out, ':', value);
+}
+
+void appendBulkString(std::string& out, std::string_view value) {
+    appendPrefixed(out, '$', static_cast<int64_t>(value.size()));
+    out.append(value);
+    out.append("\r\n");
+}
+
+void appendNull(std::string& out) {
+    out.append("$-1\r\n");
+}
+
+void appendArrayHeader(std::string& out, const size_t length) {
+    appendPrefixed(out, '*', static_cast<int64_t>(length));
+}
+
+void appendNullArray(std::string& out) {
+    out.append("*-1\r\n");
+}
@@ -0,0 +1,545 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <optional>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <system_error>
+#include <unistd.h>
+#include "resp.h"
+#include "resp_server.h"
+
+// a loop stops parsing a connection's requests once this many reply bytes are waiting, until they are written
+constexpr size_t OUTPUT_LIMIT = 1024 * 1024;
+// reads per readiness event, so one busy connection cannot starve the others on its loop
+constexpr size_t READS_PER_EVENT = 16;
+constexpr size_t READ_SIZE = 64 * 1024;
+// requests run as one batch; a longer pipeline is split so its first replies are not held back by the rest
+constexpr size_t MAX_BATCH = 1024;
+// reply buffers gathered into one sendmsg
+constexpr size_t MAX_WRITE_BUFFERS = 64;
+constexpr int MAX_EVENTS = 256;
+
+#ifdef HAVE_IO_URING
+constexpr unsigned RING_ENTRIES = 1024;
+// receive buffers a loop shares between its connections; a connection holds one only while its data is being copied out
+constexpr size_t RECEIVE_BUFFERS = 128;
+constexpr size_t RECEIVE_BUFFER_SIZE = 16 * 1024;
+
+// what a completion is for, in the low byte of its user data, under the fd
+enum Operation : uint64_t { ACCEPT, RECEIVE, SEND, WAKE };
+
+static uint64_t tag(const int fd, const Operation operation) {
+    return static_cast<uint64_t>(fd) << 8 | operation;
+}
+#endif
+
+static std::system_error systemError(const std::string& what) {
+    return std::system_error(errno, std::generic_category(), what);
+}
+
+static void clearNonBlocking(const int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+}
+
+/*
+    With IoBackend::AUTO every loop gets a ring, or if any of them cannot, none do and all use epoll.
+*/
+RespServer::RespServer(KeyValueStore& store, const RespServerOptions& options)
+    : dispatcher(store), listenFd(-1), boundPort(0), ioBackend(IoBackend::EPOLL), stopping(false) {
+#ifndef HAVE_IO_URING
+    if (options.io == IoBackend::IO_URING) {
+        throw std::system_error(ENOSYS, std::generic_category(), "built without io_uring");
+    }
+#endif
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        throw systemError("socket");
+    }
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.host.c_str(), &address.sin_addr) != 1) {
+        ::close(listenFd);
+        throw std::system_error(EINVAL, std::generic_category(), "invalid host " + options.host);
+    }
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof address) < 0 || listen(listenFd, SOMAXCONN) < 0) {
+        auto error = systemError("bind " + options.host + ":" + std::to_string(options.port));
+        ::close(listenFd);
+        throw error;
+    }
+    socklen_t length = sizeof address;
+    getsockname(listenFd, reinterpret_cast<sockaddr*>(&address), &length);
+    boundPort = ntohs(address.sin_port);
+
+    auto threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < threads; ++i) {
+        auto eventLoop = std::make_unique<EventLoop>();
+        eventLoop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (eventLoop->wakeFd < 0) {
+            throw systemError("eventfd");
+        }
+        loops.push_back(std::move(eventLoop));
+    }
+
+#ifdef HAVE_IO_URING
+    if (options.io != IoBackend::EPOLL) {
+        try {
+            for (auto& eventLoop : loops) {
+                eventLoop->ring = std::make_unique<IoUring>(RING_ENTRIES);
+                eventLoop->ring->provideBuffers(RECEIVE_BUFFERS, RECEIVE_BUFFER_SIZE);
+            }
+            ioBackend = IoBackend::IO_URING;
+        } catch (const std::system_error&) {
+            if (options.io == IoBackend::IO_URING) {
+                ::close(listenFd);
+                throw;
+            }
+            for (auto& eventLoop : loops) {
+                eventLoop->ring.reset();
+            }
+        }
+    }
+    if (ioBackend == IoBackend::IO_URING) {
+        // a ring waits for readiness itself; on a non-blocking file some kernels hand EAGAIN back instead
+        clearNonBlocking(listenFd);
+        for (auto& eventLoop : loops) {
+            clearNonBlocking(eventLoop->wakeFd);
+        }
+        return;
+    }
+#endif
+
+    for (auto& eventLoop : loops) {
+        eventLoop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (eventLoop->epollFd < 0) {
+            throw systemError("epoll_create1");
+        }
+        watch(*eventLoop, EPOLL_CTL_ADD, eventLoop->wakeFd, EPOLLIN);
+        watch(*eventLoop, EPOLL_CTL_ADD, listenFd, EPOLLIN | EPOLLEXCLUSIVE);
+    }
+}
+
+RespServer::~RespServer() {
+    for (auto& eventLoop : loops) {
+        for (auto& [fd, connection] : eventLoop->connections) {
+            ::close(fd);
+        }
+        if (eventLoop->epollFd >= 0) {
+            ::close(eventLoop->epollFd);
+        }
+        ::close(eventLoop->wakeFd);
+    }
+    ::close(listenFd);
+}
+
+void RespServer::run() {
+    auto body = &RespServer::loop;
+#ifdef HAVE_IO_URING
+    if (ioBackend == IoBackend::IO_URING) {
+        body = &RespServer::ringLoop;
+    }
+#endif
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < loops.size(); ++i) {
+        threads.emplace_back(body, this, std::ref(*loops[i]));
+    }
+    (this->*body)(*loops[0]);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void RespServer::stop() {
+    stopping = true;
+    for (auto& eventLoop : loops) {
+        uint64_t one = 1;
+        [[maybe_unused]] auto written = write(eventLoop->wakeFd, &one, sizeof one);
+    }
+}
+
+ServerStats RespServer::stats() const {
+    ServerStats ret;
+    for (const auto& eventLoop : loops) {
+        ret.requests += eventLoop->requests;
+        ret.syscalls += eventLoop->syscalls;
+    }
+    return ret;
+}
+
+size_t RespServer::Connection::gather(iovec* buffers, const size_t count) const {
+    size_t used = 0;
+    for (auto it = output.begin(); it != output.end() && used < count; ++it, ++used) {
+        auto skip = used == 0 ? written : 0;
+        buffers[used].iov_base = const_cast<char*>(it->data()) + skip;
+        buffers[used].iov_len = it->size() - skip;
+    }
+    return used;
+}
+
+void RespServer::Connection::consume(size_t bytes) {
+    pending -= bytes;
+    while (bytes > 0) {
+        auto left = output.front().size() - written;
+        if (bytes < left) {
+            written += bytes;
+            return;
+        }
+        bytes -= left;
+        output.pop_front();
+        written = 0;
+    }
+}
+
+/*
+    Run the complete requests in the input, in batches, until the input runs out or the output reaches OUTPUT_LIMIT.
+    A malformed request gets an error reply and the connection is closed after it, as Redis does.
+    Returns true if it stopped because the output is full.
+*/
+bool RespServer::execute(EventLoop& eventLoop, Connection& connection) {
+    auto& batch = eventLoop.batch;
+    size_t offset = 0;
+    bool full = false;
+    while (!connection.session.closing) {
+        if (connection.pending >= OUTPUT_LIMIT) {
+            full = true;
+            break;
+        }
+
+        size_t count = 0;
+        std::optional<std::string> malformed;
+        while (count < MAX_BATCH) {
+            if (count == batch.size()) {
+                batch.emplace_back();
+            }
+            size_t used;
+            try {
+                used = parseRequest(std::string_view(connection.input).substr(offset), batch[count]);
+            } catch (const RespError& e) {
+                malformed = std::string("ERR ") + e.what();
+                break;
+            }
+            if (used == 0) {
+                break;
+            }
+            offset += used;
+            ++count;
+        }
+
+        std::string replies;
+        dispatcher.execute(connection.session, std::span<const std::vector<std::string>>(batch.data(), count), replies);
+        eventLoop.requests += count;
+        if (malformed && !connection.session.closing) {
+            appendError(replies, *malformed);
+            connection.session.closing = true;
+        }
+        if (!replies.empty()) {
+            connection.pending += replies.size();
+            connection.output.push_back(std::move(replies));
+        }
+        if (count < MAX_BATCH) {
+            break;
+        }
+    }
+    connection.input.erase(0, offset);
+    return full;
+}
+
+void RespServer::watch(EventLoop& eventLoop, const int op, const int fd, const uint32_t events) {
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = fd;
+    ++eventLoop.syscalls;
+    if (epoll_ctl(eventLoop.epollFd, op, fd, &event) < 0) {
+        throw systemError("epoll_ctl");
+    }
+}
+
+void RespServer::loop(EventLoop& eventLoop) {
+    epoll_event events[MAX_EVENTS];
+    while (!stopping) {
+        ++eventLoop.syscalls;
+        int ready = epoll_wait(eventLoop.epollFd, events, MAX_EVENTS, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            throw systemError("epoll_wait");
+        }
+
+        for (int i = 0; i < ready; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == eventLoop.wakeFd) {
+                continue;
+            }
+            if (fd == listenFd) {
+                accept(eventLoop);
+                continue;
+            }
+
+            auto it = eventLoop.connections.find(fd);
+            if (it == eventLoop.connections.end()) {
+                continue;
+            }
+            auto& connection = it->second;
+            if (events[i].events & EPOLLOUT) {
+                // once the backlog is written, carry on with requests that arrived in the meantime
+                if (flush(eventLoop, connection) && !connection.writing) {
+                    process(eventLoop, connection);
+                }
+            } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                readable(eventLoop, connection);
+            }
+        }
+    }
+}
+
+void RespServer::accept(EventLoop& eventLoop) {
+    while (true) {
+        ++eventLoop.syscalls;
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            // EAGAIN: another loop took it, or there are no more; anything else (such as EMFILE) is retried on the next wakeup
+            return;
+        }
+        int one = 1;
+        ++eventLoop.syscalls;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        watch(eventLoop, EPOLL_CTL_ADD, fd, EPOLLIN);
+        eventLoop.connections.try_emplace(fd, Connection{fd});
+    }
+}
+
+/*
+    A client that hangs up still gets the replies to the requests it sent before, if it is still reading.
+    Returns false if the connection was closed.
+*/
+bool RespServer::readable(EventLoop& eventLoop, Connection& connection) {
+    char buffer[READ_SIZE];
+    bool hungUp = false;
+    for (size_t i = 0; i < READS_PER_EVENT; ++i) {
+        ++eventLoop.syscalls;
+        auto n = recv(connection.fd, buffer, sizeof buffer, 0);
+        if (n > 0) {
+            connection.input.append(buffer, n);
+            if (static_cast<size_t>(n) < sizeof buffer) break;
+            continue;
+        }
+        if (n == 0) {
+            hungUp = true;
+            break;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        close(eventLoop, connection);
+        return false;
+    }
+
+    if (!process(eventLoop, connection)) {
+        return false;
+    }
+    if (hungUp) {
+        connection.session.closing = true;
+        if (!connection.writing) {
+            close(eventLoop, connection);
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+    Run what can be run and start writing the replies. Returns false if the connection was closed.
+*/
+bool RespServer::process(EventLoop& eventLoop, Connection& connection) {
+    while (true) {
+        bool full = execute(eventLoop, connection);
+        if (!flush(eventLoop, connection)) {
+            return false;
+        }
+        if (!full || connection.writing) {
+            return true;
+        }
+    }
+}
+
+/*
+    Write as much of the output as the socket takes, gathering the reply buffers into one sendmsg. If some is left,
+    watch for writability instead of readability until it is written. Returns false if the connection was closed.
+*/
+bool RespServer::flush(EventLoop& eventLoop, Connection& connection) {
+    while (!connection.output.empty()) {
+        iovec buffers[MAX_WRITE_BUFFERS];
+        msghdr message{};
+        message.msg_iov = buffers;
+        message.msg_iovlen = connection.gather(buffers, MAX_WRITE_BUFFERS);
+
+        ++eventLoop.syscalls;
+        auto n = sendmsg(connection.fd, &message, MSG_NOSIGNAL);
+        if (n >= 0) {
+            connection.consume(n);
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            if (!connection.writing) {
+                watch(eventLoop, EPOLL_CTL_MOD, connection.fd, EPOLLOUT);
+                connection.writing = true;
+            }
+            return true;
+        }
+        close(eventLoop, connection);
+        return false;
+    }
+
+    if (connection.session.closing) {
+        close(eventLoop, connection);
+        return false;
+    }
+    if (connection.writing) {
+        watch(eventLoop, EPOLL_CTL_MOD, connection.fd, EPOLLIN);
+        connection.writing = false;
+    }
+    return true;
+}
+
+void RespServer::close(EventLoop& eventLoop, Connection& connection) {
+    int fd = connection.fd;
+    eventLoop.syscalls += 2;
+    epoll_ctl(eventLoop.epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    eventLoop.connections.erase(fd);
+}
+
+#ifdef HAVE_IO_URING
+/*
+    Every operation queued while handling one round of completions goes to the kernel with the next wait.
+*/
+void RespServer::ringLoop(EventLoop& eventLoop) {
+    auto& ring = *eventLoop.ring;
+    ring.prepareAccept(listenFd, tag(listenFd, ACCEPT));
+    ring.prepareRead(eventLoop.wakeFd, &eventLoop.wakeValue, sizeof eventLoop.wakeValue, tag(eventLoop.wakeFd, WAKE));
+    while (!stopping) {
+        ++eventLoop.syscalls;
+        ring.submitAndWait(1);
+        ring.forEachCompletion([this, &eventLoop](const io_uring_cqe& cqe) { completed(eventLoop, cqe); });
+    }
+}
+
+void RespServer::completed(EventLoop& eventLoop, const io_uring_cqe& cqe) {
+    auto& ring = *eventLoop.ring;
+    auto fd = static_cast<int>(cqe.user_data >> 8);
+    auto operation = static_cast<Operation>(cqe.user_data & 0xff);
+    if (operation == WAKE) {
+        return;
+    }
+    if (operation == ACCEPT) {
+        if (cqe.res >= 0) {
+            int one = 1;
+            ++eventLoop.syscalls;
+            setsockopt(cqe.res, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+            auto& connection = eventLoop.connections.try_emplace(cqe.res, Connection{cqe.res}).first->second;
+            connection.receiving = true;
+            ring.prepareRecv(connection.fd, tag(connection.fd, RECEIVE));
+        }
+        // a failed accept (such as EMFILE) is retried as well
+        ring.prepareAccept(listenFd, tag(listenFd, ACCEPT));
+        return;
+    }
+
+    auto& connection = eventLoop.connections.at(fd);
+    if (operation == RECEIVE) {
+        connection.receiving = false;
+        if (IoUring::hasBuffer(cqe)) {
+            auto id = IoUring::bufferId(cqe);
+            if (cqe.res > 0 && !connection.closed) {
+                connection.input.append(ring.buffer(id), cqe.res);
+            }
+            ring.recycle(id);
+        }
+        if (connection.closed) {
+            release(eventLoop, connection);
+            return;
+        }
+        if (cqe.res == 0) {
+            // hung up: answer what it sent before, as the epoll loop does
+            execute(eventLoop, connection);
+            connection.session.closing = true;
+        } else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -EINTR) {
+            shut(eventLoop, connection);
+            return;
+        }
+    } else {
+        connection.sending = false;
+        if (connection.closed) {
+            release(eventLoop, connection);
+            return;
+        }
+        if (cqe.res < 0) {
+            shut(eventLoop, connection);
+            return;
+        }
+        connection.consume(cqe.res);
+    }
+    resume(eventLoop, connection);
+}
+
+/*
+    Keep a send in flight while there are replies, and a receive while there is room for more of them.
+*/
+void RespServer::resume(EventLoop& eventLoop, Connection& connection) {
+    auto& ring = *eventLoop.ring;
+    execute(eventLoop, connection);
+    if (connection.pending == 0 && connection.session.closing) {
+        shut(eventLoop, connection);
+        return;
+    }
+    if (connection.pending > 0 && !connection.sending) {
+        connection.sendBuffers.resize(MAX_WRITE_BUFFERS);
+        connection.message = msghdr{};
+        connection.message.msg_iov = connection.sendBuffers.data();
+        connection.message.msg_iovlen = connection.gather(connection.sendBuffers.data(), MAX_WRITE_BUFFERS);
+        connection.sending = true;
+        ring.prepareSendmsg(connection.fd, &connection.message, tag(connection.fd, SEND));
+    }
+    if (!connection.receiving && !connection.session.closing && connection.pending < OUTPUT_LIMIT) {
+        connection.receiving = true;
+        ring.prepareRecv(connection.fd, tag(connection.fd, RECEIVE));
+    }
+}
+
+/*
+    Operations still in flight are ended by shutting the socket down; the connection is released after the last of them.
+*/
+void RespServer::shut(EventLoop& eventLoop, Connection& connection) {
+    connection.closed = true;
+    if (connection.receiving || connection.sending) {
+        ++eventLoop.syscalls;
+        shutdown(connection.fd, SHUT_RDWR);
+        return;
+    }
+    release(eventLoop, connection);
+}
+
+void RespServer::release(EventLoop& eventLoop, Connection& connection) {
+    if (connection.receiving || connection.sending) {
+        return;
+    }
+    int fd = connection.fd;
+    ++eventLoop.syscalls;
+    ::close(fd);
+    eventLoop.connections.erase(fd);
+}
+#endif
@@ -0,0 +1,100 @@
+/**
+ * @file server_main.cpp
+ * @brief Run a KeyValueStore behind the RESP server, so redis-cli and redis-benchmark can talk to it directly.
+ *
+ * Usage: key_value_store_server [--host ADDRESS] [--port PORT] [--threads N] [--io auto|epoll|io_uring]
+ *                              [--backend postgres|memory] [--pool-size N] [--appendonly PATH] [--appendfsync always|everysec|no]
+ *                              [--snapshot PATH]
+ * --appendonly logs every write of the memory backend to PATH and replays it on startup; --appendfsync is how often the log
+ * is fsynced (every second by default).
+ * --snapshot is where SAVE and BGSAVE write a snapshot of the memory backend. It is loaded on startup unless --appendonly is
+ * given too, since the log is then the complete record, and saved again when the server stops.
+ * SIGINT or SIGTERM stops the server; every acknowledged write is flushed to the database or the log before it exits.
+ */
+
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <pthread.h>
+#include <string>
+#include <thread>
+#include "resp_server.h"
+
+static void usage() {
+    std::cerr << "usage: key_value_store_server [--host ADDRESS] [--port PORT] [--threads N] [--io auto|epoll|io_uring] "
+                 "[--backend postgres|memory] [--pool-size N] [--appendonly PATH] [--appendfsync always|everysec|no] "
+                 "[--snapshot PATH]" << std::endl;
+    std::exit(2);
+}
+
+int main(int argc, char** argv) {
+    RespServerOptions options;
+    auto backend = StorageBackend::POSTGRES;
+    size_t poolSize = DEFAULT_POOL_SIZE;
+    std::string appendOnlyPath;
+    std::string snapshotPath;
+    auto fsync = FsyncPolicy::INTERVAL;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) usage();
+        std::string value = argv[++i];
+        if (flag == "--host") {
+            options.host = value;
+        } else if (flag == "--port") {
+            options.port = static_cast<uint16_t>(std::stoul(value));
+        } else if (flag == "--threads") {
+            options.threads = std::stoul(value);
+        } else if (flag == "--io" && (value == "auto" || value == "epoll" || value == "io_uring")) {
+            options.io = value == "auto" ? IoBackend::AUTO : value == "epoll" ? IoBackend::EPOLL : IoBackend::IO_URING;
+        } else if (flag == "--backend" && (value == "postgres" || value == "memory")) {
+            backend = value == "memory" ? StorageBackend::MEMORY : StorageBackend::POSTGRES;
+        } else if (flag == "--pool-size") {
+            poolSize = std::stoul(value);
+        } else if (flag == "--appendonly") {
+            appendOnlyPath = value;
+        } else if (flag == "--appendfsync" && (value == "always" || value == "everysec" || value == "no")) {
+            fsync = value == "always" ? FsyncPolicy::ALWAYS : value == "everysec" ? FsyncPolicy::INTERVAL : FsyncPolicy::OS;
+        } else if (flag == "--snapshot") {
+            snapshotPath = value;
+        } else {
+            usage();
+        }
+    }
+
+    // blocked before any thread starts, so every thread inherits the mask and only the waiter below sees the signals
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    KeyValueStore store(backend, poolSize);
+    if (!snapshotPath.empty() && store.useSnapshot(snapshotPath, appendOnlyPath.empty())) {
+        std::cout << "loaded snapshot " << snapshotPath << std::endl;
+    }
+    if (!appendOnlyPath.empty()) {
+        store.enableAppendOnlyLog(appendOnlyPath, fsync, std::chrono::seconds(1));
+    }
+    RespServer server(store, options);
+    std::thread waiter([&server, &signals] {
+        int signal;
+        sigwait(&signals, &signal);
+        server.stop();
+    });
+    waiter.detach();
+
+    std::cout << "listening on " << options.host << ":" << server.port()
+              << (server.backend() == IoBackend::IO_URING ? " with io_uring" : " with epoll") << std::endl;
+    server.run();
+    store.flush();
+    if (!snapshotPath.empty()) {
+        try {
+            store.save();
+        } catch (const std::exception& e) {
+            std::cerr << "saving the snapshot on shutdown failed: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
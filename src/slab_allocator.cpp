@@ -0,0 +1,96 @@
+#include <bit>
+#include <new>
+#include <utility>
+#include "slab_allocator.h"
+
+// classes below this size are 8 bytes apart; above it each doubling is split into four steps
+constexpr size_t FINE_LIMIT = 128;
+constexpr size_t FINE_CLASSES = FINE_LIMIT / 8;
+
+SlabAllocator::SlabAllocator(SlabAllocator&& other) noexcept
+    : classes(std::exchange(other.classes, {})),
+      slabs(std::move(other.slabs)),
+      inUse(std::exchange(other.inUse, 0)),
+      largeBytes(std::exchange(other.largeBytes, 0)) {
+    other.slabs.clear();
+}
+
+SlabAllocator& SlabAllocator::operator=(SlabAllocator&& other) noexcept {
+    if (this != &other) {
+        classes = std::exchange(other.classes, {});
+        slabs = std::move(other.slabs);
+        other.slabs.clear();
+        inUse = std::exchange(other.inUse, 0);
+        largeBytes = std::exchange(other.largeBytes, 0);
+    }
+    return *this;
+}
+
+size_t SlabAllocator::classOf(const size_t size) {
+    if (size <= FINE_LIMIT) {
+        return size == 0 ? 0 : (size + 7) / 8 - 1;
+    }
+    size_t power = std::bit_width(size - 1) - 1; // 2^power < size <= 2^(power + 1)
+    size_t step = size_t{1} << (power - 2);
+    size_t steps = (size - (size_t{1} << power) + step - 1) / step;
+    return FINE_CLASSES + (power - 7) * 4 + steps - 1;
+}
+
+size_t SlabAllocator::chunkSize(const size_t size) {
+    if (size > MAX_CHUNK_SIZE) {
+        return size;
+    }
+    size_t index = classOf(size);
+    if (index < FINE_CLASSES) {
+        return (index + 1) * 8;
+    }
+    size_t power = (index - FINE_CLASSES) / 4 + 7;
+    size_t steps = (index - FINE_CLASSES) % 4 + 1;
+    return (size_t{1} << power) + steps * (size_t{1} << (power - 2));
+}
+
+void* SlabAllocator::allocate(const size_t size) {
+    if (size > MAX_CHUNK_SIZE) {
+        largeBytes += size;
+        inUse += size;
+        return ::operator new(size);
+    }
+
+    size_t chunk = chunkSize(size);
+    SizeClass& sizeClass = classes[classOf(size)];
+    inUse += chunk;
+    if (sizeClass.freeList) {
+        FreeChunk* block = sizeClass.freeList;
+        sizeClass.freeList = block->next;
+        return block;
+    }
+
+    if (sizeClass.cursor == nullptr || static_cast<size_t>(sizeClass.end - sizeClass.cursor) < chunk) {
+        // the tail of the previous slab that is too short for a chunk is left unused
+        slabs.emplace_back(new std::byte[SLAB_SIZE]);
+        sizeClass.cursor = slabs.back().get();
+        sizeClass.end = sizeClass.cursor + SLAB_SIZE;
+    }
+    void* block = sizeClass.cursor;
+    sizeClass.cursor += chunk;
+    return block;
+}
+
+void SlabAllocator::deallocate(void* block, const size_t size) {
+    if (size > MAX_CHUNK_SIZE) {
+        largeBytes -= size;
+        inUse -= size;
+        ::operator delete(block);
+        return;
+    }
+
+    SizeClass& sizeClass = classes[classOf(size)];
+    inUse -= chunkSize(size);
+    sizeClass.freeList = new (block) FreeChunk{sizeClass.freeList};
+}
+
+void SlabAllocator::reset() {
+    classes = {};
+    slabs.clear();
+    inUse = largeBytes;
+}
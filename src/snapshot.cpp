@@ -0,0 +1,163 @@
+#include <bit>
+#include <cerrno>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include "snapshot.h"
+
+constexpr size_t WRITE_BUFFER_BYTES = 1 << 20;
+constexpr uint32_t MAX_SHARDS = 1 << 16;
+
+static std::system_error systemError(const std::string& what) {
+    return std::system_error(errno, std::generic_category(), what);
+}
+
+void SnapshotWriter::write(std::string_view bytes) {
+    buffer.append(bytes);
+    if (buffer.size() >= WRITE_BUFFER_BYTES) {
+        flush();
+    }
+}
+
+void SnapshotWriter::align() {
+    static constexpr char ZEROS[8] = {};
+    write(std::string_view(ZEROS, (8 - offset() % 8) % 8));
+}
+
+void SnapshotWriter::flush() {
+    std::string_view rest = buffer;
+    while (!rest.empty()) {
+        auto n = ::write(fd, rest.data(), rest.size());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw systemError("write " + path);
+        }
+        rest.remove_prefix(n);
+    }
+    written += buffer.size();
+    buffer.clear();
+}
+
+/*
+    Helper function to make a rename durable: the new directory entry only survives a crash once the directory is fsynced.
+*/
+static void syncDirectory(const std::string& path) {
+    auto directory = std::filesystem::path(path).parent_path();
+    int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        throw systemError("open " + directory.string());
+    }
+    auto result = fsync(fd);
+    close(fd);
+    if (result < 0) {
+        throw systemError("fsync " + directory.string());
+    }
+}
+
+void writeSnapshotFile(const std::string& path, const std::function<SnapshotHeader(SnapshotWriter&)>& write) {
+    auto temporary = path + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw systemError("open " + temporary);
+    }
+    try {
+        SnapshotWriter out(fd, temporary);
+        out.put(SnapshotHeader{}); // a file that ends before the real header is written reads as no snapshot
+        auto header = write(out);
+        out.flush();
+
+        std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof header.magic);
+        header.byteOrder = SNAPSHOT_BYTE_ORDER;
+        header.hashProbe = hashKey(SNAPSHOT_HASH_PROBE);
+        header.fileSize = out.offset();
+        if (pwrite(fd, &header, sizeof header, 0) != sizeof header) {
+            throw systemError("write " + temporary);
+        }
+        if (fdatasync(fd) < 0) {
+            throw systemError("fdatasync " + temporary);
+        }
+        if (close(fd) < 0) {
+            fd = -1;
+            throw systemError("close " + temporary);
+        }
+        fd = -1;
+        if (rename(temporary.c_str(), path.c_str()) < 0) {
+            throw systemError("rename " + temporary);
+        }
+    } catch (...) {
+        if (fd >= 0) close(fd);
+        unlink(temporary.c_str());
+        throw;
+    }
+    syncDirectory(path);
+}
+
+/*
+    Only the header and the section table are read here; sections are read in place by whoever loads them.
+*/
+SnapshotFile::SnapshotFile(const std::string& path) : path(path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw systemError("open " + path);
+    }
+    struct stat status;
+    if (fstat(fd, &status) < 0) {
+        close(fd);
+        throw systemError("stat " + path);
+    }
+    size_t size = status.st_size;
+    if (size < sizeof head) {
+        close(fd);
+        throw std::runtime_error(path + " is not a complete snapshot.");
+    }
+    auto map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        throw systemError("mmap " + path);
+    }
+    // each section is read front to back and copied out once, so read ahead and let pages go behind
+    madvise(map, size, MADV_SEQUENTIAL);
+    data = std::string_view(static_cast<const char*>(map), size);
+
+    try {
+        std::memcpy(&head, data.data(), sizeof head);
+        if (std::memcmp(head.magic, SNAPSHOT_MAGIC, sizeof head.magic) != 0 || head.fileSize != size) {
+            throw std::runtime_error(path + " is not a complete snapshot.");
+        }
+        if (head.byteOrder != SNAPSHOT_BYTE_ORDER) {
+            throw std::runtime_error(path + " was written on a machine of another byte order.");
+        }
+        if (head.shardCount == 0 || head.shardCount > MAX_SHARDS || !std::has_single_bit(head.shardCount)
+            || head.configOffset < sizeof head || head.configOffset > head.sectionOffset || head.sectionOffset > size
+            || head.sectionCount > (size - head.sectionOffset) / sizeof(SnapshotSection)) {
+            throw std::runtime_error("corrupt snapshot: bad header in " + path + ".");
+        }
+
+        table.resize(head.sectionCount);
+        std::memcpy(table.data(), data.data() + head.sectionOffset, head.sectionCount * sizeof(SnapshotSection));
+        for (const auto& section : table) {
+            if (section.shard >= head.shardCount || section.offset < sizeof head || section.offset > head.configOffset
+                || section.size > head.configOffset - section.offset) {
+                throw std::runtime_error("corrupt snapshot: bad section in " + path + ".");
+            }
+        }
+    } catch (...) {
+        munmap(const_cast<char*>(data.data()), data.size());
+        throw;
+    }
+}
+
+SnapshotFile::~SnapshotFile() {
+    munmap(const_cast<char*>(data.data()), data.size());
+}
+
+SnapshotReader SnapshotFile::configs() const {
+    return SnapshotReader(data, head.configOffset, head.sectionOffset - head.configOffset);
+}
+
+SnapshotReader SnapshotFile::section(const SnapshotSection& section) const {
+    return SnapshotReader(data, section.offset, section.size);
+}
@@ -0,0 +1,76 @@
+#include "memory_usage.h"
+#include "store_cache.h"
+
+StoreCache::StoreCache(const std::string& policy, const size_t capacity, const size_t maxMemory)
+    : capacity(capacity), maxMemory(maxMemory), evictionPolicy(makeEvictionPolicy(policy, capacity)) {}
+
+static size_t bytesOf(const std::pair<const Key, CacheEntry>& entry) {
+    return hashNodeBytes<std::pair<const Key, CacheEntry>>() + entry.first.heapBytes() + heapBytes(entry.second.value);
+}
+
+/*
+    Returns the cached entry and records the access with the eviction policy, or nullptr on a miss.
+    The entry may already be expired; the caller decides what to do with it.
+*/
+const CacheEntry* StoreCache::find(const KeyView key) {
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        return nullptr;
+    }
+
+    evictionPolicy->keyAccessed(it->first);
+    return &it->second;
+}
+
+/*
+    Insert or overwrite a key. The key is added before eviction, so the policy may choose to evict the key that was just added.
+    The policy is handed the map's own copy of the key, which stays put until the entry is erased.
+*/
+void StoreCache::put(const KeyView key, const std::string& value, const std::optional<ExpirationTime>& expiration) {
+    if (capacity == 0) {
+        return;
+    }
+
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        entryBytes -= bytesOf(*it);
+        it->second = CacheEntry{value, expiration};
+    } else {
+        it = entries.emplace(Key(key), CacheEntry{value, expiration}).first;
+    }
+    entryBytes += bytesOf(*it);
+    evictionPolicy->keyAccessed(it->first);
+    evictOverBudget();
+}
+
+void StoreCache::erase(const KeyView key) {
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        // the policy still refers to the entry's key, so it has to let go first
+        evictionPolicy->keyRemoved(key);
+        entryBytes -= bytesOf(*it);
+        entries.erase(it);
+    }
+}
+
+void StoreCache::setMaxMemory(const size_t bytes) {
+    maxMemory = bytes;
+    evictOverBudget();
+}
+
+MemoryStats StoreCache::memoryStats() const {
+    return MemoryStats{memoryUsage(), maxMemory, entries.size()};
+}
+
+size_t StoreCache::memoryUsage() const {
+    return entryBytes + bucketBytes(entries) + evictionPolicy->memoryUsage();
+}
+
+void StoreCache::evictOverBudget() {
+    while (!entries.empty() && (entries.size() > capacity || (maxMemory && memoryUsage() > maxMemory))) {
+        // the evicted view points into the entry, so it is found before the entry is erased
+        auto it = entries.find(evictionPolicy->evict());
+        entryBytes -= bytesOf(*it);
+        entries.erase(it);
+    }
+}
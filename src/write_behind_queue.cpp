@@ -0,0 +1,129 @@
+#include <iostream>
+#include "write_behind_queue.h"
+
+WriteBehindQueue::WriteBehindQueue(const WriteBehindOptions& options, std::function<void(const PendingWrites&)> flushFn)
+    : options(options), flushFn(std::move(flushFn)), flusher(&WriteBehindQueue::run, this) {}
+
+/*
+    Flushes everything still queued before stopping the background thread.
+*/
+WriteBehindQueue::~WriteBehindQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    flusher.join();
+}
+
+void WriteBehindQueue::put(const size_t storeId, const std::string& key, const std::string& value) {
+    enqueue(storeId, key, value);
+}
+
+void WriteBehindQueue::remove(const size_t storeId, const std::string& key) {
+    enqueue(storeId, key, std::nullopt);
+}
+
+void WriteBehindQueue::enqueue(const size_t storeId, const std::string& key, std::optional<std::string> value) {
+    bool notify;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bool first = queued.empty();
+        if (first) {
+            oldestQueued = std::chrono::steady_clock::now();
+        }
+        queued.insert_or_assign({storeId, key}, std::move(value));
+        ++enqueuedSeq;
+        // wake the flusher to start the durability window on the first write, and to flush early once the batch is full
+        notify = first || queued.size() >= options.maxPending;
+    }
+    if (notify) {
+        wake.notify_one();
+    }
+}
+
+std::optional<std::optional<std::string>> WriteBehindQueue::pending(const size_t storeId, const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = queued.find({storeId, key});
+    if (it != queued.end()) {
+        return it->second;
+    }
+
+    it = inFlight.find({storeId, key});
+    if (it != inFlight.end()) {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+/*
+    Barrier: blocks until every write queued before the call is committed to the database.
+    Rethrows the error if a flush failed before they were; the failed writes stay queued and are retried.
+*/
+void WriteBehindQueue::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto target = enqueuedSeq;
+    flushRequested = true;
+    wake.notify_one();
+    flushed.wait(lock, [&] { return committedSeq >= target || flushError; });
+
+    if (committedSeq < target) {
+        auto error = flushError;
+        flushError = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void WriteBehindQueue::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        if (queued.empty()) {
+            committedSeq = enqueuedSeq;
+            flushRequested = false;
+            flushed.notify_all();
+            if (stopping) {
+                return;
+            }
+            wake.wait(lock, [&] { return stopping || !queued.empty(); });
+            continue;
+        }
+
+        wake.wait_until(lock, oldestQueued + options.durabilityWindow, [&] {
+            return stopping || flushRequested || queued.size() >= options.maxPending;
+        });
+
+        inFlight.swap(queued);
+        auto batchSeq = enqueuedSeq;
+        flushRequested = false;
+
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            flushFn(inFlight);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        if (error) {
+            // newer writes queued during the flush win over the failed batch
+            queued.merge(inFlight);
+            inFlight.clear();
+            oldestQueued = std::chrono::steady_clock::now();
+            flushError = error;
+            flushed.notify_all();
+            if (stopping) {
+                std::cerr << "write-behind: dropping " << queued.size() << " unflushed writes on shutdown." << std::endl;
+                return;
+            }
+            // back off for one window before retrying, unless more work piles up
+            wake.wait_for(lock, options.durabilityWindow, [&] { return stopping || queued.size() >= options.maxPending; });
+            continue;
+        }
+
+        inFlight.clear();
+        committedSeq = batchSeq;
+        flushError = nullptr; // a failure nobody waited for is over once its writes are committed
+        flushed.notify_all();
+    }
+}
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <set>
+#include "../include/active_expirer.h"
+#include "../include/timing_wheel.h"
+
+TEST(TimingWheelTest, FiresEachTimerOnceAtItsDeadline) {
+    TimingWheel<int> wheel;
+    wheel.schedule(5, 5);
+    wheel.schedule(64, 64);
+    wheel.schedule(5000, 5000);
+    wheel.schedule(1 << 25, 1 << 25); // beyond the top level
+    EXPECT_EQ(wheel.size(), 4);
+
+    std::vector<int> due;
+    wheel.advance(4, due);
+    EXPECT_TRUE(due.empty());
+    wheel.advance(64, due);
+    EXPECT_EQ(due, (std::vector<int>{5, 64}));
+
+    due.clear();
+    wheel.advance(4999, due);
+    EXPECT_TRUE(due.empty());
+    wheel.advance((1 << 25) - 1, due);
+    EXPECT_EQ(due, (std::vector<int>{5000}));
+    wheel.advance(1 << 25, due);
+    EXPECT_EQ(due, (std::vector<int>{5000, 1 << 25}));
+    EXPECT_EQ(wheel.size(), 0);
+
+    // a deadline that already passed fires on the next advance
+    due.clear();
+    wheel.schedule(3, 3);
+    wheel.advance(wheel.currentTick(), due);
+    EXPECT_EQ(due, (std::vector<int>{3}));
+}
+
+TEST(TimingWheelTest, CancelledTimersDoNotFire) {
+    TimingWheel<int> wheel;
+    auto near = wheel.schedule(5, 5);
+    auto far = wheel.schedule(5000, 5000);
+    wheel.schedule(6, 6);
+    std::vector<int> due;
+    wheel.advance(100, due); // moves far down a level
+    EXPECT_EQ(due, (std::vector<int>{5, 6}));
+
+    wheel.cancel(far);
+    EXPECT_EQ(wheel.size(), 0);
+    near = wheel.schedule(200, 200);
+    wheel.cancel(near);
+    wheel.advance(10000, due);
+    EXPECT_EQ(due, (std::vector<int>{5, 6}));
+}
+
+TEST(ActiveExpirerTest, KeepsOneTimerPerKey) {
+    std::atomic<size_t> checked = 0;
+    ActiveExpirerOptions options{std::chrono::milliseconds(10), 4, 2};
+    ActiveExpirer expirer(options, [&](const size_t, const std::vector<std::string>& keys) {
+        checked += keys.size();
+        return keys.size();
+    });
+
+    // re-expiring a hot key replaces its timer, however often it is done
+    for (int i = 0; i < 1000; ++i) {
+        expirer.schedule(1, "hot", currentTime() + std::chrono::milliseconds(100 + i));
+    }
+    EXPECT_EQ(expirer.metrics().scheduled, 1);
+    expirer.schedule(2, "hot", currentTime() + std::chrono::seconds(60));
+    expirer.schedule(1, "persisted", currentTime() + std::chrono::milliseconds(50));
+    EXPECT_EQ(expirer.metrics().scheduled, 3);
+    expirer.cancel(1, {"persisted", "missing"});
+    EXPECT_EQ(expirer.metrics().scheduled, 2);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    auto metrics = expirer.metrics();
+    EXPECT_EQ(metrics.checked, 1);
+    EXPECT_EQ(metrics.backlog, 0);
+    EXPECT_EQ(metrics.scheduled, 1);
+    EXPECT_EQ(checked, 1);
+
+    // a key whose timer fired can be given a new one
+    expirer.schedule(1, "hot", currentTime() + std::chrono::seconds(60));
+    EXPECT_EQ(expirer.metrics().scheduled, 2);
+}
+
+TEST(ActiveExpirerTest, ReapsDueKeysInBoundedBatches) {
+    std::mutex mutex;
+    std::set<std::string> reaped;
+    std::vector<size_t> batchSizes;
+    ActiveExpirerOptions options{std::chrono::milliseconds(10), 4, 2};
+    ActiveExpirer expirer(options, [&](const size_t storeId, const std::vector<std::string>& keys) {
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_EQ(storeId, 1);
+        batchSizes.push_back(keys.size());
+        reaped.insert(keys.begin(), keys.end());
+        return keys.size();
+    });
+
+    auto now = currentTime();
+    for (int i = 0; i < 20; ++i) {
+        expirer.schedule(1, "key" + std::to_string(i), now + std::chrono::milliseconds(20));
+    }
+    expirer.schedule(1, "later", now + std::chrono::seconds(60));
+    EXPECT_EQ(expirer.metrics().scheduled, 21);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    auto metrics = expirer.metrics();
+    EXPECT_EQ(metrics.reaped, 20);
+    EXPECT_EQ(metrics.checked, 20);
+    EXPECT_EQ(metrics.backlog, 0);
+    EXPECT_EQ(metrics.scheduled, 1);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(reaped.size(), 20);
+    EXPECT_FALSE(reaped.contains("later"));
+    for (auto size : batchSizes) {
+        EXPECT_LE(size, 4);
+    }
+}
+
+TEST(ActiveExpirerTest, ScansForKeysExpiredElsewhere) {
+    std::atomic<size_t> scans = 0;
+    std::atomic<size_t> reaped = 0;
+    ActiveExpirerOptions options{std::chrono::milliseconds(10), 4, 2, std::chrono::milliseconds(50)};
+    ActiveExpirer expirer(
+        options,
+        [&](const size_t, const std::vector<std::string>& keys) {
+            reaped += keys.size();
+            return keys.size();
+        },
+        [&](const size_t limit) {
+            EXPECT_LE(limit, 8);
+            return ++scans == 1 ? std::vector<ExpiringKey>{{2, "a"}, {3, "b"}} : std::vector<ExpiringKey>{};
+        });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_EQ(reaped, 2);
+    EXPECT_GE(scans, 2);
+    EXPECT_LE(scans, 5);
+}
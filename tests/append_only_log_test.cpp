@@ -0,0 +1,280 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include "../include/append_only_log.h"
+#include "../include/in_memory_engine.h"
+
+/*
+    Helper function to get a fresh log path for one test.
+*/
+static std::string logPath(const std::string& name) {
+    auto path = std::filesystem::temp_directory_path() / ("kvs_" + name + "_" + std::to_string(getpid()) + ".aof");
+    std::filesystem::remove(path);
+    return path.string();
+}
+
+static std::vector<std::string> replayAll(const AppendOnlyLogOptions& options) {
+    std::vector<std::string> ret;
+    AppendOnlyLog log(options, [&ret](std::string_view payload) { ret.emplace_back(payload); });
+    return ret;
+}
+
+TEST(AppendOnlyLogTest, ReplaysRecordsAndTruncatesTornTail) {
+    EXPECT_EQ(AppendOnlyLog::crc32c("123456789"), 0xE3069283);
+
+    AppendOnlyLogOptions options{logPath("replay"), FsyncPolicy::ALWAYS};
+    {
+        AppendOnlyLog log(options, [](std::string_view) { FAIL() << "a new log has no records"; });
+        for (int i = 0; i < 100; ++i) {
+            log.waitForSync(log.append(0, "record" + std::to_string(i)));
+        }
+    }
+    auto records = replayAll(options);
+    ASSERT_EQ(records.size(), 100);
+    EXPECT_EQ(records[42], "record42");
+    auto intact = std::filesystem::file_size(options.path);
+
+    // a crash in the middle of a write leaves part of a record at the end
+    std::string torn;
+    AppendOnlyLog::frame(torn, "never finished");
+    std::ofstream(options.path, std::ios::app | std::ios::binary) << torn.substr(0, torn.size() - 3);
+    EXPECT_EQ(replayAll(options).size(), 100);
+    EXPECT_EQ(std::filesystem::file_size(options.path), intact);
+
+    // a damaged length field that runs past the end looks torn, but the records after it are intact, so nothing is cut off
+    std::string contents;
+    {
+        std::ifstream file(options.path, std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    auto damaged = contents;
+    auto length = damaged.find("record0") - 2 * sizeof(uint32_t);
+    damaged.replace(length, sizeof(uint32_t), "\xff\xff\xff\x7f");
+    std::ofstream(options.path, std::ios::binary | std::ios::trunc) << damaged;
+    EXPECT_THROW(replayAll(options), std::runtime_error);
+    EXPECT_EQ(std::filesystem::file_size(options.path), intact);
+    std::ofstream(options.path, std::ios::binary | std::ios::trunc) << contents;
+
+    // a damaged record followed by intact ones is corruption, not a torn write
+    {
+        std::fstream file(options.path, std::ios::in | std::ios::out | std::ios::binary);
+        std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        file.seekp(contents.find("record50"));
+        file.put('R');
+    }
+    EXPECT_THROW(replayAll(options), std::runtime_error);
+    std::filesystem::remove(options.path);
+}
+
+TEST(AppendOnlyLogTest, ConcurrentWritersShareFsyncs) {
+    AppendOnlyLogOptions options{logPath("group"), FsyncPolicy::ALWAYS};
+    {
+        AppendOnlyLog log(options, [](std::string_view) {});
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 8; ++t) {
+            writers.emplace_back([&log, t] {
+                for (int i = 0; i < 200; ++i) {
+                    log.waitForSync(log.append(t, std::to_string(t) + ":" + std::to_string(i)));
+                }
+            });
+        }
+        for (auto& writer : writers) {
+            writer.join();
+        }
+    }
+    // every writer's records are there, each writer's in its own order
+    std::vector<int> next(8, 0);
+    for (const auto& record : replayAll(options)) {
+        auto colon = record.find(':');
+        auto t = std::stoi(record.substr(0, colon));
+        EXPECT_EQ(std::stoi(record.substr(colon + 1)), next[t]++);
+    }
+    EXPECT_EQ(next, std::vector<int>(8, 200));
+    std::filesystem::remove(options.path);
+}
+
+TEST(AppendOnlyLogTest, WriteFailsWhenItsRecordDoesNotReachTheDisk) {
+    AppendOnlyLogOptions options{logPath("failing"), FsyncPolicy::ALWAYS};
+    InMemoryEngine engine(2);
+    engine.enableLog(options);
+    engine.insertString(1, "small", "1");
+
+    // a file size limit makes the next write fail with EFBIG, as a full disk would with ENOSPC
+    std::signal(SIGXFSZ, SIG_IGN);
+    rlimit original;
+    getrlimit(RLIMIT_FSIZE, &original);
+    rlimit limited = original;
+    limited.rlim_cur = std::filesystem::file_size(options.path) + 16;
+    setrlimit(RLIMIT_FSIZE, &limited);
+    EXPECT_THROW(engine.insertString(1, "large", std::string(1000, 'x')), std::system_error);
+    EXPECT_THROW(engine.setAdd(1, "set", {"member"}), std::system_error); // refused up front while the log is failing
+    setrlimit(RLIMIT_FSIZE, &original);
+    std::signal(SIGXFSZ, SIG_DFL);
+
+    // the failed batch is retried, and writes go through again once it is on disk
+    for (int attempt = 0;; ++attempt) {
+        try {
+            engine.flush();
+            break;
+        } catch (const std::system_error&) {
+            ASSERT_LT(attempt, 100);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+    engine.insertString(1, "after", "1");
+    engine.disableLog();
+    std::filesystem::remove(options.path);
+}
+
+/*
+    Helper function to compare two engines on the keys a test used.
+*/
+static void expectSameKeys(InMemoryEngine& expected, InMemoryEngine& actual, const size_t storeId, const std::vector<std::string>& keys) {
+    for (const auto& key : keys) {
+        auto type = [&](InMemoryEngine& engine) -> std::string {
+            try {
+                auto entry = engine.fetchLiveString(storeId, key);
+                if (!entry) return "none";
+                return "string " + entry->value + " " + std::to_string(entry->expiration ? toUnixMilliseconds(*entry->expiration) : -1);
+            } catch (const TypeMismatchError&) {}
+            try {
+                auto values = engine.listRange(storeId, key, 0, -1);
+                std::string ret = "list";
+                for (const auto& value : values) ret += " " + value;
+                return ret;
+            } catch (const TypeMismatchError&) {}
+            try {
+                auto members = engine.setMembers(storeId, key);
+                std::sort(members.begin(), members.end());
+                std::string ret = "set";
+                for (const auto& member : members) ret += " " + member;
+                return ret;
+            } catch (const TypeMismatchError&) {}
+            auto fields = engine.hashGetAll(storeId, key);
+            std::sort(fields.begin(), fields.end());
+            std::string ret = "hash";
+            for (const auto& [field, value] : fields) ret += " " + field + "=" + value;
+            return ret;
+        };
+        EXPECT_EQ(type(actual), type(expected)) << key;
+    }
+    EXPECT_EQ(actual.memoryStats(storeId)->keys, expected.memoryStats(storeId)->keys);
+    EXPECT_EQ(actual.getEvictionConfig(storeId)->policy, expected.getEvictionConfig(storeId)->policy);
+}
+
+TEST(AppendOnlyLogTest, EngineReplaysEveryKindOfWrite) {
+    AppendOnlyLogOptions options{logPath("engine"), FsyncPolicy::OS};
+    std::vector<std::string> keys;
+    for (int i = 0; i < 40; ++i) {
+        keys.push_back("key" + std::to_string(i));
+    }
+
+    InMemoryEngine engine(4);
+    engine.enableLog(options);
+    engine.setEvictionConfig(1, EvictionConfig{"lfu", 30});
+    engine.insertStrings(1, {"key0", "key1", "key2"}, {"a", "b", "c"});
+    engine.setExpiration(1, "key1", currentTime() + std::chrono::hours(1));
+    engine.setExpiration(1, "key2", currentTime() + std::chrono::hours(1));
+    engine.clearExpiration(1, "key2");
+    engine.deleteKeys(1, {"key0"});
+    engine.listPush(1, "key3", {"x", "y", "z"}, ListEnd::TAIL);
+    engine.listPush(1, "key3", {"w"}, ListEnd::HEAD);
+    engine.listPop(1, "key3", 2, ListEnd::TAIL);
+    engine.setAdd(1, "key4", {"1", "2", "three"});
+    engine.setRemove(1, "key4", {"2"});
+    engine.hashSet(1, "key5", {{"f", "1"}, {"g", "2"}});
+    engine.hashDelete(1, "key5", {"f"});
+    engine.listPush(1, "key6", {"gone"}, ListEnd::TAIL);
+    engine.listPop(1, "key6", 1, ListEnd::HEAD);
+    // more keys than the capacity: the log holds the evictions, whichever keys the policy picked
+    for (int i = 7; i < 40; ++i) {
+        engine.insertString(1, keys[i], std::to_string(i));
+    }
+    engine.insertString(1, "key8", "overwritten");
+    // a key that has expired is deleted when it is next read, and the log has to say so
+    engine.insertString(2, "short", "lived");
+    engine.setExpiration(2, "short", currentTime() + std::chrono::milliseconds(20));
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    EXPECT_FALSE(engine.fetchLiveString(2, "short"));
+    engine.insertString(3, "cleared", "1");
+    engine.clearStore(3);
+    engine.flush();
+
+    // an engine with another shard count takes the log's
+    InMemoryEngine restarted(16);
+    restarted.enableLog(options);
+    EXPECT_EQ(restarted.shardCount(), 4);
+    expectSameKeys(engine, restarted, 1, keys);
+    EXPECT_EQ(restarted.memoryStats(2)->keys, 0);
+    EXPECT_EQ(restarted.memoryStats(3)->keys, 0);
+    // replayed TTLs are handed to the active expirer once they pass, even for keys deleted since, which it skips
+    EXPECT_EQ(restarted.fetchExpiredKeys(10), (std::vector<std::pair<size_t, std::string>>{{2, "short"}}));
+    restarted.disableLog();
+    engine.disableLog();
+    std::filesystem::remove(options.path);
+}
+
+TEST(AppendOnlyLogTest, RewriteCompactsWhileWritesContinue) {
+    AppendOnlyLogOptions options{logPath("rewrite"), FsyncPolicy::INTERVAL, std::chrono::milliseconds(10)};
+    std::vector<std::string> keys;
+    for (int i = 0; i < 200; ++i) {
+        keys.push_back("key" + std::to_string(i));
+    }
+
+    InMemoryEngine engine(4);
+    engine.enableLog(options);
+    engine.setEvictionConfig(1, EvictionConfig{"lru", 10'000});
+    for (int round = 0; round < 50; ++round) {
+        for (const auto& key : keys) {
+            engine.insertString(1, key, std::to_string(round));
+        }
+    }
+    engine.listPush(1, "list", std::vector<std::string>(1500, "v"), ListEnd::TAIL);
+    engine.flush();
+    size_t before = 50 * keys.size() + 1;
+
+    // writers keep going while the log is rewritten, on every shard
+    std::atomic<bool> done = false;
+    std::atomic<size_t> written = 0;
+    std::thread writer([&] {
+        for (int round = 50; !done; ++round) {
+            for (const auto& key : keys) {
+                engine.insertString(1, key, std::to_string(round));
+            }
+            engine.deleteKey(1, keys[round % keys.size()]);
+            written += keys.size() + 1;
+        }
+    });
+    // the rewritten log is renamed over the old one
+    auto inode = [&options] {
+        struct stat status;
+        stat(options.path.c_str(), &status);
+        return status.st_ino;
+    };
+    auto oldInode = inode();
+    EXPECT_TRUE(engine.rewriteLog());
+    EXPECT_FALSE(engine.rewriteLog());
+    while (inode() == oldInode) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    done = true;
+    writer.join();
+    keys.push_back("list");
+    engine.flush();
+
+    InMemoryEngine restarted(4);
+    restarted.enableLog(options);
+    expectSameKeys(engine, restarted, 1, keys);
+    restarted.disableLog();
+    engine.disableLog();
+    // however far the writer got, the rewritten log holds fewer records than were ever written
+    EXPECT_LT(replayAll(options).size(), before + written);
+    std::filesystem::remove(options.path);
+}
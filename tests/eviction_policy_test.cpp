@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include "../include/lru.h"
+#include "../include/lfu.h"
+#include "../include/tiny_lfu.h"
+
+TEST(LRUTest, EvictLeastRecentlyUsed) {
+    LRU lru;
+    lru.keyAccessed("a");
+    lru.keyAccessed("b");
+    lru.keyAccessed("c");
+    EXPECT_EQ(lru.evict(), "a");
+    EXPECT_EQ(lru.evict(), "b");
+    EXPECT_EQ(lru.evict(), "c");
+}
+
+TEST(LRUTest, AccessMovesKeyToFront) {
+    LRU lru;
+    lru.keyAccessed("a");
+    lru.keyAccessed("b");
+    lru.keyAccessed("c");
+    lru.keyAccessed("a");
+    EXPECT_EQ(lru.evict(), "b");
+    EXPECT_EQ(lru.evict(), "c");
+    EXPECT_EQ(lru.evict(), "a");
+}
+
+TEST(LRUTest, RemovedKeyIsNotEvicted) {
+    LRU lru;
+    lru.keyAccessed("a");
+    lru.keyAccessed("b");
+    lru.keyRemoved("a");
+    lru.keyRemoved("missing");
+    EXPECT_EQ(lru.evict(), "b");
+    EXPECT_THROW(lru.evict(), std::runtime_error);
+}
+
+TEST(LRUTest, MovedKeyKeepsItsPosition) {
+    std::string a = "a";
+    std::string b = "b";
+    LRU lru;
+    lru.keyAccessed(a);
+    lru.keyAccessed(b);
+
+    std::string moved = a;
+    lru.keyMoved(moved);
+    a = "x"; // the policy must no longer read the old copy
+    EXPECT_EQ(lru.evict().bytes().data(), moved.data());
+    EXPECT_EQ(lru.evict(), "b");
+}
+
+TEST(LFUTest, EvictLeastFrequentlyUsed) {
+    LFU lfu;
+    lfu.keyAccessed("a");
+    lfu.keyAccessed("a");
+    lfu.keyAccessed("b");
+    lfu.keyAccessed("c");
+    lfu.keyAccessed("c");
+    lfu.keyAccessed("c");
+    EXPECT_EQ(lfu.evict(), "b");
+    EXPECT_EQ(lfu.evict(), "a");
+    EXPECT_EQ(lfu.evict(), "c");
+}
+
+TEST(LFUTest, TieBreakEvictsLeastRecentlyUsed) {
+    LFU lfu;
+    lfu.keyAccessed("a");
+    lfu.keyAccessed("b");
+    lfu.keyAccessed("c");
+    lfu.keyAccessed("b");
+    lfu.keyAccessed("a");
+    EXPECT_EQ(lfu.evict(), "c");
+    EXPECT_EQ(lfu.evict(), "b");
+    EXPECT_EQ(lfu.evict(), "a");
+}
+
+TEST(LFUTest, RemovedKeyIsNotEvicted) {
+    LFU lfu;
+    lfu.keyAccessed("a");
+    lfu.keyAccessed("b");
+    lfu.keyAccessed("b");
+    lfu.keyRemoved("a");
+    lfu.keyRemoved("missing");
+    lfu.keyAccessed("c");
+    EXPECT_EQ(lfu.evict(), "c");
+    EXPECT_EQ(lfu.evict(), "b");
+    EXPECT_THROW(lfu.evict(), std::runtime_error);
+}
+
+TEST(CountMinSketchTest, EstimateAndHalve) {
+    CountMinSketch sketch(100);
+    for (int i = 0; i < 6; ++i) {
+        sketch.increment("hot");
+    }
+    sketch.increment("cold");
+    EXPECT_GE(sketch.estimate("hot"), 6);
+    EXPECT_GE(sketch.estimate("cold"), 1);
+    sketch.halve();
+    EXPECT_EQ(sketch.estimate("hot"), 3);
+}
+
+TEST(TinyLFUTest, RejectsColdCandidate) {
+    TinyLFU tinyLfu(100);
+    tinyLfu.keyAccessed("a");
+    tinyLfu.keyAccessed("a");
+    tinyLfu.keyAccessed("b");
+    tinyLfu.keyAccessed("b");
+    tinyLfu.keyAccessed("c");
+    EXPECT_EQ(tinyLfu.evict(), "c");
+    EXPECT_EQ(tinyLfu.evict(), "a");
+}
+
+TEST(TinyLFUTest, AdmitsFrequentCandidate) {
+    TinyLFU tinyLfu(100);
+    tinyLfu.keyAccessed("a");
+    tinyLfu.keyAccessed("b");
+    tinyLfu.keyAccessed("c");
+    tinyLfu.evict();
+    tinyLfu.keyAccessed("c");
+    tinyLfu.keyAccessed("c");
+    EXPECT_EQ(tinyLfu.evict(), "a");
+}
+
+TEST(EvictionPolicyTest, RestoredPolicyEvictsInTheSameOrder) {
+    for (std::string name : {"lru", "lfu", "tinylfu"}) {
+        auto policy = makeEvictionPolicy(name, 100);
+        for (const char* key : {"a", "b", "c", "d", "b", "a", "b", "e", "c"}) {
+            policy->keyAccessed(key);
+        }
+        // a newcomer waiting for TinyLFU's admission check is not part of the restored state
+        policy->evict();
+        auto restored = makeEvictionPolicy(name, 100);
+        policy->forEachByRank([&restored](const KeyView key, const size_t count) { restored->keyRestored(key, count); });
+        for (int i = 0; i < 4; ++i) {
+            EXPECT_EQ(restored->evict(), policy->evict()) << name;
+        }
+    }
+}
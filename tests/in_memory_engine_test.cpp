@@ -0,0 +1,463 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <thread>
+#include "../include/in_memory_engine.h"
+#include "../include/key.h"
+#include "../include/record_table.h"
+#include "../include/slab_allocator.h"
+#include "../include/quicklist.h"
+#include "../include/compact_set.h"
+#include "../include/compact_hash.h"
+
+TEST(KeyTest, InlineAndHeapKeysKeepTheirHash) {
+    std::string shortKey(Key::INLINE_CAPACITY, 's');
+    std::string longKey(Key::INLINE_CAPACITY + 1, 'l');
+    Key inlined{KeyView(shortKey)};
+    Key onHeap{KeyView(longKey)};
+    EXPECT_EQ(inlined.bytes(), shortKey);
+    EXPECT_EQ(onHeap.bytes(), longKey);
+    EXPECT_EQ(inlined.hash(), hashKey(shortKey));
+    EXPECT_EQ(onHeap.hash(), hashKey(longKey));
+
+    Key copied = onHeap;
+    Key moved = std::move(onHeap);
+    EXPECT_EQ(copied.bytes(), longKey);
+    EXPECT_EQ(moved.bytes(), longKey);
+    EXPECT_NE(copied.bytes().data(), moved.bytes().data());
+    copied = inlined;
+    EXPECT_EQ(copied.view(), KeyView(shortKey));
+
+    // a view with a precomputed hash is trusted as is, so a lookup never rehashes the bytes
+    KeyMap<int> map;
+    map.emplace(Key(KeyView("a")), 1);
+    EXPECT_EQ(map.count(KeyView("a")), 1);
+    EXPECT_EQ(map.count(KeyView("a", hashKey("a") + 1)), 0);
+}
+
+TEST(RecordTableTest, UpsertFindErase) {
+    RecordTable table;
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(table.upsert("key" + std::to_string(i), "val" + std::to_string(i)));
+    }
+    EXPECT_FALSE(table.upsert("key7", "seven"));
+    EXPECT_EQ(table.size(), 1000);
+    EXPECT_EQ(table.find("key7")->value(), "seven");
+
+    // erasing every other key must keep the rest of each probe run reachable
+    for (int i = 0; i < 1000; i += 2) {
+        EXPECT_TRUE(table.erase("key" + std::to_string(i)));
+    }
+    EXPECT_FALSE(table.erase("key0"));
+    EXPECT_EQ(table.size(), 500);
+    for (int i = 1; i < 1000; i += 2) {
+        ASSERT_NE(table.find("key" + std::to_string(i)), nullptr);
+    }
+    EXPECT_EQ(table.find("key2"), nullptr);
+}
+
+TEST(RecordTableTest, ReplaceInPlaceOrMove) {
+    RecordTable table;
+    table.upsert("key", "small");
+    auto record = table.find("key");
+
+    size_t moves = 0;
+    EXPECT_FALSE(table.upsert("key", "smalL", Record::NO_EXPIRATION, [&](const Record&) { ++moves; }));
+    EXPECT_EQ(table.find("key"), record); // same size class: the key keeps its address
+    EXPECT_EQ(moves, 0);
+
+    table.upsert("key", std::string(500, 'v'), Record::NO_EXPIRATION, [&](const Record& moved) {
+        ++moves;
+        EXPECT_EQ(record->key(), "key"); // the old record is still readable while moved runs
+        EXPECT_NE(&moved, record);
+    });
+    EXPECT_EQ(moves, 1);
+    EXPECT_EQ(table.find("key")->value(), std::string(500, 'v'));
+}
+
+TEST(SlabAllocatorTest, SizeClassesAndReuse) {
+    EXPECT_EQ(SlabAllocator::chunkSize(1), 8);
+    EXPECT_EQ(SlabAllocator::chunkSize(36), 40);
+    EXPECT_EQ(SlabAllocator::chunkSize(129), 160);
+    EXPECT_EQ(SlabAllocator::chunkSize(1000), 1024);
+    EXPECT_EQ(SlabAllocator::chunkSize(SlabAllocator::MAX_CHUNK_SIZE), SlabAllocator::MAX_CHUNK_SIZE);
+    EXPECT_EQ(SlabAllocator::chunkSize(5000), 5000);
+    for (size_t size = 1; size < SlabAllocator::MAX_CHUNK_SIZE; ++size) {
+        ASSERT_GE(SlabAllocator::chunkSize(size), size);
+        ASSERT_LE(SlabAllocator::chunkSize(size), SlabAllocator::chunkSize(size + 1));
+    }
+
+    SlabAllocator allocator;
+    auto first = allocator.allocate(36);
+    auto second = allocator.allocate(40);
+    EXPECT_EQ(static_cast<char*>(second) - static_cast<char*>(first), 40); // one class, carved back to back
+    EXPECT_EQ(allocator.bytesInUse(), 80);
+    EXPECT_EQ(allocator.bytesReserved(), SlabAllocator::SLAB_SIZE);
+
+    allocator.deallocate(first, 36);
+    EXPECT_EQ(allocator.allocate(33), first); // a freed chunk is reused by its class
+    auto large = allocator.allocate(5000);
+    EXPECT_EQ(allocator.bytesReserved(), SlabAllocator::SLAB_SIZE + 5000);
+    allocator.deallocate(large, 5000);
+    allocator.reset();
+    EXPECT_EQ(allocator.bytesInUse(), 0);
+    EXPECT_EQ(allocator.bytesReserved(), 0);
+}
+
+TEST(QuickListTest, PushPopRange) {
+    QuickList list;
+    std::string large(300, 'x'); // takes the four-byte length encoding
+    for (int i = 0; i < 2000; ++i) {
+        list.pushBack(std::to_string(i));
+    }
+    list.pushFront(large);
+    list.pushFront("head");
+    EXPECT_EQ(list.size(), 2002);
+
+    auto range = list.range(0, 3);
+    EXPECT_EQ(range, (std::vector<std::string>{"head", large, "0", "1"}));
+    EXPECT_EQ(list.range(2001, 2001), std::vector<std::string>{"1999"});
+
+    EXPECT_EQ(list.popFront(), "head");
+    EXPECT_EQ(list.popFront(), large);
+    EXPECT_EQ(list.popBack(), "1999");
+    for (int i = 0; i < 1999; ++i) {
+        EXPECT_EQ(list.popFront(), std::to_string(i));
+    }
+    EXPECT_TRUE(list.empty());
+    EXPECT_FALSE(list.popBack().has_value());
+}
+
+TEST(QuickListTest, ResolveListRange) {
+    EXPECT_EQ(resolveListRange(0, -1, 5), std::make_optional(std::make_pair<size_t, size_t>(0, 4)));
+    EXPECT_EQ(resolveListRange(-3, 10, 5), std::make_optional(std::make_pair<size_t, size_t>(2, 4)));
+    EXPECT_EQ(resolveListRange(-10, 1, 5), std::make_optional(std::make_pair<size_t, size_t>(0, 1)));
+    EXPECT_FALSE(resolveListRange(3, 2, 5).has_value());
+    EXPECT_FALSE(resolveListRange(5, 10, 5).has_value());
+    EXPECT_FALSE(resolveListRange(0, -1, 0).has_value());
+}
+
+TEST(CompactSetTest, IntSetConvertsToHashSet) {
+    CompactSet set;
+    EXPECT_TRUE(set.add("5"));
+    EXPECT_TRUE(set.add("-70000")); // widens to 32 bits
+    EXPECT_TRUE(set.add("9000000000")); // widens to 64 bits
+    EXPECT_FALSE(set.add("5"));
+    EXPECT_TRUE(set.contains("-70000"));
+    EXPECT_FALSE(set.contains("05"));
+    EXPECT_TRUE(set.isIntSet());
+    EXPECT_EQ(set.members(), (std::vector<std::string>{"-70000", "5", "9000000000"}));
+
+    // a non-canonical integer is stored as a string
+    EXPECT_TRUE(set.add("05"));
+    EXPECT_FALSE(set.isIntSet());
+    EXPECT_TRUE(set.contains("05"));
+    EXPECT_TRUE(set.remove("5"));
+    EXPECT_EQ(set.size(), 3);
+
+    CompactSet large;
+    for (size_t i = 0; i < CompactSet::MAX_INTSET_ENTRIES; ++i) {
+        large.add(std::to_string(i * 3));
+    }
+    EXPECT_TRUE(large.isIntSet());
+    large.add("1");
+    EXPECT_FALSE(large.isIntSet());
+    EXPECT_TRUE(large.contains("3"));
+    EXPECT_EQ(large.size(), CompactSet::MAX_INTSET_ENTRIES + 1);
+}
+
+TEST(CompactHashTest, PackedConvertsToHashTable) {
+    CompactHash hash;
+    EXPECT_TRUE(hash.set("name", "ada"));
+    EXPECT_TRUE(hash.set("lang", "c++"));
+    EXPECT_FALSE(hash.set("name", "grace")); // rewritten in place
+    EXPECT_EQ(hash.get("name"), "grace");
+    EXPECT_EQ(hash.get("lang"), "c++");
+    EXPECT_FALSE(hash.get("missing").has_value());
+    EXPECT_TRUE(hash.remove("name"));
+    EXPECT_FALSE(hash.remove("name"));
+    EXPECT_TRUE(hash.isPacked());
+    EXPECT_EQ(hash.entries(), (std::vector<std::pair<std::string, std::string>>{{"lang", "c++"}}));
+
+    // a long value converts the hash
+    EXPECT_FALSE(hash.set("lang", std::string(CompactHash::MAX_PACKED_LENGTH + 1, 'x')));
+    EXPECT_FALSE(hash.isPacked());
+    EXPECT_EQ(hash.get("lang")->size(), CompactHash::MAX_PACKED_LENGTH + 1);
+
+    CompactHash wide;
+    for (size_t i = 0; i <= CompactHash::MAX_PACKED_ENTRIES; ++i) {
+        wide.set("field" + std::to_string(i), std::to_string(i));
+    }
+    EXPECT_FALSE(wide.isPacked());
+    EXPECT_EQ(wide.size(), CompactHash::MAX_PACKED_ENTRIES + 1);
+    EXPECT_EQ(wide.get("field7"), "7");
+}
+
+TEST(InMemoryEngineTest, SetGetDelete) {
+    InMemoryEngine engine;
+    engine.insertStrings(1, {"a", "b"}, {"1", "2"});
+    engine.insertString(2, "a", "other store");
+    EXPECT_EQ(engine.fetchLiveString(1, "a")->value, "1");
+    EXPECT_EQ(engine.fetchLiveString(2, "a")->value, "other store");
+
+    EXPECT_EQ(engine.deleteKeys(1, {"a", "missing"}), 1);
+    auto entries = engine.fetchLiveStrings(1, {"a", "b"});
+    EXPECT_FALSE(entries[0].has_value());
+    EXPECT_EQ(entries[1]->value, "2");
+}
+
+TEST(InMemoryEngineTest, ExpirationAndEviction) {
+    InMemoryEngine engine(1);
+    engine.insertString(1, "a", "1");
+    auto expiration = currentTime() + std::chrono::milliseconds(200);
+    EXPECT_EQ(engine.setExpiration(1, "a", expiration), 1);
+    EXPECT_EQ(engine.setExpiration(1, "missing", expiration), 0);
+    EXPECT_EQ(engine.fetchLiveString(1, "a")->expiration, expiration);
+    EXPECT_EQ(engine.getExpiration(1, "a"), std::make_optional(std::make_optional(expiration)));
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    EXPECT_FALSE(engine.fetchLiveString(1, "a").has_value());
+    EXPECT_FALSE(engine.getExpiration(1, "a").has_value());
+
+    engine.insertString(1, "b", "2");
+    EXPECT_EQ(engine.clearExpiration(1, "b"), 0);
+    engine.setExpiration(1, "b", currentTime() + std::chrono::seconds(10));
+    EXPECT_EQ(engine.clearExpiration(1, "b"), 1);
+    EXPECT_EQ(engine.getExpiration(1, "b"), std::make_optional(std::optional<ExpirationTime>()));
+    engine.deleteKey(1, "b");
+
+    // a store has no capacity by default, since evicting would lose data rather than a cached copy
+    for (size_t i = 0; i <= DEFAULT_CAPACITY; ++i) {
+        engine.insertString(1, std::to_string(i), "v");
+    }
+    EXPECT_EQ(engine.memoryStats(1)->keys, DEFAULT_CAPACITY + 1);
+    EXPECT_EQ(engine.getEvictionConfig(1)->capacity, InMemoryEngine::NO_CAPACITY);
+
+    // a capacity from the eviction config is enforced with LRU
+    engine.setEvictionConfig(1, EvictionConfig{"lru", DEFAULT_CAPACITY});
+    for (size_t i = 0; i <= DEFAULT_CAPACITY; ++i) {
+        engine.insertString(1, std::to_string(i), "v");
+    }
+    EXPECT_FALSE(engine.fetchLiveString(1, "0").has_value());
+    EXPECT_TRUE(engine.fetchLiveString(1, "1").has_value());
+
+    EXPECT_EQ(engine.changePolicy(1, "lfu"), 1);
+    EXPECT_EQ(engine.changePolicy(1, "lfu"), 0);
+    EXPECT_FALSE(engine.fetchLiveString(1, "1").has_value());
+    EXPECT_EQ(engine.getEvictionConfig(1)->policy, "lfu");
+}
+
+TEST(InMemoryEngineTest, ShardedConcurrentSetGet) {
+    InMemoryEngine engine(8);
+    ASSERT_EQ(engine.shardCount(), 8);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&engine, t] {
+            for (int i = 0; i < 100; ++i) {
+                auto key = std::to_string(t) + ":" + std::to_string(i);
+                engine.insertString(1, key, key);
+                EXPECT_EQ(engine.fetchLiveString(1, key)->value, key);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(engine.deleteKeys(1, {"0:0", "3:99", "missing"}), 2);
+    engine.clearStore(1);
+    EXPECT_FALSE(engine.fetchLiveString(1, "1:1").has_value());
+}
+
+TEST(InMemoryEngineTest, CapacityHoldsForTheWholeStore) {
+    for (size_t capacity : {10, 1000}) {
+        InMemoryEngine engine(64);
+        engine.setEvictionConfig(1, EvictionConfig{"lru", capacity});
+        std::vector<std::string> keys;
+        for (size_t i = 0; i < capacity; ++i) {
+            keys.push_back("key" + std::to_string(i));
+        }
+        // however unevenly the keys spread over the shards, a store at capacity evicts nothing
+        engine.insertStrings(1, keys, std::vector<std::string>(keys.size(), "v"));
+        EXPECT_EQ(engine.memoryStats(1)->keys, capacity);
+        for (const auto& key : keys) {
+            ASSERT_TRUE(engine.fetchLiveString(1, key).has_value()) << key;
+        }
+
+        // and one past it evicts one key
+        engine.insertString(1, "one more", "v");
+        EXPECT_EQ(engine.memoryStats(1)->keys, capacity);
+        EXPECT_TRUE(engine.fetchLiveString(1, "one more").has_value());
+        engine.deleteKeys(1, keys);
+        EXPECT_EQ(engine.memoryStats(1)->keys, 1);
+        engine.clearStore(1);
+        EXPECT_EQ(engine.memoryStats(1)->keys, 0);
+    }
+}
+
+TEST(InMemoryEngineTest, Lists) {
+    InMemoryEngine engine;
+    EXPECT_EQ(engine.listPush(1, "l", {"a", "b", "c"}, ListEnd::HEAD), 3);
+    EXPECT_EQ(engine.listPush(1, "l", {"d"}, ListEnd::TAIL), 4);
+    EXPECT_EQ(engine.listRange(1, "l", 0, -1), (std::vector<std::string>{"c", "b", "a", "d"}));
+    EXPECT_EQ(engine.listRange(1, "l", -2, 100), (std::vector<std::string>{"a", "d"}));
+    EXPECT_EQ(engine.listPop(1, "l", 2, ListEnd::TAIL), (std::vector<std::string>{"d", "a"}));
+    EXPECT_EQ(engine.listLength(1, "l"), 2);
+
+    engine.insertString(1, "s", "1");
+    EXPECT_THROW(engine.listPush(1, "s", {"a"}, ListEnd::HEAD), TypeMismatchError);
+    EXPECT_THROW(engine.fetchLiveString(1, "l"), TypeMismatchError);
+
+    // MGET reads a list as missing, where GET throws
+    auto entries = engine.fetchLiveStrings(1, {"s", "l", "missing"});
+    EXPECT_EQ(entries[0]->value, "1");
+    EXPECT_FALSE(entries[1].has_value());
+    EXPECT_FALSE(entries[2].has_value());
+
+    // popping the last element removes the key, and DEL counts lists
+    EXPECT_EQ(engine.listPop(1, "l", 5, ListEnd::HEAD), (std::vector<std::string>{"c", "b"}));
+    EXPECT_EQ(engine.listLength(1, "l"), 0);
+    engine.listPush(1, "l", {"a"}, ListEnd::TAIL);
+    EXPECT_EQ(engine.deleteKeys(1, {"l", "s"}), 2);
+    EXPECT_TRUE(engine.listPop(1, "l", 1, ListEnd::HEAD).empty());
+
+    // SET replaces a list
+    engine.listPush(1, "l", {"a"}, ListEnd::TAIL);
+    engine.insertString(1, "l", "string");
+    EXPECT_EQ(engine.fetchLiveString(1, "l")->value, "string");
+}
+
+TEST(InMemoryEngineTest, Sets) {
+    InMemoryEngine engine;
+    EXPECT_EQ(engine.setAdd(1, "a", {"1", "2", "3", "2"}), 3);
+    EXPECT_EQ(engine.setAdd(1, "b", {"2", "3", "x"}), 3);
+    engine.setAdd(1, "c", {"3", "y"});
+    EXPECT_TRUE(engine.setContains(1, "a", "2"));
+    EXPECT_EQ(engine.setSize(1, "b"), 3);
+
+    auto sorted = [](std::vector<std::string> members) {
+        std::sort(members.begin(), members.end());
+        return members;
+    };
+    EXPECT_EQ(sorted(engine.setCombine(1, {"a", "b", "c"}, SetOperation::INTERSECTION)), std::vector<std::string>{"3"});
+    EXPECT_TRUE(engine.setCombine(1, {"a", "missing"}, SetOperation::INTERSECTION).empty());
+    EXPECT_EQ(sorted(engine.setCombine(1, {"a", "c"}, SetOperation::UNION)), (std::vector<std::string>{"1", "2", "3", "y"}));
+    EXPECT_EQ(sorted(engine.setCombine(1, {"a", "b", "missing"}, SetOperation::DIFFERENCE)), std::vector<std::string>{"1"});
+
+    engine.insertString(1, "s", "1");
+    EXPECT_THROW(engine.setAdd(1, "s", {"1"}), TypeMismatchError);
+    EXPECT_THROW(engine.setCombine(1, {"a", "s"}, SetOperation::UNION), TypeMismatchError);
+    EXPECT_THROW(engine.listLength(1, "a"), TypeMismatchError);
+
+    // removing the last member removes the key
+    EXPECT_EQ(engine.setRemove(1, "c", {"3", "y", "z"}), 2);
+    EXPECT_EQ(engine.deleteKeys(1, {"a", "c"}), 1);
+    EXPECT_TRUE(engine.setMembers(1, "a").empty());
+}
+
+TEST(InMemoryEngineTest, Hashes) {
+    InMemoryEngine engine;
+    EXPECT_EQ(engine.hashSet(1, "h", {{"a", "1"}, {"b", "2"}}), 2);
+    EXPECT_EQ(engine.hashSet(1, "h", {{"a", "10"}, {"c", "3"}}), 1);
+    EXPECT_EQ(engine.hashGet(1, "h", {"a", "missing", "c"}), (std::vector<std::optional<std::string>>{"10", std::nullopt, "3"}));
+    EXPECT_EQ(engine.hashGet(1, "missing", {"a"}), std::vector<std::optional<std::string>>{std::nullopt});
+    EXPECT_EQ(engine.hashGetAll(1, "h").size(), 3);
+    EXPECT_EQ(engine.hashLength(1, "h"), 3);
+
+    engine.setAdd(1, "s", {"1"});
+    EXPECT_THROW(engine.hashSet(1, "s", {{"a", "1"}}), TypeMismatchError);
+    EXPECT_THROW(engine.setAdd(1, "h", {"1"}), TypeMismatchError);
+
+    // removing the last field removes the key
+    EXPECT_EQ(engine.hashDelete(1, "h", {"a", "b", "c", "d"}), 3);
+    EXPECT_EQ(engine.hashLength(1, "h"), 0);
+    EXPECT_EQ(engine.deleteKeys(1, {"h", "s"}), 1);
+}
+
+TEST(InMemoryEngineTest, MaxMemoryEvictsByBytes) {
+    InMemoryEngine engine(1);
+    engine.setEvictionConfig(1, EvictionConfig{"lru", 1'000'000});
+    std::string value(100, 'v');
+    for (size_t i = 0; i < 1000; ++i) {
+        engine.insertString(1, "key:" + std::to_string(i), value);
+    }
+    auto stats = engine.memoryStats(1);
+    EXPECT_EQ(stats->keys, 1000);
+    EXPECT_EQ(stats->maxMemory, 0);
+    EXPECT_GT(stats->usedMemory, 1000 * value.size());
+    EXPECT_GE(engine.memoryUsage(1, "key:0"), sizeof(Record) + value.size());
+    EXPECT_FALSE(engine.memoryUsage(1, "missing").has_value());
+
+    // lowering the budget evicts the least recently used keys at once, and the store stays within it as it grows
+    auto budget = stats->usedMemory / 2;
+    engine.setMaxMemory(1, budget);
+    EXPECT_LE(engine.memoryStats(1)->usedMemory, budget);
+    EXPECT_FALSE(engine.fetchLiveString(1, "key:0").has_value());
+    EXPECT_TRUE(engine.fetchLiveString(1, "key:999").has_value());
+    EXPECT_EQ(engine.getEvictionConfig(1)->maxMemory, budget);
+    for (size_t i = 0; i < 1000; ++i) {
+        engine.listPush(1, "list:" + std::to_string(i), {value}, ListEnd::TAIL);
+    }
+    EXPECT_LE(engine.memoryStats(1)->usedMemory, budget);
+    EXPECT_TRUE(engine.memoryUsage(1, "list:999").has_value());
+
+    engine.setMaxMemory(1, 0);
+    engine.insertString(1, "key:0", value);
+    EXPECT_TRUE(engine.fetchLiveString(1, "key:0").has_value());
+}
+
+TEST(InMemoryEngineTest, MaxMemoryHoldsForTheWholeStore) {
+    InMemoryEngine engine(64);
+    size_t budget = 1 << 20;
+    engine.setMaxMemory(1, budget);
+    // a key far larger than a shard's share of the budget fits, since the budget is not split between the shards
+    std::string value(40'000, 'v');
+    engine.insertString(1, "large", value);
+    EXPECT_EQ(engine.fetchLiveString(1, "large")->value, value);
+
+    // the store fills up to the budget, over every shard, and stays within it
+    for (size_t i = 0; i < 100; ++i) {
+        engine.insertString(1, "key" + std::to_string(i), value);
+    }
+    auto stats = engine.memoryStats(1);
+    EXPECT_LE(stats->usedMemory, budget);
+    EXPECT_GT(stats->usedMemory, budget - 2 * value.size());
+    EXPECT_TRUE(engine.fetchLiveString(1, "key99").has_value());
+
+    // halving the budget evicts from every shard until the store fits it
+    engine.setMaxMemory(1, budget / 2);
+    stats = engine.memoryStats(1);
+    EXPECT_LE(stats->usedMemory, budget / 2);
+    EXPECT_GT(stats->usedMemory, budget / 2 - 2 * value.size());
+
+    // a key larger than the whole budget does not fit on its own
+    engine.insertString(1, "too large", std::string(budget, 'v'));
+    EXPECT_FALSE(engine.fetchLiveString(1, "too large").has_value());
+}
+
+TEST(InMemoryEngineTest, CollectionBytesAreReleased) {
+    InMemoryEngine engine(1);
+    auto fill = [&engine] {
+        std::vector<std::string> values;
+        std::vector<std::pair<std::string, std::string>> fields;
+        for (size_t i = 0; i < 1000; ++i) {
+            values.push_back("member:" + std::to_string(i) + std::string(i % 40, 'x'));
+            fields.emplace_back(values.back(), values.back());
+        }
+        engine.listPush(1, "l", values, ListEnd::HEAD);
+        engine.setAdd(1, "s", values);
+        engine.setAdd(1, "i", {"1", "2", "3"});
+        engine.hashSet(1, "h", fields);
+        EXPECT_GT(*engine.memoryUsage(1, "h"), *engine.memoryUsage(1, "i"));
+        engine.listPop(1, "l", 500, ListEnd::TAIL);
+        engine.setRemove(1, "s", {values[0], values[1]});
+        engine.hashDelete(1, "h", {values[0]});
+        engine.deleteKeys(1, {"l", "s", "i", "h"});
+    };
+
+    // the first round grows the maps' bucket arrays, which stay; every later round must return to the same total
+    fill();
+    auto baseline = engine.memoryStats(1)->usedMemory;
+    fill();
+    EXPECT_EQ(engine.memoryStats(1)->usedMemory, baseline);
+    EXPECT_EQ(engine.memoryStats(1)->keys, 0);
+}
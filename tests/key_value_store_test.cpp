@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <limits>
 #include <thread>
 #include "../include/key_value_store.h"
 
@@ -19,6 +21,9 @@ class KeyValueStoreTest : public ::testing::Test {
 
             pqxx::work txn(*conn);
             txn.exec("TRUNCATE " + std::string(STRING_TABLE) + " CASCADE;");
+            txn.exec("TRUNCATE " + std::string(LIST_TABLE) + " CASCADE;");
+            txn.exec("TRUNCATE " + std::string(SET_TABLE) + " CASCADE;");
+            txn.exec("TRUNCATE " + std::string(HASH_TABLE) + " CASCADE;");
             txn.exec("TRUNCATE " + std::string(EVICTION_TABLE) + " CASCADE;");
             txn.commit();
 
@@ -30,6 +35,82 @@ class KeyValueStoreTest : public ::testing::Test {
         pqxx::connection* conn;
 };
 
+TEST(KeyValueStoreMemoryTest, SetGetDelWithoutDatabase) {
+    KeyValueStore store(StorageBackend::MEMORY);
+    store.set(1, "test_key", "test_value");
+    store.mset(1, {{"k1", "v1"}, {"k2", "v2"}});
+    EXPECT_EQ(store.get(1, "test_key"), "test_value");
+    EXPECT_EQ(store.del(1, std::vector<std::string>{"k1", "missing"}), 1);
+    EXPECT_EQ(store.mget(1, {"k1", "k2"}),
+              (std::vector<std::optional<std::string>>{std::nullopt, "v2"}));
+    EXPECT_EQ(store.poolMetrics().size, 0);
+    EXPECT_THROW(store.enableWriteBehind(100, std::chrono::seconds(1)), std::runtime_error);
+
+    EXPECT_EQ(store.rPush(1, "list", {"a", "b"}), 2);
+    EXPECT_EQ(store.lRange(1, "list", 0, -1), (std::vector<std::string>{"a", "b"}));
+    EXPECT_EQ(store.sAdd(1, "set", {"1", "2"}), 2);
+    EXPECT_EQ(store.sDiff(1, {"set", "missing"}).size(), 2);
+    EXPECT_EQ(store.hSet(1, "hash", {{"f", "v"}}), 1);
+    EXPECT_EQ(store.hGet(1, "hash", "f"), "v");
+    EXPECT_EQ(store.mget(1, {"k2", "list", "set", "hash"}),
+              (std::vector<std::optional<std::string>>{"v2", std::nullopt, std::nullopt, std::nullopt}));
+}
+
+TEST(KeyValueStoreMemoryTest, StoreKeepsEveryKeyWithoutCapacity) {
+    KeyValueStore store(StorageBackend::MEMORY);
+    for (size_t i = 0; i < 1500; ++i) {
+        store.set(1, "key" + std::to_string(i), "value");
+    }
+    EXPECT_EQ(store.memoryStats(1).keys, 1500);
+    EXPECT_EQ(store.get(1, "key0"), "value");
+    EXPECT_EQ(store.get(1, "key1499"), "value");
+}
+
+TEST(KeyValueStoreMemoryTest, ExpireRejectsTimesOutOfRange) {
+    KeyValueStore store(StorageBackend::MEMORY);
+    constexpr auto max = std::numeric_limits<int64_t>::max();
+    constexpr auto min = std::numeric_limits<int64_t>::min();
+    store.set(1, "k", "v");
+
+    // times that would overflow Unix epoch milliseconds are refused and leave the key alone, rather than wrapping into the past
+    EXPECT_THROW(store.expire(1, "k", std::chrono::seconds(max)), std::runtime_error);
+    EXPECT_THROW(store.expire(1, "k", std::chrono::seconds(max / 1000 + 1)), std::runtime_error);
+    EXPECT_THROW(store.expire(1, "k", std::chrono::seconds(min / 1000 - 1)), std::runtime_error);
+    EXPECT_THROW(store.pExpire(1, "k", std::chrono::milliseconds(max)), std::runtime_error);
+    EXPECT_THROW(store.expireAt(1, "k", max / 1000 + 1), std::runtime_error);
+    EXPECT_THROW(store.expireAt(1, "k", min / 1000 - 1), std::runtime_error);
+    EXPECT_EQ(store.get(1, "k"), "v");
+    EXPECT_EQ(store.ttl(1, "k"), -1);
+
+    // the furthest times that fit are kept
+    EXPECT_EQ(store.expireAt(1, "k", max / 1000), 1);
+    EXPECT_GT(store.ttl(1, "k"), 0);
+    auto now = toUnixMilliseconds(currentTime());
+    EXPECT_EQ(store.pExpire(1, "k", std::chrono::milliseconds(max - now - 60'000)), 1);
+    EXPECT_GT(store.pTTL(1, "k"), 0);
+    EXPECT_EQ(store.get(1, "k"), "v");
+
+    // the most negative time that fits is in the past, so it deletes the key
+    EXPECT_EQ(store.expire(1, "k", std::chrono::seconds(min / 1000)), 0);
+    EXPECT_EQ(store.get(1, "k"), std::nullopt);
+}
+
+TEST(KeyValueStoreMemoryTest, ReExpiringKeepsOneTimerPerKey) {
+    KeyValueStore store(StorageBackend::MEMORY);
+    store.set(1, "hot", "v");
+    store.set(1, "other", "v");
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(store.expire(1, "hot", std::chrono::seconds(60 + i)), 1);
+    }
+    store.pExpire(1, "other", std::chrono::seconds(60));
+    EXPECT_EQ(store.expirationMetrics().scheduled, 2);
+
+    // PERSIST and DEL drop the timer with the TTL
+    EXPECT_EQ(store.persist(1, "hot"), 1);
+    EXPECT_EQ(store.del(1, "other"), 1);
+    EXPECT_EQ(store.expirationMetrics().scheduled, 0);
+}
+
 TEST_F(KeyValueStoreTest, SetAndGet) {
     store->set(1, "test_key", "test_value");
     EXPECT_EQ(store->get(1, "test_key"), "test_value");
@@ -41,61 +122,156 @@ TEST_F(KeyValueStoreTest, SetDelGet) {
     EXPECT_FALSE(store->get(1, "test_key2").has_value());
 }
 
-// TEST_F(KeyValueStoreTest, LeftPushTwiceLen) {
-//     store->lPush("test_list", "item1");
-//     store->lPush("test_list", "item2");
-//     EXPECT_EQ(store->lLen("test_list"), 2);
-// }
+TEST_F(KeyValueStoreTest, WriteBehindReadYourWritesAndFlush) {
+    store->enableWriteBehind(100, std::chrono::seconds(10));
+    store->set(1, "test_key", "test_value");
+    store->set(1, "test_key2", "test_value2");
+    store->del(1, "test_key2");
+    EXPECT_EQ(store->get(1, "test_key"), "test_value");
+    EXPECT_FALSE(store->get(1, "test_key2").has_value());
 
-// TEST_F(KeyValueStoreTest, LeftPushLRange) {
-//     store->lPush("test_list", "item1");
-//     EXPECT_EQ(store->lRange("test_list", 0, 0), (std::deque<std::string>{"item1"}));
-// }
+    store->flush();
+    pqxx::work txn(*conn);
+    auto res = txn.exec("SELECT key, value FROM " + std::string(STRING_TABLE) + " WHERE store_id = 1;");
+    ASSERT_EQ(res.size(), 1);
+    EXPECT_EQ(res[0][0].as<std::string>(), "test_key");
+    EXPECT_EQ(res[0][1].as<std::string>(), "test_value");
+}
 
-// TEST_F(KeyValueStoreTest, LeftPushTwiceRightPopLRange) {
-//     store->lPush("test_list", "item1");
-//     store->lPush("test_list", "item2");
-//     store->rPop("test_list");
-//     EXPECT_EQ(store->lRange("test_list", 0, 0), (std::deque<std::string>{"item2"}));
-// }
+TEST_F(KeyValueStoreTest, MultiSetGetDel) {
+    EXPECT_EQ(store->mset(1, {{"k1", "v1"}, {"k2", "v2"}, {"k1", "v3"}}), "OK");
+    EXPECT_EQ(store->mget(1, {"k1", "missing", "k2"}),
+              (std::vector<std::optional<std::string>>{"v3", std::nullopt, "v2"}));
+    EXPECT_EQ(store->del(1, std::vector<std::string>{"k1", "k1", "missing"}), 1);
+    EXPECT_EQ(store->mget(1, {"k1", "k2"}),
+              (std::vector<std::optional<std::string>>{std::nullopt, "v2"}));
+}
 
-// TEST_F(KeyValueStoreTest, RightPushTwiceLeftPopLRange) {
-//     store->rPush("test_list", "item1");
-//     store->rPush("test_list", "item2");
-//     store->lPop("test_list");
-//     EXPECT_EQ(store->lRange("test_list", 0, 0), (std::deque<std::string>{"item2"}));
-// }
+TEST_F(KeyValueStoreTest, ConcurrentSetGet) {
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 8; ++t) {
+        threads.emplace_back([this, t] {
+            for (size_t i = 0; i < 20; ++i) {
+                auto key = "key_" + std::to_string(t) + "_" + std::to_string(i);
+                store->set(1, key, "value");
+                EXPECT_EQ(store->get(1, key), "value");
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
 
-// TEST_F(KeyValueStoreTest, RightLeftPushLRange) {
-//     store->rPush("test_list", "item1");
-//     store->rPush("test_list", "item2");
-//     store->lPush("test_list", "item0");
-//     store->rPush("test_list", "item3");
-//     EXPECT_EQ(store->lRange("test_list", 0, 3), (std::deque<std::string>{"item0", "item1", "item2", "item3"}));
-// }
+    auto metrics = store->poolMetrics();
+    EXPECT_LE(metrics.open, metrics.size);
+    EXPECT_EQ(metrics.inUse, 0);
+}
 
-// TEST_F(KeyValueStoreTest, SetAddRemCard) {
-//     store->sAdd("test_set", "item1");
-//     store->sAdd("test_set", "item2");
-//     store->sAdd("test_set", "item3");
-//     EXPECT_EQ(store->sRem("test_set", "item2"), 1);
-//     EXPECT_EQ(store->sCard("test_set"), 2);
-// }
+TEST_F(KeyValueStoreTest, LeftPushTwiceLen) {
+    store->lPush(1, "test_list", {"item1"});
+    store->lPush(1, "test_list", {"item2"});
+    EXPECT_EQ(store->lLen(1, "test_list"), 2);
+}
 
-// TEST_F(KeyValueStoreTest, SetAddRemMembers) {
-//     EXPECT_EQ(store->sMembers("test_set"), (std::unordered_set<std::string>{}));
-//     store->sAdd("test_set", "item1");
-//     store->sAdd("test_set", "item2");
-//     store->sAdd("test_set", "item3");
-//     EXPECT_EQ(store->sRem("test_set", "item2"), 1);
-//     EXPECT_EQ(store->sMembers("test_set"), (std::unordered_set<std::string>{"item1", "item3"}));
-// }
+TEST_F(KeyValueStoreTest, LeftPushLRange) {
+    store->lPush(1, "test_list", {"item1"});
+    EXPECT_EQ(store->lRange(1, "test_list", 0, 0), (std::vector<std::string>{"item1"}));
+}
 
-// TEST_F(KeyValueStoreTest, SetAddIsMember) {
-//     EXPECT_EQ(store->sIsMember("test_set", "item1"), 0);
-//     store->sAdd("test_set", "item1");
-//     EXPECT_EQ(store->sIsMember("test_set", "item1"), 1);
-// }
+TEST_F(KeyValueStoreTest, LeftPushTwiceRightPopLRange) {
+    store->lPush(1, "test_list", {"item1"});
+    store->lPush(1, "test_list", {"item2"});
+    EXPECT_EQ(store->rPop(1, "test_list"), "item1");
+    EXPECT_EQ(store->lRange(1, "test_list", 0, 0), (std::vector<std::string>{"item2"}));
+}
+
+TEST_F(KeyValueStoreTest, RightPushTwiceLeftPopLRange) {
+    store->rPush(1, "test_list", {"item1", "item2"});
+    EXPECT_EQ(store->lPop(1, "test_list"), "item1");
+    EXPECT_EQ(store->lRange(1, "test_list", 0, 0), (std::vector<std::string>{"item2"}));
+}
+
+TEST_F(KeyValueStoreTest, RightLeftPushLRange) {
+    store->rPush(1, "test_list", {"item1", "item2"});
+    store->lPush(1, "test_list", {"item0"});
+    store->rPush(1, "test_list", {"item3"});
+    EXPECT_EQ(store->lRange(1, "test_list", 0, 3), (std::vector<std::string>{"item0", "item1", "item2", "item3"}));
+    EXPECT_EQ(store->lRange(1, "test_list", -2, -1), (std::vector<std::string>{"item2", "item3"}));
+}
+
+TEST_F(KeyValueStoreTest, ListSpansNodes) {
+    // 1000-byte elements fill a node every eight pushes
+    std::vector<std::string> vals;
+    for (int i = 0; i < 100; ++i) {
+        vals.push_back(std::string(1000, 'a' + i % 26) + std::to_string(i));
+    }
+    EXPECT_EQ(store->rPush(1, "test_list", vals), 100);
+    EXPECT_EQ(store->lRange(1, "test_list", 0, -1), vals);
+    EXPECT_EQ(store->lRange(1, "test_list", 15, 17), std::vector<std::string>(vals.begin() + 15, vals.begin() + 18));
+
+    auto popped = store->lPop(1, "test_list", 20);
+    EXPECT_EQ(popped, std::vector<std::string>(vals.begin(), vals.begin() + 20));
+    EXPECT_EQ(store->lLen(1, "test_list"), 80);
+    EXPECT_EQ(store->rPop(1, "test_list", 100).size(), 80);
+
+    pqxx::work txn(*conn);
+    auto res = txn.exec("SELECT 1 FROM " + std::string(LIST_TABLE) + " WHERE store_id = 1;");
+    EXPECT_TRUE(res.empty());
+}
+
+TEST_F(KeyValueStoreTest, ListTypeMismatchAndDel) {
+    store->set(1, "test_key", "test_value");
+    EXPECT_THROW(store->lPush(1, "test_key", {"item1"}), TypeMismatchError);
+    EXPECT_THROW(store->lLen(1, "test_key"), TypeMismatchError);
+
+    store->rPush(1, "test_list", {"item1"});
+    EXPECT_EQ(store->del(1, std::vector<std::string>{"test_key", "test_list"}), 2);
+    EXPECT_FALSE(store->lPop(1, "test_list").has_value());
+
+    store->rPush(1, "test_list", {"item1"});
+    store->set(1, "test_list", "test_value");
+    EXPECT_EQ(store->get(1, "test_list"), "test_value");
+    EXPECT_THROW(store->lLen(1, "test_list"), TypeMismatchError);
+}
+
+TEST_F(KeyValueStoreTest, SetAddRemCard) {
+    store->sAdd(1, "test_set", {"item1", "item2"});
+    store->sAdd(1, "test_set", {"item3"});
+    EXPECT_EQ(store->sRem(1, "test_set", {"item2"}), 1);
+    EXPECT_EQ(store->sCard(1, "test_set"), 2);
+}
+
+TEST_F(KeyValueStoreTest, SetAddRemMembers) {
+    EXPECT_TRUE(store->sMembers(1, "test_set").empty());
+    EXPECT_EQ(store->sAdd(1, "test_set", {"item1", "item2", "item3", "item1"}), 3);
+    EXPECT_EQ(store->sRem(1, "test_set", {"item2"}), 1);
+    auto members = store->sMembers(1, "test_set");
+    EXPECT_EQ(std::unordered_set<std::string>(members.begin(), members.end()), (std::unordered_set<std::string>{"item1", "item3"}));
+}
+
+TEST_F(KeyValueStoreTest, SetAddIsMember) {
+    EXPECT_EQ(store->sIsMember(1, "test_set", "item1"), 0);
+    store->sAdd(1, "test_set", {"item1"});
+    EXPECT_EQ(store->sIsMember(1, "test_set", "item1"), 1);
+}
+
+TEST_F(KeyValueStoreTest, SetInterUnionDiff) {
+    store->sAdd(1, "tags1", {"1", "2", "3"});
+    store->sAdd(1, "tags2", {"2", "3", "red"});
+    auto sorted = [](std::vector<std::string> members) {
+        std::sort(members.begin(), members.end());
+        return members;
+    };
+    EXPECT_EQ(sorted(store->sInter(1, {"tags1", "tags2"})), (std::vector<std::string>{"2", "3"}));
+    EXPECT_EQ(sorted(store->sUnion(1, {"tags1", "tags2", "missing"})), (std::vector<std::string>{"1", "2", "3", "red"}));
+    EXPECT_EQ(store->sDiff(1, {"tags1", "tags2"}), std::vector<std::string>{"1"});
+    EXPECT_TRUE(store->sDiff(1, {"tags1", "tags1"}).empty());
+
+    store->set(1, "test_key", "test_value");
+    EXPECT_THROW(store->sInter(1, {"tags1", "test_key"}), TypeMismatchError);
+    EXPECT_EQ(store->del(1, std::vector<std::string>{"tags1", "tags2"}), 2);
+    EXPECT_EQ(store->sCard(1, "tags1"), 0);
+}
 
 TEST_F(KeyValueStoreTest, StringExpireBasic) {
     store->set(1, "test_key1", "item1");
@@ -105,6 +281,23 @@ TEST_F(KeyValueStoreTest, StringExpireBasic) {
     EXPECT_FALSE(store->get(1, "test_key1").has_value());
 }
 
+TEST_F(KeyValueStoreTest, StringExpireActive) {
+    store->set(1, "test_key1", "item1");
+    store->set(1, "test_key2", "item2");
+    store->expire(1, "test_key1", std::chrono::seconds(1));
+    store->expire(1, "test_key2", std::chrono::seconds(1));
+    store->set(1, "test_key2", "item2"); // SET clears the TTL, so the pending timer must not delete it
+    std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+
+    // reaped without being read again
+    pqxx::work txn(*conn);
+    auto res = txn.exec("SELECT key FROM " + std::string(STRING_TABLE) + " WHERE store_id = 1;");
+    ASSERT_EQ(res.size(), 1);
+    EXPECT_EQ(res[0][0].as<std::string>(), "test_key2");
+    EXPECT_EQ(store->expirationMetrics().reaped, 1);
+    EXPECT_EQ(store->expirationMetrics().scheduled, 0);
+}
+
 // TEST_F(KeyValueStoreTest, ListExpireBasic) {
 //     store->lPush("test_list1", "item1");
 //     store->expire("test_list1", std::chrono::seconds(1));
@@ -113,6 +306,33 @@ TEST_F(KeyValueStoreTest, StringExpireBasic) {
 //     EXPECT_FALSE(store->lRange("test_list1",0,0).has_value());
 // }
 
+TEST_F(KeyValueStoreTest, StringPExpireTTLPersist) {
+    EXPECT_EQ(store->pTTL(1, "test_key1"), -2);
+    store->set(1, "test_key1", "item1");
+    EXPECT_EQ(store->ttl(1, "test_key1"), -1);
+
+    EXPECT_EQ(store->pExpire(1, "test_key1", std::chrono::milliseconds(1500)), 1);
+    EXPECT_GT(store->pTTL(1, "test_key1"), 1000);
+    EXPECT_EQ(store->ttl(1, "test_key1"), 2);
+    EXPECT_EQ(store->persist(1, "test_key1"), 1);
+    EXPECT_EQ(store->persist(1, "test_key1"), 0);
+    EXPECT_EQ(store->ttl(1, "test_key1"), -1);
+
+    // stored as absolute Unix milliseconds
+    auto at = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() + 300;
+    EXPECT_EQ(store->pExpireAt(1, "test_key1", at), 1);
+    pqxx::work txn(*conn);
+    auto res = txn.exec("SELECT expiration FROM " + std::string(STRING_TABLE) + " WHERE store_id = 1 AND key = 'test_key1';");
+    txn.commit();
+    EXPECT_EQ(res[0][0].as<int64_t>(), at);
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    EXPECT_FALSE(store->get(1, "test_key1").has_value());
+
+    store->set(1, "test_key2", "item2");
+    EXPECT_EQ(store->expireAt(1, "test_key2", 1), 0); // in the past: deleted
+    EXPECT_EQ(store->ttl(1, "test_key2"), -2);
+}
+
 // TEST_F(KeyValueStoreTest, StringExpirePersist) {
 //     store->set("test_key1", "item1");
 //     store->expire("test_key1", std::chrono::seconds(1));
@@ -138,6 +358,29 @@ TEST_F(KeyValueStoreTest, StringExpireUpdate) {
 //     EXPECT_FALSE(store->lRange("test_list1",0,1).has_value());
 // }
 
+TEST_F(KeyValueStoreTest, HashSetGetAll) {
+    EXPECT_EQ(store->hSet(1, "user", {{"name", "ada"}, {"lang", "c"}, {"lang", "c++"}}), 2);
+    EXPECT_EQ(store->hSet(1, "user", {{"name", "grace"}, {"year", "1906"}}), 1);
+    EXPECT_EQ(store->hGet(1, "user", "lang"), "c++");
+    EXPECT_EQ(store->hMGet(1, "user", {"name", "missing"}), (std::vector<std::optional<std::string>>{"grace", std::nullopt}));
+    auto all = store->hGetAll(1, "user");
+    std::sort(all.begin(), all.end());
+    EXPECT_EQ(all, (std::vector<std::pair<std::string, std::string>>{{"lang", "c++"}, {"name", "grace"}, {"year", "1906"}}));
+
+    // one row per field: the update above touched only name and year
+    pqxx::work txn(*conn);
+    auto res = txn.exec("SELECT count(*) FROM " + std::string(HASH_TABLE) + " WHERE store_id = 1 AND key = 'user';");
+    EXPECT_EQ(res[0][0].as<int>(), 3);
+    txn.commit();
+
+    EXPECT_EQ(store->hDel(1, "user", {"name", "missing"}), 1);
+    EXPECT_EQ(store->hLen(1, "user"), 2);
+    store->set(1, "test_key", "test_value");
+    EXPECT_THROW(store->hGet(1, "test_key", "name"), TypeMismatchError);
+    EXPECT_EQ(store->del(1, std::vector<std::string>{"user"}), 1);
+    EXPECT_TRUE(store->hGetAll(1, "user").empty());
+}
+
 // TEST_F(KeyValueStoreTest, SetExpireUpdate) {
 //     EXPECT_EQ(store->expire("test_set1", std::chrono::seconds(1)), 0);
 //     store->sAdd("test_set1", "item1");
@@ -197,6 +440,22 @@ TEST_F(KeyValueStoreTest, SetCapacityChangeEviction) {
     // EXPECT_FALSE(store->get("test_key2").has_value());
 }
 
+TEST_F(KeyValueStoreTest, SetMaxMemoryBoundsCache) {
+    std::string value(1000, 'v');
+    for (size_t i = 0; i < 10; ++i) {
+        store->set(1, "test_key" + std::to_string(i), value);
+    }
+    EXPECT_EQ(store->memoryUsage(1, "test_key0"), std::optional<size_t>(std::string("test_key0").size() + value.size()));
+    EXPECT_FALSE(store->memoryUsage(1, "missing").has_value());
+
+    EXPECT_EQ(store->setMaxMemory(1, 5000), "OK");
+    EXPECT_LE(store->memoryStats(1).usedMemory, 5000);
+    EXPECT_EQ(store->memoryStats(1).maxMemory, 5000);
+    // the budget only bounds the cache; every key is still in the database
+    EXPECT_EQ(store->get(1, "test_key0"), value);
+    EXPECT_EQ(store->get(1, "test_key9"), value);
+}
+
 // TEST_F(KeyValueStoreTest, SetCapacityChangeEviction) {
 //     EXPECT_EQ(store->useLRU(), 0);
 //     EXPECT_EQ(store->useLFU(), 1);
@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include "../include/resp.h"
+#include "../include/resp_server.h"
+
+TEST(RespTest, ParsesCompleteAndPartialRequests) {
+    std::vector<std::string> args;
+    std::string request = "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$5\r\nva\r\nl\r\n*1\r\n$4\r\nPING\r\n";
+    auto first = parseRequest(request, args);
+    EXPECT_EQ(args, (std::vector<std::string>{"SET", "key", "va\r\nl"}));
+    EXPECT_EQ(parseRequest(std::string_view(request).substr(first), args), request.size() - first);
+    EXPECT_EQ(args, std::vector<std::string>{"PING"});
+
+    // every proper prefix is incomplete
+    for (size_t i = 0; i < first; ++i) {
+        EXPECT_EQ(parseRequest(std::string_view(request).substr(0, i), args), 0) << i;
+    }
+
+    EXPECT_EQ(parseRequest("GET  key\r\n", args), 10);
+    EXPECT_EQ(args, (std::vector<std::string>{"GET", "key"}));
+    EXPECT_EQ(parseRequest("GET key", args), 0);
+
+    EXPECT_THROW(parseRequest("*1\r\n+PING\r\n", args), RespError);
+    EXPECT_THROW(parseRequest("*1\r\n$4\r\nPINGxx", args), RespError);
+    EXPECT_THROW(parseRequest("*x\r\n", args), RespError);
+}
+
+TEST(RespTest, EncodesReplies) {
+    std::string out;
+    appendSimpleString(out, "OK");
+    appendError(out, "ERR bad\r\nthing");
+    appendInteger(out, -2);
+    appendBulkString(out, "");
+    appendNull(out);
+    appendArrayHeader(out, 1);
+    appendBulkString(out, "a");
+    EXPECT_EQ(out, "+OK\r\n-ERR bad  thing\r\n:-2\r\n$0\r\n\r\n$-1\r\n*1\r\n$1\r\na\r\n");
+}
+
+TEST(CommandDispatcherTest, RunsCommandsAgainstStore) {
+    KeyValueStore store(StorageBackend::MEMORY);
+    CommandDispatcher dispatcher(store);
+    Session session;
+    auto run = [&](std::vector<std::string> args) {
+        std::string out;
+        dispatcher.execute(session, args, out);
+        return out;
+    };
+
+    EXPECT_EQ(run({"ping"}), "+PONG\r\n");
+    EXPECT_EQ(run({"SET", "k", "v"}), "+OK\r\n");
+    EXPECT_EQ(run({"get", "k"}), "$1\r\nv\r\n");
+    EXPECT_EQ(run({"GET", "missing"}), "$-1\r\n");
+    EXPECT_EQ(run({"rpush", "l", "a", "b"}), ":2\r\n");
+    EXPECT_EQ(run({"lrange", "l", "0", "-1"}), "*2\r\n$1\r\na\r\n$1\r\nb\r\n");
+    EXPECT_EQ(run({"lpop", "missing", "2"}), "*-1\r\n");
+    EXPECT_EQ(run({"hset", "h", "f", "1"}), ":1\r\n");
+    EXPECT_EQ(run({"hgetall", "h"}), "*2\r\n$1\r\nf\r\n$1\r\n1\r\n");
+    EXPECT_EQ(run({"sadd", "k", "x"}), "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n");
+    EXPECT_EQ(run({"get"}), "-ERR wrong number of arguments for 'get' command\r\n");
+    EXPECT_EQ(run({"expire", "k", "soon"}), "-ERR value is not an integer or out of range\r\n");
+    EXPECT_EQ(run({"expire", "k", "9223372036854775807"}), "-ERR invalid expire time in 'expire' command\r\n");
+    EXPECT_EQ(run({"EXPIREAT", "k", "9223372036854776"}), "-ERR invalid expire time in 'expireat' command\r\n");
+    EXPECT_EQ(run({"pexpire", "k", "9223372036854775807"}), "-ERR invalid expire time in 'pexpire' command\r\n");
+    EXPECT_EQ(run({"expireat", "k", "9223372036854775"}), ":1\r\n");
+    EXPECT_EQ(run({"persist", "k"}), ":1\r\n");
+    EXPECT_EQ(run({"nosuch"}), "-ERR unknown command 'nosuch'\r\n");
+    EXPECT_EQ(run({"ttl", "k"}), ":-1\r\n");
+
+    // stores stand in for databases
+    EXPECT_EQ(run({"select", "1"}), "+OK\r\n");
+    EXPECT_EQ(run({"get", "k"}), "$-1\r\n");
+    EXPECT_EQ(run({"config", "set", "maxmemory", "4096"}), "+OK\r\n");
+    EXPECT_EQ(run({"config", "get", "maxmemory"}), "*2\r\n$9\r\nmaxmemory\r\n$4\r\n4096\r\n");
+    EXPECT_EQ(run({"config", "get", "save"}), "*0\r\n");
+    EXPECT_EQ(run({"bgsave"}), "-ERR no snapshot file is set.\r\n");
+    EXPECT_EQ(run({"lastsave"}), ":0\r\n");
+    EXPECT_EQ(run({"quit"}), "+OK\r\n");
+    EXPECT_TRUE(session.closing);
+}
+
+TEST(CommandDispatcherTest, RunsPipelinedBatches) {
+    KeyValueStore store(StorageBackend::MEMORY);
+    CommandDispatcher dispatcher(store);
+    Session session;
+    store.rPush(DEFAULT_STORE_ID, "list", {"a"});
+
+    std::vector<std::vector<std::string>> batch = {
+        {"SET", "a", "1"}, {"set", "b", "2"}, {"SET", "a", "3"}, // one MSET, last value wins
+        {"GET", "a"}, {"get", "b"}, {"GET", "missing"},          // one MGET
+        {"GET", "a"}, {"GET", "list"},                           // one MGET, which reads the list as nil
+        {"llen", "list"}, {"get", "list"},                       // a GET on its own is WRONGTYPE
+        {"quit"}, {"set", "c", "4"},                             // nothing after QUIT runs
+    };
+    std::string out;
+    dispatcher.execute(session, batch, out);
+    EXPECT_EQ(out, "+OK\r\n+OK\r\n+OK\r\n"
+                   "$1\r\n3\r\n$1\r\n2\r\n$-1\r\n"
+                   "$1\r\n3\r\n$-1\r\n"
+                   ":1\r\n-WRONGTYPE Operation against a key holding the wrong kind of value\r\n+OK\r\n");
+    EXPECT_TRUE(session.closing);
+    EXPECT_EQ(store.get(DEFAULT_STORE_ID, "c"), std::nullopt);
+}
+
+/*
+    Helper function to read from a socket until the expected number of bytes has arrived.
+*/
+static std::string receive(int fd, size_t bytes) {
+    std::string ret;
+    char buffer[4096];
+    while (ret.size() < bytes) {
+        auto n = recv(fd, buffer, sizeof buffer, 0);
+        if (n <= 0) break;
+        ret.append(buffer, n);
+    }
+    return ret;
+}
+
+/*
+    Helper function to run the same conversation against either I/O backend.
+*/
+static void servePipelinedRequests(const IoBackend io) {
+    KeyValueStore store(StorageBackend::MEMORY);
+    RespServer server(store, RespServerOptions{"127.0.0.1", 0, 2, io});
+    std::thread serving([&server] { server.run(); });
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(server.port());
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    EXPECT_EQ(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof address), 0);
+
+    // three requests in one write, the last one split across two
+    std::string requests = "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$1\r\nv\r\nPING\r\n*2\r\n$3\r\nGET\r\n$1\r\nk\r\n";
+    auto split = requests.size() - 5;
+    send(fd, requests.data(), split, 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    send(fd, requests.data() + split, requests.size() - split, 0);
+    std::string expected = "+OK\r\n+PONG\r\n$1\r\nv\r\n";
+    EXPECT_EQ(receive(fd, expected.size()), expected);
+
+    // a pipeline longer than one batch is answered in order
+    std::string pipeline;
+    std::string pipelineReplies;
+    for (size_t i = 0; i < 2500; ++i) {
+        auto key = std::to_string(i);
+        pipeline += "*3\r\n$3\r\nSET\r\n$" + std::to_string(key.size()) + "\r\n" + key + "\r\n$1\r\nv\r\n";
+        pipeline += "*2\r\n$3\r\nGET\r\n$" + std::to_string(key.size()) + "\r\n" + key + "\r\n";
+        pipelineReplies += "+OK\r\n$1\r\nv\r\n";
+    }
+    send(fd, pipeline.data(), pipeline.size(), 0);
+    EXPECT_EQ(receive(fd, pipelineReplies.size()), pipelineReplies);
+
+    // a reply larger than the socket buffers is written across several writable events
+    std::string value(4 * 1024 * 1024, 'x');
+    store.set(DEFAULT_STORE_ID, "big", value);
+    std::string get = "*2\r\n$3\r\nGET\r\n$3\r\nbig\r\n";
+    send(fd, get.data(), get.size(), 0);
+    auto reply = receive(fd, value.size() + 12);
+    EXPECT_EQ(reply.size(), value.size() + 12);
+    EXPECT_EQ(reply.substr(0, 10), "$4194304\r\n");
+
+    // a malformed request is answered with an error and the connection is closed
+    std::string bad = "*1\r\n+PING\r\n";
+    send(fd, bad.data(), bad.size(), 0);
+    auto error = receive(fd, 1024);
+    EXPECT_EQ(error.substr(0, 20), "-ERR Protocol error:");
+
+    close(fd);
+    server.stop();
+    serving.join();
+    EXPECT_EQ(server.stats().requests, 3 + 5000 + 1);
+}
+
+TEST(RespServerTest, ServesPipelinedRequestsWithEpoll) {
+    servePipelinedRequests(IoBackend::EPOLL);
+}
+
+// io_uring where the kernel allows it, epoll again otherwise
+TEST(RespServerTest, ServesPipelinedRequestsWithAutoBackend) {
+    servePipelinedRequests(IoBackend::AUTO);
+}
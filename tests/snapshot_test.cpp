@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+#include "../include/in_memory_engine.h"
+
+/*
+    Helper function to get a fresh snapshot path for one test.
+*/
+static std::string snapshotPath(const std::string& name) {
+    auto path = std::filesystem::temp_directory_path() / ("kvs_" + name + "_" + std::to_string(getpid()) + ".snapshot");
+    std::filesystem::remove(path);
+    return path.string();
+}
+
+/*
+    Helper function to describe a key of any type, so two engines can be compared key by key.
+*/
+static std::string describe(InMemoryEngine& engine, const size_t storeId, const std::string& key) {
+    try {
+        auto entry = engine.fetchLiveString(storeId, key);
+        if (!entry) return "none";
+        return "string " + entry->value + " " + std::to_string(entry->expiration ? toUnixMilliseconds(*entry->expiration) : -1);
+    } catch (const TypeMismatchError&) {}
+    try {
+        auto values = engine.listRange(storeId, key, 0, -1);
+        std::string ret = "list";
+        for (const auto& value : values) ret += " " + value;
+        return ret;
+    } catch (const TypeMismatchError&) {}
+    try {
+        auto members = engine.setMembers(storeId, key);
+        std::sort(members.begin(), members.end());
+        std::string ret = "set";
+        for (const auto& member : members) ret += " " + member;
+        return ret;
+    } catch (const TypeMismatchError&) {}
+    auto fields = engine.hashGetAll(storeId, key);
+    std::sort(fields.begin(), fields.end());
+    std::string ret = "hash";
+    for (const auto& [field, value] : fields) ret += " " + field + "=" + value;
+    return ret;
+}
+
+TEST(SnapshotTest, SavesAndLoadsEveryKindOfKey) {
+    auto path = snapshotPath("kinds");
+    InMemoryEngine engine(4);
+    engine.setEvictionConfig(1, EvictionConfig{"lfu", 1000, 1 << 20});
+    std::vector<std::string> keys;
+    for (int i = 0; i < 100; ++i) {
+        keys.push_back("string" + std::to_string(i));
+        engine.insertString(1, keys.back(), std::string(i, 'v'));
+    }
+    engine.setExpiration(1, "string1", currentTime() + std::chrono::hours(1));
+    engine.setExpiration(1, "string2", currentTime() + std::chrono::milliseconds(50));
+    std::vector<std::string> values;
+    for (int i = 0; i < 5000; ++i) {
+        values.push_back(std::to_string(i));
+    }
+    engine.listPush(1, "list", values, ListEnd::TAIL); // several packed nodes
+    engine.setAdd(1, "integers", {"1", "2", "300000"});
+    engine.setAdd(1, "words", {"a", "b", "c"});
+    engine.hashSet(1, "packed", {{"f", "1"}, {"g", "2"}});
+    engine.hashSet(1, "large", {{"field", std::string(100, 'x')}});
+    engine.insertString(2, "other", "store");
+    keys.insert(keys.end(), {"list", "integers", "words", "packed", "large"});
+
+    ASSERT_TRUE(engine.saveSnapshot(path));
+    EXPECT_TRUE(engine.waitForSnapshot());
+    EXPECT_GT(engine.lastSnapshot(), 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+
+    // an engine with another shard count takes the snapshot's
+    InMemoryEngine loaded(16);
+    loaded.loadSnapshot(path);
+    EXPECT_EQ(loaded.shardCount(), 4);
+    EXPECT_EQ(loaded.lastSnapshot(), engine.lastSnapshot());
+    for (const auto& key : keys) {
+        EXPECT_EQ(describe(loaded, 1, key), describe(engine, 1, key)) << key;
+    }
+    EXPECT_EQ(describe(loaded, 2, "other"), "string store -1");
+    EXPECT_EQ(loaded.getEvictionConfig(1)->policy, "lfu");
+    EXPECT_EQ(loaded.memoryStats(1)->maxMemory, 1 << 20);
+    // a key that expired while the engine was down is not loaded
+    EXPECT_EQ(loaded.memoryStats(1)->keys, engine.memoryStats(1)->keys);
+    EXPECT_EQ(loaded.memoryStats(1)->keys, keys.size() - 1);
+
+    // a snapshot from a build that hashes keys differently is loaded with the hashes recomputed
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(offsetof(SnapshotHeader, hashProbe));
+        file.put('\0');
+        file.put('\0');
+    }
+    InMemoryEngine rehashed(4);
+    rehashed.loadSnapshot(path);
+    for (const auto& key : keys) {
+        EXPECT_EQ(describe(rehashed, 1, key), describe(engine, 1, key)) << key;
+    }
+    EXPECT_EQ(rehashed.memoryStats(1)->keys, keys.size() - 1);
+    std::filesystem::remove(path);
+}
+
+TEST(SnapshotTest, KeepsEvictionOrder) {
+    auto path = snapshotPath("order");
+    for (std::string policy : {"lru", "lfu"}) {
+        InMemoryEngine engine(1);
+        engine.setEvictionConfig(1, EvictionConfig{policy, 4});
+        for (const char* key : {"a", "b", "c", "d"}) {
+            engine.insertString(1, key, "1");
+        }
+        engine.fetchLiveString(1, "a");
+        engine.fetchLiveString(1, "c");
+        ASSERT_TRUE(engine.saveSnapshot(path));
+        ASSERT_TRUE(engine.waitForSnapshot());
+
+        InMemoryEngine loaded(1);
+        loaded.loadSnapshot(path);
+        engine.insertString(1, "e", "1");
+        loaded.insertString(1, "e", "1");
+        for (const char* key : {"a", "b", "c", "d", "e"}) {
+            EXPECT_EQ(describe(loaded, 1, key), describe(engine, 1, key)) << policy << " " << key;
+        }
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(SnapshotTest, CapturesOneInstantWhileWritesContinue) {
+    auto path = snapshotPath("instant");
+    InMemoryEngine engine(8);
+    engine.setEvictionConfig(1, EvictionConfig{"lru", 100'000});
+    std::vector<std::string> keys;
+    for (int i = 0; i < 20'000; ++i) {
+        keys.push_back("key" + std::to_string(i));
+    }
+    engine.insertStrings(1, keys, std::vector<std::string>(keys.size(), "before"));
+
+    ASSERT_TRUE(engine.saveSnapshot(path));
+    // the child has its copy by the time saveSnapshot returns, so none of these reach the file
+    engine.insertStrings(1, keys, std::vector<std::string>(keys.size(), "after"));
+    engine.deleteKeys(1, {keys[0], keys[1]});
+    ASSERT_TRUE(engine.waitForSnapshot());
+
+    InMemoryEngine loaded(8);
+    loaded.loadSnapshot(path);
+    EXPECT_EQ(loaded.memoryStats(1)->keys, keys.size());
+    for (const auto& key : keys) {
+        ASSERT_EQ(describe(loaded, 1, key), "string before -1");
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(SnapshotTest, RefusesIncompleteOrCorruptFiles) {
+    auto path = snapshotPath("corrupt");
+    InMemoryEngine missing;
+    EXPECT_THROW(missing.loadSnapshot(path), std::system_error);
+
+    InMemoryEngine engine(2);
+    for (int i = 0; i < 100; ++i) {
+        engine.insertString(1, "key" + std::to_string(i), "value");
+    }
+    ASSERT_TRUE(engine.saveSnapshot(path));
+    ASSERT_TRUE(engine.waitForSnapshot());
+    EXPECT_THROW(engine.loadSnapshot(path), std::runtime_error); // not empty
+
+    std::string contents;
+    {
+        std::ifstream file(path, std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    auto rewrite = [&path](const std::string& bytes) {
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes;
+    };
+
+    rewrite(contents.substr(0, contents.size() - 1));
+    InMemoryEngine truncated(2);
+    EXPECT_THROW(truncated.loadSnapshot(path), std::runtime_error);
+
+    // a key length that runs past its section
+    auto damaged = contents;
+    auto keySize = damaged.find("key42") - sizeof(SnapshotEntry) + offsetof(SnapshotEntry, keySize);
+    damaged[keySize + 3] = '\x7f';
+    rewrite(damaged);
+    InMemoryEngine corrupt(2);
+    EXPECT_THROW(corrupt.loadSnapshot(path), std::runtime_error);
+    EXPECT_EQ(corrupt.memoryStats(1)->keys, 0);
+    std::filesystem::remove(path);
+}
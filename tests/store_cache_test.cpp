@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+#include "../include/store_cache.h"
+
+TEST(StoreCacheTest, EvictsThroughPolicyAtCapacity) {
+    StoreCache cache("lru", 2);
+    cache.put("a", "1", std::nullopt);
+    cache.put("b", "2", std::nullopt);
+    ASSERT_NE(cache.find("a"), nullptr);
+    cache.put("c", "3", std::nullopt);
+    EXPECT_EQ(cache.find("b"), nullptr);
+    EXPECT_EQ(cache.find("a")->value, "1");
+    EXPECT_EQ(cache.find("c")->value, "3");
+}
+
+TEST(StoreCacheTest, OverwriteAndErase) {
+    StoreCache cache("lfu", 2);
+    auto expiration = currentTime();
+    cache.put("a", "1", expiration);
+    EXPECT_EQ(cache.find("a")->expiration, expiration);
+    cache.put("a", "2", std::nullopt);
+    EXPECT_EQ(cache.find("a")->value, "2");
+    EXPECT_FALSE(cache.find("a")->expiration.has_value());
+    cache.erase("a");
+    EXPECT_EQ(cache.find("a"), nullptr);
+}
+
+TEST(StoreCacheTest, ZeroCapacityCachesNothing) {
+    StoreCache cache("tinylfu", 0);
+    cache.put("a", "1", std::nullopt);
+    EXPECT_EQ(cache.find("a"), nullptr);
+}
+
+TEST(StoreCacheTest, MaxMemoryEvictsByBytes) {
+    StoreCache cache("lru", 1000);
+    std::string value(1000, 'v');
+    for (size_t i = 0; i < 10; ++i) {
+        cache.put(std::to_string(i), value, std::nullopt);
+    }
+    EXPECT_EQ(cache.memoryStats().keys, 10);
+    EXPECT_GT(cache.memoryStats().usedMemory, 10 * value.size());
+
+    cache.setMaxMemory(5000);
+    EXPECT_LE(cache.memoryStats().usedMemory, 5000);
+    EXPECT_LT(cache.memoryStats().keys, 5);
+    EXPECT_EQ(cache.find("0"), nullptr);
+    EXPECT_NE(cache.find("9"), nullptr);
+
+    cache.put("10", value, std::nullopt);
+    EXPECT_LE(cache.memoryStats().usedMemory, 5000);
+    EXPECT_NE(cache.find("10"), nullptr);
+
+    auto before = cache.memoryStats().usedMemory;
+    cache.erase("10");
+    EXPECT_LE(cache.memoryStats().usedMemory, before - value.size());
+}
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include "../include/write_behind_queue.h"
+
+TEST(WriteBehindQueueTest, CoalescesAndFlushesOnBarrier) {
+    std::vector<PendingWrites> batches;
+    WriteBehindQueue queue(WriteBehindOptions{100, std::chrono::seconds(10)}, [&](const PendingWrites& writes) {
+        batches.push_back(writes);
+    });
+
+    queue.put(1, "a", "1");
+    queue.put(1, "a", "2");
+    queue.put(1, "b", "3");
+    queue.remove(1, "b");
+    EXPECT_EQ(queue.pending(1, "a"), std::optional<std::optional<std::string>>("2"));
+    EXPECT_EQ(queue.pending(1, "b"), std::make_optional(std::optional<std::string>()));
+    EXPECT_FALSE(queue.pending(2, "a").has_value());
+
+    queue.flush();
+    ASSERT_EQ(batches.size(), 1);
+    EXPECT_EQ(batches[0].size(), 2);
+    EXPECT_EQ(batches[0].at({1, "a"}), "2");
+    EXPECT_FALSE(batches[0].at({1, "b"}).has_value());
+    EXPECT_FALSE(queue.pending(1, "a").has_value());
+}
+
+TEST(WriteBehindQueueTest, FlushesWhenDurabilityWindowElapses) {
+    std::atomic<size_t> flushedWrites = 0;
+    WriteBehindQueue queue(WriteBehindOptions{100, std::chrono::milliseconds(10)}, [&](const PendingWrites& writes) {
+        flushedWrites += writes.size();
+    });
+
+    queue.put(1, "a", "1");
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_EQ(flushedWrites, 1);
+}
+
+TEST(WriteBehindQueueTest, FailedFlushIsRetried) {
+    size_t attempts = 0;
+    // the retry waits a window, long enough for the flush to see the failure before the retry commits
+    WriteBehindQueue queue(WriteBehindOptions{100, std::chrono::milliseconds(100)}, [&](const PendingWrites&) {
+        if (++attempts == 1) {
+            throw std::runtime_error("connection lost.");
+        }
+    });
+
+    queue.put(1, "a", "1");
+    EXPECT_THROW(queue.flush(), std::runtime_error);
+    queue.flush();
+    EXPECT_FALSE(queue.pending(1, "a").has_value());
+}
+
+TEST(WriteBehindQueueTest, RetriedFailureDoesNotFailLaterFlush) {
+    std::atomic<size_t> attempts = 0;
+    std::atomic<size_t> committed = 0;
+    WriteBehindQueue queue(WriteBehindOptions{100, std::chrono::milliseconds(1)}, [&](const PendingWrites& writes) {
+        if (++attempts == 1) {
+            throw std::runtime_error("connection lost.");
+        }
+        committed += writes.size();
+    });
+
+    // the first batch fails and is retried in the background, without anyone waiting on it
+    queue.put(1, "a", "1");
+    while (committed == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    queue.put(1, "b", "2");
+    queue.flush();
+    EXPECT_EQ(committed, 2);
+}